@@ -179,6 +179,7 @@ extern char *trap_default_socket_path_format;
 #define TRAP_IFC_TYPE_UNIX      'u' ///< trap_ifc_tcpip via UNIX socket(input&output part)
 #define TRAP_IFC_TYPE_SERVICE   's' ///< service ifc
 #define TRAP_IFC_TYPE_FILE      'f' ///< trap_ifc_file (input&output part)
+#define TRAP_IFC_TYPE_SHM       'm' ///< trap_ifc_tcpip with data in shared memory (input&output part)
 extern char trap_ifc_type_supported[];
 
 /**
@@ -209,6 +210,11 @@ enum trap_ifcctl_request {
 #ifndef TRAP_IFC_MESSAGEQ_SIZE
 #define TRAP_IFC_MESSAGEQ_SIZE 100000 ///< size of message queue used for buffering
 #endif
+#define TRAP_IFC_MIN_BUFFER_SIZE 1024 ///< minimal size of buffer that can be set by "bufsize=" IFC parameter
+#define TRAP_IFC_MAX_BUFFER_SIZE (64 * 1024 * 1024) ///< maximal size of buffer that can be set by "bufsize=" IFC parameter
+#define TRAP_IFC_MAX_SENDBUFS 256 ///< maximal number of buffers of output IFC that can be set by "sendbufs=" IFC parameter
+#define TRAP_IFC_MAX_CLIENT_QUEUE 256 ///< maximal length of client queues of output IFC that can be set by "clientq=" IFC parameter
+#define TRAP_IFC_DEFAULT_CLIENT_LAG 10 ///< default time (seconds) a client can be behind before disconnection, it can be set by "clientlag=" IFC parameter
 
 /**
  * Record with message of multi-result #trap_get_data
@@ -714,6 +720,45 @@ int trap_ctx_terminate(trap_ctx_t *ctx);
  */
 int trap_ctx_recv(trap_ctx_t *ctx, uint32_t ifc, const void **data, uint16_t *size);
 
+/** Read data from input interface, size of message can exceed 64 KB.
+ *
+ * Messages bigger than 65535 B can be received only if the output interface
+ * has large messages enabled ("largemsg=on" IFC parameter). #trap_ctx_recv()
+ * skips such messages with TRAP_E_MEMORY.
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc    Index of input interface (counted from 0).
+ * \param[out] data  Pointer to received data.
+ * \param[out] size  Size of received data in bytes.
+ *
+ * \return Error code - TRAP_E_OK on success, TRAP_E_TIMEOUT if timeout elapses.
+ * \see #trap_ctx_recv
+ */
+int trap_ctx_recv_large(trap_ctx_t *ctx, uint32_t ifc, const void **data, uint32_t *size);
+
+/**
+ * \brief Read a burst of messages from input interface.
+ *
+ * Return up to `max` messages that are available in the internal buffer of
+ * input interface `ifc` at once. If the buffer is empty, new data are received
+ * first (the interface timeout applies as in #trap_ctx_recv()). Messages are
+ * not copied, `data` contains pointers into the internal buffer.
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc    Index of input interface (counted from 0).
+ * \param[out] data  Array of at least `max` items, it is filled by pointers to received messages.
+ * \param[out] sizes Array of at least `max` items, it is filled by sizes of received messages in bytes.
+ * \param[in] max    Maximal number of messages to return.
+ * \param[out] got   Number of returned messages.
+ *
+ * \return Error code - TRAP_E_OK on success, TRAP_E_TIMEOUT if timeout elapses,
+ * TRAP_E_FORMAT_CHANGED if data format has changed (returned messages are valid and already in the new format).
+ *
+ * \note Returned pointers are valid until the next receive call on the same interface.
+ * \see #trap_ctx_recv, #trap_ctx_ifcctl
+ */
+int trap_ctx_recv_burst(trap_ctx_t *ctx, uint32_t ifc, const void **data, uint16_t *sizes, unsigned int max, unsigned int *got);
+
 /**
  * \brief Read data from input interfaces according to ifc_mask.
  *
@@ -730,12 +775,130 @@ int trap_ctx_recv(trap_ctx_t *ctx, uint32_t ifc, const void **data, uint16_t *si
  * \param[out] size  Size of data in bytes containing the size of #trap_multi_result_t array in bytes.
  * \return Error code - 0 on success, TRAP_E_TIMEOUT if timeout elapses.
  *
+ * When more interfaces are selected, one message is received from every
+ * selected interface, the function returns when all of them have a result
+ * or the timeout elapses (result_code of the interfaces without data is
+ * TRAP_E_TIMEOUT).  The timeout is the shortest timeout of the selected
+ * interfaces, #TRAP_HALFWAIT is the same as #TRAP_NO_WAIT.  Use
+ * trap_ctx_multi_recv_ifcs() or trap_ctx_recv_any() to return as soon as
+ * any interface has data.
+ *
  * \note Data must not be freed! Library stores
  * incomming data into static array and rewrites it during every trap_get_data() call.
- * \see #trap_ctx_ifcctl, #trap_multi_result_t
+ * \see #trap_ctx_ifcctl, #trap_multi_result_t, #trap_ctx_multi_recv_ifcs
  */
 int trap_ctx_multi_recv(trap_ctx_t *ctx, uint32_t ifc_mask, const void **data, uint16_t *size);
 
+/**
+ * \brief Read data from the given input interfaces that have data, wait until data arrive to any of them.
+ *
+ * Unlike trap_ctx_multi_recv(), the function returns as soon as some of the
+ * interfaces have data, one message is received from every such interface
+ * (result_code of the others is TRAP_E_TIMEOUT).  There is no limit of
+ * 32 interfaces and the timeout is explicit.
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (trap_ctx_init()).
+ * \param[in] ifcs   Array of indexes of input interfaces to listen on.
+ * \param[in] count  Number of items of ifcs.
+ * \param[in] timeout  Timeout in microseconds, #TRAP_WAIT, or #TRAP_NO_WAIT (#TRAP_HALFWAIT is the same, only the interfaces that have data are read).
+ * \param[out] data  Pointer to received data. The result is an array of #trap_multi_result_t,
+ * its size is equal to the number of input IFCs.
+ * \param[out] size  Size of data in bytes containing the size of #trap_multi_result_t array in bytes.
+ * \return Error code - 0 on success, TRAP_E_TIMEOUT if timeout elapses.
+ */
+int trap_ctx_multi_recv_ifcs(trap_ctx_t *ctx, const uint32_t *ifcs, uint32_t count, int timeout, const void **data, uint16_t *size);
+
+/**
+ * \brief Receive the next message from any input interface.
+ *
+ * Interfaces are served in round-robin order: after a message is returned
+ * from interface *i*, the next call checks interface *i+1* first, so
+ * a busy interface does not starve the others.  Waiting for data is
+ * driven by poll(), no helper threads are used.  The timeout is the shortest
+ * timeout of input interfaces (see #TRAPCTL_SETTIMEOUT).
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (trap_ctx_init()).
+ * \param[out] ifc   Index of input interface the message was received from.
+ * \param[out] data  Pointer to received message, valid until the next receive call on the same interface.
+ * \param[out] size  Size of the message.
+ * \return Error code of receiving from ifc (see trap_ctx_recv()), TRAP_E_TIMEOUT if timeout elapses.
+ */
+int trap_ctx_recv_any(trap_ctx_t *ctx, uint32_t *ifc, const void **data, uint16_t *size);
+
+/**
+ * \brief Whole buffer of messages received by input interface, see #trap_ctx_recv_workers().
+ */
+typedef struct trap_recv_buffer_s trap_recv_buffer_t;
+
+/**
+ * \brief Function processing a received buffer in a worker thread of #trap_ctx_recv_workers().
+ *
+ * \param[in] buf   Received buffer, messages are read by #trap_recv_buffer_next().
+ * It is valid only until the function returns.
+ * \param[in] arg   User argument given to #trap_ctx_recv_workers().
+ * \return 0 to continue, any other value stops the pool (e.g. at the end of data).
+ */
+typedef int (*trap_recv_worker_func_t)(trap_recv_buffer_t *buf, void *arg);
+
+/**
+ * \brief Receive data from input interface by a pool of worker threads.
+ *
+ * The calling thread receives whole buffers of input interface `ifc` and
+ * hands them over to `workers` threads, every thread calls `func` for one
+ * buffer at a time, so messages of different buffers are processed in
+ * parallel and in no particular order (the order of messages within one
+ * buffer is kept).  `buffers` buffers are allocated in advance and recycled
+ * via a free-list: the receiver swaps a free buffer with the internal
+ * buffer of the interface, no data are copied and nothing is allocated
+ * per buffer.  When all buffers are being processed or queued, the receiver
+ * waits for a worker to return one.
+ *
+ * The function returns when `func` returns non-zero (buffers queued at that
+ * moment are not processed), when libtrap is terminated, or when receiving
+ * fails.  The timeout of interface does not apply, receiving is retried
+ * until one of these events.
+ *
+ * \param[in] ctx      Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc      Index of input interface (counted from 0).
+ * \param[in] workers  Number of worker threads.
+ * \param[in] buffers  Number of buffers, 0 means 2 * `workers`.
+ * \param[in] func     Function called for every received buffer.
+ * \param[in] arg      User argument passed to `func`.
+ * \return Error code - TRAP_E_OK when the pool was stopped by `func`, TRAP_E_TERMINATED,
+ * or the error code of receiving (see #trap_ctx_recv()).
+ *
+ * \note The data format of interface (#trap_ctx_get_data_fmt()) may change while older
+ * buffers are being processed, see #trap_recv_buffer_format_changed().
+ */
+int trap_ctx_recv_workers(trap_ctx_t *ctx, uint32_t ifc, unsigned int workers, unsigned int buffers,
+                          trap_recv_worker_func_t func, void *arg);
+
+/**
+ * \brief Get the next message of buffer received by #trap_ctx_recv_workers().
+ *
+ * \param[in] buf    Received buffer.
+ * \param[out] data  Pointer to the message, valid until `func` returns.
+ * \param[out] size  Size of the message in bytes.
+ * \return 1 if a message was returned, 0 at the end of buffer.
+ */
+int trap_recv_buffer_next(trap_recv_buffer_t *buf, const void **data, uint32_t *size);
+
+/**
+ * \brief Check whether data format of input interface changed before the buffer was received.
+ *
+ * \param[in] buf    Received buffer.
+ * \return 1 if the format changed (as if #trap_ctx_recv() returned TRAP_E_FORMAT_CHANGED), otherwise 0.
+ */
+int trap_recv_buffer_format_changed(const trap_recv_buffer_t *buf);
+
+/**
+ * \brief Get index of worker thread processing the buffer, e.g. to access per-thread data.
+ *
+ * \param[in] buf    Received buffer.
+ * \return Index of worker thread, from 0 to `workers` - 1.
+ */
+uint32_t trap_recv_buffer_worker(const trap_recv_buffer_t *buf);
+
 /**
  * \brief Send data via output interface.
  *
@@ -753,6 +916,109 @@ int trap_ctx_multi_recv(trap_ctx_t *ctx, uint32_t ifc_mask, const void **data, u
  */
 int trap_ctx_send(trap_ctx_t *ctx, unsigned int ifc, const void *data, uint16_t size);
 
+/**
+ * \brief Send data via output interface, size of message can exceed 64 KB.
+ *
+ * Messages bigger than 65535 B require large messages enabled on the interface
+ * ("largemsg=on" IFC parameter), the message must also fit into the buffer of
+ * interface ("bufsize=" IFC parameter). Otherwise TRAP_E_MEMORY is returned.
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc    Index of interface to write into.
+ * \param[in] data   Pointer to data.
+ * \param[in] size   Number of bytes of data.
+ * \return Error code - 0 on success, TRAP_E_TIMEOUT if timeout elapses.
+ * \see #trap_ctx_send
+ */
+int trap_ctx_send_large(trap_ctx_t *ctx, unsigned int ifc, const void *data, uint32_t size);
+
+/**
+ * \brief Send a burst of messages via output interface.
+ *
+ * Write `count` messages given by arrays `data` and `sizes` into interface `ifc`.
+ * Messages are stored into the output buffer within one locked section, the buffer
+ * is sent only when it becomes full. Sending stops at the first message that cannot
+ * be written (see #trap_ctx_send() for the timeout semantics).
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc    Index of interface to write into.
+ * \param[in] data   Array of pointers to messages.
+ * \param[in] sizes  Array of sizes of messages in bytes.
+ * \param[in] count  Number of messages.
+ * \param[out] sent  Number of accepted messages (messages data[0] ... data[sent - 1]), can be NULL.
+ * \return Error code - 0 on success (all messages were accepted), TRAP_E_TIMEOUT if timeout elapses.
+ * If the buffer could not be sent because the interface has no client, TRAP_E_TIMEOUT is returned
+ * as well but the last accepted message data[sent - 1] is kept in the new buffer, the same way as
+ * by #trap_ctx_send().
+ * \see #trap_ctx_send, #trap_ctx_ifcctl
+ */
+int trap_ctx_send_burst(trap_ctx_t *ctx, unsigned int ifc, const void **data, const uint16_t *sizes, unsigned int count, unsigned int *sent);
+
+/**
+ * \brief Reserve space for a message directly in the buffer of output interface.
+ *
+ * The returned memory can be used to build the message in place (e.g. UniRec
+ * record), the message is finished by #trap_ctx_send_commit(). If the buffer
+ * does not have enough free space, it is sent first (see #trap_ctx_send() for
+ * the timeout semantics).
+ *
+ * The interface is locked between trap_ctx_send_reserve() and trap_ctx_send_commit(),
+ * both functions must be called by the same thread and no other function sending via
+ * the same interface may be called in between.  Other threads sending via the interface
+ * wait until the reservation is committed.  A second reservation by the thread that holds
+ * an uncommitted one fails with TRAP_E_BAD_FPARAMS.  Reservation is not supported by
+ * interfaces with "shard=hash" or "threadbufs=on" IFC parameter.
+ *
+ * \param[in] ctx       Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc       Index of interface to write into.
+ * \param[in] max_size  Maximal size of the message in bytes.
+ * \return Pointer to at least `max_size` bytes of memory, NULL on error (see #trap_ctx_get_last_error()).
+ * \see #trap_ctx_send_commit
+ */
+void *trap_ctx_send_reserve(trap_ctx_t *ctx, unsigned int ifc, uint16_t max_size);
+
+/**
+ * \brief Finish the message started by #trap_ctx_send_reserve().
+ *
+ * It must be called by the thread that made the reservation, a call from any other
+ * thread fails with TRAP_E_BAD_FPARAMS and the reservation is kept.
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc    Index of interface to write into.
+ * \param[in] size   Actual size of the message in bytes, it must not exceed the reserved `max_size`.
+ * \return Error code - 0 on success, TRAP_E_TIMEOUT if buffering is disabled and the message could not be sent,
+ * TRAP_E_BAD_FPARAMS if the calling thread has no reservation or `size` is too big (the reservation is kept in such case).
+ */
+int trap_ctx_send_commit(trap_ctx_t *ctx, unsigned int ifc, uint16_t size);
+
+/**
+ * \brief Function returning the key of message for "shard=hash", see #trap_ctx_set_shard_key().
+ *
+ * \param[in] data   Pointer to the message.
+ * \param[in] size   Size of the message in bytes.
+ * \param[in] arg    User argument given to #trap_ctx_set_shard_key().
+ * \return Key of the message, e.g. hash of the source IP address of flow record.
+ */
+typedef uint64_t (*trap_shard_key_func_t)(const void *data, uint32_t size, void *arg);
+
+/**
+ * \brief Set the function that distributes messages among clients of output interface.
+ *
+ * With "shard=hash" IFC parameter of TCP or UNIX output interface, every message
+ * is sent to exactly one connected client chosen by the key returned by `func`:
+ * messages with the same key are sent to the same client as long as the set of
+ * connected clients does not change.  Messages are sent by #trap_ctx_send(),
+ * #trap_ctx_send_large() or #trap_ctx_send_burst(), #trap_ctx_send_reserve()
+ * is not supported because the key is not known before the message is written.
+ *
+ * \param[in] ctx    Pointer to the private libtrap context data (#trap_ctx_init()).
+ * \param[in] ifc    Index of output interface.
+ * \param[in] func   Function returning the key of message, NULL to unset.
+ * \param[in] arg    User argument passed to `func`.
+ * \return TRAP_E_OK on success, TRAP_E_BAD_IFC_INDEX for wrong `ifc`.
+ */
+int trap_ctx_set_shard_key(trap_ctx_t *ctx, unsigned int ifc, trap_shard_key_func_t func, void *arg);
+
 /**
  * \brief Set verbosity level of library functions.
  *
@@ -325,9 +325,8 @@ int file_recv(void *priv, void *data, uint32_t *size, int timeout)
 {
    size_t loaded;
    char *next_file = NULL;
-   /* header of message inside the buffer */
-   uint16_t *m_head = data;
    uint32_t data_size = 0;
+   trap_input_ifc_t *ifc;
 
    file_private_t *config = (file_private_t*) priv;
 
@@ -378,6 +377,10 @@ neg_start:
    }
 #endif
 
+   /* buffer could be resized during negotiation */
+   ifc = &config->ctx->in_ifc_list[config->ifc_idx];
+   data = ifc->buffer;
+
    /* Reads 4 bytes from the file, determining the length of bytes to be read to @param[out] data */
    loaded = fread(&data_size, sizeof(uint32_t), 1, config->fd);
    if (loaded != 1) {
@@ -385,9 +388,9 @@ neg_start:
          next_file = get_next_file(priv);
          if (!next_file) {
             /* set size of buffer to the size of 1 message (including its header) */
-            (*size) = 2;
+            (*size) = TRAP_MSG_HEADER_SIZE(ifc);
             /* set the header of message to 0B */
-            *m_head = 0;
+            memset(data, 0, (*size));
 
             return TRAP_E_OK;
          } else {
@@ -406,6 +409,9 @@ neg_start:
    }
 
    *size = ntohl(data_size);
+   if ((*size) > ifc->buffer_size) {
+      return trap_errorf(config->ctx, TRAP_E_IO_ERROR, "INPUT FILE IFC[%"PRIu32"]: Buffer of %"PRIu32" B exceeds the size of input buffer.", config->ifc_idx, (*size));
+   }
    /* Reads (*size) bytes from the file */
    loaded = fread(data, 1, (*size), config->fd);
    if (loaded != (*size)) {
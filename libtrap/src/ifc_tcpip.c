@@ -45,10 +45,13 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -56,6 +59,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <poll.h>
 #include <pthread.h>
 #include <errno.h>
 #include <semaphore.h>
@@ -66,6 +70,9 @@
 #include "trap_ifc.h"
 #include "trap_error.h"
 #include "ifc_tcpip.h"
+#include "trap_shm_ring.h"
+#include "trap_uring.h"
+#include "trap_pool.h"
 #include "ifc_tcpip_internal.h"
 
 /**
@@ -157,6 +164,101 @@ static int check_portrange(const char *port)
    return EXIT_SUCCESS;
 }
 
+/**
+ * Maximal number of events returned by one epoll_wait().
+ */
+#define TCPIP_EPOLL_EVENTS 64
+
+/**
+ * Identifier (epoll_data.u32) of termination pipe of output IFC, clients are identified by index.
+ */
+#define TCPIP_EPOLL_TERM UINT32_MAX
+
+/**
+ * user_data of io_uring operations that are not sends to clients, sends are identified by index of client.
+ */
+#define TCPIP_URING_TERM UINT64_MAX
+#define TCPIP_URING_CANCEL (UINT64_MAX - 1)
+#define TCPIP_URING_RECV (UINT64_MAX - 2)
+
+int tcpip_set_sockopts(int sd, const trap_sockopts_t *opts, int tcp)
+{
+   int val, ret = TRAP_E_OK;
+
+   if (opts->sndbuf != 0) {
+      val = opts->sndbuf;
+      if (setsockopt(sd, SOL_SOCKET, SO_SNDBUF, &val, sizeof(val)) == -1) {
+         VERBOSE(CL_ERROR, "Failed to set SO_SNDBUF of socket. (%d)", errno);
+         ret = TRAP_E_IO_ERROR;
+      }
+   }
+   if (opts->rcvbuf != 0) {
+      val = opts->rcvbuf;
+      if (setsockopt(sd, SOL_SOCKET, SO_RCVBUF, &val, sizeof(val)) == -1) {
+         VERBOSE(CL_ERROR, "Failed to set SO_RCVBUF of socket. (%d)", errno);
+         ret = TRAP_E_IO_ERROR;
+      }
+   }
+   if ((opts->nodelay != 0) && (tcp != 0)) {
+      val = 1;
+      if (setsockopt(sd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val)) == -1) {
+         VERBOSE(CL_ERROR, "Failed to set TCP_NODELAY of socket. (%d)", errno);
+         ret = TRAP_E_IO_ERROR;
+      }
+   }
+#ifdef SO_BUSY_POLL
+   if (opts->busypoll != 0) {
+      val = opts->busypoll;
+      /* raising it above net.core.busy_read requires CAP_NET_ADMIN */
+      if (setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, &val, sizeof(val)) == -1) {
+         VERBOSE(CL_ERROR, "Failed to set SO_BUSY_POLL of socket. (%d)", errno);
+         ret = TRAP_E_IO_ERROR;
+      }
+   }
+#endif
+   return ret;
+}
+
+/**
+ * \brief Register socket into epoll instance.
+ *
+ * Sockets are registered as edge-triggered, i.e. the caller must wait
+ * only after the socket returned EAGAIN.
+ *
+ * \param[in] epfd    epoll file descriptor
+ * \param[in] sd      socket descriptor
+ * \param[in] events  EPOLLIN, EPOLLOUT, ...
+ * \param[in] id      identifier returned in epoll_data.u32
+ * \return TRAP_E_OK on success, TRAP_E_IO_ERROR otherwise
+ */
+static int tcpip_epoll_add(int epfd, int sd, uint32_t events, uint32_t id)
+{
+   struct epoll_event ev;
+
+   memset(&ev, 0, sizeof(ev));
+   ev.events = events | EPOLLET;
+   ev.data.u32 = id;
+   if (epoll_ctl(epfd, EPOLL_CTL_ADD, sd, &ev) == -1) {
+      VERBOSE(CL_ERROR, "epoll_ctl() failed (%d): %s", errno, strerror(errno));
+      return TRAP_E_IO_ERROR;
+   }
+   return TRAP_E_OK;
+}
+
+/**
+ * \brief Convert timeout for select() into timeout for epoll_wait().
+ *
+ * \param[in] tv  timeout, NULL means blocking
+ * \return timeout in milliseconds rounded up, -1 when blocking
+ */
+static inline int tcpip_epoll_timeout(struct timeval *tv)
+{
+   if (tv == NULL) {
+      return -1;
+   }
+   return tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+}
+
 /**
  * \addtogroup tcpip_receiver
  * @{
@@ -164,12 +266,113 @@ static int check_portrange(const char *port)
 /* Receiver (client socket) */
 // Receiver is a client that connects itself to the source of data (to sender) = server
 
+/**
+ * Size of the staging buffer of receiver.  Data that arrived behind the
+ * awaited part (next headers and small buffers) are received into the
+ * staging buffer by the same syscall and used by the next calls of
+ * receive_part().
+ */
+#define TCPIP_RECV_STAGE_SIZE 65536
+
+/**
+ * \brief Receive into the given memory and store any further available data into staging buffer.
+ *
+ * Staging buffer must be empty.
+ *
+ * \param[in] config  private IFC data
+ * \param[out] p      memory for the awaited data
+ * \param[in] size    size of the awaited data
+ * \param[in] flags   flags of recvmsg()
+ * \return number of bytes stored into p, or -1 on error (see errno)
+ */
+static ssize_t receive_staged(tcpip_receiver_private_t *config, void *p, size_t size, int flags)
+{
+   struct iovec iov[2];
+   struct msghdr msg;
+   ssize_t recvb;
+
+   iov[0].iov_base = p;
+   iov[0].iov_len = size;
+   iov[1].iov_base = config->stage;
+   iov[1].iov_len = TCPIP_RECV_STAGE_SIZE;
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = iov;
+   msg.msg_iovlen = 2;
+
+   recvb = recvmsg(config->sd, &msg, flags);
+   if (recvb > (ssize_t) size) {
+      config->stage_head = 0;
+      config->stage_len = recvb - size;
+      recvb = size;
+   }
+   return recvb;
+}
+
+/**
+ * \brief Wait for data and receive them by one io_uring submission, otherwise the same as receive_staged().
+ *
+ * When no data arrive in timeout, the read is cancelled before return.
+ *
+ * \param[in] config  private IFC data
+ * \param[out] p      memory for the awaited data
+ * \param[in] size    size of the awaited data
+ * \param[in] tm      timeout, NULL means blocking
+ * \return number of bytes stored into p, or -1 on error (see errno, ETIME when timeout expired)
+ */
+static ssize_t receive_uring(tcpip_receiver_private_t *config, void *p, size_t size, struct timeval *tm)
+{
+   struct iovec iov[2];
+   uint64_t id;
+   int32_t res;
+   char cancelled = 0;
+
+   iov[0].iov_base = p;
+   iov[0].iov_len = size;
+   iov[1].iov_base = config->stage;
+   iov[1].iov_len = TCPIP_RECV_STAGE_SIZE;
+   if ((trap_uring_prep_readv(&config->uring, config->sd, iov, 2, TCPIP_URING_RECV) != TRAP_E_OK) ||
+       (trap_uring_submit_and_wait(&config->uring, 1, tm) != TRAP_E_OK)) {
+      errno = EIO;
+      return -1;
+   }
+   while (1) {
+      while (trap_uring_get_cqe(&config->uring, &id, &res) != 0) {
+         if (id == TCPIP_URING_RECV) {
+            goto completed;
+         }
+      }
+      /* timeout expired, iov must not be used after return */
+      if (cancelled == 0) {
+         trap_uring_prep_cancel(&config->uring, TCPIP_URING_RECV, TCPIP_URING_CANCEL);
+         cancelled = 1;
+      }
+      if (trap_uring_submit_and_wait(&config->uring, 1, NULL) != TRAP_E_OK) {
+         errno = EIO;
+         return -1;
+      }
+   }
+completed:
+   if (res < 0) {
+      errno = ((res == -ECANCELED) || (res == -EINTR)) ? ETIME : -res;
+      return -1;
+   }
+   if (res > (ssize_t) size) {
+      config->stage_head = 0;
+      config->stage_len = res - size;
+      res = size;
+   }
+   return res;
+}
+
 /**
  * Receive chunk of data.
  *
  * Caller is responsible for checking elapsed time, since this function
  * may finished before the given timeout without having data.
  *
+ * Data remaining in staging buffer from the previous call are used first,
+ * a syscall is made only when they are not sufficient.
+ *
  * \param[in] priv      private IFC data
  * \param[out] data     received data
  * \param[in,out] size  expected size to wait for, it is used to return size that was not read
@@ -180,8 +383,9 @@ static int receive_part(void *priv, void **data, uint32_t *size, struct timeval
    void *data_p = (*data);
    tcpip_receiver_private_t *config = (tcpip_receiver_private_t *) priv;
    ssize_t numbytes = *size;
-   int recvb, retval;
-   fd_set set;
+   ssize_t recvb;
+   int retval;
+   struct epoll_event ev;
 
    assert(data_p != NULL);
 
@@ -189,61 +393,214 @@ static int receive_part(void *priv, void **data, uint32_t *size, struct timeval
       DEBUG_IFC(if (tm) {VERBOSE(CL_VERBOSE_LIBRARY, "Try to receive data in timeout %" PRIu64
                         "s%"PRIu64"us", tm->tv_sec, tm->tv_usec)});
 
-      FD_ZERO(&set);
-      FD_SET(config->sd, &set);
-      /*
-       * Blocking or with timeout?
-       * With timeout 0,0 - non-blocking
-       */
-      retval = select(config->sd + 1, &set, NULL, NULL, tm);
-      if (retval > 0) {
-         do {
-            recvb = recv(config->sd, data_p, numbytes, 0);
-            if (recvb < 1) {
-               if (recvb == 0) {
-                  errno = EPIPE;
-               }
-               switch (errno) {
-               case EINTR:
-                  if (config->is_terminated == 1) {
-                     client_socket_disconnect(priv);
-                     return TRAP_E_TERMINATED;
-                  }
-                  break;
-               case ECONNRESET:
-               case EBADF:
-               case EPIPE:
+      if (config->stage_len > 0) {
+         /* data received together with the previous part */
+         recvb = MIN(numbytes, config->stage_len);
+         memcpy(data_p, config->stage + config->stage_head, recvb);
+         config->stage_head += recvb;
+         config->stage_len -= recvb;
+      } else if (config->uring.fd != -1) {
+         /* wait and receive by one syscall */
+         recvb = receive_uring(config, data_p, numbytes, tm);
+         if ((recvb == -1) && (errno == ETIME)) {
+            (*size) = numbytes;
+            return TRAP_E_TIMEOUT;
+         }
+      } else {
+         /* wait for the socket only when there is nothing to read */
+         recvb = receive_staged(config, data_p, numbytes, MSG_DONTWAIT);
+         if ((recvb == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            /*
+             * Blocking or with timeout?
+             * With timeout 0,0 - non-blocking
+             */
+            retval = epoll_wait(config->epfd, &ev, 1, tcpip_epoll_timeout(tm));
+            if (retval > 0) {
+               continue;
+            } else if ((retval == 0) || (retval < 0 && errno == EINTR)) {
+               /* Timeout expired or signal received.  Caller of this function
+                * has to decide to call this function again or not according
+                * to elapsed time from the calling. */
+               (*size) = numbytes;
+               return TRAP_E_TIMEOUT;
+            } else { // some error has occured
+               VERBOSE(CL_VERBOSE_OFF, "epoll_wait() returned %i (%s)", retval, strerror(errno));
+               client_socket_disconnect(priv);
+               return TRAP_E_IO_ERROR;
+            }
+         }
+      }
+
+      /* some data arrived, receive the rest of part */
+      while (1) {
+         if (recvb < 1) {
+            if (recvb == 0) {
+               errno = EPIPE;
+            }
+            switch (errno) {
+            case EINTR:
+               if (config->is_terminated == 1) {
                   client_socket_disconnect(priv);
-                  return TRAP_E_IO_ERROR;
-               case EAGAIN:
-                  /* This should never happen with blocking socket. */
-                  (*size) = numbytes;
-                  (*data) = data_p;
-                  return TRAP_E_TIMEOUT;
+                  return TRAP_E_TERMINATED;
                }
+               break;
+            case EAGAIN:
+               /* This should never happen with blocking socket. */
+               (*size) = numbytes;
+               (*data) = data_p;
+               return TRAP_E_TIMEOUT;
+            default:
+               VERBOSE(CL_VERBOSE_OFF, "recv() failed (%s)", strerror(errno));
+               /* fall through */
+            case ECONNRESET:
+            case EBADF:
+            case EPIPE:
+               client_socket_disconnect(priv);
+               return TRAP_E_IO_ERROR;
             }
+         } else {
             numbytes -= recvb;
             data_p += recvb;
-            DEBUG_IFC(VERBOSE(CL_VERBOSE_LIBRARY, "receive_part got %" PRId32 "B", recvb));
-         } while (numbytes > 0);
-         (*size) = numbytes;
-         (*data) = data_p;
-         return TRAP_E_OK;
-      } else if ((retval == 0) || (retval < 0 && errno == EINTR)) {
-         /* Timeout expired or signal received.  Caller of this function
-          * has to decide to call this function again or not according
-          * to elapsed time from the calling. */
-         (*size) = numbytes;
-         return TRAP_E_TIMEOUT;
-      } else { // some error has occured
-         VERBOSE(CL_VERBOSE_OFF, "select() returned %i (%s)", retval, strerror(errno));
-         client_socket_disconnect(priv);
+            DEBUG_IFC(VERBOSE(CL_VERBOSE_LIBRARY, "receive_part got %zd B", recvb));
+         }
+         if (numbytes == 0) {
+            break;
+         }
+         recvb = receive_staged(config, data_p, numbytes, 0);
+      }
+      (*size) = numbytes;
+      (*data) = data_p;
+      return TRAP_E_OK;
+   }
+   return TRAP_E_TERMINATED;
+}
+
+/**
+ * Message sent by output IFC of TRAP_IFC_TCPIP_SHM with the file descriptor of ring.
+ */
+struct tcpip_shm_msg_s {
+   uint32_t slot; /**< Slot of ring assigned to the client */
+   uint32_t gen; /**< Generation of slot */
+};
+
+/**
+ * \brief Receive file descriptor of shared memory ring from output IFC and map the ring.
+ *
+ * \param[in] config  private IFC data
+ * \param[in] tm      timeout
+ * \return TRAP_E_OK on success, TRAP_E_TIMEOUT, TRAP_E_TERMINATED, or TRAP_E_IO_ERROR when disconnected
+ */
+static int receive_shm_ring(tcpip_receiver_private_t *config, struct timeval *tm)
+{
+   struct tcpip_shm_msg_s shm_msg;
+   char control[CMSG_SPACE(sizeof(int))];
+   struct iovec iov;
+   struct msghdr msg;
+   struct cmsghdr *cmsg;
+   struct epoll_event ev;
+   ssize_t recvb;
+   int fd, retval;
+
+   while (config->is_terminated == 0) {
+      iov.iov_base = &shm_msg;
+      iov.iov_len = sizeof(shm_msg);
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov;
+      msg.msg_iovlen = 1;
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+
+      recvb = recvmsg(config->sd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+      if ((recvb == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))) {
+         retval = epoll_wait(config->epfd, &ev, 1, tcpip_epoll_timeout(tm));
+         if (retval == 0) {
+            return TRAP_E_TIMEOUT;
+         }
+         continue;
+      }
+
+      cmsg = CMSG_FIRSTHDR(&msg);
+      if ((recvb != sizeof(shm_msg)) || (cmsg == NULL) || (cmsg->cmsg_level != SOL_SOCKET) ||
+          (cmsg->cmsg_type != SCM_RIGHTS) || (cmsg->cmsg_len != CMSG_LEN(sizeof(int)))) {
+         VERBOSE(CL_VERBOSE_OFF, "Receiving of shared memory from output IFC failed.");
+         client_socket_disconnect(config);
+         return TRAP_E_IO_ERROR;
+      }
+      memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+      if (shm_ring_attach(&config->ring, fd) != TRAP_E_OK) {
+         client_socket_disconnect(config);
+         return TRAP_E_IO_ERROR;
+      }
+      if (shm_msg.slot >= config->ring.hdr->slots) {
+         VERBOSE(CL_ERROR, "Output IFC assigned invalid slot of shared memory.");
+         client_socket_disconnect(config);
          return TRAP_E_IO_ERROR;
       }
+      config->shm_slot = shm_msg.slot;
+      config->shm_gen = shm_msg.gen;
+      config->shm_pos = config->ring.hdr->slot[shm_msg.slot].read;
+      return TRAP_E_OK;
    }
    return TRAP_E_TERMINATED;
 }
 
+/**
+ * \brief Read the next buffer from shared memory ring.
+ *
+ * Waiting is split into intervals of at most 1 second, the socket is
+ * checked for disconnection of output IFC after every interval.
+ *
+ * \param[in] config    private IFC data
+ * \param[out] data     memory for payload of buffer
+ * \param[in,out] size  size of memory, it is used to return size of payload
+ * \param[in] tm        timeout
+ * \return TRAP_E_OK on success, TRAP_E_TIMEOUT, TRAP_E_TERMINATED, or TRAP_E_IO_ERROR when disconnected
+ */
+static int receive_shm(tcpip_receiver_private_t *config, void *data, uint32_t *size, struct timeval *tm)
+{
+   struct timeval no_wait = {0, 0};
+   uint64_t wait_time;
+   uint32_t data_size = *size;
+   ssize_t recvb;
+   char c;
+   int retval;
+
+   while (1) {
+      *size = data_size;
+      retval = shm_ring_get(&config->ring, config->shm_slot, config->shm_gen, &config->shm_pos, data, size);
+      if (retval != TRAP_E_TIMEOUT) {
+         if (retval != TRAP_E_OK) {
+            client_socket_disconnect(config);
+         }
+         return retval;
+      }
+      *size = 0;
+
+      /* output IFC closes the socket when it disconnects us */
+      recvb = recv(config->sd, &c, 1, MSG_DONTWAIT | MSG_PEEK);
+      if ((recvb == 0) || ((recvb == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))) {
+         client_socket_disconnect(config);
+         return TRAP_E_IO_ERROR;
+      }
+      if (config->is_terminated != 0) {
+         return TRAP_E_TERMINATED;
+      }
+
+      wait_time = 1000000;
+      if (tm != NULL) {
+         wait_time = MIN(wait_time, tm->tv_sec * 1000000 + tm->tv_usec);
+         if (wait_time == 0) {
+            return TRAP_E_TIMEOUT;
+         }
+      }
+      shm_ring_wait_data(&config->ring, config->shm_slot, config->shm_pos, wait_time);
+      if (tm != NULL) {
+         /* caller checks the elapsed time and calls again */
+         tm = &no_wait;
+      }
+   }
+}
+
 /**
  * Return current time in microseconds.
  *
@@ -267,6 +624,7 @@ static inline uint64_t get_cur_timestamp()
  *
  * This function contains finite state machine that controls receiving messages (header
  * and payload), handles timeouts and sleep (to offload CPU during waiting for connection).
+ * With TRAP_IFC_TCPIP_SHM, whole buffers are read from shared memory in SHM_WAIT instead.
  * The transition graph is:
  * \dot
  * digraph fsm { label="tcpip_receiver_recv()";labelloc=t;
@@ -286,6 +644,9 @@ static inline uint64_t get_cur_timestamp()
  *      head_wait -> mess_wait;
  *      mess_wait -> discard;
  *      mess_wait -> reset;
+ *      head_wait -> shm_wait;
+ *      shm_wait -> discard;
+ *      shm_wait -> reset;
  * }
  * \enddot
  *
@@ -439,6 +800,9 @@ conn_wait:
 head_wait:
       /* get and check header of message, next state can be MESS_WAIT or RESET */
       DEBUG_IFC(VERBOSE(CL_VERBOSE_LIBRARY, "recv HEAD_WAIT (%p)", p));
+      if (config->socket_type == TRAP_IFC_TCPIP_SHM) {
+         goto shm_wait;
+      }
       config->data_wait_size = sizeof(trap_buffer_header_t);
       retval = receive_part(config, &p, &config->data_wait_size, temptm);
       if (retval != TRAP_E_OK) {
@@ -461,6 +825,14 @@ head_wait:
             goto reset;
          }
 #endif
+         /* buffer could be resized during negotiation */
+         data = config->ctx->in_ifc_list[config->ifc_idx].buffer;
+         if (messageframe.data_length > config->ctx->in_ifc_list[config->ifc_idx].buffer_size) {
+            VERBOSE(CL_ERROR, "Received buffer of %"PRIu32" B exceeds the size of input buffer, disconnecting.",
+                    messageframe.data_length);
+            client_socket_disconnect(priv);
+            goto discard;
+         }
          /* we got header, now we can start receiving payload */
          p = data;
          config->ext_buffer = data;
@@ -486,6 +858,33 @@ mess_wait:
          config->data_pointer = p;
          goto reset;
       }
+shm_wait:
+      /* get the whole buffer from shared memory, next state can be RESET or success exit */
+      DEBUG_IFC(VERBOSE(CL_VERBOSE_LIBRARY, "recv SHM_WAIT"));
+      if (config->ring.hdr == NULL) {
+         /* output IFC sends the ring after negotiation */
+         retval = receive_shm_ring(config, temptm);
+         if (retval != TRAP_E_OK) {
+            if (retval == TRAP_E_IO_ERROR) {
+               goto discard;
+            }
+            goto reset;
+         }
+      }
+      /* buffer could be resized during negotiation */
+      data = config->ctx->in_ifc_list[config->ifc_idx].buffer;
+      config->ext_buffer = data;
+      (*size) = config->ctx->in_ifc_list[config->ifc_idx].buffer_size;
+      retval = receive_shm(config, data, size, temptm);
+      if (retval == TRAP_E_OK) {
+         config->ext_buffer_size = (*size);
+         return TRAP_E_OK;
+      }
+      (*size) = 0;
+      if (retval == TRAP_E_IO_ERROR) {
+         goto discard;
+      }
+      goto reset;
    }
    return TRAP_E_TERMINATED;
 }
@@ -521,6 +920,10 @@ p = NULL; \
       if (config->connected == 1) {
          close(config->sd);
       }
+      shm_ring_close(&config->ring);
+      trap_uring_destroy(&config->uring);
+      close(config->epfd);
+      X(config->stage);
       X(config->dest_addr);
       X(config->dest_port);
       X(config);
@@ -555,10 +958,11 @@ static void tcpip_receiver_create_dump(void *priv, uint32_t idx, const char *pat
            "Terminated: %d\nSocket descriptor: %d\nSocket type: %d\n"
            "Data pointer: %p\nData wait size: %"PRIu32"\nMessage header: %"PRIu32"\n"
            "Extern buffer pointer: %p\nExtern buffer data size: %"PRIu32"\n"
+           "Staged data size: %"PRIu32"\n"
            "Timeout: %"PRId32"us (%s)\n",
            c->dest_addr, c->dest_port, c->connected, c->is_terminated, c->sd, c->socket_type,
            c->data_pointer, c->data_wait_size, c->int_mess_header.data_length,
-           c->ext_buffer, c->ext_buffer_size,
+           c->ext_buffer, c->ext_buffer_size, c->stage_len,
            c->ctx->in_ifc_list[idx].datatimeout,
            TRAP_TIMEOUT_STR(c->ctx->in_ifc_list[idx].datatimeout));
    fclose(f);
@@ -613,6 +1017,28 @@ uint8_t tcpip_recv_ifc_is_conn(void *priv)
    return 0;
 }
 
+/**
+ * \brief Get socket to wait for data, see #ifc_get_pollfd_func_t.
+ *
+ * Shared memory is not waited for by poll(), the IFC must be checked periodically.
+ *
+ * \param[in] priv  pointer to module private data
+ * \return socket descriptor, TRAP_IFC_POLL_READY, or TRAP_IFC_POLL_NONE
+ */
+static int tcpip_recv_ifc_get_pollfd(void *priv)
+{
+   tcpip_receiver_private_t *config = (tcpip_receiver_private_t *) priv;
+
+   if ((config->connected == 0) || (config->is_terminated != 0) || (config->socket_type == TRAP_IFC_TCPIP_SHM)) {
+      return TRAP_IFC_POLL_NONE;
+   }
+   if (config->stage_len > 0) {
+      /* received together with the previous part */
+      return TRAP_IFC_POLL_READY;
+   }
+   return config->sd;
+}
+
 /**
  * \brief Constructor of input TCP/IP IFC module.
  * This function is called by TRAP library to initialize one input interface.
@@ -650,7 +1076,27 @@ int create_tcpip_receiver_ifc(trap_ctx_priv_t *ctx, char *params, trap_input_ifc
    config->ctx = ctx;
    config->is_terminated = 0;
    config->socket_type = type;
+   config->sockopts = ifc->sockopts;
    config->ifc_idx = idx;
+   config->ring.fd = -1;
+   config->uring.fd = -1;
+   config->epfd = epoll_create1(EPOLL_CLOEXEC);
+   if (config->epfd == -1) {
+      VERBOSE(CL_ERROR, "Failed to create epoll instance for input IFC.");
+      free(config);
+      return TRAP_E_IO_ERROR;
+   }
+   config->stage = malloc(TCPIP_RECV_STAGE_SIZE);
+   if (config->stage == NULL) {
+      VERBOSE(CL_ERROR, "Failed to allocate internal memory for input IFC.");
+      close(config->epfd);
+      free(config);
+      return TRAP_E_MEMORY;
+   }
+   if ((ifc->uring != 0) && (type != TRAP_IFC_TCPIP_SHM)) {
+      /* plain syscalls are used when io_uring is not available */
+      trap_uring_init(&config->uring, 4);
+   }
 
    /* Parsing params */
    param_iterator = trap_get_param_by_delimiter(params, &dest_addr, TRAP_IFC_PARAM_DELIMITER);
@@ -717,6 +1163,7 @@ int create_tcpip_receiver_ifc(trap_ctx_priv_t *ctx, char *params, trap_input_ifc
    ifc->priv = config;
    ifc->get_id = tcpip_recv_ifc_get_id;
    ifc->is_conn = tcpip_recv_ifc_is_conn;
+   ifc->get_pollfd = tcpip_recv_ifc_get_pollfd;
 
 #ifndef ENABLE_NEGOTIATION
    if (config->connected == 0) {
@@ -731,6 +1178,9 @@ int create_tcpip_receiver_ifc(trap_ctx_priv_t *ctx, char *params, trap_input_ifc
 failsafe_cleanup:
    X(dest_addr);
    X(dest_port);
+   trap_uring_destroy(&config->uring);
+   close(config->epfd);
+   X(config->stage);
    X(config);
    return result;
 #undef X
@@ -750,6 +1200,10 @@ static void client_socket_disconnect(void *priv)
       close(config->sd);
       config->connected = 0;
    }
+   config->stage_len = 0;
+   if (config->ring.hdr != NULL) {
+      shm_ring_close(&config->ring);
+   }
 }
 
 /**
@@ -837,6 +1291,8 @@ static int client_socket_connect(void *priv, const char *dest_addr, const char *
          if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
             continue;
          }
+         /* buffer sizes must be set before connect() to take effect on TCP window */
+         tcpip_set_sockopts(sockfd, &config->sockopts, 1);
 
          /* Change the socket to be non-blocking if required by user. */
          if (tv != NULL) {
@@ -879,12 +1335,13 @@ static int client_socket_connect(void *priv, const char *dest_addr, const char *
          }
       }
       freeaddrinfo(servinfo); // all done with this structure
-   } else if (config->socket_type == TRAP_IFC_TCPIP_UNIX) {
+   } else if ((config->socket_type == TRAP_IFC_TCPIP_UNIX) || (config->socket_type == TRAP_IFC_TCPIP_SHM)) {
       /* UNIX socket */
       addr.unix_addr.sun_family = AF_UNIX;
       snprintf(addr.unix_addr.sun_path, sizeof(addr.unix_addr.sun_path) - 1, trap_default_socket_path_format, dest_port);
       sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
       if (sockfd != -1) {
+         tcpip_set_sockopts(sockfd, &config->sockopts, 0);
          if (connect(sockfd, (struct sockaddr *) &addr.unix_addr, sizeof(addr.unix_addr)) < 0) {
             VERBOSE(CL_VERBOSE_LIBRARY, "recv UNIX domain socket connect error %d (%s)", errno, strerror(errno));
             close(sockfd);
@@ -908,6 +1365,11 @@ static int client_socket_connect(void *priv, const char *dest_addr, const char *
 
    *socket_descriptor = sockfd;
 
+   /* the socket is removed from epoll automatically by close() */
+   if (tcpip_epoll_add(config->epfd, sockfd, EPOLLIN | EPOLLRDHUP, 0) != TRAP_E_OK) {
+      close(sockfd);
+      return TRAP_E_IO_ERROR;
+   }
 
    /** Input interface negotiation */
 #ifdef ENABLE_NEGOTIATION
@@ -964,6 +1426,9 @@ static void server_disconnected_client(tcpip_sender_private_t *c, int cl_id)
 {
    struct client_s *cl = &c->clients[cl_id];
    pthread_mutex_lock(&c->lock);
+   if (c->ring.hdr != NULL) {
+      shm_ring_leave(&c->ring, cl_id);
+   }
    close(cl->sd);
    cl->sd = -1;
    cl->client_state = CURRENT_IDLE;
@@ -1102,81 +1567,876 @@ static inline int tcpip_sender_conn_phase(tcpip_sender_private_t *config, struct
 }
 
 /**
- * \brief Send data to all connected clients.
- *
- * All clients are in 'current' buffer or in 'backup' buffer.
- * All clients get messages from current buffer at first.
- * * When all buffer is successfully sent to all clients
- * in 'current' buffer, everything is alright.
- *
- * * When everybody fails due to timeout, everything
- * is alright, everybody stays in 'current' buffer.
- *
- * * When somebody fails and somebody is successful, failing clients are moved into 'backup' buffer and they have chance to receive the rest of message later. We disconnect all clients that were in 'backup' buffer before moving new ones from 'current' buffer.
- *
- * * All successful clients from 'backup' buffer are moved back into 'current' buffer.
- *
- * \param[in] priv  pointer to module private data
- * \param[in] data  pointer to data to send
- * \param[in] size  size of data to send
- * \param[in] timeout  timeout in microseconds
- * \return 0 on success (TRAP_E_OK), TRAP_E_BAD_FPARAMS if sender was not properly initialized, TRAP_E_TERMINATED if interface was terminated.
+ * Pointer to element of ring of client queues for the given sequence number.
  */
-int tcpip_sender_send(void *priv, const void *data, uint32_t size, int timeout)
-{
-   uint8_t buffer[DEFAULT_MAX_DATA_LENGTH];
-   int result = TRAP_E_TIMEOUT;
-   tcpip_sender_private_t *c = (tcpip_sender_private_t *) priv;
-   /* timeout for select */
-   struct timeval tv;
-   /* timeout for sem_timedwait */
-   struct timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
-   fd_set set, disset;
-   int maxsd = -1;
-   struct client_s *cl;
-   uint32_t i, j, failed, passed;
-   int retval;
-   ssize_t readbytes;
-   /* first timestamp for global timeout in this function...
-    * in the RESET state, we should check the timeout given by caller
-    * with elapsed time from entry_time.
-    * Timeout is in microseconds... */
+#define TCPIP_CQ_BUFFER(c, seq) (&(c)->cq_buffers[(seq) % (c)->cq_size])
 
-   uint64_t entry_time = get_cur_timestamp();
-   uint64_t curr_time = 0, elapsed_time;
-
-   char block = ((timeout == TRAP_WAIT || timeout == TRAP_HALFWAIT) ? 1 : 0);
+/**
+ * Period (us) of checks of termination in threads and functions waiting for client queues.
+ */
+#define TCPIP_CQ_CHECK_PERIOD 100000
 
-   /* pointer to timeout for select() */
-   struct timeval *tv_p = ((block != 0) ? NULL : &tv);
-   /* pointer to timeout for sem_timedwait() */
-   struct timespec *ts_p = &ts;
+/**
+ * Maximal time (us) to send the rest of client queues after termination.
+ */
+#define TCPIP_CQ_DRAIN_TIMEOUT 1000000
 
-   /* correct module will pass only possitive timeout or TRAP_WAIT, TRAP_HALFWAIT */
-   assert(timeout >= TRAP_HALFWAIT);
+/**
+ * Maximal number of queued buffers passed to one sendmsg() call.
+ */
+#define TCPIP_CQ_IOV_MAX 16
 
-   /* I. Init phase: set timeout and double-send switch */
+/**
+ * \brief Check if the client is connected and served by client queues.
+ *
+ * A client that has just finished negotiation is not served until it joins
+ * the queues, see tcpip_cq_join().  The caller must hold sending_lock.
+ *
+ * \param [in] cl     client
+ * \return 1 if the client has its queue, 0 otherwise
+ */
+static inline int tcpip_cq_client_active(const struct client_s *cl)
+{
+   return (cl->sd > 0) && (cl->next_seq < TCPIP_CQ_JOIN);
+}
 
-blocking_repeat:
+/**
+ * \brief Let clients that have just finished negotiation start with the next stored buffer.
+ *
+ * The accepting thread sets next_seq of the client to TCPIP_CQ_JOIN without
+ * sending_lock.  The caller must hold sending_lock.
+ *
+ * \param [in] c      private data
+ */
+static void tcpip_cq_join(tcpip_sender_private_t *c)
+{
+   int i;
 
-   if (c->is_terminated) {
-      return TRAP_E_TERMINATED;
+   for (i = 0; i < c->clients_arr_size; i++) {
+      if ((c->clients[i].sd > 0) && (c->clients[i].next_seq == TCPIP_CQ_JOIN)) {
+         __sync_bool_compare_and_swap(&c->clients[i].next_seq, TCPIP_CQ_JOIN, c->cq_seq);
+      }
    }
+}
 
-   switch (timeout) {
-   case TRAP_WAIT:
-      trap_set_timeouts(1000000, &tv, &ts);
-      break;
-   case TRAP_HALFWAIT:
-      /*
-       * wait 1s in a loop for select(),
-       * do not change timeout for sem_timedwait in connphase
-       */
-      trap_set_timeouts(1000000, &tv, NULL);
-      break;
+/**
+ * \brief Send queued buffers to the client until its socket is full.
+ *
+ * The caller must hold sending_lock.
+ *
+ * \param [in] c      private data
+ * \param [in] cl_id  index of client
+ * \return TRAP_E_OK if the queue is empty, TRAP_E_TIMEOUT if the socket is full,
+ * TRAP_E_IO_ERROR if the client was disconnected
+ */
+static int tcpip_cq_client_flush(tcpip_sender_private_t *c, int cl_id)
+{
+   struct client_s *cl = &c->clients[cl_id];
+   struct tcpip_cq_buffer_s *b;
+   struct iovec iov[TCPIP_CQ_IOV_MAX];
+   struct msghdr msg;
+   uint64_t seq;
+   ssize_t sent_b;
+   int n;
+
+   memset(&msg, 0, sizeof(msg));
+   msg.msg_iov = iov;
+   while (1) {
+      if (cl->pending_bytes == 0) {
+         if (cl->next_seq == c->cq_seq) {
+            /* the client caught up */
+            cl->client_state = CURRENT_IDLE;
+            cl->behind_since = 0;
+            return TRAP_E_OK;
+         }
+         b = TCPIP_CQ_BUFFER(c, cl->next_seq);
+         cl->sending_pointer = b->data;
+         cl->pending_bytes = b->size;
+         cl->client_state = CURRENT_PAYLOAD;
+      }
+      /* rest of the current buffer followed by the next queued buffers */
+      iov[0].iov_base = cl->sending_pointer;
+      iov[0].iov_len = cl->pending_bytes;
+      /* rest of buffer in backup buffer was already removed from the queue */
+      seq = (cl->client_state == BACKUP_BUFFER) ? cl->next_seq : cl->next_seq + 1;
+      for (n = 1; (n < TCPIP_CQ_IOV_MAX) && (seq != c->cq_seq); n++, seq++) {
+         b = TCPIP_CQ_BUFFER(c, seq);
+         iov[n].iov_base = b->data;
+         iov[n].iov_len = b->size;
+      }
+      msg.msg_iovlen = n;
+      sent_b = sendmsg(cl->sd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (sent_b == -1) {
+         if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return TRAP_E_TIMEOUT;
+         }
+         VERBOSE(CL_VERBOSE_OFF, "Disconnected client (%i)", errno);
+         server_disconnected_client(c, cl_id);
+         return TRAP_E_IO_ERROR;
+      }
+      cl->sent_bytes += sent_b;
+      /* move over the sent buffers */
+      while (sent_b >= cl->pending_bytes) {
+         sent_b -= cl->pending_bytes;
+         cl->pending_bytes = 0;
+         if (cl->client_state != BACKUP_BUFFER) {
+            cl->next_seq++;
+         }
+         cl->sent_buffers++;
+         if (sent_b == 0) {
+            break;
+         }
+         b = TCPIP_CQ_BUFFER(c, cl->next_seq);
+         cl->sending_pointer = b->data;
+         cl->pending_bytes = b->size;
+         cl->client_state = CURRENT_PAYLOAD;
+      }
+      cl->sending_pointer += sent_b;
+      cl->pending_bytes -= sent_b;
+   }
+}
+
+/**
+ * \brief Make space in the full queue of the client by dropping its oldest buffer.
+ *
+ * The partially sent buffer is not dropped, its rest is moved into the
+ * backup buffer of the client so that the client never gets an incomplete
+ * buffer.  With TRAP_CLIENT_POLICY_DISCONNECT, the client is disconnected
+ * instead when it is behind (not emptied its queue since the first drop)
+ * for more than cq_lag.  The caller must hold sending_lock.
+ *
+ * \param [in] c      private data
+ * \param [in] cl_id  index of client
+ */
+static void tcpip_cq_client_drop(tcpip_sender_private_t *c, int cl_id)
+{
+   struct client_s *cl = &c->clients[cl_id];
+   uint64_t now = get_cur_timestamp();
+
+   if (cl->behind_since == 0) {
+      cl->behind_since = now;
+   } else if ((c->cq_policy == TRAP_CLIENT_POLICY_DISCONNECT) && (now - cl->behind_since >= c->cq_lag)) {
+      VERBOSE(CL_VERBOSE_LIBRARY, "Disconnected client that is behind for %"PRIu64" us.", now - cl->behind_since);
+      server_disconnected_client(c, cl_id);
+      return;
+   }
+
+   if ((cl->pending_bytes > 0) && (cl->client_state != BACKUP_BUFFER)) {
+      memcpy(cl->buffer, cl->sending_pointer, cl->pending_bytes);
+      cl->sending_pointer = cl->buffer;
+      cl->client_state = BACKUP_BUFFER;
+   } else {
+      cl->dropped_buffers++;
+   }
+   cl->next_seq++;
+}
+
+/**
+ * \brief Drop references to buffers that were sent to all clients.
+ *
+ * The caller must hold sending_lock.
+ *
+ * \param [in] c      private data
+ */
+static void tcpip_cq_release(tcpip_sender_private_t *c)
+{
+#ifndef DISABLE_BUFFERING
+   struct tcpip_cq_buffer_s *b;
+   uint64_t min_seq = c->cq_seq;
+   int i;
+
+   for (i = 0; i < c->clients_arr_size; i++) {
+      if ((tcpip_cq_client_active(&c->clients[i]) != 0) && (c->clients[i].next_seq < min_seq)) {
+         min_seq = c->clients[i].next_seq;
+      }
+   }
+   for (; c->cq_tail < min_seq; c->cq_tail++) {
+      b = TCPIP_CQ_BUFFER(c, c->cq_tail);
+      trap_pool_put(b->data);
+      b->data = NULL;
+   }
+#else
+   (void) c;
+#endif
+}
+
+/**
+ * \brief Thread sending queued buffers to clients that could not receive them immediately.
+ *
+ * It waits for EPOLLOUT of sockets that returned EAGAIN and detects
+ * disconnected clients.  After termination, it tries to send the rest of
+ * queues for TCPIP_CQ_DRAIN_TIMEOUT.
+ *
+ * \param [in] arg  private data
+ * \return NULL
+ */
+static void *tcpip_cq_thread(void *arg)
+{
+   tcpip_sender_private_t *c = (tcpip_sender_private_t *) arg;
+   struct client_s *cl;
+   struct epoll_event events[TCPIP_EPOLL_EVENTS];
+   uint64_t drain_deadline = 0;
+   uint8_t buffer[64];
+   ssize_t readbytes;
+   int i, e, retval, pending;
+
+   pthread_mutex_lock(&c->sending_lock);
+   while (1) {
+      tcpip_cq_join(c);
+      if (c->is_terminated != 0) {
+         pending = 0;
+         for (i = 0; i < c->clients_arr_size; i++) {
+            cl = &c->clients[i];
+            if ((tcpip_cq_client_active(cl) != 0) && ((cl->pending_bytes > 0) || (cl->next_seq != c->cq_seq))) {
+               pending = 1;
+               break;
+            }
+         }
+         if (drain_deadline == 0) {
+            drain_deadline = get_cur_timestamp() + TCPIP_CQ_DRAIN_TIMEOUT;
+         }
+         if ((pending == 0) || (get_cur_timestamp() >= drain_deadline)) {
+            break;
+         }
+      }
+      pthread_mutex_unlock(&c->sending_lock);
+
+      retval = epoll_wait(c->epfd, events, TCPIP_EPOLL_EVENTS, TCPIP_CQ_CHECK_PERIOD / 1000);
+
+      pthread_mutex_lock(&c->sending_lock);
+      for (e = 0; e < retval; e++) {
+         if (events[e].data.u32 == TCPIP_EPOLL_TERM) {
+            continue;
+         }
+         i = events[e].data.u32;
+         cl = &c->clients[i];
+         if (tcpip_cq_client_active(cl) == 0) {
+            continue;
+         }
+         if ((events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0) {
+            readbytes = recv(cl->sd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if ((readbytes == 0) || ((readbytes == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+               VERBOSE(CL_VERBOSE_LIBRARY, "Disconnected client.");
+               server_disconnected_client(c, i);
+               continue;
+            }
+         }
+         if ((events[e].events & EPOLLOUT) != 0) {
+            tcpip_cq_client_flush(c, i);
+         }
+      }
+      tcpip_cq_release(c);
+      pthread_cond_broadcast(&c->cq_cond);
+   }
+   pthread_cond_broadcast(&c->cq_cond);
+   pthread_mutex_unlock(&c->sending_lock);
+   return NULL;
+}
+
+/**
+ * \brief Store the buffer into client queues and send it to clients that are ready.
+ *
+ * When a client queue is full, the oldest buffer is dropped for the client
+ * (TRAP_CLIENT_POLICY_DROP, TRAP_CLIENT_POLICY_DISCONNECT) or the function
+ * waits for the client according to the timeout (TRAP_CLIENT_POLICY_BLOCK).
+ * The buffer is not copied, the queue keeps a reference to it (data must
+ * be borrowed from the pool) until all clients get it.
+ *
+ * \param [in] c        private data
+ * \param [in] data     pointer to data to send
+ * \param [in] size     size of data to send
+ * \param [in] timeout  timeout in microseconds, TRAP_WAIT or TRAP_HALFWAIT
+ * \return TRAP_E_OK when the buffer was stored, TRAP_E_TIMEOUT, TRAP_E_TERMINATED
+ */
+static int tcpip_cq_push(tcpip_sender_private_t *c, const void *data, uint32_t size, int timeout)
+{
+   struct tcpip_cq_buffer_s *b;
+   struct client_s *cl;
+   struct timeval tv;
+   struct timespec ts;
+   uint64_t entry_time = get_cur_timestamp();
+   int i, full;
+   int result = TRAP_E_OK;
+
+   pthread_mutex_lock(&c->sending_lock);
+   while (1) {
+      /* new clients get this buffer */
+      tcpip_cq_join(c);
+      full = 0;
+      for (i = 0; i < c->clients_arr_size; i++) {
+         cl = &c->clients[i];
+         if ((tcpip_cq_client_active(cl) == 0) || (c->cq_seq - cl->next_seq < c->cq_size)) {
+            continue;
+         }
+         /* the oldest buffer of the ring is still in the queue of the client */
+         if (c->cq_policy == TRAP_CLIENT_POLICY_BLOCK) {
+            full = 1;
+         } else {
+            tcpip_cq_client_drop(c, i);
+         }
+      }
+      if (full == 0) {
+         break;
+      }
+      if (c->is_terminated != 0) {
+         result = TRAP_E_TERMINATED;
+         goto exit;
+      }
+      if ((timeout != TRAP_WAIT) && (timeout != TRAP_HALFWAIT) && (get_cur_timestamp() - entry_time >= timeout)) {
+         result = TRAP_E_TIMEOUT;
+         goto exit;
+      }
+      trap_set_timeouts(TCPIP_CQ_CHECK_PERIOD, &tv, &ts);
+      pthread_cond_timedwait(&c->cq_cond, &c->sending_lock, &ts);
+   }
+
+   /* the oldest buffer may be still referenced when its clients were dropped or disconnected */
+   tcpip_cq_release(c);
+   b = TCPIP_CQ_BUFFER(c, c->cq_seq);
+#ifndef DISABLE_BUFFERING
+   b->data = trap_pool_ref((void *) data);
+#else
+   memcpy(b->data, data, size);
+#endif
+   b->size = size;
+   c->cq_seq++;
+
+   /* clients that keep up get the buffer immediately, cq_thread continues when their sockets are full */
+   for (i = 0; i < c->clients_arr_size; i++) {
+      if (tcpip_cq_client_active(&c->clients[i]) != 0) {
+         tcpip_cq_client_flush(c, i);
+      }
+   }
+   tcpip_cq_release(c);
+exit:
+   pthread_mutex_unlock(&c->sending_lock);
+   return result;
+}
+
+/**
+ * \brief Pass shared memory ring to a client of TRAP_IFC_TCPIP_SHM that finished negotiation.
+ *
+ * The client gets a slot with the same index and starts reading at the current write position.
+ *
+ * \param [in] c      private data
+ * \param [in] cl_id  index of client
+ * \return TRAP_E_OK on success, TRAP_E_IO_ERROR when sending failed
+ */
+static int tcpip_shm_send_ring(tcpip_sender_private_t *c, int cl_id)
+{
+   struct tcpip_shm_msg_s shm_msg;
+   char control[CMSG_SPACE(sizeof(int))];
+   struct iovec iov;
+   struct msghdr msg;
+   struct cmsghdr *cmsg;
+
+   shm_msg.slot = cl_id;
+   shm_msg.gen = shm_ring_join(&c->ring, cl_id);
+
+   iov.iov_base = &shm_msg;
+   iov.iov_len = sizeof(shm_msg);
+   memset(&msg, 0, sizeof(msg));
+   memset(control, 0, sizeof(control));
+   msg.msg_iov = &iov;
+   msg.msg_iovlen = 1;
+   msg.msg_control = control;
+   msg.msg_controllen = sizeof(control);
+   cmsg = CMSG_FIRSTHDR(&msg);
+   cmsg->cmsg_level = SOL_SOCKET;
+   cmsg->cmsg_type = SCM_RIGHTS;
+   cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+   memcpy(CMSG_DATA(cmsg), &c->ring.fd, sizeof(int));
+
+   if (sendmsg(c->clients[cl_id].sd, &msg, MSG_NOSIGNAL) != sizeof(shm_msg)) {
+      VERBOSE(CL_ERROR, "Sending of shared memory to client failed (%s).", strerror(errno));
+      shm_ring_leave(&c->ring, cl_id);
+      return TRAP_E_IO_ERROR;
+   }
+   return TRAP_E_OK;
+}
+
+/**
+ * \brief Disconnect clients of TRAP_IFC_TCPIP_SHM that closed their sockets.
+ *
+ * Clients do not send any data, so readable socket means disconnection.
+ * The caller must hold sending_lock.
+ *
+ * \param [in] c  private data
+ */
+static void tcpip_shm_check_clients(tcpip_sender_private_t *c)
+{
+   uint8_t buffer[DEFAULT_MAX_DATA_LENGTH];
+   struct epoll_event events[TCPIP_EPOLL_EVENTS];
+   struct client_s *cl;
+   ssize_t readbytes;
+   int e, retval;
+
+   c->shm_checked = get_cur_timestamp();
+   retval = epoll_wait(c->epfd, events, TCPIP_EPOLL_EVENTS, 0);
+   for (e = 0; e < retval; e++) {
+      if (events[e].data.u32 == TCPIP_EPOLL_TERM) {
+         continue;
+      }
+      cl = &c->clients[events[e].data.u32];
+      if ((cl->sd <= 0) || ((events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) == 0)) {
+         continue;
+      }
+      readbytes = recv(cl->sd, buffer, DEFAULT_MAX_DATA_LENGTH, MSG_DONTWAIT);
+      if ((readbytes == 0) || ((readbytes < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+         VERBOSE(CL_VERBOSE_LIBRARY, "Disconnected client.");
+         server_disconnected_client(c, events[e].data.u32);
+      }
+   }
+}
+
+/**
+ * \brief Store buffer into shared memory ring of TRAP_IFC_TCPIP_SHM.
+ *
+ * When the ring is full, wait until the slowest client reads its oldest
+ * buffer.  Sockets of clients are checked every TCPIP_CQ_CHECK_PERIOD
+ * so that a terminated client does not block the ring.
+ *
+ * \param [in] c        private data
+ * \param [in] data     buffer with header
+ * \param [in] size     size of buffer with header
+ * \param [in] timeout  timeout in microseconds, TRAP_WAIT, or TRAP_HALFWAIT
+ * \return TRAP_E_OK on success, TRAP_E_TIMEOUT, or TRAP_E_TERMINATED
+ */
+static int tcpip_shm_push(tcpip_sender_private_t *c, const void *data, uint32_t size, int timeout)
+{
+   uint64_t entry_time = get_cur_timestamp();
+   uint64_t curr_time, wait_time;
+   int result;
+
+   pthread_mutex_lock(&c->sending_lock);
+   while (1) {
+      curr_time = get_cur_timestamp();
+      if (curr_time - c->shm_checked >= TCPIP_CQ_CHECK_PERIOD) {
+         tcpip_shm_check_clients(c);
+      }
+      result = shm_ring_put(&c->ring, data, size);
+      if (result == TRAP_E_OK) {
+         break;
+      }
+      if (c->is_terminated != 0) {
+         result = TRAP_E_TERMINATED;
+         break;
+      }
+      wait_time = TCPIP_CQ_CHECK_PERIOD;
+      if ((timeout != TRAP_WAIT) && (timeout != TRAP_HALFWAIT)) {
+         if (curr_time - entry_time >= timeout) {
+            result = TRAP_E_TIMEOUT;
+            break;
+         }
+         wait_time = MIN(wait_time, timeout - (curr_time - entry_time));
+      }
+      shm_ring_wait_space(&c->ring, size, wait_time);
+   }
+   pthread_mutex_unlock(&c->sending_lock);
+   return result;
+}
+
+/**
+ * Maximal time (us) of one wait for completions of sends by io_uring, termination is checked after it.
+ */
+#define TCPIP_URING_WAIT 1000000
+
+/**
+ * \brief Process completions of sends to clients submitted by tcpip_uring_send().
+ *
+ * \param [in] c         private data
+ * \param [in] resubmit  1 to submit the rest of partially sent or interrupted buffers again
+ * \return number of sends that are not in flight anymore
+ */
+static int tcpip_uring_reap(tcpip_sender_private_t *c, int resubmit)
+{
+   struct client_s *cl;
+   uint64_t id;
+   int32_t res;
+   int done = 0;
+
+   while (trap_uring_get_cqe(&c->uring, &id, &res) != 0) {
+      if ((id == TCPIP_URING_TERM) || (id == TCPIP_URING_CANCEL)) {
+         continue;
+      }
+      cl = &c->clients[id];
+      if (res > 0) {
+         cl->sending_pointer += res;
+         cl->pending_bytes -= res;
+         if (cl->pending_bytes == 0) {
+            cl->sending_pointer = NULL;
+            cl->client_state = CURRENT_COMPLETE;
+            done++;
+            continue;
+         }
+      } else if ((res != 0) && (res != -EINTR) && (res != -EAGAIN) && (res != -ECANCELED)) {
+         VERBOSE(CL_VERBOSE_OFF, "Disconnected client (%i)", -res);
+         server_disconnected_client(c, id);
+         done++;
+         continue;
+      }
+      if (resubmit != 0) {
+         trap_uring_prep_send(&c->uring, cl->sd, cl->sending_pointer, cl->pending_bytes, MSG_NOSIGNAL | MSG_WAITALL, id);
+      } else {
+         done++;
+      }
+   }
+   return done;
+}
+
+/**
+ * \brief Send data to all connected clients using io_uring.
+ *
+ * Sends to all clients that have not received the buffer yet are submitted
+ * by one syscall and the kernel waits for their sockets, there is no other
+ * syscall when all sockets accept the whole buffer.  Sends that did not
+ * finish in timeout are cancelled and continued by the next call with the
+ * same buffer, as with send_all_data().  When io_uring_enter() fails, queued
+ * sends are withdrawn and submitted ones are cancelled, or their clients are
+ * shut down, so the kernel does not access data after return.
+ *
+ * \param [in] c        private data
+ * \param [in] data     buffer with header
+ * \param [in] size     size of buffer with header
+ * \param [in] timeout  timeout in microseconds, TRAP_WAIT, or TRAP_HALFWAIT
+ * \return TRAP_E_OK on success, TRAP_E_TIMEOUT, TRAP_E_TERMINATED, or TRAP_E_IO_ERROR
+ */
+static int tcpip_uring_send(tcpip_sender_private_t *c, const void *data, uint32_t size, int timeout)
+{
+   uint64_t entry_time = get_cur_timestamp();
+   uint64_t elapsed_time, wait_time = 0;
+   struct client_s *cl;
+   struct timeval tv;
+   int i, inflight = 0;
+   int result = TRAP_E_OK;
+
+   pthread_mutex_lock(&c->sending_lock);
+   for (i = 0; i < c->clients_arr_size; i++) {
+      cl = &c->clients[i];
+      if ((cl->sd <= 0) || (cl->client_state == CURRENT_COMPLETE)) {
+         continue;
+      }
+      if ((cl->sending_pointer == NULL) || (cl->pending_bytes == 0)) {
+         cl->sending_pointer = (void *) data;
+         cl->pending_bytes = size;
+      }
+      /* the ring has space for sends and cancellations of all clients */
+      trap_uring_prep_send(&c->uring, cl->sd, cl->sending_pointer, cl->pending_bytes, MSG_NOSIGNAL | MSG_WAITALL, i);
+      inflight++;
+   }
+
+   while (inflight > 0) {
+      trap_set_timeouts(wait_time, &tv, NULL);
+      if (trap_uring_submit_and_wait(&c->uring, 1, &tv) != TRAP_E_OK) {
+         /* only sends are queued here, the withdrawn ones are continued by the next call */
+         inflight -= trap_uring_drop(&c->uring);
+         result = TRAP_E_IO_ERROR;
+         break;
+      }
+      inflight -= tcpip_uring_reap(c, 1);
+      if (inflight == 0) {
+         break;
+      }
+      if (c->is_terminated != 0) {
+         result = TRAP_E_TERMINATED;
+         break;
+      }
+      wait_time = TCPIP_URING_WAIT;
+      if ((timeout != TRAP_WAIT) && (timeout != TRAP_HALFWAIT)) {
+         elapsed_time = get_cur_timestamp() - entry_time;
+         if (elapsed_time >= timeout) {
+            result = TRAP_E_TIMEOUT;
+            break;
+         }
+         wait_time = MIN(wait_time, timeout - elapsed_time);
+      }
+   }
+
+   if (inflight > 0) {
+      /* the kernel must not access data after return */
+      for (i = 0; i < c->clients_arr_size; i++) {
+         cl = &c->clients[i];
+         if ((cl->sd > 0) && (cl->client_state != CURRENT_COMPLETE)) {
+            trap_uring_prep_cancel(&c->uring, i, TCPIP_URING_CANCEL);
+         }
+      }
+      while (inflight > 0) {
+         if (trap_uring_submit_and_wait(&c->uring, 1, NULL) != TRAP_E_OK) {
+            /* cancellations could not be submitted, shutdown() makes the pending sends fail */
+            trap_uring_drop(&c->uring);
+            for (i = 0; i < c->clients_arr_size; i++) {
+               cl = &c->clients[i];
+               if ((cl->sd > 0) && (cl->client_state != CURRENT_COMPLETE)) {
+                  shutdown(cl->sd, SHUT_RDWR);
+               }
+            }
+            if (trap_uring_submit_and_wait(&c->uring, 1, NULL) != TRAP_E_OK) {
+               VERBOSE(CL_ERROR, "Unable to wait for %d sends of io_uring.", inflight);
+               break;
+            }
+         }
+         inflight -= tcpip_uring_reap(c, 0);
+      }
+   } else {
+      /* everybody got the buffer */
+      for (i = 0; i < c->clients_arr_size; i++) {
+         cl = &c->clients[i];
+         if (cl->client_state == CURRENT_COMPLETE) {
+            cl->client_state = CURRENT_IDLE;
+         }
+      }
+   }
+   pthread_mutex_unlock(&c->sending_lock);
+   return result;
+}
+
+/**
+ * \brief Check that the client of "shard=" can receive data.
+ *
+ * Clients do not send anything after negotiation, so readable socket means
+ * that the client disconnected.  Such client is removed before data are sent
+ * to it, otherwise the buffer could be lost in the socket of closed connection.
+ *
+ * The caller must hold sending_lock.
+ *
+ * \param [in] c      private data
+ * \param [in] cl_id  index of client
+ * \return 1 if the client is connected and negotiated, 0 otherwise
+ */
+static int tcpip_shard_client_ok(tcpip_sender_private_t *c, int32_t cl_id)
+{
+   uint8_t buffer[DEFAULT_MAX_DATA_LENGTH];
+   struct client_s *cl = &c->clients[cl_id];
+   struct pollfd pfd;
+   ssize_t readbytes;
+
+   if ((cl->sd <= 0) || (cl->next_seq == TCPIP_CQ_NEGOTIATING)) {
+      return 0;
+   }
+   pfd.fd = cl->sd;
+   pfd.events = POLLIN | POLLRDHUP;
+   if ((poll(&pfd, 1, 0) == 1) && (pfd.revents != 0)) {
+      readbytes = recv(cl->sd, buffer, DEFAULT_MAX_DATA_LENGTH, MSG_DONTWAIT);
+      if ((readbytes == 0) || ((readbytes < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+         VERBOSE(CL_VERBOSE_LIBRARY, "Disconnected client.");
+         server_disconnected_client(c, cl_id);
+         return 0;
+      }
+   }
+   return 1;
+}
+
+/**
+ * \brief Choose the client that receives the next buffer with "shard=".
+ *
+ * With TRAP_SHARD_RR, clients take turns.  With TRAP_SHARD_HASH, libtrap
+ * stores messages into the buffer given by their key modulo the number of
+ * connected clients (tcpip_sender_get_client_count()), the buffer is sent
+ * to the client with the same order among connected clients.
+ *
+ * The caller must hold sending_lock.
+ *
+ * \param [in] c     private data
+ * \param [in] slot  index of the buffer with TRAP_SHARD_HASH
+ * \return index of client, -1 if there is no connected client
+ */
+static int32_t tcpip_shard_pick(tcpip_sender_private_t *c, uint32_t slot)
+{
+   int32_t i, n, target;
+
+   if (c->shard == TRAP_SHARD_RR) {
+      for (n = 0; n < c->clients_arr_size; n++) {
+         i = (c->shard_next + n) % c->clients_arr_size;
+         if (tcpip_shard_client_ok(c, i) != 0) {
+            c->shard_next = i + 1;
+            return i;
+         }
+      }
+      return -1;
+   }
+
+   /* disconnected clients are removed at first, the order must not change after that */
+   for (i = 0; i < c->clients_arr_size; i++) {
+      tcpip_shard_client_ok(c, i);
+   }
+   /* connected_clients counts the same clients as the loop below, a client is added
+    * to both when its negotiation is finished */
+   pthread_mutex_lock(&c->lock);
+   n = c->connected_clients;
+   target = (n > 0) ? slot % n : -1;
+   for (i = 0; (target >= 0) && (i < c->clients_arr_size); i++) {
+      if ((c->clients[i].sd > 0) && (c->clients[i].next_seq != TCPIP_CQ_NEGOTIATING)) {
+         if (target == 0) {
+            break;
+         }
+         target--;
+      }
+   }
+   pthread_mutex_unlock(&c->lock);
+   return ((target == 0) && (i < c->clients_arr_size)) ? i : -1;
+}
+
+/**
+ * \brief Send data to one of connected clients ("shard=").
+ *
+ * The client is chosen by tcpip_shard_pick().  When the timeout elapses in
+ * the middle of the buffer, the caller repeats the call with the same data
+ * and sending continues to the same client.  When the client disconnects,
+ * the whole buffer is sent to another one.
+ *
+ * \param [in] c        private data
+ * \param [in] data     pointer to data to send
+ * \param [in] size     size of data to send
+ * \param [in] slot     index of the buffer with TRAP_SHARD_HASH
+ * \param [in] timeout  timeout in microseconds, TRAP_WAIT or TRAP_HALFWAIT
+ * \return TRAP_E_OK, TRAP_E_TIMEOUT, TRAP_E_TERMINATED or TRAP_E_IO_ERROR if there is no client
+ */
+static int tcpip_shard_send(tcpip_sender_private_t *c, const void *data, uint32_t size, uint32_t slot, int timeout)
+{
+   struct client_s *cl;
+   struct pollfd pfd[2];
+   uint64_t entry_time = get_cur_timestamp(), elapsed_time;
+   uint32_t pending;
+   int result, wait_time;
+
+   pthread_mutex_lock(&c->sending_lock);
+   while (1) {
+      if (c->is_terminated != 0) {
+         result = TRAP_E_TERMINATED;
+         break;
+      }
+      if ((c->shard_client < 0) || (c->clients[c->shard_client].sd <= 0)) {
+         c->shard_client = tcpip_shard_pick(c, slot);
+         if (c->shard_client < 0) {
+            /* there is no client to send to */
+            result = TRAP_E_IO_ERROR;
+            break;
+         }
+         cl = &c->clients[c->shard_client];
+         cl->sending_pointer = (void *) data;
+         cl->pending_bytes = size;
+      }
+      cl = &c->clients[c->shard_client];
+
+      pending = cl->pending_bytes;
+      result = send_all_data(c, cl->sd, &cl->sending_pointer, &cl->pending_bytes, 0);
+      if (result == TRAP_E_OK || result == TRAP_E_TIMEOUT) {
+         cl->sent_bytes += pending - cl->pending_bytes;
+      }
+      if (result == TRAP_E_OK) {
+         cl->sent_buffers++;
+         c->shard_client = -1;
+         break;
+      } else if (result == TRAP_E_IO_ERROR) {
+         /* the next client gets the whole buffer */
+         server_disconnected_client(c, c->shard_client);
+         c->shard_client = -1;
+         continue;
+      } else if (result != TRAP_E_TIMEOUT) {
+         break;
+      }
+
+      /* socket is full, wait until the client reads data */
+      if ((timeout == TRAP_WAIT) || (timeout == TRAP_HALFWAIT)) {
+         wait_time = -1;
+      } else {
+         elapsed_time = get_cur_timestamp() - entry_time;
+         if (elapsed_time >= timeout) {
+            break;
+         }
+         wait_time = (timeout - elapsed_time + 999) / 1000;
+      }
+      pfd[0].fd = cl->sd;
+      pfd[0].events = POLLOUT;
+      pfd[1].fd = c->term_pipe[0];
+      pfd[1].events = POLLIN;
+      pthread_mutex_unlock(&c->sending_lock);
+      if ((poll(pfd, 2, wait_time) < 0) && (errno != EINTR)) {
+         VERBOSE(CL_ERROR, "poll() failed (%d): %s", errno, strerror(errno));
+         return TRAP_E_IO_ERROR;
+      }
+      pthread_mutex_lock(&c->sending_lock);
+   }
+   pthread_mutex_unlock(&c->sending_lock);
+   return result;
+}
+
+/**
+ * \brief Send data to all connected clients.
+ *
+ * All clients are in 'current' buffer or in 'backup' buffer.
+ * All clients get messages from current buffer at first.
+ * * When all buffer is successfully sent to all clients
+ * in 'current' buffer, everything is alright.
+ *
+ * * When everybody fails due to timeout, everything
+ * is alright, everybody stays in 'current' buffer.
+ *
+ * * When somebody fails and somebody is successful, failing clients are moved into 'backup' buffer and they have chance to receive the rest of message later. We disconnect all clients that were in 'backup' buffer before moving new ones from 'current' buffer.
+ *
+ * * All successful clients from 'backup' buffer are moved back into 'current' buffer.
+ *
+ * \param[in] priv  pointer to module private data
+ * \param[in] data  pointer to data to send
+ * \param[in] size  size of data to send
+ * \param[in] slot  index of the buffer with "shard=hash", see tcpip_shard_pick()
+ * \param[in] timeout  timeout in microseconds
+ * \return 0 on success (TRAP_E_OK), TRAP_E_BAD_FPARAMS if sender was not properly initialized, TRAP_E_TERMINATED if interface was terminated.
+ */
+int tcpip_sender_send_slot(void *priv, const void *data, uint32_t size, uint32_t slot, int timeout)
+{
+   uint8_t buffer[DEFAULT_MAX_DATA_LENGTH];
+   int result = TRAP_E_TIMEOUT;
+   tcpip_sender_private_t *c = (tcpip_sender_private_t *) priv;
+   /* timeout for epoll_wait */
+   struct timeval tv;
+   /* timeout for sem_timedwait */
+   struct timespec ts = { .tv_sec = 0, .tv_nsec = 0 };
+   struct epoll_event events[TCPIP_EPOLL_EVENTS];
+   struct client_s *cl;
+   uint32_t i, j, failed, passed;
+   int retval, e, pending, ready;
+   ssize_t readbytes;
+   /* first timestamp for global timeout in this function...
+    * in the RESET state, we should check the timeout given by caller
+    * with elapsed time from entry_time.
+    * Timeout is in microseconds... */
+
+   uint64_t entry_time = get_cur_timestamp();
+   uint64_t curr_time = 0, elapsed_time;
+
+   char block = ((timeout == TRAP_WAIT || timeout == TRAP_HALFWAIT) ? 1 : 0);
+
+   /* pointer to timeout for epoll_wait() */
+   struct timeval *tv_p = ((block != 0) ? NULL : &tv);
+   /* pointer to timeout for sem_timedwait() */
+   struct timespec *ts_p = &ts;
+
+   /* correct module will pass only possitive timeout or TRAP_WAIT, TRAP_HALFWAIT */
+   assert(timeout >= TRAP_HALFWAIT);
+
+   /* I. Init phase: set timeout and double-send switch */
+
+blocking_repeat:
+
+   if (c->is_terminated) {
+      return TRAP_E_TERMINATED;
+   }
+
+   switch (timeout) {
+   case TRAP_WAIT:
+      trap_set_timeouts(1000000, &tv, &ts);
+      break;
+   case TRAP_HALFWAIT:
+      /*
+       * wait 1s in a loop for epoll_wait(),
+       * do not change timeout for sem_timedwait in connphase
+       */
+      trap_set_timeouts(1000000, &tv, NULL);
+      break;
    default:
       /*
-       * set timeout (can be 0 - nowait or any positive number) for select(),
+       * set timeout (can be 0 - nowait or any positive number) for epoll_wait(),
        * do not change timeout for sem_timedwait in connphase
        */
       trap_set_timeouts(timeout, &tv, NULL);
@@ -1190,40 +2450,101 @@ blocking_repeat:
       goto exit;
    }
 
-   FD_ZERO(&disset);
-   FD_ZERO(&set);
+   if (c->ring.hdr != NULL) {
+      /* clients read the data from shared memory */
+      result = tcpip_shm_push(c, data, size, timeout);
+      goto exit;
+   }
+
+   if (c->shard != TRAP_SHARD_OFF) {
+      /* every buffer goes to one client */
+      result = tcpip_shard_send(c, data, size, slot, timeout);
+      goto exit;
+   }
+
+   if (c->cq_size > 0) {
+      /* clients are served from their queues */
+      result = tcpip_cq_push(c, data, size, timeout);
+      goto exit;
+   }
+
+   if (c->uring.fd != -1) {
+      /* sends to all clients are submitted together */
+      result = tcpip_uring_send(c, data, size, timeout);
+      goto exit;
+   }
 
    /*
-    * add term_pipe for reading into the disconnect client set
+    * Sockets are edge-triggered, wait only when every client that has not
+    * received the data yet returned EAGAIN; check events without waiting
+    * when only some of them did.  When all of them can take data, events
+    * are not checked at all, disconnection is found out by send().
     */
-   FD_SET(c->term_pipe[0], &disset);
-   if (maxsd < c->term_pipe[0]) {
-      maxsd = c->term_pipe[0];
+   pending = ready = 0;
+   for (i = 0; i < c->clients_arr_size; ++i) {
+      cl = &c->clients[i];
+      if ((cl->sd > 0) && (cl->client_state != CURRENT_COMPLETE)) {
+         if (cl->ready != 0) {
+            ready = 1;
+         } else {
+            pending = 1;
+         }
+      }
+   }
+   if ((pending == 0) && (ready != 0)) {
+      retval = 0;
+   } else {
+      retval = epoll_wait(c->epfd, events, TCPIP_EPOLL_EVENTS, (ready != 0) ? 0 : tcpip_epoll_timeout(tv_p));
+   }
+   if (retval < 0) {
+      if (c->is_terminated != 0) {
+         goto exit;
+      } else if (errno != EINTR) {
+         VERBOSE(CL_ERROR, "epoll_wait() failed (%d): %s", errno, strerror(errno));
+         result = TRAP_E_IO_ERROR;
+         goto exit;
+      }
+      retval = 0;
    }
 
-   for (i = 0, j = 0; i < c->clients_arr_size; ++i) {
-      cl = &c->clients[i];
-      if (j == c->connected_clients) {
-         break;
+   for (e = 0; e < retval; e++) {
+      if (events[e].data.u32 == TCPIP_EPOLL_TERM) {
+         /* Sending was interrupted by terminate(), exit even from TRAP_WAIT function call. */
+         return TRAP_E_TERMINATED;
       }
+      cl = &c->clients[events[e].data.u32];
       if (cl->sd <= 0) {
-         /* not connected client */
          continue;
       }
-      j++;
-      if (maxsd < cl->sd) {
-         maxsd = cl->sd;
+      if ((events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0) {
+         /* client disconnects */
+         readbytes = recv(cl->sd, buffer, DEFAULT_MAX_DATA_LENGTH, MSG_DONTWAIT);
+         if ((readbytes == 0) || ((readbytes < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))) {
+            VERBOSE(CL_VERBOSE_LIBRARY, "Disconnected client.");
+            result = TRAP_E_IO_ERROR;
+            pthread_mutex_lock(&c->sending_lock);
+            server_disconnected_client(c, events[e].data.u32);
+            pthread_mutex_unlock(&c->sending_lock);
+            continue;
+         }
       }
-      /* check if client is still connected */
-      FD_SET(cl->sd, &disset);
-      if (cl->client_state != CURRENT_COMPLETE) {
-         /* check if client is ready for message */
-         FD_SET(cl->sd, &set);
+      if ((events[e].events & EPOLLOUT) != 0) {
+         cl->ready = 1;
       }
    }
 
-   retval = select(maxsd + 1, &disset, &set, NULL, tv_p);
-   if ((retval == 0) || (retval < 0 && errno == EINTR)) {
+   pending = ready = 0;
+   for (i = 0; i < c->clients_arr_size; ++i) {
+      cl = &c->clients[i];
+      if ((cl->sd > 0) && (cl->client_state != CURRENT_COMPLETE)) {
+         pending = 1;
+         if (cl->ready != 0) {
+            ready = 1;
+            break;
+         }
+      }
+   }
+   if ((pending != 0) && (ready == 0)) {
       if (block == 0) {
          /* non-blocking mode */
          curr_time = get_cur_timestamp();
@@ -1242,14 +2563,6 @@ blocking_repeat:
          /* blocking mode */
          goto blocking_repeat;
       }
-   } else if (retval < 0) {
-      if (c->is_terminated != 0) {
-         goto exit;
-      } else if (errno == EBADF) {
-         assert(0);
-         result = TRAP_E_IO_ERROR;
-         goto exit;
-      }
    }
 
    passed = failed = 0;
@@ -1263,22 +2576,11 @@ blocking_repeat:
       if(cl->sd == -1) {
          continue;
       }
-      if (FD_ISSET(cl->sd, &disset)) {
-         /* client disconnects */
-         readbytes = recv(cl->sd, buffer, DEFAULT_MAX_DATA_LENGTH, 0);
-         if (readbytes < 1) {
-            VERBOSE(CL_VERBOSE_LIBRARY, "Disconnected client.");
-            result = TRAP_E_IO_ERROR;
-            server_disconnected_client(c, i);
-            continue;
-         }
-      }
 
-      if (FD_ISSET(cl->sd, &set)) {
+      if ((cl->client_state != CURRENT_COMPLETE) && (cl->ready != 0)) {
          if (j == c->connected_clients) {
             break;
          }
-         /* we added only clients whose sending is not CURRENT_COMPLETE */
          if ((cl->sending_pointer == NULL) || (cl->pending_bytes == 0)) {
             cl->sending_pointer = (void *) data;
             cl->pending_bytes = size;
@@ -1294,6 +2596,8 @@ blocking_repeat:
             cl->client_state = CURRENT_COMPLETE;
             break;
          case TRAP_E_TIMEOUT:
+            /* socket is full, wait for EPOLLOUT */
+            cl->ready = 0;
             failed++;
             break;
          }
@@ -1307,11 +2611,6 @@ blocking_repeat:
    }
    pthread_mutex_unlock(&c->sending_lock);
 
-   if (FD_ISSET(c->term_pipe[0], &disset)) {
-      /* Sending was interrupted by terminate(), exit even from TRAP_WAIT function call. */
-      return TRAP_E_TERMINATED;
-   }
-
    if (failed != 0) {
       result = TRAP_E_TIMEOUT;
    } else {
@@ -1355,6 +2654,20 @@ exit:
    return result;
 }
 
+/**
+ * \brief Send data to all connected clients, see tcpip_sender_send_slot().
+ *
+ * \param[in] priv  pointer to module private data
+ * \param[in] data  pointer to data to send
+ * \param[in] size  size of data to send
+ * \param[in] timeout  timeout in microseconds
+ * \return 0 on success (TRAP_E_OK), TRAP_E_BAD_FPARAMS if sender was not properly initialized, TRAP_E_TERMINATED if interface was terminated.
+ */
+int tcpip_sender_send(void *priv, const void *data, uint32_t size, int timeout)
+{
+   return tcpip_sender_send_slot(priv, data, size, 0, timeout);
+}
+
 
 /**
  * \brief Set interface state as terminated.
@@ -1366,6 +2679,10 @@ void tcpip_sender_terminate(void *priv)
    if (c != NULL) {
       c->is_terminated = 1;
       close(c->term_pipe[1]);
+      if (c->ring.hdr != NULL) {
+         /* break waiting for space in ring */
+         shm_ring_wake(&c->ring);
+      }
       VERBOSE(CL_VERBOSE_LIBRARY, "Closed term_pipe, it should break select()");
    } else {
       VERBOSE(CL_ERROR, "Destroying IFC that is probably not initialized.");
@@ -1389,7 +2706,8 @@ void tcpip_sender_destroy(void *priv)
 #define X(x) free(x); x = NULL;
    // Free private data
    if (c != NULL) {
-      if ((c->socket_type == TRAP_IFC_TCPIP_UNIX) || (c->socket_type == TRAP_IFC_TCPIP_SERVICE)) {
+      if ((c->socket_type == TRAP_IFC_TCPIP_UNIX) || (c->socket_type == TRAP_IFC_TCPIP_SHM) ||
+          (c->socket_type == TRAP_IFC_TCPIP_SERVICE)) {
          if (asprintf(&unix_socket_path, trap_default_socket_path_format, c->server_port) != -1) {
             if (unix_socket_path != NULL) {
                unlink(unix_socket_path);
@@ -1406,6 +2724,12 @@ void tcpip_sender_destroy(void *priv)
          pthread_join(c->accept_thread, &res);
       }
 
+      if (c->cq_thread_started) {
+         /* let the thread send the rest of client queues */
+         c->is_terminated = 1;
+         pthread_join(c->cq_thread, &res);
+      }
+
       /* close server socket */
       close(c->server_sd);
 
@@ -1415,11 +2739,15 @@ void tcpip_sender_destroy(void *priv)
          for (i = 0; i < c->clients_arr_size; i++) {
             cl = &c->clients[i];
             if (cl->sd > 0) {
+               if (c->ring.hdr != NULL) {
+                  shm_ring_leave(&c->ring, i);
+               }
                close(cl->sd);
                cl->sd = -1;
                c->connected_clients--;
             }
-            X(cl->buffer);
+            trap_pool_put(cl->buffer);
+            cl->buffer = NULL;
          }
          free(c->clients);
          c->clients = NULL;
@@ -1429,7 +2757,17 @@ void tcpip_sender_destroy(void *priv)
       pthread_mutex_destroy(&c->sending_lock);
       sem_destroy(&c->have_clients);
 
-      X(c->backup_buffer)
+      if (c->cq_buffers != NULL) {
+         for (i = 0; i < c->cq_size; i++) {
+            trap_pool_put(c->cq_buffers[i].data);
+         }
+         X(c->cq_buffers);
+         pthread_cond_destroy(&c->cq_cond);
+      }
+      shm_ring_close(&c->ring);
+      trap_uring_destroy(&c->uring);
+      close(c->epfd);
+      trap_pool_put(c->backup_buffer);
       X(c)
    }
 #undef X
@@ -1449,6 +2787,42 @@ int32_t tcpip_sender_get_client_count(void *priv)
    return client_count;
 }
 
+int32_t tcpip_sender_get_client_stats(void *priv, trap_client_stats_t *stats, int32_t n)
+{
+   tcpip_sender_private_t *c = (tcpip_sender_private_t *) priv;
+   struct client_s *cl;
+   int32_t i, count = 0;
+
+   if (c == NULL) {
+      return 0;
+   }
+   pthread_mutex_lock(&c->sending_lock);
+   for (i = 0; (i < c->clients_arr_size) && (count < n); i++) {
+      cl = &c->clients[i];
+      if (c->cq_size == 0) {
+         /* "shard=", nothing is queued */
+         if ((cl->sd <= 0) || (cl->next_seq == TCPIP_CQ_NEGOTIATING)) {
+            continue;
+         }
+         stats[count].queued = 0;
+      } else if ((cl->sd > 0) && (cl->next_seq == TCPIP_CQ_JOIN)) {
+         /* it gets the buffers stored after its connection */
+         stats[count].queued = 0;
+      } else if (tcpip_cq_client_active(cl) == 0) {
+         continue;
+      } else {
+         stats[count].queued = c->cq_seq - cl->next_seq;
+      }
+      stats[count].id = i;
+      stats[count].sent_buffers = cl->sent_buffers;
+      stats[count].sent_bytes = cl->sent_bytes;
+      stats[count].dropped_buffers = cl->dropped_buffers;
+      count++;
+   }
+   pthread_mutex_unlock(&c->sending_lock);
+   return count;
+}
+
 static void tcpip_sender_create_dump(void *priv, uint32_t idx, const char *path)
 {
    tcpip_sender_private_t *c = (tcpip_sender_private_t *) priv;
@@ -1539,6 +2913,9 @@ void server_disconnect_all_clients(void *priv)
       for (i = 0; i < c->clients_arr_size; i++) {
          cl = &c->clients[i];
          if (cl->sd > 0) {
+            if (c->ring.hdr != NULL) {
+               shm_ring_leave(&c->ring, i);
+            }
             close(cl->sd);
             cl->sd = -1;
             c->connected_clients--;
@@ -1603,7 +2980,10 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
 
    priv->ctx = ctx;
    priv->socket_type = type;
+   priv->sockopts = ifc->sockopts;
    priv->ifc_idx = idx;
+   priv->ring.fd = -1;
+   priv->uring.fd = -1;
 
    /* Parsing params */
    param_iterator = trap_get_param_by_delimiter(params, &server_port, TRAP_IFC_PARAM_DELIMITER);
@@ -1628,7 +3008,7 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
    }
 
    /* set global buffer size */
-   priv->int_mess_header.data_length = TRAP_IFC_MESSAGEQ_SIZE;
+   priv->int_mess_header.data_length = ifc->buffer_size;
    /* Parsing params ended */
 
    priv->clients_arr_size = max_num_client;
@@ -1639,11 +3019,11 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
       goto failsafe_cleanup;
    }
 
-   /* allocate buffer according to TRAP_IFC_MESSAGEQ_SIZE with additional space for message header */
+   /* allocate buffer according to the size of IFC buffer with additional space for message header */
    //priv->message_buffer = (void *) calloc(1, priv->int_mess_header.data_length +
    //                        sizeof(trap_buffer_header_t));
-   priv->backup_buffer = (void *) calloc(1, priv->int_mess_header.data_length +
-                           sizeof(trap_buffer_header_t));
+   priv->backup_buffer = trap_pool_calloc(priv->int_mess_header.data_length +
+                                          sizeof(trap_buffer_header_t));
 
    if (priv->clients == NULL) {
       /* if some memory could not have been allocated, we cannot continue */
@@ -1654,7 +3034,47 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
       priv->clients[i].client_state = CURRENT_IDLE;
       /* all clients are disconnected */
       priv->clients[i].sd = -1;
-      priv->clients[i].buffer = calloc(TRAP_IFC_MESSAGEQ_SIZE + 4, 1);
+      priv->clients[i].buffer = trap_pool_calloc(ifc->buffer_size + sizeof(trap_buffer_header_t));
+   }
+
+   priv->shard = ifc->shard;
+   priv->shard_client = -1;
+   if ((ifc->client_queue > 0) && (priv->shard != TRAP_SHARD_OFF)) {
+      VERBOSE(CL_ERROR, "Client queues are not used with \"shard\", every buffer is sent to one client.");
+   } else if (ifc->client_queue > 0) {
+      priv->cq_size = ifc->client_queue;
+      priv->cq_policy = ifc->client_policy;
+      priv->cq_lag = (uint64_t) ifc->client_lag * USEC_IN_SEC;
+      priv->cq_buffers = calloc(priv->cq_size, sizeof(struct tcpip_cq_buffer_s));
+      if (priv->cq_buffers == NULL) {
+         result = TRAP_E_MEMORY;
+         goto failsafe_cleanup;
+      }
+#ifdef DISABLE_BUFFERING
+      /* messages of the caller are copied */
+      for (i = 0; i < priv->cq_size; i++) {
+         priv->cq_buffers[i].data = trap_pool_get(ifc->buffer_size + sizeof(trap_buffer_header_t));
+         if (priv->cq_buffers[i].data == NULL) {
+            result = TRAP_E_MEMORY;
+            goto failsafe_cleanup;
+         }
+      }
+#endif
+   }
+
+   if (type == TRAP_IFC_TCPIP_SHM) {
+      if (priv->cq_size > 0) {
+         VERBOSE(CL_ERROR, "Client queues are not used by SHM IFC, clients read data from shared memory.");
+         for (i = 0; i < priv->cq_size; i++) {
+            trap_pool_put(priv->cq_buffers[i].data);
+         }
+         X(priv->cq_buffers);
+         priv->cq_size = 0;
+      }
+      result = shm_ring_create(&priv->ring, max_num_client, ifc->buffer_size + sizeof(trap_buffer_header_t));
+      if (result != TRAP_E_OK) {
+         goto failsafe_cleanup;
+      }
    }
 
    priv->connected_clients = 0;
@@ -1673,6 +3093,25 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
       goto failsafe_cleanup;
    }
 
+   /* sockets of clients are registered by accept thread */
+   priv->epfd = epoll_create1(EPOLL_CLOEXEC);
+   if (priv->epfd == -1) {
+      VERBOSE(CL_ERROR, "Failed to create epoll instance for output IFC.");
+      result = TRAP_E_IO_ERROR;
+      goto failsafe_cleanup;
+   }
+
+   if (priv->cq_size > 0) {
+      pthread_cond_init(&priv->cq_cond, NULL);
+      if (pthread_create(&priv->cq_thread, NULL, tcpip_cq_thread, priv) != 0) {
+         VERBOSE(CL_ERROR, "Failed to create thread for client queues.");
+         pthread_cond_destroy(&priv->cq_cond);
+         result = TRAP_E_IO_ERROR;
+         goto failsafe_cleanup;
+      }
+      priv->cq_thread_started = 1;
+   }
+
    result = server_socket_open(priv);
    if (result != TRAP_E_OK) {
       VERBOSE(CL_ERROR, "Socket could not be opened on given port '%s'.", server_port);
@@ -1683,13 +3122,29 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
       VERBOSE(CL_ERROR, "Opening of pipe failed. Using stdin as a fall back.");
       priv->term_pipe[0] = 0;
    }
+   tcpip_epoll_add(priv->epfd, priv->term_pipe[0], EPOLLIN, TCPIP_EPOLL_TERM);
+
+   if ((ifc->uring != 0) && (type != TRAP_IFC_TCPIP_SHM)) {
+      if (priv->cq_size > 0) {
+         VERBOSE(CL_ERROR, "io_uring is not used with client queues.");
+      } else if (priv->shard != TRAP_SHARD_OFF) {
+         VERBOSE(CL_ERROR, "io_uring is not used with \"shard\".");
+      } else if (trap_uring_init(&priv->uring, 2 * priv->clients_arr_size + 1) == TRAP_E_OK) {
+         /* plain syscalls are used when io_uring is not available */
+         trap_uring_prep_poll(&priv->uring, priv->term_pipe[0], POLLIN, TCPIP_URING_TERM);
+      }
+   }
 
    // Fill struct defining the interface
    ifc->disconn_clients = server_disconnect_all_clients;
    ifc->send = tcpip_sender_send;
+   ifc->send_slot = tcpip_sender_send_slot;
    ifc->terminate = tcpip_sender_terminate;
    ifc->destroy = tcpip_sender_destroy;
    ifc->get_client_count = tcpip_sender_get_client_count;
+   if ((priv->cq_size > 0) || (priv->shard != TRAP_SHARD_OFF)) {
+      ifc->get_client_stats = tcpip_sender_get_client_stats;
+   }
    ifc->create_dump = tcpip_sender_create_dump;
    ifc->priv = priv;
    ifc->get_id = tcpip_send_ifc_get_id;
@@ -1700,10 +3155,27 @@ failsafe_cleanup:
    X(server_port);
    X(max_clients);
    if (priv != NULL) {
-      X(priv->backup_buffer);
+      if (priv->cq_thread_started) {
+         priv->is_terminated = 1;
+         pthread_join(priv->cq_thread, NULL);
+         pthread_cond_destroy(&priv->cq_cond);
+      }
+      if (priv->epfd > 0) {
+         close(priv->epfd);
+      }
+      if (priv->cq_buffers != NULL) {
+         for (i = 0; i < priv->cq_size; i++) {
+            trap_pool_put(priv->cq_buffers[i].data);
+         }
+         X(priv->cq_buffers);
+      }
+      shm_ring_close(&priv->ring);
+      trap_pool_put(priv->backup_buffer);
+      priv->backup_buffer = NULL;
       if (priv->clients != NULL) {
          for (i = 0; i < max_num_client; i++) {
-            X(priv->clients[i].buffer);
+            trap_pool_put(priv->clients[i].buffer);
+            priv->clients[i].buffer = NULL;
          }
       }
       X(priv->clients);
@@ -1765,6 +3237,7 @@ static void *accept_clients_thread(void *arg)
             VERBOSE(CL_VERBOSE_ADVANCED, "New connection from %s on socket %d",
                inet_ntop(remoteaddr.ss_family, get_in_addr((struct sockaddr*) &remoteaddr), remoteIP, INET6_ADDRSTRLEN),
                   newclient);
+            tcpip_set_sockopts(newclient, &c->sockopts, c->socket_type == TRAP_IFC_TCPIP);
 
             pthread_mutex_lock(&c->lock);
 
@@ -1779,6 +3252,12 @@ static void *accept_clients_thread(void *arg)
                if (cl == NULL) {
                   goto refuse_client;
                }
+               /* client queue is not used until negotiation is finished */
+               cl->next_seq = TCPIP_CQ_NEGOTIATING;
+               cl->sent_buffers = 0;
+               cl->sent_bytes = 0;
+               cl->dropped_buffers = 0;
+               cl->behind_since = 0;
                cl->sd = newclient;
                cl->client_state = CURRENT_IDLE;
                cl->sending_pointer = NULL;
@@ -1799,8 +3278,18 @@ static void *accept_clients_thread(void *arg)
                   goto refuse_client;
                }
 #endif
+               /* the socket is removed from epoll automatically by close() */
+               cl->ready = 1;
+               if (tcpip_epoll_add(c->epfd, cl->sd, EPOLLIN | EPOLLOUT | EPOLLRDHUP, i) != TRAP_E_OK) {
+                  cl->sd = -1;
+                  goto refuse_client;
+               }
+               if ((c->ring.hdr != NULL) && (tcpip_shm_send_ring(c, i) != TRAP_E_OK)) {
+                  cl->sd = -1;
+                  goto refuse_client;
+               }
                c->connected_clients++;
-
+               cl->next_seq = TCPIP_CQ_JOIN;
 
                if (sem_post(&c->have_clients) == -1) {
                   VERBOSE(CL_ERROR, "Semaphore post failed.");
@@ -1869,7 +3358,8 @@ static int server_socket_open(void *priv)
          break; /* found socket to bind */
       }
       freeaddrinfo(ai); // all done with this
-   } else if ((c->socket_type == TRAP_IFC_TCPIP_UNIX) || (c->socket_type == TRAP_IFC_TCPIP_SERVICE)) {
+   } else if ((c->socket_type == TRAP_IFC_TCPIP_UNIX) || (c->socket_type == TRAP_IFC_TCPIP_SHM) ||
+              (c->socket_type == TRAP_IFC_TCPIP_SERVICE)) {
       /* UNIX socket */
       addr.unix_addr.sun_family = AF_UNIX;
       snprintf(addr.unix_addr.sun_path, sizeof(addr.unix_addr.sun_path) - 1, trap_default_socket_path_format, c->server_port);
@@ -70,9 +70,10 @@
 enum tcpip_ifc_sockettype {
    TRAP_IFC_TCPIP, ///< use TCP/IP connection
    TRAP_IFC_TCPIP_UNIX, ///< use UNIX socket for local communication
-   TRAP_IFC_TCPIP_SERVICE ///< use UNIX socket as a service interface
+   TRAP_IFC_TCPIP_SERVICE, ///< use UNIX socket as a service interface
+   TRAP_IFC_TCPIP_SHM ///< use UNIX socket for control and shared memory ring for data
 };
-#define TCPIP_SOCKETTYPE_STR(st) (st == TRAP_IFC_TCPIP?"TCP":(st == TRAP_IFC_TCPIP_UNIX ? "UNIX": "SERVICE"))
+#define TCPIP_SOCKETTYPE_STR(st) (st == TRAP_IFC_TCPIP?"TCP":(st == TRAP_IFC_TCPIP_UNIX ? "UNIX": (st == TRAP_IFC_TCPIP_SHM ? "SHM": "SERVICE")))
 /** Create TCP/IP output interface.
  *  \param [in] ctx   Pointer to the private libtrap context data (#trap_ctx_init()).
  *  \param [in] params  format not decided yet
@@ -92,4 +93,12 @@ int create_tcpip_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_outpu
  */
 int create_tcpip_receiver_ifc(trap_ctx_priv_t *ctx, char *params, trap_input_ifc_t *ifc, uint32_t itx, enum tcpip_ifc_sockettype type);
 
+/** Set options given by IFC parameters to a socket, failures are reported but they are not fatal.
+ *  \param [in] sd    socket descriptor
+ *  \param [in] opts  options of the IFC
+ *  \param [in] tcp   if not 0, the socket is TCP and TCP level options are set too
+ *  \return TRAP_E_OK on success, TRAP_E_IO_ERROR if some option could not be set
+ */
+int tcpip_set_sockopts(int sd, const trap_sockopts_t *opts, int tcp);
+
 #endif
@@ -73,12 +73,36 @@ enum client_send_state {
    BACKUP_BUFFER /**< timeout in backup buffer */
 };
 
+/**
+ * Value of client_s.next_seq of a client that is not ready to receive data yet (negotiation).
+ */
+#define TCPIP_CQ_NEGOTIATING UINT64_MAX
+
+/**
+ * Value of client_s.next_seq of a client that will receive buffers stored after its connection.
+ */
+#define TCPIP_CQ_JOIN (UINT64_MAX - 1)
+
 struct client_s {
    int sd; /**< Socket descriptor */
    void *sending_pointer; /**< Array of pointers into buffer */
-   void *buffer; /**< separate message buffer */
+   void *buffer; /**< separate message buffer, used for the rest of partially sent buffer dropped from client queue */
    uint32_t pending_bytes; /**< The size of data that must be sent */
    enum client_send_state client_state; /**< State of sending */
+   uint8_t ready; /**< 0 if the socket returned EAGAIN and EPOLLOUT was not received since then */
+   uint64_t next_seq; /**< Sequence number of the first buffer in client queue (being sent unless client_state is BACKUP_BUFFER) */
+   uint64_t sent_buffers; /**< Number of buffers sent from client queue or by "shard=" */
+   uint64_t sent_bytes; /**< Number of bytes sent from client queue or by "shard=" */
+   uint64_t dropped_buffers; /**< Number of buffers dropped from full client queue */
+   uint64_t behind_since; /**< Timestamp (us) of the first drop since the client emptied its queue, 0 if there was no drop */
+};
+
+/**
+ * Buffer shared by client queues.
+ */
+struct tcpip_cq_buffer_s {
+   void *data; /**< Reference to buffer passed to tcpip_sender_send() (its copy with DISABLE_BUFFERING), NULL when it was sent to all clients */
+   uint32_t size; /**< Size of data */
 };
 
 typedef struct tcpip_sender_private_s {
@@ -113,10 +137,65 @@ typedef struct tcpip_sender_private_s {
     */
    int term_pipe[2];
 
+   /**
+    * epoll instance with sockets of clients (identified by index) and term_pipe,
+    * all registered as edge-triggered.
+    */
+   int epfd;
+
    pthread_mutex_t  lock;
    pthread_mutex_t  sending_lock;
    pthread_t        accept_thread;
    uint32_t ifc_idx;
+
+   /**
+    * Client queues.
+    *
+    * When cq_size is non-zero, tcpip_sender_send() stores the buffer into
+    * the ring cq_buffers and returns without waiting for slow clients.
+    * Buffers of libtrap are borrowed from the pool, the ring holds
+    * a reference (trap_pool_ref()) to them until all clients get them,
+    * libtrap continues with another buffer meanwhile.  Every client sends
+    * buffers from its next_seq up to cq_seq, a client can be at most
+    * cq_size buffers behind, cq_policy is applied otherwise.  Everything
+    * is protected by sending_lock.
+    */
+   uint32_t cq_size; /**< Length of client queues, 0 if client queues are not used */
+   enum trap_client_policy cq_policy; /**< Behavior when a client queue is full */
+   uint64_t cq_lag; /**< Time (us) a client can be behind with TRAP_CLIENT_POLICY_DISCONNECT */
+   struct tcpip_cq_buffer_s *cq_buffers; /**< Ring of cq_size buffers */
+   uint64_t cq_seq; /**< Sequence number of the next stored buffer */
+   uint64_t cq_tail; /**< Sequence number of the oldest buffer still referenced by the ring */
+   pthread_cond_t cq_cond; /**< Signaled when a client made progress or disconnected */
+   pthread_t cq_thread; /**< Thread sending queued buffers to clients whose sockets were full */
+   char cq_thread_started; /**< 1 if cq_thread is running */
+
+   /**
+    * Shared memory ring of TRAP_IFC_TCPIP_SHM.
+    *
+    * Buffers are copied into the ring instead of sending them to sockets,
+    * sockets of clients are used for negotiation, passing of ring's file
+    * descriptor and detection of disconnection.  Slot of ring is the index
+    * of client.
+    */
+   shm_ring_t ring;
+   uint64_t shm_checked; /**< Timestamp (us) of the last check of clients' sockets */
+
+   /**
+    * io_uring used instead of epoll and send() when enabled by "uring=on".
+    * Sends to all clients are submitted by one syscall, termination pipe is
+    * polled by the ring to break waiting.  Protected by sending_lock.
+    */
+   trap_uring_t uring;
+
+   /**
+    * Sharding ("shard=rr|hash"), every buffer is sent to one client only,
+    * see tcpip_shard_send().  Protected by sending_lock.
+    */
+   enum trap_shard_mode shard; /**< Distribution of buffers among clients */
+   int32_t shard_client; /**< Index of client receiving the current buffer, -1 if no buffer is being sent */
+   uint32_t shard_next; /**< Index of client where the round-robin search starts */
+   trap_sockopts_t sockopts; /**< Options set to sockets of accepted clients */
 } tcpip_sender_private_t;
 
 #define TCPIP_SENDER_STATE_STR(st) (st == CURRENT_IDLE ? "CURRENT_IDLE": \
@@ -140,6 +219,7 @@ typedef struct tcpip_receiver_private_s {
    char connected;
    char is_terminated;
    int sd;
+   int epfd; /**< epoll instance with sd (edge-triggered) */
    enum tcpip_ifc_sockettype socket_type;
    void *data_pointer; /**< Pointer to next free byte, if NULL, we ended in header */
    uint32_t data_wait_size; /** Missing data to accept in the next function call */
@@ -147,6 +227,15 @@ typedef struct tcpip_receiver_private_s {
    uint32_t ext_buffer_size; /** size of content of the extbuffer */
    trap_buffer_header_t int_mess_header; /**< Internal message header - used for message_buffer payload size \note message_buffer size is sizeof(tcpip_tdu_header_t) + payload size */
    uint32_t ifc_idx;
+   char *stage; /**< Staging buffer for data received beyond the currently awaited part */
+   uint32_t stage_head; /**< Offset of the first unread byte in stage */
+   uint32_t stage_len; /**< Number of unread bytes in stage */
+   shm_ring_t ring; /**< Shared memory ring of TRAP_IFC_TCPIP_SHM, mapped after connection */
+   uint32_t shm_slot; /**< Slot of ring assigned by output IFC */
+   uint32_t shm_gen; /**< Generation of slot, it changes when output IFC disconnects us */
+   uint64_t shm_pos; /**< Read position in ring */
+   trap_uring_t uring; /**< io_uring used for waiting and receiving when enabled by "uring=on", fd is -1 otherwise */
+   trap_sockopts_t sockopts; /**< Options set to the socket before connection */
 } tcpip_receiver_private_t;
 
 /**
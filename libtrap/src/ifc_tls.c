@@ -74,7 +74,9 @@
 #include "trap_ifc.h"
 #include "trap_error.h"
 #include "ifc_tls.h"
+#include "ifc_tcpip.h"
 #include "ifc_tls_internal.h"
+#include "trap_pool.h"
 
 /**
  * \addtogroup trap_ifc TRAP communication module interface
@@ -572,6 +574,14 @@ head_wait:
             goto reset;
          }
 #endif
+         /* buffer could be resized during negotiation */
+         data = config->ctx->in_ifc_list[config->ifc_idx].buffer;
+         if (messageframe.data_length > config->ctx->in_ifc_list[config->ifc_idx].buffer_size) {
+            VERBOSE(CL_ERROR, "Received buffer of %"PRIu32" B exceeds the size of input buffer, disconnecting.",
+                    messageframe.data_length);
+            client_socket_disconnect(priv);
+            goto discard;
+         }
          /* we got header, now we can start receiving payload */
          p = data;
          config->ext_buffer = data;
@@ -759,6 +769,7 @@ int create_tls_receiver_ifc(trap_ctx_priv_t *ctx, char *params, trap_input_ifc_t
       return TRAP_E_MEMORY;
    }
    config->ctx = ctx;
+   config->sockopts = ifc->sockopts;
    config->is_terminated = 0;
    config->ifc_idx = idx;
 
@@ -981,6 +992,8 @@ static int client_socket_connect(tls_receiver_private_t *c, struct timeval *tv)
       if ((sockfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) == -1) {
          continue;
       }
+      /* buffer sizes must be set before connect() to take effect on TCP window */
+      tcpip_set_sockopts(sockfd, &c->sockopts, 1);
       if ((options = fcntl(sockfd, F_GETFL)) != -1) {
          if (fcntl(sockfd, F_SETFL, O_NONBLOCK | options) == -1) {
             VERBOSE(CL_ERROR, "Could not set socket to non-blocking.");
@@ -1562,7 +1575,7 @@ void tls_sender_destroy(void *priv)
                cl->sd = -1;
                c->connected_clients--;
             }
-            free(cl->buffer);
+            trap_pool_put(cl->buffer);
          }
          free(c->clients);
       }
@@ -1571,7 +1584,7 @@ void tls_sender_destroy(void *priv)
       pthread_mutex_destroy(&c->sending_lock);
       sem_destroy(&c->have_clients);
 
-      free(c->backup_buffer);
+      trap_pool_put(c->backup_buffer);
       free(c);
    }
 }
@@ -1744,6 +1757,7 @@ int create_tls_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_output_
    }
 
    priv->ctx = ctx;
+   priv->sockopts = ifc->sockopts;
    priv->ifc_idx = idx;
 
    /* Parsing params */
@@ -1792,7 +1806,7 @@ int create_tls_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_output_
    }
 
    /* set global buffer size */
-   priv->int_mess_header.data_length = TRAP_IFC_MESSAGEQ_SIZE;
+   priv->int_mess_header.data_length = ifc->buffer_size;
    /* Parsing params ended */
 
    priv->clients_arr_size = max_num_client;
@@ -1803,9 +1817,9 @@ int create_tls_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_output_
       goto failsafe_cleanup;
    }
 
-   /* allocate buffer according to TRAP_IFC_MESSAGEQ_SIZE with additional space for message header */
-   priv->backup_buffer = (void *) calloc(1, priv->int_mess_header.data_length +
-                           sizeof(trap_buffer_header_t));
+   /* allocate buffer according to the size of IFC buffer with additional space for message header */
+   priv->backup_buffer = trap_pool_calloc(priv->int_mess_header.data_length +
+                                          sizeof(trap_buffer_header_t));
 
    if (priv->backup_buffer == NULL) {
       /* if some memory could not have been allocated, we cannot continue */
@@ -1817,7 +1831,7 @@ int create_tls_sender_ifc(trap_ctx_priv_t *ctx, const char *params, trap_output_
       priv->clients[i].client_state = TLSCURRENT_IDLE;
       /* all clients are disconnected */
       priv->clients[i].sd = -1;
-      priv->clients[i].buffer = (void *) calloc(TRAP_IFC_MESSAGEQ_SIZE + 4, 1);
+      priv->clients[i].buffer = trap_pool_calloc(ifc->buffer_size + 4);
       if (priv->clients[i].buffer == NULL) {
          result = TRAP_E_MEMORY;
          goto failsafe_cleanup;
@@ -1891,10 +1905,10 @@ failsafe_cleanup:
    free(cafile);
    free(keyfile);
    if (priv != NULL) {
-      free(priv->backup_buffer);
+      trap_pool_put(priv->backup_buffer);
       if (priv->clients != NULL) {
          for (i = 0; i < max_num_client; i++) {
-            free(priv->clients[i].buffer);
+            trap_pool_put(priv->clients[i].buffer);
          }
       }
       free(priv->clients);
@@ -1954,6 +1968,7 @@ static void *accept_clients_thread(void *arg)
             VERBOSE(CL_VERBOSE_ADVANCED, "New connection from %s on socket %d",
                inet_ntop(remoteaddr.ss_family, get_in_addr((struct sockaddr*) &remoteaddr), remoteIP, INET6_ADDRSTRLEN),
                   newclient);
+            tcpip_set_sockopts(newclient, &c->sockopts, 1);
 
             pthread_mutex_lock(&c->lock);
 
@@ -131,6 +131,7 @@ typedef struct tls_sender_private_s {
    pthread_mutex_t  sending_lock; /**< Lock used while working with whole structure. */
    pthread_t        accept_thread; /**< Thread for accepting clients. */
    uint32_t ifc_idx; /**< Index of IFC. */
+   trap_sockopts_t sockopts; /**< Options set to sockets of accepted clients. */
 } tls_sender_private_t;
 
 #define tls_SENDER_STATE_STR(st) (st == TLSCURRENT_IDLE ? "TLSCURRENT_IDLE": \
@@ -168,6 +169,7 @@ typedef struct tls_receiver_private_s {
    uint32_t ext_buffer_size; /** size of content of the extbuffer */
    trap_buffer_header_t int_mess_header; /**< Internal message header - used for message_buffer payload size \note message_buffer size is sizeof(tls_tdu_header_t) + payload size */
    uint32_t ifc_idx; /**< Index of IFC */
+   trap_sockopts_t sockopts; /**< Options set to the socket before connection */
 } tls_receiver_private_t;
 
 /**
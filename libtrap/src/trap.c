@@ -56,8 +56,10 @@
 #include <stdio.h>
 #include <getopt.h>
 #include <pthread.h>
+#include <sched.h>
 #include <signal.h>
-#include <semaphore.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <errno.h>
 #include <sys/socket.h>
@@ -71,8 +73,13 @@
 #include "trap_internal.h"
 #include "trap_error.h"
 #include "trap_ifc.h"
+#include "trap_buffer.h"
 #include "ifc_dummy.h"
 #include "ifc_tcpip.h"
+#include "trap_shm_ring.h"
+#include "trap_uring.h"
+#include "trap_compress.h"
+#include "trap_pool.h"
 #include "ifc_tcpip_internal.h"
 #include "ifc_file.h"
 
@@ -115,6 +122,7 @@ char trap_ifc_type_supported[] = {
    TRAP_IFC_TYPE_UNIX,
    TRAP_IFC_TYPE_SERVICE,
    TRAP_IFC_TYPE_FILE,
+   TRAP_IFC_TYPE_SHM,
    0
 };
 
@@ -127,8 +135,27 @@ const char *trap_last_error_msg = NULL;
 
 char error_msg_buffer[MAX_ERROR_MSG_BUFF_SIZE];
 
-/** Share semaphore between process? 0 for share between threads only. */
-#define SEM_PSHARED  0
+/** Maximal wait (us) for input IFCs that cannot be waited for by poll() when reading from more of them. */
+#define TRAP_MULTI_RECV_SLICE 1000
+
+/** Limit (us) of the wait for IFCs that cannot be waited for by poll(), it doubles from TRAP_MULTI_RECV_SLICE while they have no data. */
+#define TRAP_MULTI_RECV_SLICE_MAX 16000
+
+/** trap_multi_recv_ready() returns after the first received message. */
+#define TRAP_MULTI_RECV_ONE 0
+/** trap_multi_recv_ready() returns when some IFCs have received a message. */
+#define TRAP_MULTI_RECV_ANY 1
+/** trap_multi_recv_ready() returns when all IFCs have a result (result_code other than TRAP_E_TIMEOUT). */
+#define TRAP_MULTI_RECV_ALL 2
+
+/** Time (us) between attempts to receive from input IFC that is not connected when reading from more of them. */
+#define TRAP_MULTI_RECV_RETRY 100000
+
+/** Maximal wait (us) of the receiver of trap_ctx_recv_workers() before it checks whether the pool was stopped. */
+#define TRAP_RECV_WORKERS_SLICE 100000
+
+/** Maximal wait (us) in poll(), termination of libtrap is checked after it. */
+#define TRAP_MULTI_RECV_TERM_CHECK 1000000
 
 /** Size of multiresult array for reading from more than one interface at once. */
 #define IN_IFC_RESULTS_SIZE(ctx) ((ctx)->num_ifc_in * sizeof(trap_multi_result_t))
@@ -137,7 +164,6 @@ char error_msg_buffer[MAX_ERROR_MSG_BUFF_SIZE];
 #define ifcdir2str(type) (((type) == TRAPIFC_OUTPUT) ? "Output" : "Input")
 
 static inline char *get_param_by_delimiter(const char *source, char **dest, const char delimiter);
-static int compare_timeouts(const void *a, const void *b);
 int trap_ctx_multi_recv(trap_ctx_t *ctx, uint32_t ifc_mask, const void **data, uint16_t *size);
 void *service_thread_routine(void *arg);
 
@@ -147,6 +173,10 @@ void *service_thread_routine(void *arg);
 void trap_check_global_vars(void)
 {
    int size;
+
+   /* every context uses the shared buffer pool */
+   trap_pool_init();
+
    /* According to man, getenv is not secured in some cases.
     * 1) effective ID does not match real ID */
    if ((getuid() != geteuid()) || (getgid() != getegid())) {
@@ -179,6 +209,8 @@ void trap_check_global_vars(void)
 
 void trap_free_global_vars(void)
 {
+   trap_pool_release();
+
    if (strcmp(trap_default_socket_path_format, UNIX_PATH_FILENAME_FORMAT) != 0) {
       free(trap_default_socket_path_format);
       trap_default_socket_path_format = UNIX_PATH_FILENAME_FORMAT;
@@ -224,6 +256,8 @@ int trap_update_module_param(trap_module_info_t *m, uint16_t param_id, char shor
 
 /**
  * \brief Check content of buffer, iterate over message headers
+ *
+ * Only buffers with 16-bit message headers (largemsg=off) can be checked.
  * \param [in] buffer      start of buffer
  * \param [in] buffer_size size of buffer
  * \return 0 on success, number of errors otherwise
@@ -235,7 +269,7 @@ int trap_check_buffer_content(void *buffer, uint32_t buffer_size)
    int errors = 0;
    void *check_mess_pointer;
    for (offset = 0, check_mess_header = check_mess_pointer = buffer;
-         ((offset < buffer_size) && (offset < TRAP_IFC_MESSAGEQ_SIZE));) {
+         (offset < buffer_size);) {
       check_mess_counter++;
       /* go to next size, skip header + payload */
       offset += sizeof(*check_mess_header) + (*check_mess_header);
@@ -251,37 +285,230 @@ int trap_check_buffer_content(void *buffer, uint32_t buffer_size)
 }
 
 /**
- * Read data from buffer or receive data into buffer if buffer is empty
+ * Grow the buffer of input IFC so that it can hold a buffer of size bytes.
+ *
+ * Called during negotiation when the sender announces bigger buffers
+ * than the default. The buffer is never shrunk; its content is dropped.
+ *
+ * \param[in,out] ifc   input interface
+ * \param[in] size      buffer size announced by the sender
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY if allocation failed
+ */
+static int trap_in_ifc_resize_buffer(trap_input_ifc_t *ifc, uint32_t size)
+{
+   void *p;
+
+   if (size > ifc->buffer_size) {
+      /* + 1 for the terminating zero as in the initial allocation */
+      p = trap_pool_resize(ifc->buffer, size + 1);
+      if (p == NULL) {
+         return TRAP_E_MEMORY;
+      }
+      ifc->buffer = p;
+      ifc->buffer_size = size;
+   }
+   ifc->buffer_pointer = ifc->buffer;
+   ifc->buffer_full = 0;
+   return TRAP_E_OK;
+}
+
+/**
+ * Set compression method of input IFC negotiated with the sender.
+ *
+ * \param[in,out] ifc   input interface
+ * \param[in] method    #trap_compress_method
+ */
+static void trap_in_ifc_set_compress(trap_input_ifc_t *ifc, uint8_t method)
+{
+   if (ifc->compress != method) {
+      /* state of the previous method cannot be reused */
+      trap_compress_free(ifc->compress, ifc->compress_state, 1);
+      ifc->compress_state = NULL;
+      ifc->compress = method;
+   }
+}
+
+/**
+ * Get current time of CLOCK_REALTIME, it is comparable between modules (and hosts with synchronized clocks).
+ *
+ * \return time in microseconds since the Epoch
+ */
+static inline uint64_t trap_realtime_us(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_REALTIME, &ts);
+   return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Get bin of histogram of buffer latency, see #TRAP_LATENCY_SUB_BITS.
+ *
+ * \param[in] value   latency in microseconds
+ * \return index of bin
+ */
+static inline uint32_t trap_latency_bin(uint64_t value)
+{
+   uint32_t exp;
+
+   if (value < (1 << TRAP_LATENCY_SUB_BITS)) {
+      return value;
+   }
+   exp = 63 - __builtin_clzll(value);
+   if (exp >= 32) {
+      return TRAP_LATENCY_BINS - 1;
+   }
+   return ((exp - TRAP_LATENCY_SUB_BITS + 1) << TRAP_LATENCY_SUB_BITS) +
+          (value >> (exp - TRAP_LATENCY_SUB_BITS)) - (1 << TRAP_LATENCY_SUB_BITS);
+}
+
+/**
+ * Get the lowest value of bin of histogram of buffer latency (inverse of trap_latency_bin()).
+ *
+ * \param[in] bin   index of bin
+ * \return latency in microseconds
+ */
+static inline uint64_t trap_latency_bin_min(uint32_t bin)
+{
+   uint32_t exp;
+
+   if (bin < (1 << TRAP_LATENCY_SUB_BITS)) {
+      return bin;
+   }
+   exp = (bin >> TRAP_LATENCY_SUB_BITS) + TRAP_LATENCY_SUB_BITS - 1;
+   return (uint64_t) ((bin & ((1 << TRAP_LATENCY_SUB_BITS) - 1)) + (1 << TRAP_LATENCY_SUB_BITS)) << (exp - TRAP_LATENCY_SUB_BITS);
+}
+
+/**
+ * Remove the time of sending from the end of received buffer and count the latency of the buffer.
  *
  * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
  * \param[in] ifc_idx   index of input interface
- * \param[out] data     pointer to received message
- * \param[out] size     size of message
- * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | timeout
+ * \param[in] bp        received data
+ * \param[in,out] length   size of received data, the time is subtracted
+ */
+static inline void trap_in_buffer_latency(trap_ctx_priv_t *ctx, uint32_t ifc_idx, const char *bp, uint32_t *length)
+{
+   trap_in_ifc_stats_t *st = &ctx->in_ifc_stats[ifc_idx];
+   uint32_t ts[2];
+   uint64_t sent, now, latency = 0;
+
+   if (*length < TRAP_BUFFER_TIMESTAMP_SIZE) {
+      return;
+   }
+   (*length) -= TRAP_BUFFER_TIMESTAMP_SIZE;
+   memcpy(ts, bp + *length, TRAP_BUFFER_TIMESTAMP_SIZE);
+   sent = ((uint64_t) ntohl(ts[0]) << 32) | ntohl(ts[1]);
+   now = trap_realtime_us();
+   /* clocks of different hosts may not be synchronized precisely */
+   if (now > sent) {
+      latency = now - sent;
+   }
+   TRAP_CNT_ADD(st->latency_count, 1);
+   TRAP_CNT_ADD(st->latency_sum, latency);
+   if (latency > TRAP_CNT_GET(st->latency_max)) {
+      /* only the receiving thread writes it */
+      __atomic_store_n(&st->latency_max, latency, __ATOMIC_RELAXED);
+   }
+   TRAP_CNT_ADD(st->latency[trap_latency_bin(latency)], 1);
+}
+
+/**
+ * Decompress received buffer of input IFC with negotiated "compress=".
+ *
+ * The trailer (#TRAP_BUFFER_COMPRESS_SIZE) is removed, compressed data are
+ * decompressed into compress_buf, which is swapped with the buffer of IFC.
+ *
+ * \param[in,out] ifc     input interface
+ * \param[in,out] length  size of received data, it is replaced by size of decompressed data
+ * \return TRAP_E_OK on success, TRAP_E_IO_ERROR if the buffer is corrupted
  */
-static inline int trap_read_from_buffer(trap_ctx_priv_t *ctx, uint32_t ifc_idx, const void **data, uint16_t *size, int timeout)
+static inline int trap_in_buffer_decompress(trap_input_ifc_t *ifc, uint32_t *length)
 {
-   int result = TRAP_E_TIMEOUT;
-   /* pointer to current message header */
-   uint32_t tempbufheader = 0;
+   uint32_t raw;
+   char *p;
+
+   if (*length < TRAP_BUFFER_COMPRESS_SIZE) {
+      return TRAP_E_IO_ERROR;
+   }
+   (*length) -= TRAP_BUFFER_COMPRESS_SIZE;
+   memcpy(&raw, ifc->buffer + *length, TRAP_BUFFER_COMPRESS_SIZE);
+   raw = ntohl(raw);
+   if (raw == 0) {
+      /* sender could not compress the data */
+      return TRAP_E_OK;
+   }
+   if (raw > ifc->buffer_size) {
+      return TRAP_E_IO_ERROR;
+   }
+   if (ifc->compress_buf_size < ifc->buffer_size) {
+      /* + 1 for the terminating zero as the buffer */
+      p = trap_pool_resize(ifc->compress_buf, ifc->buffer_size + 1);
+      if (p == NULL) {
+         return TRAP_E_IO_ERROR;
+      }
+      ifc->compress_buf = p;
+      ifc->compress_buf_size = ifc->buffer_size;
+   }
+   if (trap_decompress(ifc->compress, &ifc->compress_state, ifc->compress_buf, raw, ifc->buffer, *length) != TRAP_E_OK) {
+      return TRAP_E_IO_ERROR;
+   }
+   /* the buffer never shrinks, so both have buffer_size now */
+   p = ifc->buffer;
+   ifc->buffer = ifc->compress_buf;
+   ifc->compress_buf = p;
+   *length = raw;
+   return TRAP_E_OK;
+}
 
-   /* pointer to current message payload */
+/**
+ * Receive new data into the buffer of input IFC if the buffer is empty.
+ *
+ * The caller must hold in_ifc_list[ifc_idx].ifc_mtx.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc_idx   index of input interface
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | timeout
+ * \return TRAP_E_OK if the buffer contains data, otherwise the error code of recv()
+ */
+static inline int trap_fill_in_buffer(trap_ctx_priv_t *ctx, uint32_t ifc_idx, int timeout)
+{
+   int result = TRAP_E_OK;
+   uint32_t tempbufheader = 0, recvbytes = 0;
    void *bp = ctx->in_ifc_list[ifc_idx].buffer;
-   pthread_mutex_lock(&ctx->in_ifc_list[ifc_idx].ifc_mtx);
-   if ((ctx->in_ifc_list[ifc_idx].buffer_full == 0) || (ctx->in_ifc_list[ifc_idx].buffer_full > TRAP_IFC_MESSAGEQ_SIZE)) {
+
+   if ((ctx->in_ifc_list[ifc_idx].buffer_full == 0) || (ctx->in_ifc_list[ifc_idx].buffer_full > ctx->in_ifc_list[ifc_idx].buffer_size)) {
       /* get new data and store into buffer, set buffer_full size */
+recv_again:
+      ctx->in_ifc_list[ifc_idx].buffer_full = 0;
       ctx->in_ifc_list[ifc_idx].buffer_pointer = ctx->in_ifc_list[ifc_idx].buffer;
+      bp = ctx->in_ifc_list[ifc_idx].buffer;
       result = ctx->in_ifc_list[ifc_idx].recv(ctx->in_ifc_list[ifc_idx].priv, bp, &tempbufheader, timeout);
       if (result == TRAP_E_FORMAT_MISMATCH) {
-         goto exit;
+         return result;
+      }
+      if (result == TRAP_E_OK && ctx->in_ifc_list[ifc_idx].compress != 0) {
+         recvbytes = tempbufheader - TRAP_BUFFER_COMPRESS_SIZE;
+         if (trap_in_buffer_decompress(&ctx->in_ifc_list[ifc_idx], &tempbufheader) != TRAP_E_OK) {
+            VERBOSE(CL_ERROR, "Decompression of buffer received by input IFC %"PRIu32" failed, the buffer is dropped.", ifc_idx);
+            goto recv_again;
+         }
+      }
+      /* buffer could have been reallocated during negotiation or swapped by decompression */
+      bp = ctx->in_ifc_list[ifc_idx].buffer;
+      if (result == TRAP_E_OK && ctx->in_ifc_list[ifc_idx].timestamp != 0) {
+         trap_in_buffer_latency(ctx, ifc_idx, bp, &tempbufheader);
       }
 #ifdef BUFFERING_CHECK_HEADERS
-      if (trap_check_buffer_content(bp, tempbufheader) != 0) {
+      if (ctx->in_ifc_list[ifc_idx].large_msgs == 0 &&
+          trap_check_buffer_content(bp, tempbufheader) != 0) {
          VERBOSE(CL_ERROR, "Buffer is not valid.");
       }
 #endif
       if (result == TRAP_E_OK) {
-         ctx->counter_recv_buffer[ifc_idx]++;
+         TRAP_CNT_ADD(ctx->in_ifc_stats[ifc_idx].recv_buffer, 1);
+         TRAP_CNT_ADD(ctx->in_ifc_stats[ifc_idx].recv_bytes, (ctx->in_ifc_list[ifc_idx].compress != 0) ? recvbytes : tempbufheader);
+         TRAP_CNT_ADD(ctx->in_ifc_stats[ifc_idx].recv_raw_bytes, tempbufheader);
 
          ctx->in_ifc_list[ifc_idx].buffer_full = tempbufheader;
          ctx->in_ifc_list[ifc_idx].buffer_pointer = ctx->in_ifc_list[ifc_idx].buffer;
@@ -291,31 +518,66 @@ static inline int trap_read_from_buffer(trap_ctx_priv_t *ctx, uint32_t ifc_idx,
 #ifdef TESTBUFFERING
          VERBOSE(CL_VERBOSE_OFF, "Received buffer of size %u.", ctx->in_ifc_list[ifc_idx].buffer_full);
 #endif
-      } else {
-         goto exit;
       }
    }
+   return result;
+}
+
+/**
+ * Get size of message from its header in the buffer of input IFC.
+ *
+ * \param[in] ifc   input interface
+ * \param[in] p     pointer to the message header
+ * \return size of message payload
+ */
+static inline uint32_t trap_get_msg_size(const trap_input_ifc_t *ifc, const char *p)
+{
+   if (ifc->large_msgs != 0) {
+      return ntohl(*((uint32_t *) p));
+   }
+   return ntohs(*((uint16_t *) p));
+}
+
+/**
+ * Read data from buffer or receive data into buffer if buffer is empty
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc_idx   index of input interface
+ * \param[out] data     pointer to received message
+ * \param[out] size     size of message
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | timeout
+ */
+static inline int trap_read_from_buffer(trap_ctx_priv_t *ctx, uint32_t ifc_idx, const void **data, uint32_t *size, int timeout)
+{
+   int result;
+   uint32_t hsize;
+
+   pthread_mutex_lock(&ctx->in_ifc_list[ifc_idx].ifc_mtx);
+   result = trap_fill_in_buffer(ctx, ifc_idx, timeout);
+   if (result != TRAP_E_OK) {
+      goto exit;
+   }
 
    if (ctx->in_ifc_list[ifc_idx].buffer_full > 0) {
       /* get message from buffer */
-      (*size) = ntohs(*((uint16_t *) ctx->in_ifc_list[ifc_idx].buffer_pointer));
-      (*data) = (ctx->in_ifc_list[ifc_idx].buffer_pointer + sizeof(*size));
+      hsize = TRAP_MSG_HEADER_SIZE(&ctx->in_ifc_list[ifc_idx]);
+      (*size) = trap_get_msg_size(&ctx->in_ifc_list[ifc_idx], ctx->in_ifc_list[ifc_idx].buffer_pointer);
+      (*data) = (ctx->in_ifc_list[ifc_idx].buffer_pointer + hsize);
       /* decrease buffer_full size by returned payload and its header */
-      ctx->in_ifc_list[ifc_idx].buffer_full -= (*size + sizeof(*size));
-      ctx->in_ifc_list[ifc_idx].buffer_pointer += (*size) + sizeof(*size);
-      DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "read from buffer %"PRIu16" B skip %"PRIu64" B, new bf %"PRIu32" %p",
+      ctx->in_ifc_list[ifc_idx].buffer_full -= (*size + hsize);
+      ctx->in_ifc_list[ifc_idx].buffer_pointer += (*size) + hsize;
+      DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "read from buffer %"PRIu32" B skip %"PRIu32" B, new bf %"PRIu32" %p",
                 (*size),
-                (*size + sizeof(*size)),
+                (*size + hsize),
                 ctx->in_ifc_list[ifc_idx].buffer_full,
                 ctx->in_ifc_list[ifc_idx].buffer_pointer));
-      result = TRAP_E_OK;
    } else {
       (*size) = 0;
    }
 exit:
    pthread_mutex_unlock(&ctx->in_ifc_list[ifc_idx].ifc_mtx);
    if (result == TRAP_E_OK) {
-      ctx->counter_recv_message[ifc_idx]++;
+      TRAP_CNT_ADD(ctx->in_ifc_stats[ifc_idx].recv_message, 1);
       if (ctx->in_ifc_list[ifc_idx].client_state == FMT_CHANGED) {
          ctx->in_ifc_list[ifc_idx].client_state = FMT_OK;
          return TRAP_E_FORMAT_CHANGED;
@@ -324,1462 +586,3489 @@ exit:
    return result;
 }
 
-static void insert_into_buffer(trap_output_ifc_t *priv, const void *data, const uint16_t size)
+/**
+ * Read data from buffer, the same as trap_read_from_buffer() but the size of message is limited to 16 bits.
+ *
+ * Bigger message (possible with large messages negotiated) is skipped and TRAP_E_MEMORY is returned.
+ */
+static inline int trap_read_from_buffer16(trap_ctx_priv_t *ctx, uint32_t ifc_idx, const void **data, uint16_t *size, int timeout)
 {
-   assert(priv->buffer_index <= (TRAP_IFC_MESSAGEQ_SIZE - sizeof(trap_buffer_header_t)));
-   if (priv->buffer_occupied == 0) {
-      uint16_t *msize = (uint16_t *) &priv->buffer[priv->buffer_index];
-      (*msize) = htons(size);
-      memcpy((void *) (msize + 1), data, size);
-      priv->buffer_index += size + sizeof size;
+   uint32_t size32 = 0;
+   int result = trap_read_from_buffer(ctx, ifc_idx, data, &size32, timeout);
+
+   if (size32 > UINT16_MAX) {
+      (*size) = 0;
+      return trap_errorf(ctx, TRAP_E_MEMORY, "Message of %"PRIu32" B received on input IFC %"PRIu32" is too big, "
+                         "it was skipped (trap_ctx_recv_large() must be used).", size32, ifc_idx);
    }
+   (*size) = (uint16_t) size32;
+   return result;
 }
-static inline int trap_store_into_buffer(trap_ctx_priv_t *ctx, unsigned int ifc, const void *data, uint16_t size, int timeout, char flush)
+
+/**
+ * Read all messages remaining in the buffer (at most max), receive data into buffer if buffer is empty
+ *
+ * Returned pointers point directly into the buffer of input IFC, they are valid until the next
+ * receive call on the same IFC.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc_idx   index of input interface
+ * \param[out] data     array of at least max pointers to received messages
+ * \param[out] sizes    array of at least max sizes of messages
+ * \param[in] max       maximal number of messages to return
+ * \param[out] got      number of returned messages
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | timeout
+ */
+static inline int trap_read_burst_from_buffer(trap_ctx_priv_t *ctx, uint32_t ifc_idx, const void **data, uint16_t *sizes,
+                                              unsigned int max, unsigned int *got, int timeout)
 {
-   /* Declaration of variables, we can have small buffer, initialization after checking the condition. */
-   uint32_t freespace, needed_size = size + sizeof(size);
    int result;
-
-   if (ctx->out_ifc_list[ifc].ifc_type == TRAP_IFC_TYPE_BLACKHOLE) {
-      return TRAP_E_OK;
-   }
-
-   /* Can we put message at least into empty buffer? In the worst case, we could end up with SEGFAULT -> rather skip with error */
-   if (needed_size > TRAP_IFC_MESSAGEQ_SIZE) {
-      return trap_errorf(ctx, TRAP_E_MEMORY, "Buffer is too small for this message. Skipping...");
-   }
-
-   if (flush != 0) {
-      /* Autoflush call, trying to lock section, maybe interface is waiting for clients -> rather skip than block the whole thread. */
-      if (pthread_mutex_trylock(&ctx->out_ifc_list[ifc].ifc_mtx) != 0) {
-         return TRAP_E_OK;
+   unsigned int count = 0;
+   uint32_t msize, hsize;
+   trap_input_ifc_t *ifc = &ctx->in_ifc_list[ifc_idx];
+
+   pthread_mutex_lock(&ifc->ifc_mtx);
+   result = trap_fill_in_buffer(ctx, ifc_idx, timeout);
+   if (result != TRAP_E_OK) {
+      goto exit;
+   }
+
+   hsize = TRAP_MSG_HEADER_SIZE(ifc);
+   while ((count < max) && (ifc->buffer_full > 0)) {
+      msize = trap_get_msg_size(ifc, ifc->buffer_pointer);
+      if ((uint64_t) msize + hsize > ifc->buffer_full) {
+         VERBOSE(CL_ERROR, "Malformed message header in buffer of input IFC %"PRIu32", dropping rest of the buffer.", ifc_idx);
+         ifc->buffer_full = 0;
+         break;
       }
-   } else {
-      /* Lock this section at first before sending whole buffer. */
-      pthread_mutex_lock(&ctx->out_ifc_list[ifc].ifc_mtx);
-   }
-   /* initialization in locked section, otherwise autoflush can send buffer which has been already sent */
-   if (ctx->out_ifc_list[ifc].buffer_index <= (TRAP_IFC_MESSAGEQ_SIZE - sizeof(trap_buffer_header_t))) {
-      freespace = TRAP_IFC_MESSAGEQ_SIZE - ctx->out_ifc_list[ifc].buffer_index - sizeof(trap_buffer_header_t);
-   } else {
-      freespace = 0;
-   }
-   result = TRAP_E_TIMEOUT;
-
-   /* Is this a autoflush call? If we have empty buffer, we do not send anything. */
-   if (flush != 0) {
-      if (ctx->out_ifc_list[ifc].buffer_index != 0) {
-#ifdef BUFFERING_CHECK_HEADERS
-         if (trap_check_buffer_content(ctx->out_ifc_list[ifc].buffer, ctx->out_ifc_list[ifc].buffer_index) != 0) {
-            VERBOSE(CL_ERROR, "Buffer is not valid.");
-         }
-#endif
-         DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "sending by autoflush %"PRIu32" B from %p", ctx->out_ifc_list[ifc].buffer_index, ctx->out_ifc_list[ifc].buffer));
-
-         ctx->out_ifc_list[ifc].buffer_occupied = 1;
-         trap_buffer_header_t *h = (trap_buffer_header_t *) ctx->out_ifc_list[ifc].buffer_header;
-         h->data_length = htonl(ctx->out_ifc_list[ifc].buffer_index);
-         result = ctx->out_ifc_list[ifc].send(ctx->out_ifc_list[ifc].priv, ctx->out_ifc_list[ifc].buffer_header,
-                                              ctx->out_ifc_list[ifc].buffer_index + sizeof(trap_buffer_header_t), timeout);
-
-         if (result == TRAP_E_OK) {
-            ctx->counter_send_buffer[ifc]++;
-            ctx->out_ifc_list[ifc].buffer_index = 0;
-            ctx->out_ifc_list[ifc].buffer_occupied = 0;
-            DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "Sending partial buffer invoked by autoflush timeout on interface %d", ifc));
-         } else {
-            VERBOSE(CL_VERBOSE_LIBRARY, "Autoflush was not successful.");
-            if (trap_ctx_get_client_count(ctx, ifc) == 0) {
-               ctx->out_ifc_list[ifc].buffer_occupied = 0;
-            }
+      if (msize > UINT16_MAX) {
+         if (count == 0) {
+            /* skip the message in the same way as trap_read_from_buffer16() */
+            ifc->buffer_full -= msize + hsize;
+            ifc->buffer_pointer += msize + hsize;
+            result = trap_errorf(ctx, TRAP_E_MEMORY, "Message of %"PRIu32" B received on input IFC %"PRIu32" is too big, "
+                                 "it was skipped (trap_ctx_recv_large() must be used).", msize, ifc_idx);
          }
+         break;
       }
-      goto fn_exit;
+      sizes[count] = msize;
+      data[count] = ifc->buffer_pointer + hsize;
+      ifc->buffer_full -= msize + hsize;
+      ifc->buffer_pointer += msize + hsize;
+      count++;
    }
-   /* we send buffer before timeout, no need to flush it */
-   ctx->out_ifc_list[ifc].bufferflush = 1;
-
-   if ((freespace >= needed_size) && (ctx->out_ifc_list[ifc].bufferswitch == 1)) {
-      /* we have enough space, buffering is enabled and size is not "flush" */
-
-      insert_into_buffer(&ctx->out_ifc_list[ifc], data, size);
-
-      result = TRAP_E_OK;
-
-   } else {
-      /* not enough space */
-
-#ifdef BUFFERING_CHECK_HEADERS
-      if (trap_check_buffer_content(ctx->out_ifc_list[ifc].buffer, ctx->out_ifc_list[ifc].buffer_index) != 0) {
-         VERBOSE(CL_ERROR, "Buffer is not valid.");
-      }
-#endif
-
-      DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "sending %"PRIu32" B from %p", ctx->out_ifc_list[ifc].buffer_index, ctx->out_ifc_list[ifc].buffer));
-
-#ifdef BUFFERING_CREATE_DUMPS
-      char *n = NULL;
-      if (asprintf(&n, "store-buffers-dump%04"PRIu64, ctx->counter_send_buffer[ifc]) != -1) {
-         mkdir(n, 0700);
-         ctx->out_ifc_list[ifc].create_dump(ctx->out_ifc_list[ifc].priv, ifc, n);
-         free(n);
-      }
-#endif
-
-      if (ctx->out_ifc_list[ifc].bufferswitch == 0) {
-         insert_into_buffer(&ctx->out_ifc_list[ifc], data, size);
-      }
-
-      ctx->out_ifc_list[ifc].buffer_occupied = 1;
-      trap_buffer_header_t *h = (trap_buffer_header_t *) ctx->out_ifc_list[ifc].buffer_header;
-      h->data_length = htonl(ctx->out_ifc_list[ifc].buffer_index);
-      result = ctx->out_ifc_list[ifc].send(ctx->out_ifc_list[ifc].priv, ctx->out_ifc_list[ifc].buffer_header,
-                                           ctx->out_ifc_list[ifc].buffer_index + sizeof(trap_buffer_header_t), timeout);
-
-      /* if the buffer was successfully sent OR we have no client: */
-      if (result == TRAP_E_OK || result == TRAP_E_IO_ERROR) {
-         if (result == TRAP_E_OK) {
-            /*
-             * buffer was successfully sent but we still have current message pending/not stored
-             * it will be the first message in buffer
-             */
-            ctx->counter_send_buffer[ifc]++;
-         } else {
-            /* we had no client but we can propagate either OK or TIMEOUT: */
-            result = TRAP_E_TIMEOUT;
-         }
-         /* buffer will be cleaned */
-         ctx->out_ifc_list[ifc].buffer_index = 0;
-         ctx->out_ifc_list[ifc].buffer_occupied = 0;
-         /* buffer was successfully sent but we still have current message pending/not stored
-          * it will be the first message in buffer */
-         if (ctx->out_ifc_list[ifc].bufferswitch == 1) {
-            insert_into_buffer(&ctx->out_ifc_list[ifc], data, size);
-         }
-      } else {
-         if (result == TRAP_E_TIMEOUT) {
-            ctx->counter_dropped_message[ifc]++;
-         }
-         if (trap_ctx_get_client_count(ctx, ifc) == 0) {
-            ctx->out_ifc_list[ifc].buffer_occupied = 0;
-         }
+   DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "read burst of %u messages from buffer, new bf %"PRIu32" %p",
+             count, ifc->buffer_full, ifc->buffer_pointer));
+exit:
+   pthread_mutex_unlock(&ifc->ifc_mtx);
+   (*got) = count;
+   if (result == TRAP_E_OK) {
+      TRAP_CNT_ADD(ctx->in_ifc_stats[ifc_idx].recv_message, count);
+      if (ifc->client_state == FMT_CHANGED) {
+         ifc->client_state = FMT_OK;
+         return TRAP_E_FORMAT_CHANGED;
       }
    }
-
-fn_exit:
-   pthread_mutex_unlock(&ctx->out_ifc_list[ifc].ifc_mtx);
    return result;
 }
 
 /**
- * @}
+ * Write header of message (its size) at the given position in the buffer of output IFC.
+ *
+ * \param[in] priv  output interface
+ * \param[out] p    pointer to the message header
+ * \param[in] size  size of message payload
  */
+static inline void trap_set_msg_size(const trap_output_ifc_t *priv, unsigned char *p, uint32_t size)
+{
+   if (priv->large_msgs != 0) {
+      *((uint32_t *) p) = htonl(size);
+   } else {
+      *((uint16_t *) p) = htons((uint16_t) size);
+   }
+}
 
-struct reader_threads_arg {
-   trap_ctx_priv_t *ctx;
-   int thread_index;
-};
+static void insert_into_buffer(trap_output_ifc_t *priv, const void *data, const uint32_t size)
+{
+   assert(priv->buffer_index <= TRAP_OUT_BUFFER_SPACE(priv));
+   if (priv->buffer_occupied == 0) {
+      unsigned char *p = &priv->buffer[priv->buffer_index];
+      trap_set_msg_size(priv, p, size);
+      memcpy((void *) (p + TRAP_MSG_HEADER_SIZE(priv)), data, size);
+      priv->buffer_index += size + TRAP_MSG_HEADER_SIZE(priv);
+      TRAP_CNT_ADD(priv->stored_bytes, size + TRAP_MSG_HEADER_SIZE(priv));
+   }
+}
 
 /**
- * Function of reader-thread.
+ * Lock the buffer of output IFC.
  *
- * \param[in] arg struct reader_threads_arg with context and thread id - used as the index in ctx->in_ifc_list, in_ifc_results
- * \return NULL
+ * A message that fits into the buffer is stored by trap_store_into_buffer()
+ * without ifc_mtx, the producer only takes buffer_owned by an atomic
+ * operation and holds it for copying of the message.  Everybody else takes
+ * ifc_mtx and then waits for buffer_owned.  The lock can be held for long,
+ * e.g. trap_ctx_send_reserve() holds it until trap_ctx_send_commit() and
+ * full buffers are sent under it.  The fast path of other producers fails
+ * meanwhile and they wait for ifc_mtx, so only the copying of a message
+ * is waited for by sched_yield().
+ *
+ * flush_req and bufferflush are written by the fast path and by autoflush
+ * without a common lock, they are accessed by atomic operations.
+ *
+ * \param[in,out] o  output interface
  */
-void *reader_threads_fn(void *arg)
+static inline void trap_out_buffer_lock(trap_output_ifc_t *o)
 {
-   struct reader_threads_arg *argdata = (struct reader_threads_arg *) arg;
-   trap_ctx_priv_t *ctx = NULL;
-   int thread_id;
-   int retval;
-#ifdef DISABLE_BUFFERING
-   uint32_t recvsize = 0;
-#endif
-
-   if (argdata == NULL) {
-      pthread_exit(NULL);
+   pthread_mutex_lock(&o->ifc_mtx);
+   while (__sync_bool_compare_and_swap(&o->buffer_owned, 0, 1) == 0) {
+      sched_yield();
    }
-   ctx = argdata->ctx;
-   thread_id = argdata->thread_index;
-   do {
-      sem_wait(&ctx->reader_threads[thread_id].sem);
-      if (__sync_add_and_fetch(&ctx->terminated, 0) != 0) {
-         break;
-      }
+}
 
-      /* call recv of my IFC and let it store results into multi-result array */
-#ifndef DISABLE_BUFFERING
-      /* handle buffering */
-      retval = trap_read_from_buffer(ctx, thread_id, (const void **) &ctx->in_ifc_results[thread_id].message,
-                                     &ctx->in_ifc_results[thread_id].message_size,
-                                     ctx->get_data_timeout);
-#else
-      retval = ctx->in_ifc_list[thread_id].recv(ctx->in_ifc_list[thread_id].priv,
-                                                ctx->in_ifc_list[thread_id].buffer,
-                                                &recvsize,
-                                                ctx->get_data_timeout);
-      /* if sender uses buffering, we are loosing data! in addition, data can be corrupted in this case!!! */
-      ctx->in_ifc_results[thread_id].message_size = (uint16_t) recvsize;
-      ctx->in_ifc_results[thread_id].message = ctx->in_ifc_list[thread_id].buffer;
-#endif
+/**
+ * Unlock the buffer of output IFC locked by trap_out_buffer_lock().
+ *
+ * \param[in,out] o  output interface
+ */
+static inline void trap_out_buffer_unlock(trap_output_ifc_t *o)
+{
+   __sync_lock_release(&o->buffer_owned);
+   pthread_mutex_unlock(&o->ifc_mtx);
+}
 
-      ctx->in_ifc_results[thread_id].result_code = retval;
-      pthread_mutex_lock(&ctx->mut_sem_collector);
-      ctx->readers_count--;
-      if (ctx->readers_count == 0) {
-         /* the last reader wakes collector */
-         retval = sem_post(&ctx->sem_collector);
-         if (retval != 0) {
-            VERBOSE(CL_ERROR, "Waking up collector thread of multiread function failed. (%d)", retval);
-         }
+/**
+ * Size of block of trap_buffer_t used as output buffer of IFC with the given buffer size.
+ *
+ * Blocks are borrowed from the buffer pool, so that they can be passed to
+ * the IFC by reference, see trap_out_buffer_unshare().
+ */
+#define TRAP_OUT_BLOCK_SIZE(buffer_size) (sizeof(trap_buffer_header_t) + (buffer_size) + 1)
+
+/**
+ * Get current time of CLOCK_MONOTONIC.
+ *
+ * \return time in microseconds
+ */
+static inline uint64_t trap_monotonic_us(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Prepare the output buffer for sending: append the time of sending if "timestamp=on" and set its header.
+ *
+ * \param[in,out] o   output interface
+ * \return size of data in the buffer (data_length of the header)
+ */
+static inline uint32_t trap_out_buffer_seal(trap_output_ifc_t *o)
+{
+   uint32_t length = o->buffer_index;
+   uint32_t ts[2];
+   uint64_t now;
+
+   if (o->timestamp != 0) {
+      /* the space is reserved by TRAP_OUT_BUFFER_SPACE() */
+      now = trap_realtime_us();
+      ts[0] = htonl((uint32_t) (now >> 32));
+      ts[1] = htonl((uint32_t) now);
+      memcpy(o->buffer + length, ts, TRAP_BUFFER_TIMESTAMP_SIZE);
+      length += TRAP_BUFFER_TIMESTAMP_SIZE;
+   }
+   ((trap_buffer_header_t *) o->buffer_header)->data_length = htonl(length);
+   return length;
+}
+
+/**
+ * Compress sealed buffer of output IFC with "compress=" into compress_buf.
+ *
+ * The data are stored as they are when they do not fit into the buffer after
+ * compression, see #TRAP_BUFFER_COMPRESS_SIZE.
+ *
+ * \param[in,out] o   output interface
+ * \param[in] h       sealed buffer (the current one or a block of the sender thread)
+ * \return size of data in compress_buf (without buffer header)
+ */
+static inline uint32_t trap_out_buffer_compress(trap_output_ifc_t *o, const trap_buffer_header_t *h)
+{
+   trap_buffer_header_t *z = (trap_buffer_header_t *) o->compress_buf;
+   uint32_t raw = ntohl(h->data_length), length, mark;
+
+   length = trap_compress(o->compress, &o->compress_state, z->data, o->buffer_size - TRAP_BUFFER_COMPRESS_SIZE, h->data, raw);
+   if (length != 0 && length < raw) {
+      mark = htonl(raw);
+   } else {
+      /* incompressible data, the space for trailer is reserved by TRAP_OUT_BUFFER_SPACE() */
+      memcpy(z->data, h->data, raw);
+      length = raw;
+      mark = 0;
+   }
+   memcpy(z->data + length, &mark, TRAP_BUFFER_COMPRESS_SIZE);
+   length += TRAP_BUFFER_COMPRESS_SIZE;
+   z->data_length = htonl(length);
+   o->compress_len = length;
+   return length;
+}
+
+/**
+ * Prepare the current buffer of output IFC for send().
+ *
+ * The buffer is sealed by trap_out_buffer_seal() and compressed if "compress="
+ * is set.  The compressed buffer is kept until compress_len is cleared, so that
+ * send() repeated after timeout continues with the same data.
+ *
+ * \param[in,out] o       output interface
+ * \param[out] length     size of data to send (without buffer header)
+ * \param[out] raw_length size of data before compression
+ * \return buffer (header followed by data) to pass to send()
+ */
+static inline const void *trap_out_buffer_prepare(trap_output_ifc_t *o, uint32_t *length, uint32_t *raw_length)
+{
+   if (o->compress == 0) {
+      *raw_length = *length = trap_out_buffer_seal(o);
+      return o->buffer_header;
+   }
+   if (o->compress_len == 0) {
+      trap_out_buffer_seal(o);
+      trap_out_buffer_compress(o, (trap_buffer_header_t *) o->buffer_header);
+   }
+   *raw_length = ntohl(((trap_buffer_header_t *) o->buffer_header)->data_length);
+   *length = o->compress_len;
+   return o->compress_buf;
+}
+
+/**
+ * Get a new buffer for output IFC when the sent buffer is still referenced by the IFC.
+ *
+ * IFCs with client queues ("clientq=") keep a reference to the sent buffer
+ * (trap_pool_ref()) until all clients get it instead of copying it, so the
+ * buffer must not be overwritten.  When there is no memory for a new buffer,
+ * the function waits until the IFC drops its reference.
+ *
+ * \param[in] buf   sent buffer (header followed by data)
+ * \return new buffer with empty header, the caller drops its reference to buf,
+ * NULL if buf can be reused
+ */
+static void *trap_out_buffer_unshare(void *buf)
+{
+   trap_buffer_header_t *h;
+
+   if (trap_pool_shared(buf) == 0) {
+      return NULL;
+   }
+   h = (trap_buffer_header_t *) trap_pool_get(trap_pool_size(buf));
+   if (h == NULL) {
+      while (trap_pool_shared(buf) != 0) {
+         usleep(TRAP_UNSHARE_WAIT);
       }
-      pthread_mutex_unlock(&ctx->mut_sem_collector);
-      /* inform collector about finished job */
+      return NULL;
+   }
+   h->data_length = 0;
+   return h;
+}
 
-      if (__sync_add_and_fetch(&ctx->terminated, 0) != 0) {
-         break;
+/**
+ * Make the given buffer the current buffer of output IFC.
+ *
+ * The caller must hold the buffer (trap_out_buffer_lock()).  The buffer
+ * replaces memory of the current block of tb (or of the current slot with
+ * "shard=hash"), the caller takes over the previous buffer.
+ *
+ * \param[in,out] o    output interface
+ * \param[in] header   buffer with size TRAP_OUT_BLOCK_SIZE() from the pool
+ */
+static void trap_out_buffer_replace(trap_output_ifc_t *o, unsigned char *header)
+{
+   if (o->shard_slots != NULL) {
+      o->shard_slots[o->shard_slot].header = header;
+   }
+   if (o->buffer_header == (unsigned char *) o->tb->cur_wr_block->data) {
+      /* sender thread checks the current block when there is nothing to send */
+      if (o->sendq != NULL) {
+         pthread_mutex_lock(&o->sendq->mtx);
       }
-   } while (1);
-   free(arg);
-   pthread_exit(NULL);
+      tb_block_set_data(o->tb->cur_wr_block, header);
+      if (o->sendq != NULL) {
+         pthread_mutex_unlock(&o->sendq->mtx);
+      }
+   }
+   o->buffer_header = header;
+   o->buffer = ((trap_buffer_header_t *) header)->data;
 }
 
 /**
- * Function to initialize or change the array of structures with information about timeouts
- * on output interfaces.
+ * Let the producer continue with a buffer that the IFC does not reference after it was sent directly.
  *
- * @param[in,out] ctx         pointer to the private libtrap context data (trap_ctx_init())
- * @return Number of output interfaces, where the timeout is set.
+ * \param[in,out] o    output interface
  */
-static inline int trap_init_ifcs_timeouts(trap_ctx_priv_t *ctx)
+static void trap_out_buffer_release(trap_output_ifc_t *o)
 {
-   int i, idx, res;
-   struct out_ifc_timeout_s *out_ifc_timeout = ctx->ifc_autoflush_timeout;
-   idx = 0;
-   for (i = 0; i < ctx->num_ifc_out; i++) {
-      if ((ctx->out_ifc_list[i].timeout != TRAP_NO_AUTO_FLUSH) && (ctx->out_ifc_list[i].bufferswitch != 0)) {
-         out_ifc_timeout[idx].idx = i;
-         // Try lock updating of timeout, it could be changing, do not block
-         res = pthread_mutex_trylock(&ctx->out_ifc_list[i].ifc_mtx);
-         out_ifc_timeout[idx].tm = ctx->out_ifc_list[i].timeout;
-         if (res == 0)
-            pthread_mutex_unlock(&ctx->out_ifc_list[i].ifc_mtx);
-         idx++;
+   unsigned char *old = o->buffer_header;
+   void *p;
+
+   if (o->compress_buf != NULL) {
+      p = trap_out_buffer_unshare(o->compress_buf);
+      if (p != NULL) {
+         trap_pool_put(o->compress_buf);
+         o->compress_buf = p;
       }
    }
-   // All changes updated, set to zero
-   if (pthread_rwlock_wrlock(&ctx->context_lock) != 0) {
-      VERBOSE(CL_ERROR, "Locking of context failed. %s", __func__);
+   p = trap_out_buffer_unshare(old);
+   if (p != NULL) {
+      trap_out_buffer_replace(o, (unsigned char *) p);
+      trap_pool_put(old);
    }
-   ctx->ifc_change = 0;
-   pthread_rwlock_unlock(&ctx->context_lock);
-   return idx;
 }
 
 /**
- * Handle the timeouts on output interfaces and flush buffer after timeout is reached.
+ * Update counters of output IFC after a buffer was sent.
  *
- *
- * @return NULL
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] length    size of sent data (without buffer header)
+ * \param[in] raw_length   size of data in the buffer before compression
  */
-static void *trap_automatic_flush_thr(void *arg)
+static inline void trap_count_out_buffer(trap_ctx_priv_t *ctx, unsigned int ifc, uint32_t length, uint32_t raw_length)
 {
-   int i, n;
-   int64_t usec;
-   trap_ctx_priv_t *ctx = (trap_ctx_priv_t *) arg;
+   trap_out_ifc_stats_t *st = &ctx->out_ifc_stats[ifc];
 
-   n = trap_init_ifcs_timeouts(ctx);
+   TRAP_CNT_ADD(st->send_buffer, 1);
+   TRAP_CNT_ADD(st->send_bytes, length);
+   TRAP_CNT_ADD(st->send_raw_bytes, raw_length);
+   TRAP_CNT_ADD(st->send_fill, (uint64_t) raw_length * 1000 / ctx->out_ifc_list[ifc].buffer_size);
+}
 
+/**
+ * Function of sender thread of output IFC with several blocks.
+ *
+ * Blocks of out_ifc_list[ifc].tb between cur_rd_block and cur_wr_block are
+ * full (sealed by trap_sendq_push()).  The thread sends them in order and
+ * releases them for writing.  The thread finishes when stop is requested
+ * and all blocks were sent.
+ *
+ * \param[in] arg   queue of the output interface (struct trap_sendq_s)
+ * \return NULL
+ */
+static void *trap_sendq_thr(void *arg)
+{
+   struct trap_sendq_s *q = (struct trap_sendq_s *) arg;
+   trap_output_ifc_t *o = &q->ctx->out_ifc_list[q->ifc];
+   trap_buffer_t *tb = o->tb;
+   tb_block_t *bl;
+   trap_buffer_header_t *h;
+   const void *data;
+   void *p;
+   uint32_t length;
+   int result, timeout;
+
+   pthread_mutex_lock(&q->mtx);
    while (1) {
-      if (__sync_add_and_fetch(&ctx->terminated, 0) != 0) {
-         break;
+      while (tb_isblockfree(tb->cur_rd_block) == TB_SUCCESS && q->stop == 0) {
+         pthread_cond_wait(&q->cond_queued, &q->mtx);
       }
-
-      if (pthread_rwlock_rdlock(&ctx->context_lock) != 0) {
-         VERBOSE(CL_ERROR, "Locking of context failed. %s", __func__);
+      bl = tb->cur_rd_block;
+      if (tb_isblockfree(bl) == TB_SUCCESS) {
+         /* stop was requested and everything was sent */
          break;
       }
+      pthread_mutex_unlock(&q->mtx);
 
-      // Checking if automatic flushing or buffering was changed or disabled
-      if (ctx->ifc_change == 1) {
-         pthread_rwlock_unlock(&ctx->context_lock);
-         n = trap_init_ifcs_timeouts(ctx);
+      h = (trap_buffer_header_t *) bl->data;
+      /* this thread may block, non-blocking timeouts would make it spin while there is no client */
+      timeout = o->datatimeout;
+      if (timeout != TRAP_WAIT && timeout < TRAP_SENDQ_MIN_TIMEOUT) {
+         timeout = TRAP_SENDQ_MIN_TIMEOUT;
+      }
+      /* the producer does not send directly, so compress_buf belongs to this thread */
+      if (o->compress != 0) {
+         length = trap_out_buffer_compress(o, h);
+         data = o->compress_buf;
       } else {
-         pthread_rwlock_unlock(&ctx->context_lock);
+         length = ntohl(h->data_length);
+         data = h;
       }
-
-      // Sort array by timeout if we have more than one output interface
-      if (n != 0) {
-         if (n > 1) {
-            qsort(ctx->ifc_autoflush_timeout, n, sizeof(struct out_ifc_timeout_s), compare_timeouts);
-         }
-         usec = ctx->ifc_autoflush_timeout[0].tm;
-         VERBOSE(CL_VERBOSE_LIBRARY, "Autoflush thread is going to sleep for %ld microseconds.", usec);
-         if (sleep(usec/1000000) != 0) {
-            if (__sync_add_and_fetch(&ctx->terminated, 0) != 0) {
-               break;
-            }
-         }
-         if (usleep(usec%1000000) == -1) {
-            if (__sync_add_and_fetch(&ctx->terminated, 0) != 0) {
-               break;
-            }
-         }
-
-         // Check all interfaces if timeout has elapsed, otherwise break
-         for (i = 0; i < n; i++) {
-            ctx->ifc_autoflush_timeout[i].tm -= usec;
-            if (ctx->ifc_autoflush_timeout[i].tm == 0) {
-               pthread_mutex_lock(&ctx->out_ifc_list[i].ifc_mtx);
-               if (ctx->out_ifc_list[ctx->ifc_autoflush_timeout[i].idx].bufferflush == 0) {
-                  pthread_mutex_unlock(&ctx->out_ifc_list[i].ifc_mtx);
-                  // No event on the interface, flushing the buffer
-                  trap_ctx_send_flush((trap_ctx_t *) ctx, i);
-                  ctx->counter_autoflush[ctx->ifc_autoflush_timeout[i].idx]++;
-               }
-               else {
-                  // Buffer was sent before timeout has elapsed, no need to flush the buffer
-                  ctx->out_ifc_list[ctx->ifc_autoflush_timeout[i].idx].bufferflush = 0;
-                  pthread_mutex_unlock(&ctx->out_ifc_list[i].ifc_mtx);
-               }
-               // Updating of timeout, it could be changing
-               pthread_mutex_lock(&ctx->out_ifc_list[i].ifc_mtx);
-               ctx->ifc_autoflush_timeout[i].tm = ctx->out_ifc_list[ctx->ifc_autoflush_timeout[i].idx].timeout;
-               pthread_mutex_unlock(&ctx->out_ifc_list[i].ifc_mtx);
-            } else {
-               continue;
-            }
-         }
+      do {
+         /* repeat as the producer would do with its buffer, give up only when stopping */
+         result = o->send(o->priv, data, length + sizeof(trap_buffer_header_t), timeout);
+      } while (result == TRAP_E_TIMEOUT && __sync_add_and_fetch(&q->stop, 0) == 0);
+      if (result == TRAP_E_OK) {
+         trap_count_out_buffer(q->ctx, q->ifc, length, ntohl(h->data_length));
       } else {
-         // Sleep for defined time, default 2 seconds
-         if (sleep(TRAP_NO_IFC_SLEEP)) {
-            break;
+         DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "Sender thread of IFC %"PRIu32" dropped buffer (%d).", q->ifc, result));
+      }
+      /* the IFC can still reference the sent data, such memory is replaced */
+      if (o->compress != 0) {
+         p = trap_out_buffer_unshare(o->compress_buf);
+         if (p != NULL) {
+            trap_pool_put(o->compress_buf);
+            o->compress_buf = p;
          }
+         p = NULL;
+      } else {
+         p = trap_out_buffer_unshare(h);
       }
-   }
 
-   pthread_exit(NULL);
+      pthread_mutex_lock(&q->mtx);
+      /* drop the reference, the block is marked as free when nobody uses it */
+      tb_block_lock(bl);
+      if (p != NULL) {
+         trap_pool_put(tb_block_set_data(bl, p));
+      }
+      bl->refcount--;
+      TB_FLUSH_END(tb, bl, 0);
+      pthread_cond_broadcast(&q->cond_free);
+   }
+   pthread_mutex_unlock(&q->mtx);
+   return NULL;
 }
 
-/** Set section for trap_print_help()
+/**
+ * Create sender thread of output IFC.
  *
- * \param [in] level  0 for default info about module, 1 for info about IFC specifier
+ * out_ifc_list[ifc].tb must be already allocated with more than one block.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY on failure
  */
-void trap_set_help_section(int level)
+static int trap_sendq_init(trap_ctx_priv_t *ctx, unsigned int ifc)
 {
-   trap_help_spec = level;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   struct trap_sendq_s *q;
+
+   q = calloc(1, sizeof(*q));
+   if (q == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   q->ctx = ctx;
+   q->ifc = ifc;
+   pthread_mutex_init(&q->mtx, NULL);
+   pthread_cond_init(&q->cond_queued, NULL);
+   pthread_cond_init(&q->cond_free, NULL);
+   if (pthread_create(&q->thr, NULL, trap_sendq_thr, q) != 0) {
+      pthread_cond_destroy(&q->cond_free);
+      pthread_cond_destroy(&q->cond_queued);
+      pthread_mutex_destroy(&q->mtx);
+      free(q);
+      return TRAP_E_MEMORY;
+   }
+   o->sendq = q;
+   return TRAP_E_OK;
 }
 
-/** Initialization function.
- * Create and initialize all interfaces. This function parses command-line
- * arguments; it extracts arguments it needs to set up interfaces and returns
- * the rest (argc and argv are modified).
- * @param[in,out] argc Pointer to number of command-line arguments.
- * @param[in,out] argv Command-line arguments.
- * @param[out] ifc_spec Structure with specification of interface types and
- *                      their parameters.
- * @return Error code (0 on success)
+/**
+ * Wait until the sender thread sends all full blocks.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] timeout   maximal time in microseconds to wait for sending of one block
  */
-int trap_parse_params(int *argc, char **argv, trap_ifc_spec_t *ifc_spec)
+static void trap_sendq_drain(trap_ctx_priv_t *ctx, unsigned int ifc, int timeout)
 {
-   uint32_t i, j, ifc_count = 0;
-   char *ifc_spec_str = NULL;
-   char *ifc_type = NULL;
-   char *p;
-   int rv = TRAP_E_OK;
+   struct trap_sendq_s *q = ctx->out_ifc_list[ifc].sendq;
+   trap_buffer_t *tb = ctx->out_ifc_list[ifc].tb;
+   struct timeval tv;
+   struct timespec ts;
 
-   if (ifc_spec == NULL) {
-      VERBOSE(CL_ERROR, "Bad pointer 'ifc_spec' passed to trap_parse_params().");
-      return TRAP_E_BAD_FPARAMS;
+   if (q == NULL) {
+      return;
+   }
+   pthread_mutex_lock(&q->mtx);
+   while (tb_isblockfree(tb->cur_rd_block) != TB_SUCCESS) {
+      trap_set_timeouts(timeout, &tv, &ts);
+      if (pthread_cond_timedwait(&q->cond_free, &q->mtx, &ts) == ETIMEDOUT) {
+         break;
+      }
    }
+   pthread_mutex_unlock(&q->mtx);
+}
 
-   /* initialization of ifc_spec */
-   memset(ifc_spec, 0, sizeof(trap_ifc_spec_t));
+/**
+ * Send the rest of full blocks and stop sender thread.
+ *
+ * Blocks that cannot be sent within the timeout of output IFC are dropped.
+ * Messages are sent directly by the producer afterwards.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ */
+static void trap_sendq_destroy(trap_ctx_priv_t *ctx, unsigned int ifc)
+{
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   struct trap_sendq_s *q = o->sendq;
 
-   // Look for -h (or --help) parameter
-   for (i = 0; i < *argc; i++) {
-      if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
-         if (i + 1 < *argc && ((strcmp(argv[i + 1], "trap") == 0) || (strcmp(argv[i + 1], "1") == 0))) {
-            trap_help_spec = 1;
-         }
-         // Remove parameter from argv and break
-         for (j = i; j + 1 < *argc; j++) {
-            argv[j] = argv[j + 1];
-         }
-         *argc -= 1;
-         return TRAP_E_HELP;
-      }
+   if (q == NULL) {
+      return;
    }
+   pthread_mutex_lock(&q->mtx);
+   q->stop = 1;
+   pthread_cond_signal(&q->cond_queued);
+   pthread_cond_broadcast(&q->cond_free);
+   pthread_mutex_unlock(&q->mtx);
+   pthread_join(q->thr, NULL);
+
+   pthread_mutex_lock(&o->ifc_mtx);
+   o->sendq = NULL;
+   pthread_mutex_unlock(&o->ifc_mtx);
+
+   pthread_cond_destroy(&q->cond_free);
+   pthread_cond_destroy(&q->cond_queued);
+   pthread_mutex_destroy(&q->mtx);
+   free(q);
+}
 
-   // Extract -i parameter (interface specifier)
-   for (i = 0; i < *argc-1; i++) {
-      if (argv[i] && strcmp(argv[i], "-i") == 0) {
-         ifc_spec_str = argv[i+1];
-         // Remove parameters from argv
-         for (j = i; j + 2 < *argc; j++) {
-            argv[j] = argv[j + 2];
+/**
+ * Hand the current block over to the sender thread and continue with the next one.
+ *
+ * The caller must hold out_ifc_list[ifc].ifc_mtx.  When all other blocks are
+ * in flight, the function waits for a free block according to the timeout
+ * unless "sendpolicy=drop" is set.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \return TRAP_E_OK if the block was handed over, TRAP_E_TIMEOUT if there is no free block
+ * (the current block is kept), TRAP_E_TERMINATED if libtrap is terminating
+ */
+static int trap_sendq_push(trap_ctx_priv_t *ctx, unsigned int ifc, int timeout)
+{
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   struct trap_sendq_s *q = o->sendq;
+   trap_buffer_t *tb = o->tb;
+   tb_block_t *next;
+   struct timeval tv;
+   struct timespec ts;
+   int result = TRAP_E_OK;
+
+   assert(o->buffer_index > 0);
+
+   pthread_mutex_lock(&q->mtx);
+   next = tb->blocks[(tb->cur_wr_block_idx + 1) % tb->nblocks];
+   if (tb_isblockfree(next) != TB_SUCCESS && o->sendq_drop == 0 && timeout != TRAP_NO_WAIT) {
+      if (timeout > 0) {
+         trap_set_timeouts(timeout, &tv, &ts);
+      }
+      while (tb_isblockfree(next) != TB_SUCCESS && q->stop == 0 && __sync_add_and_fetch(&ctx->terminated, 0) == 0) {
+         if (timeout > 0) {
+            if (pthread_cond_timedwait(&q->cond_free, &q->mtx, &ts) == ETIMEDOUT) {
+               break;
+            }
+         } else {
+            pthread_cond_wait(&q->cond_free, &q->mtx);
          }
-         *argc -= 2;
-         break;
       }
    }
-   if (ifc_spec_str == NULL) {
-      //return trap_errorf(ctx, TRAP_E_BADPARAMS, "Interface specifier (option -i) not found.");
-      trap_last_error = TRAP_E_BADPARAMS;
-      trap_last_error_msg = "Interface specifier (option -i) not found.";
-      return TRAP_E_BADPARAMS;
-   }
 
-   // Extract verbose level parameter (-v, -vv, -vvv)
-   for (i = 0; i < *argc; i++) {
-      // If param matches -v, -vv or -vvv, set verbosity level
-      if (strcmp(argv[i], "-v") == 0) {
-         trap_set_verbose_level(0);
-      } else if (strcmp(argv[i], "-vv") == 0) {
-         trap_set_verbose_level(1);
-      } else if (strcmp(argv[i], "-vvv") == 0) {
-         trap_set_verbose_level(2);
-      } else {
-         continue;
-      }
-      // Remove parameter from argv and break
-      for (j = i; j + 1 < *argc; j++) {
-         argv[j] = argv[j + 1];
-      }
-      *argc -= 1;
-      break;
+   if (q->stop != 0 || __sync_add_and_fetch(&ctx->terminated, 0) != 0) {
+      result = TRAP_E_TERMINATED;
+   } else if (tb_isblockfree(next) != TB_SUCCESS) {
+      result = TRAP_E_TIMEOUT;
+   } else {
+      /* non-zero length in header marks the block as full, sender thread holds the reference */
+      trap_out_buffer_seal(o);
+      tb->cur_wr_block->refcount = 1;
+      tb_next_wr_block(tb);
+      pthread_cond_signal(&q->cond_queued);
+
+      o->buffer_header = (unsigned char *) tb->cur_wr_block->data;
+      o->buffer = ((trap_buffer_header_t *) o->buffer_header)->data;
+      o->buffer_index = 0;
    }
+   pthread_mutex_unlock(&q->mtx);
+   return result;
+}
 
-   /* count the number of IFC parameters, the format is:
-    * type1:param1:param1_2,type2:,type3:param3 */
-   p = ifc_spec_str;
-   while (p && *p != '\0') {
-      p = strchr(p, TRAP_IFC_DELIMITER);
-      if (p != NULL && *p == TRAP_IFC_DELIMITER) {
-         p++;
-      }
-      ifc_count++;
+/**
+ * Call send() of the interface, with "shard=hash" the interface gets also the index of the current buffer.
+ *
+ * \param[in] o        output interface
+ * \param[in] data     buffer with header
+ * \param[in] size     size of buffer with header
+ * \param[in] timeout  TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \return result of send() of the interface
+ */
+static inline int trap_out_ifc_send(trap_output_ifc_t *o, const void *data, uint32_t size, int timeout)
+{
+   if (o->shard == TRAP_SHARD_HASH) {
+      return o->send_slot(o->priv, data, size, o->shard_slot, timeout);
    }
+   return o->send(o->priv, data, size, timeout);
+}
 
-   ifc_spec->types = calloc(ifc_count + 1, sizeof(*ifc_spec->types));
-   if (ifc_spec->types == NULL) {
-      return TRAP_E_MEMORY;
-   }
-   ifc_spec->params = calloc(ifc_count, sizeof(char *));
-   if (ifc_spec->params == NULL) {
-      free(ifc_spec->types);
-      ifc_spec->types = NULL;
-      return TRAP_E_MEMORY;
+/**
+ * Send the content of output buffer to the interface.
+ *
+ * The caller must hold out_ifc_list[ifc].ifc_mtx. The buffer is cleaned if it
+ * was sent or if there is no client (TRAP_E_IO_ERROR).
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \return result of send() of the interface or trap_sendq_push() if the IFC has a sender thread
+ */
+static inline int trap_send_out_buffer(trap_ctx_priv_t *ctx, unsigned int ifc, int timeout)
+{
+   int result;
+   uint32_t length, raw_length;
+   const void *data;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   /* the producer is blocked until the buffer is sent or handed over */
+   uint64_t start = trap_monotonic_us();
+
+   DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "sending %"PRIu32" B from %p", o->buffer_index, o->buffer));
+
+   /* pending request of autoflush is satisfied by this buffer */
+   __atomic_store_n(&o->flush_req, 0, __ATOMIC_RELAXED);
+   if (o->sendq != NULL) {
+      result = trap_sendq_push(ctx, ifc, timeout);
+      TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].send_blocked, trap_monotonic_us() - start);
+      return result;
    }
 
-   p = ifc_spec_str;
-   for (i = 0; i < ifc_count; i++) {
-      /* set IFC type and skip to params */
-      if (p != NULL) {
-         ifc_spec->types[i] = p[0];
-         if (strlen(p) >= 2 && p[1] == TRAP_IFC_PARAM_DELIMITER) {
-            /* there is a param string to parse */
-            p += 2;
-            p = get_param_by_delimiter(p, &ifc_spec->params[i], TRAP_IFC_DELIMITER);
-         } else {
-            /* param was not passed, set an empty one */
-            ifc_spec->params[i] = strdup("");
-         }
-      } else {
-         /* unexpected error, p shouldn't be NULL */
-         VERBOSE(CL_ERROR, "Bad IFC_SPEC '%s'. See -h trap for help.", ifc_spec_str);
-         ifc_spec->params[i] = strdup("");
-      }
-      if (ifc_spec->params[i] == NULL) {
-         VERBOSE(CL_ERROR, "Allocation failed.");
-         rv = TRAP_E_MEMORY;
-         goto clean_on_fail;
+   o->buffer_occupied = 1;
+   data = trap_out_buffer_prepare(o, &length, &raw_length);
+   result = trap_out_ifc_send(o, data, length + sizeof(trap_buffer_header_t), timeout);
+   TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].send_blocked, trap_monotonic_us() - start);
+
+   /* if the buffer was successfully sent OR we have no client: */
+   if (result == TRAP_E_OK || result == TRAP_E_IO_ERROR) {
+      if (result == TRAP_E_OK) {
+         trap_count_out_buffer(ctx, ifc, length, raw_length);
       }
+      /* buffer will be cleaned */
+      trap_out_buffer_release(o);
+      o->buffer_index = 0;
+      o->buffer_occupied = 0;
+      o->compress_len = 0;
+   } else if (trap_ctx_get_client_count(ctx, ifc) == 0) {
+      o->buffer_occupied = 0;
+      o->compress_len = 0;
    }
+   return result;
+}
 
-   /* check for unsupported IFCs */
-   for (i = 0; ifc_spec->types[i] != 0; ++i) {
-      for (ifc_type = trap_ifc_type_supported; *ifc_type != 0; ++ifc_type) {
-         if (*ifc_type == ifc_spec->types[i]) {
-            break;
+/**
+ * Free buffers of clients of output IFC with "shard=hash".
+ *
+ * The first slot uses the block of tb, it is freed by tb_destroy().
+ *
+ * \param[in,out] o  output interface
+ */
+static void trap_shard_free(trap_output_ifc_t *o)
+{
+   uint32_t i;
+
+   for (i = 1; i < o->shard_nslots; i++) {
+      trap_pool_put(o->shard_slots[i].header);
+   }
+   free(o->shard_slots);
+   o->shard_slots = NULL;
+   o->shard_nslots = 0;
+}
+
+/**
+ * Make the buffer of the given client current ("shard=hash").
+ *
+ * The caller must hold the buffer (trap_out_buffer_lock()).  The current
+ * buffer that was not sent completely is sent at first, the IFC continues
+ * with the same data.  Buffers of clients are allocated on demand.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] slot      index of buffer in shard_slots
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \return TRAP_E_OK on success, result of trap_send_out_buffer() if the current buffer could not be sent
+ */
+static int trap_shard_switch(trap_ctx_priv_t *ctx, unsigned int ifc, uint32_t slot, int timeout)
+{
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   struct trap_shard_slot_s *s;
+   int result;
+
+   if (slot == o->shard_slot) {
+      return TRAP_E_OK;
+   }
+   if (slot >= o->shard_nslots) {
+      s = realloc(o->shard_slots, (slot + 1) * sizeof(struct trap_shard_slot_s));
+      if (s == NULL) {
+         return trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for output ifc buffer.");
+      }
+      o->shard_slots = s;
+      for (; o->shard_nslots <= slot; o->shard_nslots++) {
+         s[o->shard_nslots].header = trap_pool_get(TRAP_OUT_BLOCK_SIZE(o->buffer_size));
+         if (s[o->shard_nslots].header == NULL) {
+            return trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for output ifc buffer.");
          }
+         s[o->shard_nslots].index = 0;
       }
-      if (*ifc_type == 0) {
-         /* not found */
-         VERBOSE(CL_ERROR, "Unsupported IFC type '%c'.", ifc_spec->types[i]);
-         rv = TRAP_E_BADPARAMS;
-         goto clean_on_fail;
+   }
+   if (o->buffer_occupied != 0) {
+      result = trap_send_out_buffer(ctx, ifc, timeout);
+      if (result != TRAP_E_OK && result != TRAP_E_IO_ERROR) {
+         return result;
       }
    }
 
-   trap_last_error = TRAP_E_OK;
-   trap_last_error_msg = default_err_msg[TRAP_E_OK];
+   o->shard_slots[o->shard_slot].index = o->buffer_index;
+   o->buffer_header = o->shard_slots[slot].header;
+   o->buffer = ((trap_buffer_header_t *) o->buffer_header)->data;
+   o->buffer_index = o->shard_slots[slot].index;
+   o->shard_slot = slot;
    return TRAP_E_OK;
+}
 
-clean_on_fail:
-   for (i = 0; i < ifc_count; i++) {
-      /* set IFC type and skip to params */
-      if (ifc_spec->params[i] != NULL) {
-         free(ifc_spec->params[i]);
-         ifc_spec->params[i] = NULL;
+/**
+ * Store a message into the buffer of the client chosen by its key ("shard=hash").
+ *
+ * The key is taken from the function set by trap_ctx_set_shard_key(), the
+ * buffer is the key modulo the number of connected clients given by
+ * get_client_count() of the IFC, send_slot() maps the buffer to a client by
+ * the same number.  There is no fast path, the current buffer is switched
+ * under the lock.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] data      message
+ * \param[in] size      size of message
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ */
+static int trap_shard_store(trap_ctx_priv_t *ctx, unsigned int ifc, const void *data, uint32_t size, int timeout)
+{
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   uint32_t needed_size = size + TRAP_MSG_HEADER_SIZE(o);
+   int32_t clients;
+   int result;
+
+   if (o->shard_key == NULL) {
+      return trap_errorf(ctx, TRAP_E_BAD_FPARAMS, "Key function for \"shard=hash\" of output IFC %u is not set (trap_ctx_set_shard_key()).", ifc);
+   }
+   clients = o->get_client_count(o->priv);
+
+   trap_out_buffer_lock(o);
+   result = trap_shard_switch(ctx, ifc, o->shard_key(data, size, o->shard_key_arg) % (clients > 0 ? clients : 1), timeout);
+   if (result != TRAP_E_OK) {
+      if (result == TRAP_E_TIMEOUT) {
+         TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].dropped_message, 1);
       }
+      goto exit;
    }
-   if (ifc_spec->types != NULL) {
-      free(ifc_spec->types);
+   /* we send buffer before timeout, no need to flush it */
+   __atomic_store_n(&o->bufferflush, 1, __ATOMIC_RELAXED);
+
+   if ((o->bufferswitch == 1) && (o->buffer_occupied == 0) &&
+       (TRAP_OUT_BUFFER_SPACE(o) - o->buffer_index >= needed_size)) {
+      insert_into_buffer(o, data, size);
+      goto exit;
    }
-   if (ifc_spec->params) {
-      free(ifc_spec->params);
+
+   if (o->bufferswitch == 0) {
+      insert_into_buffer(o, data, size);
    }
-   memset(ifc_spec, 0, sizeof(trap_ifc_spec_t));
-   return rv;
+   result = trap_send_out_buffer(ctx, ifc, timeout);
+   if (result == TRAP_E_OK || result == TRAP_E_IO_ERROR) {
+      if (result == TRAP_E_IO_ERROR) {
+         /* we had no client but we can propagate either OK or TIMEOUT: */
+         result = TRAP_E_TIMEOUT;
+      }
+      if (o->bufferswitch == 1) {
+         insert_into_buffer(o, data, size);
+      }
+   } else if (result == TRAP_E_TIMEOUT) {
+      TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].dropped_message, 1);
+   }
+
+exit:
+   trap_out_buffer_unlock(o);
+   return result;
 }
 
-/** Destructor of trap_ifc_spec_t structure.
- * @param[in] ifc_spec trap_ifc_spec_t structure to clear.
- * @return  Error code (0 on success)
+/**
+ * Send all non-empty buffers of clients ("shard=hash"), it is used by autoflush and flush.
+ *
+ * Like autoflush of one buffer, the function does not wait for the lock of
+ * the interface.  It stops at the first buffer that could not be sent.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
  */
-int trap_free_ifc_spec(trap_ifc_spec_t ifc_spec)
+static int trap_shard_flush(trap_ctx_priv_t *ctx, unsigned int ifc, int timeout)
 {
-   int i;
-   if (ifc_spec.types == NULL) {
-      return trap_error(trap_glob_ctx, TRAP_E_BADPARAMS);
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   uint32_t i, index;
+   int result = TRAP_E_OK;
+
+   if (pthread_mutex_trylock(&o->ifc_mtx) != 0) {
+      return TRAP_E_OK;
    }
-   if (ifc_spec.params != NULL) {
-      for (i = 0; i < strlen(ifc_spec.types); i++) {
-         if (ifc_spec.params[i] != NULL) {
-            free(ifc_spec.params[i]);
-            ifc_spec.params[i] = NULL;
-         }
+   /* producers of "shard=hash" take buffer_owned only with ifc_mtx */
+   while (__sync_bool_compare_and_swap(&o->buffer_owned, 0, 1) == 0) {
+      sched_yield();
+   }
+   __atomic_store_n(&o->flush_req, 0, __ATOMIC_RELAXED);
+   for (i = 0; i < o->shard_nslots; i++) {
+      index = (i == o->shard_slot) ? o->buffer_index : o->shard_slots[i].index;
+      if (index == 0) {
+         continue;
+      }
+      result = trap_shard_switch(ctx, ifc, i, timeout);
+      if (result == TRAP_E_OK) {
+         result = trap_send_out_buffer(ctx, ifc, timeout);
+      }
+      if (result != TRAP_E_OK && result != TRAP_E_IO_ERROR) {
+         VERBOSE(CL_VERBOSE_LIBRARY, "Autoflush was not successful.");
+         break;
       }
-      free(ifc_spec.params);
-      ifc_spec.params = NULL;
    }
-   free(ifc_spec.types);
-   return trap_error(trap_glob_ctx, TRAP_E_OK);
+   trap_out_buffer_unlock(o);
+   return result;
 }
 
-void trap_free_ctx_t(trap_ctx_priv_t **ctx);
+/**
+ * Mark the buffer of producer thread as free when the thread exits ("threadbufs=on").
+ *
+ * Destructor of out_ifc_list[ifc].stage_key, the buffer is kept in the list
+ * with its data, the next new thread continues with it.
+ *
+ * \param[in] arg  buffer of the thread (struct trap_stage_s)
+ */
+static void trap_stage_release(void *arg)
+{
+   __sync_lock_test_and_set(&((struct trap_stage_s *) arg)->exited, 1);
+}
 
-/** Initialization function.
- * Create and initialize all interfaces.
- * @param[in] module_info Pointer to struct containing info about the module.
- * @param[in] ifc_spec Structure with specification of interface types and
- *                      their parameters.
- * @return Error code (0 on success)
+/**
+ * Free buffers of producer threads of output IFC ("threadbufs=on").
+ *
+ * \param[in,out] o  output interface
  */
-int trap_init(trap_module_info_t *module_info, trap_ifc_spec_t ifc_spec)
+static void trap_stage_free(trap_output_ifc_t *o)
 {
-   int le;
-   if ((trap_glob_ctx != NULL) && (trap_glob_ctx->initialized != 0)) {
-      return trap_error(trap_glob_ctx, TRAP_E_INITIALIZED);
+   struct trap_stage_s *st;
+
+   if (o->stage_key_created == 0) {
+      return;
    }
-   trap_glob_ctx = trap_ctx_init(module_info, ifc_spec);
-   if (trap_glob_ctx == NULL) {
-      return TRAP_E_MEMORY;
+   pthread_key_delete(o->stage_key);
+   while (o->stages != NULL) {
+      st = o->stages;
+      o->stages = st->next;
+      trap_pool_put(st->header);
+      free(st);
    }
-   if (trap_glob_ctx->trap_last_error != TRAP_E_OK) {
-      le = trap_glob_ctx->trap_last_error;
-      strncpy(error_msg_buffer, trap_glob_ctx->trap_last_error_msg, MAX_ERROR_MSG_BUFF_SIZE - 1);
+   pthread_mutex_destroy(&o->stage_mtx);
+   o->stage_key_created = 0;
+}
 
-      trap_finalize();
-      trap_free_ctx_t(&trap_glob_ctx);
+/**
+ * Get the buffer of the calling thread ("threadbufs=on").
+ *
+ * The buffer of a finished thread is reused, otherwise a new one is allocated.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \return buffer of the thread, NULL if there is not enough memory
+ */
+static struct trap_stage_s *trap_stage_get(trap_ctx_priv_t *ctx, unsigned int ifc)
+{
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   struct trap_stage_s *st;
 
-      /* restore error message that was lost by finalize&free */
-      trap_last_error_msg = error_msg_buffer;
-      trap_last_error = le;
-      return trap_last_error;
+   st = (struct trap_stage_s *) pthread_getspecific(o->stage_key);
+   if (st != NULL) {
+      return st;
    }
-   return trap_glob_ctx->trap_last_error;
-}
 
+   pthread_mutex_lock(&o->stage_mtx);
+   for (st = o->stages; st != NULL; st = st->next) {
+      if (__sync_bool_compare_and_swap(&st->exited, 1, 0)) {
+         break;
+      }
+   }
+   if (st == NULL) {
+      st = (struct trap_stage_s *) calloc(1, sizeof(struct trap_stage_s));
+      if (st != NULL) {
+         st->header = trap_pool_get(TRAP_OUT_BLOCK_SIZE(o->buffer_size));
+         if (st->header == NULL) {
+            free(st);
+            st = NULL;
+         } else {
+            st->next = o->stages;
+            o->stages = st;
+         }
+      }
+   }
+   pthread_mutex_unlock(&o->stage_mtx);
 
-/** Function to terminate module's operation.
- * This function stops all read/write operations on all interfaces.
- * Any waiting in trap_get_data and trap_send_data is interrupted and these
- * functions return immediately with TRAP_E_TERMINATED.
- * Any call of trap_get_data or trap_send_data after call of this function
- * returns TRAP_E_TERMINATED.
+   if (st != NULL) {
+      pthread_setspecific(o->stage_key, st);
+   }
+   return st;
+}
+
+/**
+ * Hand the buffer of producer thread over to the output IFC ("threadbufs=on").
  *
- * This function is used to terminate module's operation (asynchronously), e.g.
- * in SIGTERM handler.
- * @return Always TRAP_E_OK (0).
+ * The caller must own the buffer (st->owned).  The buffer is swapped with
+ * the empty buffer of the IFC and sent by trap_send_out_buffer().  The buffer
+ * of the IFC that was not sent before (timeout) is sent at first, the data of
+ * the thread are kept when it fails.  When sending of the handed over data
+ * times out, they wait in the buffer of the IFC for the next call.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in,out] st    buffer of producer thread, st->index is 0 if the data were handed over
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \param[in] flush     if not 0, do not wait for the lock of the IFC (autoflush)
+ * \return TRAP_E_OK, TRAP_E_TIMEOUT, TRAP_E_IO_ERROR if there is no client, TRAP_E_TERMINATED
  */
-int trap_terminate()
+static int trap_stage_send(trap_ctx_priv_t *ctx, unsigned int ifc, struct trap_stage_s *st, int timeout, char flush)
 {
-   int ret = trap_ctx_terminate(trap_glob_ctx);
-   if (trap_glob_ctx != NULL) {
-      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
-      trap_last_error = trap_glob_ctx->trap_last_error;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   unsigned char *h;
+   int result = TRAP_E_OK;
+
+   if (flush != 0) {
+      if (pthread_mutex_trylock(&o->ifc_mtx) != 0) {
+         return TRAP_E_TIMEOUT;
+      }
+      while (__sync_bool_compare_and_swap(&o->buffer_owned, 0, 1) == 0) {
+         sched_yield();
+      }
    } else {
-      trap_last_error_msg = "No allocated global context.";
-      trap_last_error = ret;
+      trap_out_buffer_lock(o);
    }
-   return ret;
-}
-
 
-
-int trap_finalize()
-{
-   int ret;
-   ret = trap_ctx_finalize(((trap_ctx_t **) &trap_glob_ctx));
-   if (ret != TRAP_E_OK) {
-      if (trap_glob_ctx != NULL) {
-         trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
-         trap_last_error = trap_glob_ctx->trap_last_error;
-      } else {
-         trap_last_error_msg = "No allocated global context.";
-         trap_last_error = ret;
+   if ((o->buffer_index != 0) || (o->buffer_occupied != 0)) {
+      result = trap_send_out_buffer(ctx, ifc, timeout);
+      if (result != TRAP_E_OK && result != TRAP_E_IO_ERROR) {
+         goto exit;
       }
    }
-   return ret;
-}
+   /* the buffer of thread becomes the buffer of IFC, the thread continues with the empty one */
+   h = o->buffer_header;
+   trap_out_buffer_replace(o, st->header);
+   st->header = h;
+   o->buffer_index = st->index;
+   TRAP_CNT_ADD(o->stored_bytes, st->index);
+   st->index = 0;
+   /* we send buffer before timeout, no need to flush it */
+   __atomic_store_n(&o->bufferflush, 1, __ATOMIC_RELAXED);
+
+   result = trap_send_out_buffer(ctx, ifc, timeout);
+   if (result == TRAP_E_TIMEOUT) {
+      /* data wait in the buffer of IFC */
+      result = TRAP_E_OK;
+   }
 
+exit:
+   trap_out_buffer_unlock(o);
+   return result;
+}
 
 /**
- * \brief Get pointer to data stored in buffer (with headers) and mark buffer as clean.
+ * Store a message into the buffer of the calling thread ("threadbufs=on").
+ *
+ * The buffer is locked only against autoflush by st->owned, which is not
+ * shared with other producers.  The full buffer is handed over by
+ * trap_stage_send().
  *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] data      message
+ * \param[in] size      size of message
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
  */
-void trap_get_internal_buffer(trap_ctx_priv_t *ctx, uint16_t ifc_idx, const void **data, uint32_t *size)
+static int trap_stage_store(trap_ctx_priv_t *ctx, unsigned int ifc, const void *data, uint32_t size, int timeout)
 {
-   (*data) = ctx->in_ifc_list[ifc_idx].buffer;
-   (*size) = ctx->in_ifc_list[ifc_idx].buffer_full;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   uint32_t needed_size = size + TRAP_MSG_HEADER_SIZE(o);
+   struct trap_stage_s *st;
+   unsigned char *p;
+   int result = TRAP_E_OK;
 
-   /* mark internal buffer as free for next reading */
-   ctx->in_ifc_list[ifc_idx].buffer_pointer = ctx->in_ifc_list[ifc_idx].buffer;
-   ctx->in_ifc_list[ifc_idx].buffer_full = 0;
-}
+   st = trap_stage_get(ctx, ifc);
+   if (st == NULL) {
+      return trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for buffer of thread of output ifc %u.", ifc);
+   }
+   while (__sync_bool_compare_and_swap(&st->owned, 0, 1) == 0) {
+      /* autoflush is sending the buffer */
+      sched_yield();
+   }
 
-/** Read data from input interface.
- * Read a record from one of interfaces specified by `ifc_mask` and store
- * pointer to it into `data`. If `ifc_mask` contains more than 1 interface,
- * data are retrieve via parallel threads. In this case, resulting `data` is array
- * of `trap_multi_result` number of elements same as number of interfaces (returned `size` is size of
- * array in bytes --- number_of_interfaces * sizeof(trap_multi_result)).
- * If data are not available on any of specified
- * interfaces, wait until data are available or `timeout` microseconds elapses.
- * If `timeout` is equal to TRAP_WAIT, wait indefinitely. If `timeout` is equal to TRAP_NO_WAIT,
- * function is non-blocking with no timeout.
- * When function returns due to timeout, contents of `data` and `size` are undefined.
- * @param[in] ifc_mask Mask of interfaces to listen on (if *i*-th bit is set, interface *i* is enabled).
- * @param[out] data Pointer to data, you have to cast it to appropriate structure.
- * @param[out] size Number of bytes of data.
- * @param[in] timeout Timeout in microseconds.
- * @return Error code - 0 on success, TRAP_E_TIMEOUT if timeout elapses.
- */
-int trap_get_data(uint32_t ifc_mask, const void **data, uint16_t *size, int timeout)
-{
-   int counter;
-   int selected_mask = 0x1;
-   int res;
-   /* timeout */
-   for (counter = 0; counter < trap_glob_ctx->num_ifc_in; ++counter) {
-      if ((ifc_mask & selected_mask) != 0) {
-         trap_glob_ctx->in_ifc_list[counter].datatimeout = timeout;
+   if ((st->index != 0) && ((__atomic_load_n(&st->flush_req, __ATOMIC_RELAXED) != 0) || (TRAP_OUT_BUFFER_SPACE(o) - st->index < needed_size))) {
+      result = trap_stage_send(ctx, ifc, st, timeout, 0);
+      if (st->index != 0) {
+         /* previous buffer of IFC was not sent */
+         if (result == TRAP_E_TIMEOUT) {
+            TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].dropped_message, 1);
+         }
+         goto exit;
+      }
+      if (result == TRAP_E_IO_ERROR) {
+         /* we had no client but we can propagate either OK or TIMEOUT: */
+         result = TRAP_E_TIMEOUT;
       }
-      selected_mask <<= 1;
-   }
-   /* receive data */
-   if (trap_glob_ctx->num_ifc_in > 1) {
-      res = trap_ctx_multi_recv((trap_ctx_t *) trap_glob_ctx, ifc_mask, data, size);
-      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
-      trap_last_error = trap_glob_ctx->trap_last_error;
-   } else {
-      /* libtrap initialized with only one IFC */
-      res = trap_ctx_recv((trap_ctx_t *) trap_glob_ctx, 0, data, size);
-      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
-      trap_last_error = trap_glob_ctx->trap_last_error;
    }
-   return res;
-}
+   __atomic_store_n(&st->flush_req, 0, __ATOMIC_RELAXED);
 
-#define SEND_DATA() do { \
-   int res = trap_ctx_send((trap_ctx_t *) trap_glob_ctx, ifcidx, data, size); \
-   if (res != TRAP_E_NOT_INITIALIZED) { \
-      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;  \
-      trap_last_error = trap_glob_ctx->trap_last_error; \
-   } \
-   return res; \
-} while (0);
+   p = &((trap_buffer_header_t *) st->header)->data[st->index];
+   trap_set_msg_size(o, p, size);
+   memcpy(p + TRAP_MSG_HEADER_SIZE(o), data, size);
+   st->index += needed_size;
 
-int trap_send_data(unsigned int ifcidx, const void *data, uint16_t size, int timeout)
-{
-   trap_glob_ctx->out_ifc_list[ifcidx].datatimeout = timeout;
-   SEND_DATA()
-}
+   if (o->bufferswitch == 0) {
+      result = trap_stage_send(ctx, ifc, st, timeout, 0);
+      if (result == TRAP_E_IO_ERROR) {
+         result = TRAP_E_TIMEOUT;
+      } else if (st->index != 0 && result == TRAP_E_TIMEOUT) {
+         TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].dropped_message, 1);
+      }
+   }
 
-int trap_send(uint32_t ifcidx, const void *data, uint16_t size)
-{
-   SEND_DATA()
+exit:
+   __sync_lock_release(&st->owned);
+   return result;
 }
 
-#undef SEND_DATA
-
-int trap_recv(uint32_t ifcidx, const void **data, uint16_t *size)
+/**
+ * Hand over non-empty buffers of all producer threads ("threadbufs=on"), it is used by autoflush and flush.
+ *
+ * A buffer that is used by its owner right now is handed over by the owner
+ * in its next call (flush_req).
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ */
+static void trap_stage_flush(trap_ctx_priv_t *ctx, unsigned int ifc, int timeout)
 {
-   int res;
-   res = trap_ctx_recv((trap_ctx_t *) trap_glob_ctx, ifcidx, data, size);
-   if (res != TRAP_E_NOT_INITIALIZED) {
-      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
-      trap_last_error = trap_glob_ctx->trap_last_error;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   struct trap_stage_s *st;
+
+   pthread_mutex_lock(&o->stage_mtx);
+   for (st = o->stages; st != NULL; st = st->next) {
+      if (__sync_add_and_fetch(&st->index, 0) == 0) {
+         continue;
+      }
+      if (__sync_bool_compare_and_swap(&st->owned, 0, 1) == 0) {
+         /* the owner reads it without stage_mtx */
+         __atomic_store_n(&st->flush_req, 1, __ATOMIC_RELAXED);
+         continue;
+      }
+      if (st->index != 0) {
+         trap_stage_send(ctx, ifc, st, timeout, 1);
+      }
+      __sync_lock_release(&st->owned);
    }
-   return res;
+   pthread_mutex_unlock(&o->stage_mtx);
 }
 
-
-/** Set verbosity level.
- * Verbosity levels are:
- *   - -3 - errors
- *   - -2 - warnings
- *   - -1 - notices (default)
- *   -  0 - verbose
- *   -  1 - more verbose
- *   -  2 - even more verbose
+/**
+ * Store a message into the output buffer, send the buffer when it is full.
  *
- * @param[in] level Desired level of verbosity.
+ * Fast path: when the message fits into the buffer, it is stored without
+ * ifc_mtx, see trap_out_buffer_lock().  Autoflush (flush != 0) does not
+ * wait for the producer, when the producer owns the buffer, autoflush
+ * sets flush_req and the producer sends the buffer in its next call.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] data      message
+ * \param[in] size      size of message
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \param[in] flush     if not 0, send non-empty buffer and ignore the message (autoflush)
  */
-void trap_set_verbose_level(int level)
+static inline int trap_store_into_buffer(trap_ctx_priv_t *ctx, unsigned int ifc, const void *data, uint32_t size, int timeout, char flush)
 {
-   trap_verbose = level;
-}
+   /* Declaration of variables, we can have small buffer, initialization after checking the condition. */
+   uint32_t freespace;
+   uint64_t needed_size = (uint64_t) size + TRAP_MSG_HEADER_SIZE(&ctx->out_ifc_list[ifc]);
+   int result;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
 
-/** Get verbosity level.
- * See trap_set_verbose_level for list of levels.
- * @return Verbosity level currently set in the library.
- */
-int trap_get_verbose_level()
-{
-   return trap_verbose;
-}
+   if (ctx->out_ifc_list[ifc].ifc_type == TRAP_IFC_TYPE_BLACKHOLE) {
+      return TRAP_E_OK;
+   }
 
-extern char *environ[];
+   /* Can we put message at least into empty buffer? In the worst case, we could end up with SEGFAULT -> rather skip with error */
+   if (needed_size > TRAP_OUT_BUFFER_SPACE(o)) {
+      return trap_errorf(ctx, TRAP_E_MEMORY, "Buffer is too small for this message. Skipping...");
+   }
+   if ((size > UINT16_MAX) && (ctx->out_ifc_list[ifc].large_msgs == 0)) {
+      return trap_errorf(ctx, TRAP_E_MEMORY, "Message is too big, large messages are not enabled on output IFC %u (largemsg=on). Skipping...", ifc);
+   }
 
-void trap_json_print_string(char *str)
-{
-   printf("\"");
-   if (str != NULL) {
-      while (*str != 0) {
-         if (*str == '\n') {
-            printf("\\n");
-         } else if (*str == '\t') {
-            printf(" ");
+   if (o->threadbufs != 0) {
+      /* every producer thread has its own buffer */
+      if (flush == 0) {
+         return trap_stage_store(ctx, ifc, data, size, timeout);
+      }
+      trap_stage_flush(ctx, ifc, timeout);
+      /* buffer of IFC that was not sent yet is sent below */
+   }
+
+   if (o->shard == TRAP_SHARD_HASH) {
+      /* every client has its own buffer */
+      if (flush != 0) {
+         return trap_shard_flush(ctx, ifc, timeout);
+      }
+      return trap_shard_store(ctx, ifc, data, size, timeout);
+   }
+
+   if (flush != 0) {
+      /* Autoflush call, trying to lock section, maybe interface is waiting for clients -> rather skip than block the whole thread. */
+      if (pthread_mutex_trylock(&o->ifc_mtx) != 0) {
+         return TRAP_E_OK;
+      }
+      if (__sync_bool_compare_and_swap(&o->buffer_owned, 0, 1) == 0) {
+         /* producer is storing a message right now, let it send the buffer */
+         __atomic_store_n(&o->flush_req, 1, __ATOMIC_RELAXED);
+         pthread_mutex_unlock(&o->ifc_mtx);
+         return TRAP_E_OK;
+      }
+   } else {
+      if ((o->bufferswitch == 1) && (__atomic_load_n(&o->flush_req, __ATOMIC_RELAXED) == 0) &&
+          __sync_bool_compare_and_swap(&o->buffer_owned, 0, 1)) {
+         /* fast path, the message fits into the buffer */
+         if ((o->buffer_occupied == 0) && (o->buffer_index <= TRAP_OUT_BUFFER_SPACE(o)) &&
+             (TRAP_OUT_BUFFER_SPACE(o) - o->buffer_index >= needed_size)) {
+            insert_into_buffer(o, data, size);
+            __atomic_store_n(&o->bufferflush, 1, __ATOMIC_RELAXED);
+            __sync_lock_release(&o->buffer_owned);
+            return TRAP_E_OK;
+         }
+         __sync_lock_release(&o->buffer_owned);
+      }
+      /* Lock this section at first before sending whole buffer. */
+      trap_out_buffer_lock(o);
+   }
+   /* initialization in locked section, otherwise autoflush can send buffer which has been already sent */
+   if ((o->buffer_index <= TRAP_OUT_BUFFER_SPACE(o)) && (__atomic_load_n(&o->flush_req, __ATOMIC_RELAXED) == 0 || o->buffer_index == 0)) {
+      freespace = TRAP_OUT_BUFFER_SPACE(o) - o->buffer_index;
+   } else {
+      /* full buffer or autoflush requested sending of this buffer */
+      freespace = 0;
+   }
+   result = TRAP_E_TIMEOUT;
+
+   /* Is this a autoflush call? If we have empty buffer, we do not send anything. */
+   if (flush != 0) {
+      __atomic_store_n(&o->flush_req, 0, __ATOMIC_RELAXED);
+      if (ctx->out_ifc_list[ifc].buffer_index != 0) {
+#ifdef BUFFERING_CHECK_HEADERS
+         if (ctx->out_ifc_list[ifc].large_msgs == 0 &&
+             trap_check_buffer_content(ctx->out_ifc_list[ifc].buffer, ctx->out_ifc_list[ifc].buffer_index) != 0) {
+            VERBOSE(CL_ERROR, "Buffer is not valid.");
+         }
+#endif
+         DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "sending by autoflush %"PRIu32" B from %p", ctx->out_ifc_list[ifc].buffer_index, ctx->out_ifc_list[ifc].buffer));
+
+         if (ctx->out_ifc_list[ifc].sendq != NULL) {
+            result = trap_sendq_push(ctx, ifc, timeout);
+            goto fn_exit;
+         }
+
+         ctx->out_ifc_list[ifc].buffer_occupied = 1;
+         uint32_t length, raw_length;
+         const void *buf = trap_out_buffer_prepare(o, &length, &raw_length);
+         result = trap_out_ifc_send(o, buf, length + sizeof(trap_buffer_header_t), timeout);
+
+         if (result == TRAP_E_OK) {
+            trap_count_out_buffer(ctx, ifc, length, raw_length);
+            trap_out_buffer_release(o);
+            ctx->out_ifc_list[ifc].buffer_index = 0;
+            ctx->out_ifc_list[ifc].buffer_occupied = 0;
+            ctx->out_ifc_list[ifc].compress_len = 0;
+            DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "Sending partial buffer invoked by autoflush timeout on interface %d", ifc));
          } else {
-            printf("%c", *str);
+            VERBOSE(CL_VERBOSE_LIBRARY, "Autoflush was not successful.");
+            if (trap_ctx_get_client_count(ctx, ifc) == 0) {
+               ctx->out_ifc_list[ifc].buffer_occupied = 0;
+               ctx->out_ifc_list[ifc].compress_len = 0;
+            }
          }
-         str++;
       }
+      goto fn_exit;
    }
-   printf("\"");
-}
+   /* we send buffer before timeout, no need to flush it */
+   __atomic_store_n(&ctx->out_ifc_list[ifc].bufferflush, 1, __ATOMIC_RELAXED);
 
-void trap_convert_module_info_to_json(const trap_module_info_t *info)
-{
-   int i = 0;
+   if ((freespace >= needed_size) && (ctx->out_ifc_list[ifc].bufferswitch == 1)) {
+      /* we have enough space, buffering is enabled and size is not "flush" */
 
-   printf("{\"name\":");
-   trap_json_print_string(info->name);
-   printf(",\"description\":");
-   trap_json_print_string(info->description);
-   printf(",\"num_ifc_in\":%u,\"num_ifc_out\":%u,\"params\":[",
-         info->num_ifc_in, info->num_ifc_out);
+      insert_into_buffer(&ctx->out_ifc_list[ifc], data, size);
 
-   while (info->params[i] != NULL) {
-      if (i != 0) {
-         printf(",");
+      result = TRAP_E_OK;
+
+   } else {
+      /* not enough space */
+
+#ifdef BUFFERING_CHECK_HEADERS
+      if (ctx->out_ifc_list[ifc].large_msgs == 0 &&
+          trap_check_buffer_content(ctx->out_ifc_list[ifc].buffer, ctx->out_ifc_list[ifc].buffer_index) != 0) {
+         VERBOSE(CL_ERROR, "Buffer is not valid.");
+      }
+#endif
+
+#ifdef BUFFERING_CREATE_DUMPS
+      char *n = NULL;
+      if (asprintf(&n, "store-buffers-dump%04"PRIu64, ctx->out_ifc_stats[ifc].send_buffer) != -1) {
+         mkdir(n, 0700);
+         ctx->out_ifc_list[ifc].create_dump(ctx->out_ifc_list[ifc].priv, ifc, n);
+         free(n);
+      }
+#endif
+
+      if (ctx->out_ifc_list[ifc].bufferswitch == 0) {
+         insert_into_buffer(&ctx->out_ifc_list[ifc], data, size);
+      }
+
+      result = trap_send_out_buffer(ctx, ifc, timeout);
+
+      if (result == TRAP_E_OK || result == TRAP_E_IO_ERROR) {
+         if (result == TRAP_E_IO_ERROR) {
+            /* we had no client but we can propagate either OK or TIMEOUT: */
+            result = TRAP_E_TIMEOUT;
+         }
+         /* buffer was successfully sent but we still have current message pending/not stored
+          * it will be the first message in buffer */
+         if (ctx->out_ifc_list[ifc].bufferswitch == 1) {
+            insert_into_buffer(&ctx->out_ifc_list[ifc], data, size);
+         }
+      } else if (result == TRAP_E_TIMEOUT) {
+         TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].dropped_message, 1);
       }
-      printf("{\"short_opt\":\"%c\",\"long_opt\":", info->params[i]->short_opt);
-      trap_json_print_string(info->params[i]->long_opt);
-      printf(",\"description\":");
-      trap_json_print_string(info->params[i]->description);
-      printf(",\"argument_type\":");
-      trap_json_print_string(info->params[i]->argument_type);
-      printf(",\"mandatory_argument\": %d}", info->params[i]->param_required_argument);
-      i++;
    }
-   printf("]}\n");
+
+fn_exit:
+   trap_out_buffer_unlock(o);
+   return result;
 }
 
 /**
- * Print helper for formatting text of help.
+ * Store several messages into the output buffer within one critical section.
  *
- * \param[in] s String to print (e.g. description).
- * \param[in] align The number of spaces that should be add after line-break.
- * \param[in] cut Approximate (minimal) length of string that is printed on the line.
- * Line-break is added if needed, after the current word.
+ * The buffer is sent only when the next message does not fit into it.
+ * Storing stops at the first message that cannot be accepted.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc       index of output interface
+ * \param[in] data      array of pointers to messages
+ * \param[in] sizes     array of sizes of messages
+ * \param[in] count     number of messages
+ * \param[out] sent     number of accepted messages
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
  */
-static void print_aligned(const char *s, uint16_t align, uint16_t cut)
+static inline int trap_store_burst_into_buffer(trap_ctx_priv_t *ctx, unsigned int ifc, const void **data, const uint16_t *sizes,
+                                               unsigned int count, unsigned int *sent, int timeout)
 {
-   int32_t tmp = 0, rest, written;
-   const char *p = s;
+   unsigned int i;
+   uint32_t freespace, needed_size;
+   int result = TRAP_E_OK;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
 
-   rest = strlen(s);
-   if (rest < cut) {
-      printf("%s\n", s);
-   } else {
-      written = 0;
-      while (rest > 0) {
-         /* print alignment spaces */
-         if (p != s) {
-            printf("%*s", align, " ");
-         }
-         /* skip leading spaces of text */
-         while ((*p == ' ' || *p == '\t') && *p != 0) {
-            p++;
-            rest--;
+   if (o->ifc_type == TRAP_IFC_TYPE_BLACKHOLE) {
+      (*sent) = count;
+      return TRAP_E_OK;
+   }
+
+   if ((o->bufferswitch == 0) || (o->shard == TRAP_SHARD_HASH) || (o->threadbufs != 0)) {
+      /* no buffering or buffer chosen by every message, messages are stored separately */
+      for (i = 0; i < count; i++) {
+         result = trap_store_into_buffer(ctx, ifc, data[i], sizes[i], timeout, 0);
+         if (result != TRAP_E_OK) {
+            break;
          }
-         /* find word boundary */
-         if (rest > cut) {
-            for (tmp = cut; tmp > 0; tmp--) {
-               switch (p[tmp]) {
-               case '.':
-               case ',':
-               case ';':
-                  /* let this character on the end of line */
-                  tmp += 1;
-                  goto write;
-               case ' ':
-               case '\t':
-               case '\n':
-                  goto write;
-               default:
-                  break;
-               }
+      }
+      (*sent) = i;
+      return result;
+   }
+
+   trap_out_buffer_lock(o);
+   /* we send buffer before timeout, no need to flush it */
+   __atomic_store_n(&o->bufferflush, 1, __ATOMIC_RELAXED);
+
+   for (i = 0; i < count; i++) {
+      needed_size = sizes[i] + TRAP_MSG_HEADER_SIZE(o);
+      if (needed_size > TRAP_OUT_BUFFER_SPACE(o)) {
+         result = trap_errorf(ctx, TRAP_E_MEMORY, "Buffer is too small for this message. Skipping...");
+         break;
+      }
+      if (o->buffer_index <= TRAP_OUT_BUFFER_SPACE(o)) {
+         freespace = TRAP_OUT_BUFFER_SPACE(o) - o->buffer_index;
+      } else {
+         freespace = 0;
+      }
+      if (freespace < needed_size) {
+         result = trap_send_out_buffer(ctx, ifc, timeout);
+         if (result == TRAP_E_IO_ERROR) {
+            /* no client, behave the same way as trap_store_into_buffer(),
+             * the message is stored so it is counted as accepted */
+            insert_into_buffer(o, data[i], sizes[i]);
+            result = TRAP_E_TIMEOUT;
+            i++;
+            break;
+         } else if (result != TRAP_E_OK) {
+            if (result == TRAP_E_TIMEOUT) {
+               TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].dropped_message, 1);
             }
-         } else {
-            tmp = cut;
-         }
-write:
-         if (tmp == 0) {
-            /* failed to find word separator and it is useless
-             * to write 0 chars -> write the whole line */
-            tmp = cut;
+            break;
          }
-         written = printf("%.*s\n", tmp, p);
-         rest -= written;
-         p += written - 1;
       }
+      insert_into_buffer(o, data[i], sizes[i]);
    }
+
+   trap_out_buffer_unlock(o);
+   (*sent) = i;
+   return result;
 }
 
 /**
- * Print helper for formatting multiline text of help.
- *
- * Multiline text means that the string contains '\n'.
- * print_aligned() is used for line breaking.
+ * @}
+ */
+
+/**
+ * Period of autoflush checks of an interface, at least 1 us.
+ */
+#define TRAP_AUTOFLUSH_PERIOD(tm) ((uint64_t) ((tm) > 0 ? (tm) : 1))
+
+/**
+ * Restore the order of heap of autoflush deadlines after the deadline of the element i was increased.
  *
- * \param[in] s String to print (e.g. description).
- * \param[in] align The number of spaces that should be add after line-break.
- * \param[in] cut Approximate (minimal) length of string that is printed on the line.
- * Line-break is added if needed, after the current word.
+ * \param[in,out] h  array of n elements ordered as a binary min-heap by deadline
+ * \param[in] n      number of elements
+ * \param[in] i      index of the changed element
  */
-static void print_aligned_multiline(const char *s, uint16_t align, uint16_t cut)
+static void trap_autoflush_heap_down(struct out_ifc_timeout_s *h, int n, int i)
 {
-   const char *eol = NULL, *sol = s;
-   int bufsize = 512, linewidth;
-   char *buffer = calloc(1, bufsize);
-   if (buffer == NULL) {
-      VERBOSE(CL_ERROR, "Failed to allocate buffer for printing.");
-      goto failed;
-   }
-   do {
-      eol = strchr(sol, '\n');
-      if (eol == NULL) {
-         /* end of text */
-         linewidth = strlen(sol);
-      } else {
-         linewidth = eol - sol;
-      }
+   struct out_ifc_timeout_s tmp;
+   int child;
 
-      if (linewidth >= bufsize) {
-         buffer = realloc(buffer, linewidth + 1);
-         bufsize = linewidth + 1;
-         if (buffer == NULL) {
-            VERBOSE(CL_ERROR, "Failed to allocate buffer for printing.");
-            goto failed;
-         }
+   while ((child = 2 * i + 1) < n) {
+      if ((child + 1 < n) && (h[child + 1].deadline < h[child].deadline)) {
+         child++;
       }
-      strncpy(buffer, sol, linewidth);
-      if (buffer[linewidth - 1] == '\n') {
-         buffer[linewidth - 1] = 0;
-      } else {
-         buffer[linewidth] = 0;
+      if (h[i].deadline <= h[child].deadline) {
+         break;
       }
-      print_aligned(buffer, 0, cut);
-      sol = eol + 1;
-   } while (eol != NULL);
-
-failed:
-   free(buffer);
+      tmp = h[i];
+      h[i] = h[child];
+      h[child] = tmp;
+      i = child;
+   }
 }
 
 /**
- * Get size of terminal.
+ * Function to initialize or change the array of structures with information about timeouts
+ * on output interfaces.
  *
- * \return Returns columns of terminal.
+ * The array is ordered as a heap by deadlines, the first deadline of every
+ * interface is one autoflush timeout from now.
+ *
+ * @param[in,out] ctx         pointer to the private libtrap context data (trap_ctx_init())
+ * @return Number of output interfaces, where the timeout is set.
  */
-static uint16_t get_terminal_width()
+static inline int trap_init_ifcs_timeouts(trap_ctx_priv_t *ctx)
 {
-   struct winsize ws;
-   if (ioctl(1, TIOCGWINSZ, &ws) == 0) {
-      if (ws.ws_col > 0) {
-         return ws.ws_col - 1;
-      } else {
-         return 0;
+   int i, idx, res;
+   struct out_ifc_timeout_s *out_ifc_timeout = ctx->ifc_autoflush_timeout;
+   uint64_t now = trap_monotonic_us();
+   idx = 0;
+   for (i = 0; i < ctx->num_ifc_out; i++) {
+      if ((ctx->out_ifc_list[i].timeout != TRAP_NO_AUTO_FLUSH) && (ctx->out_ifc_list[i].bufferswitch != 0)) {
+         out_ifc_timeout[idx].idx = i;
+         // Try lock updating of timeout, it could be changing, do not block
+         res = pthread_mutex_trylock(&ctx->out_ifc_list[i].ifc_mtx);
+         out_ifc_timeout[idx].tm = ctx->out_ifc_list[i].timeout;
+         if (res == 0)
+            pthread_mutex_unlock(&ctx->out_ifc_list[i].ifc_mtx);
+         out_ifc_timeout[idx].deadline = now + TRAP_AUTOFLUSH_PERIOD(out_ifc_timeout[idx].tm);
+         out_ifc_timeout[idx].last_check = now;
+         out_ifc_timeout[idx].last_bytes = TRAP_CNT_GET(ctx->out_ifc_list[i].stored_bytes);
+         out_ifc_timeout[idx].rate = 0;
+         out_ifc_timeout[idx].periodic = 0;
+         idx++;
       }
    }
-   return 0;
+   for (i = idx / 2 - 1; i >= 0; i--) {
+      trap_autoflush_heap_down(out_ifc_timeout, idx, i);
+   }
+   // All changes updated, set to zero
+   if (pthread_rwlock_wrlock(&ctx->context_lock) != 0) {
+      VERBOSE(CL_ERROR, "Locking of context failed. %s", __func__);
+   }
+   ctx->ifc_change = 0;
+   pthread_rwlock_unlock(&ctx->context_lock);
+   return idx;
 }
 
 /**
- * Get name of this process/module.
+ * Choose autoflush timeout of output interface with "autoflush=adaptive".
  *
- * \return Allocated string. If it is not possible to get the name,
- * "module" is returned.
+ * When the buffer is expected to be filled within flush_latency at the
+ * current rate of messages, it is checked every flush_latency / 2 and
+ * flushed only if no message came since the last check (as with a fixed
+ * timeout), so full buffers are sent and a partial buffer waits at most
+ * flush_latency.  Otherwise, the buffer is flushed every flush_latency
+ * to bound the latency of messages even though they keep coming.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in,out] t     autoflush entry of the interface
+ * \param[in] now       current time (CLOCK_MONOTONIC, us)
  */
-char *get_module_name(void)
+static void trap_autoflush_adapt(trap_ctx_priv_t *ctx, struct out_ifc_timeout_s *t, uint64_t now)
 {
-   size_t bufsize = 1024, rv;
-   char buffer[bufsize], *p, *ret;
-   FILE *f = fopen("/proc/self/cmdline", "r");
-   if (f == NULL) {
-      /* unknown name */
-      return strdup("module");
+   trap_output_ifc_t *o = &ctx->out_ifc_list[t->idx];
+   /* written by producers without ifc_mtx */
+   uint64_t bytes = TRAP_CNT_GET(o->stored_bytes);
+   double rate;
+
+   if (now <= t->last_check) {
+      return;
    }
-   rv = fread(buffer, 1, bufsize - 1, f);
-   buffer[rv] = 0;
-   if (rv > 0) {
-      p = buffer;
-      /* skip to the next argument if this one matches regex /^python[23]?/ */
-      ret = strstr(p, "python");
-      if (ret != NULL && ((ret[6] == 0) || (ret[6] == '2') || (ret[6] == '3'))) {
-         p = strchr(p, 0);
-         p += 1;
-      }
-      ret = strrchr(p, '/');
-      if (ret == NULL) {
-         /* '/' was not found, module_name does not contain path */
-         ret = strdup(p);
-      } else {
-         /* skip found '/' */
-         p = ret + 1;
-         /* skip "lt-" prefix of libtool */
-         if (p[0] == 'l' && p[1] == 't' && p[2] == '-') {
-            p += 3;
-         }
-         /* return the result */
-         ret = strdup(p);
-      }
+   rate = (double) (bytes - t->last_bytes) / (now - t->last_check);
+   /* smooth bursts, but follow decrease of traffic quickly enough */
+   t->rate = (t->rate * 3 + rate) / 4;
+   t->last_check = now;
+   t->last_bytes = bytes;
+
+   t->periodic = (t->rate * o->flush_latency < o->buffer_size);
+   pthread_mutex_lock(&o->ifc_mtx);
+   o->timeout = t->periodic ? o->flush_latency : o->flush_latency / 2;
+   pthread_mutex_unlock(&o->ifc_mtx);
+}
+
+/**
+ * Flush the buffer of output interface if nothing was sent since its last check.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] t         autoflush entry of the interface
+ * \param[in] late      time in microseconds elapsed since the deadline of the check
+ */
+static void trap_automatic_flush_ifc(trap_ctx_priv_t *ctx, const struct out_ifc_timeout_s *t, uint64_t late)
+{
+   int ifc = t->idx;
+   trap_output_ifc_t *o = &ctx->out_ifc_list[ifc];
+   int bin = 0;
+
+   pthread_mutex_lock(&o->ifc_mtx);
+   /* buffers of producer threads are not covered by bufferflush, the fast path sets it without ifc_mtx */
+   if (__atomic_exchange_n(&o->bufferflush, 0, __ATOMIC_RELAXED) == 0 || t->periodic != 0 || o->threadbufs != 0) {
+      pthread_mutex_unlock(&o->ifc_mtx);
+      // No event on the interface, flushing the buffer
+      trap_ctx_send_flush((trap_ctx_t *) ctx, ifc);
+      TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].autoflush, 1);
+      while (late != 0 && bin < TRAP_AUTOFLUSH_LATENCY_BINS - 1) {
+         late >>= 1;
+         bin++;
+      }
+      TRAP_CNT_ADD(ctx->out_ifc_stats[ifc].autoflush_latency[bin], 1);
    } else {
-      /* unknown name */
-      ret = strdup("module");
+      // Buffer was sent before timeout has elapsed, no need to flush the buffer
+      pthread_mutex_unlock(&o->ifc_mtx);
    }
-   fclose(f);
-   return ret;
 }
 
-/** Print common TRAP help message.
- * The help message contains information from module_info and describes common
- * TRAP command-line parameters.
- * @param[in] module_info Pointer to struct containing info about the module.
+/**
+ * Handle the timeouts on output interfaces and flush buffer after timeout is reached.
+ *
+ * The thread sleeps until the nearest deadline of the heap ctx->ifc_autoflush_timeout
+ * (CLOCK_MONOTONIC, absolute time), so the period of autoflush does not drift
+ * and it can be shorter than a millisecond.
+ *
+ * @return NULL
  */
-void trap_print_help(const trap_module_info_t *module_info)
+static void *trap_automatic_flush_thr(void *arg)
 {
-   char *pager = NULL, *output_format = NULL;
-   const char *temp_env;
-   int pager_fds[2];
-   uint32_t i, written = 0, tmp = 0, cols;
-   pid_t p;
-   uint8_t adit_param = 0, opt_param = 0;
-   uint16_t align_def = 0, align_opt = 0;
+   int n;
+   uint64_t now;
+   struct out_ifc_timeout_s *top;
+   struct timespec ts;
+   trap_ctx_priv_t *ctx = (trap_ctx_priv_t *) arg;
 
-   /* Decide which format of output will be used according to the environment variable */
-   temp_env = getenv("LIBTRAP_OUTPUT_FORMAT");
-   if (temp_env != NULL) {
-      output_format = strdup(temp_env);
-   }
-   if (output_format != NULL) {
-      if (strcmp(output_format, "json") == 0) {
-         trap_convert_module_info_to_json(module_info);
-         free(output_format);
-         return;
-      }
-   }
-   /* output format is useless by now */
-   free(output_format);
+   n = trap_init_ifcs_timeouts(ctx);
 
-   cols = get_terminal_width();
-   if (cols == 0) {
-      cols = DEFAULT_MAX_TERMINAL_WIDTH;
-   }
+   while (1) {
+      if (__sync_add_and_fetch(&ctx->terminated, 0) != 0) {
+         break;
+      }
 
-   temp_env = getenv("PAGER");
-   if (temp_env != NULL) {
-      pager = strdup(temp_env);
-   }
+      if (pthread_rwlock_rdlock(&ctx->context_lock) != 0) {
+         VERBOSE(CL_ERROR, "Locking of context failed. %s", __func__);
+         break;
+      }
 
-   if ((pager == NULL) || (strcmp(pager, "") == 0)) {
-      goto output;
-   }
+      // Checking if automatic flushing or buffering was changed or disabled
+      if (ctx->ifc_change == 1) {
+         pthread_rwlock_unlock(&ctx->context_lock);
+         n = trap_init_ifcs_timeouts(ctx);
+      } else {
+         pthread_rwlock_unlock(&ctx->context_lock);
+      }
 
-   if (pipe(pager_fds) < 0) {
+      if (n != 0) {
+         top = &ctx->ifc_autoflush_timeout[0];
+         ts.tv_sec = top->deadline / 1000000;
+         ts.tv_nsec = (top->deadline % 1000000) * 1000;
+         if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+            /* interrupted, check termination and the deadline again */
+            continue;
+         }
+
+         // Process all interfaces whose deadline has elapsed
+         now = trap_monotonic_us();
+         while (top->deadline <= now) {
+            if (ctx->out_ifc_list[top->idx].autoflush_adaptive != 0) {
+               trap_autoflush_adapt(ctx, top, now);
+            }
+            trap_automatic_flush_ifc(ctx, top, now - top->deadline);
+
+            // Updating of timeout, it could be changing
+            pthread_mutex_lock(&ctx->out_ifc_list[top->idx].ifc_mtx);
+            top->tm = ctx->out_ifc_list[top->idx].timeout;
+            pthread_mutex_unlock(&ctx->out_ifc_list[top->idx].ifc_mtx);
+            top->deadline += TRAP_AUTOFLUSH_PERIOD(top->tm);
+            if (top->deadline <= now) {
+               /* the thread was delayed for more than the whole period, do not catch up */
+               top->deadline = now + TRAP_AUTOFLUSH_PERIOD(top->tm);
+            }
+            trap_autoflush_heap_down(ctx->ifc_autoflush_timeout, n, 0);
+         }
+      } else {
+         // Sleep for defined time, default 2 seconds
+         if (sleep(TRAP_NO_IFC_SLEEP)) {
+            break;
+         }
+      }
+   }
+
+   pthread_exit(NULL);
+}
+
+/** Set section for trap_print_help()
+ *
+ * \param [in] level  0 for default info about module, 1 for info about IFC specifier
+ */
+void trap_set_help_section(int level)
+{
+   trap_help_spec = level;
+}
+
+/** Initialization function.
+ * Create and initialize all interfaces. This function parses command-line
+ * arguments; it extracts arguments it needs to set up interfaces and returns
+ * the rest (argc and argv are modified).
+ * @param[in,out] argc Pointer to number of command-line arguments.
+ * @param[in,out] argv Command-line arguments.
+ * @param[out] ifc_spec Structure with specification of interface types and
+ *                      their parameters.
+ * @return Error code (0 on success)
+ */
+int trap_parse_params(int *argc, char **argv, trap_ifc_spec_t *ifc_spec)
+{
+   uint32_t i, j, ifc_count = 0;
+   char *ifc_spec_str = NULL;
+   char *ifc_type = NULL;
+   char *p;
+   int rv = TRAP_E_OK;
+
+   if (ifc_spec == NULL) {
+      VERBOSE(CL_ERROR, "Bad pointer 'ifc_spec' passed to trap_parse_params().");
+      return TRAP_E_BAD_FPARAMS;
+   }
+
+   /* initialization of ifc_spec */
+   memset(ifc_spec, 0, sizeof(trap_ifc_spec_t));
+
+   // Look for -h (or --help) parameter
+   for (i = 0; i < *argc; i++) {
+      if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
+         if (i + 1 < *argc && ((strcmp(argv[i + 1], "trap") == 0) || (strcmp(argv[i + 1], "1") == 0))) {
+            trap_help_spec = 1;
+         }
+         // Remove parameter from argv and break
+         for (j = i; j + 1 < *argc; j++) {
+            argv[j] = argv[j + 1];
+         }
+         *argc -= 1;
+         return TRAP_E_HELP;
+      }
+   }
+
+   // Extract -i parameter (interface specifier)
+   for (i = 0; i < *argc-1; i++) {
+      if (argv[i] && strcmp(argv[i], "-i") == 0) {
+         ifc_spec_str = argv[i+1];
+         // Remove parameters from argv
+         for (j = i; j + 2 < *argc; j++) {
+            argv[j] = argv[j + 2];
+         }
+         *argc -= 2;
+         break;
+      }
+   }
+   if (ifc_spec_str == NULL) {
+      //return trap_errorf(ctx, TRAP_E_BADPARAMS, "Interface specifier (option -i) not found.");
+      trap_last_error = TRAP_E_BADPARAMS;
+      trap_last_error_msg = "Interface specifier (option -i) not found.";
+      return TRAP_E_BADPARAMS;
+   }
+
+   // Extract verbose level parameter (-v, -vv, -vvv)
+   for (i = 0; i < *argc; i++) {
+      // If param matches -v, -vv or -vvv, set verbosity level
+      if (strcmp(argv[i], "-v") == 0) {
+         trap_set_verbose_level(0);
+      } else if (strcmp(argv[i], "-vv") == 0) {
+         trap_set_verbose_level(1);
+      } else if (strcmp(argv[i], "-vvv") == 0) {
+         trap_set_verbose_level(2);
+      } else {
+         continue;
+      }
+      // Remove parameter from argv and break
+      for (j = i; j + 1 < *argc; j++) {
+         argv[j] = argv[j + 1];
+      }
+      *argc -= 1;
+      break;
+   }
+
+   /* count the number of IFC parameters, the format is:
+    * type1:param1:param1_2,type2:,type3:param3 */
+   p = ifc_spec_str;
+   while (p && *p != '\0') {
+      p = strchr(p, TRAP_IFC_DELIMITER);
+      if (p != NULL && *p == TRAP_IFC_DELIMITER) {
+         p++;
+      }
+      ifc_count++;
+   }
+
+   ifc_spec->types = calloc(ifc_count + 1, sizeof(*ifc_spec->types));
+   if (ifc_spec->types == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   ifc_spec->params = calloc(ifc_count, sizeof(char *));
+   if (ifc_spec->params == NULL) {
+      free(ifc_spec->types);
+      ifc_spec->types = NULL;
+      return TRAP_E_MEMORY;
+   }
+
+   p = ifc_spec_str;
+   for (i = 0; i < ifc_count; i++) {
+      /* set IFC type and skip to params */
+      if (p != NULL) {
+         ifc_spec->types[i] = p[0];
+         if (strlen(p) >= 2 && p[1] == TRAP_IFC_PARAM_DELIMITER) {
+            /* there is a param string to parse */
+            p += 2;
+            p = get_param_by_delimiter(p, &ifc_spec->params[i], TRAP_IFC_DELIMITER);
+         } else {
+            /* param was not passed, set an empty one */
+            ifc_spec->params[i] = strdup("");
+         }
+      } else {
+         /* unexpected error, p shouldn't be NULL */
+         VERBOSE(CL_ERROR, "Bad IFC_SPEC '%s'. See -h trap for help.", ifc_spec_str);
+         ifc_spec->params[i] = strdup("");
+      }
+      if (ifc_spec->params[i] == NULL) {
+         VERBOSE(CL_ERROR, "Allocation failed.");
+         rv = TRAP_E_MEMORY;
+         goto clean_on_fail;
+      }
+   }
+
+   /* check for unsupported IFCs */
+   for (i = 0; ifc_spec->types[i] != 0; ++i) {
+      for (ifc_type = trap_ifc_type_supported; *ifc_type != 0; ++ifc_type) {
+         if (*ifc_type == ifc_spec->types[i]) {
+            break;
+         }
+      }
+      if (*ifc_type == 0) {
+         /* not found */
+         VERBOSE(CL_ERROR, "Unsupported IFC type '%c'.", ifc_spec->types[i]);
+         rv = TRAP_E_BADPARAMS;
+         goto clean_on_fail;
+      }
+   }
+
+   trap_last_error = TRAP_E_OK;
+   trap_last_error_msg = default_err_msg[TRAP_E_OK];
+   return TRAP_E_OK;
+
+clean_on_fail:
+   for (i = 0; i < ifc_count; i++) {
+      /* set IFC type and skip to params */
+      if (ifc_spec->params[i] != NULL) {
+         free(ifc_spec->params[i]);
+         ifc_spec->params[i] = NULL;
+      }
+   }
+   if (ifc_spec->types != NULL) {
+      free(ifc_spec->types);
+   }
+   if (ifc_spec->params) {
+      free(ifc_spec->params);
+   }
+   memset(ifc_spec, 0, sizeof(trap_ifc_spec_t));
+   return rv;
+}
+
+/** Destructor of trap_ifc_spec_t structure.
+ * @param[in] ifc_spec trap_ifc_spec_t structure to clear.
+ * @return  Error code (0 on success)
+ */
+int trap_free_ifc_spec(trap_ifc_spec_t ifc_spec)
+{
+   int i;
+   if (ifc_spec.types == NULL) {
+      return trap_error(trap_glob_ctx, TRAP_E_BADPARAMS);
+   }
+   if (ifc_spec.params != NULL) {
+      for (i = 0; i < strlen(ifc_spec.types); i++) {
+         if (ifc_spec.params[i] != NULL) {
+            free(ifc_spec.params[i]);
+            ifc_spec.params[i] = NULL;
+         }
+      }
+      free(ifc_spec.params);
+      ifc_spec.params = NULL;
+   }
+   free(ifc_spec.types);
+   return trap_error(trap_glob_ctx, TRAP_E_OK);
+}
+
+void trap_free_ctx_t(trap_ctx_priv_t **ctx);
+
+/** Initialization function.
+ * Create and initialize all interfaces.
+ * @param[in] module_info Pointer to struct containing info about the module.
+ * @param[in] ifc_spec Structure with specification of interface types and
+ *                      their parameters.
+ * @return Error code (0 on success)
+ */
+int trap_init(trap_module_info_t *module_info, trap_ifc_spec_t ifc_spec)
+{
+   int le;
+   if ((trap_glob_ctx != NULL) && (trap_glob_ctx->initialized != 0)) {
+      return trap_error(trap_glob_ctx, TRAP_E_INITIALIZED);
+   }
+   trap_glob_ctx = trap_ctx_init(module_info, ifc_spec);
+   if (trap_glob_ctx == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   if (trap_glob_ctx->trap_last_error != TRAP_E_OK) {
+      le = trap_glob_ctx->trap_last_error;
+      strncpy(error_msg_buffer, trap_glob_ctx->trap_last_error_msg, MAX_ERROR_MSG_BUFF_SIZE - 1);
+
+      trap_finalize();
+      trap_free_ctx_t(&trap_glob_ctx);
+
+      /* restore error message that was lost by finalize&free */
+      trap_last_error_msg = error_msg_buffer;
+      trap_last_error = le;
+      return trap_last_error;
+   }
+   return trap_glob_ctx->trap_last_error;
+}
+
+
+/** Function to terminate module's operation.
+ * This function stops all read/write operations on all interfaces.
+ * Any waiting in trap_get_data and trap_send_data is interrupted and these
+ * functions return immediately with TRAP_E_TERMINATED.
+ * Any call of trap_get_data or trap_send_data after call of this function
+ * returns TRAP_E_TERMINATED.
+ *
+ * This function is used to terminate module's operation (asynchronously), e.g.
+ * in SIGTERM handler.
+ * @return Always TRAP_E_OK (0).
+ */
+int trap_terminate()
+{
+   int ret = trap_ctx_terminate(trap_glob_ctx);
+   if (trap_glob_ctx != NULL) {
+      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
+      trap_last_error = trap_glob_ctx->trap_last_error;
+   } else {
+      trap_last_error_msg = "No allocated global context.";
+      trap_last_error = ret;
+   }
+   return ret;
+}
+
+
+
+int trap_finalize()
+{
+   int ret;
+   ret = trap_ctx_finalize(((trap_ctx_t **) &trap_glob_ctx));
+   if (ret != TRAP_E_OK) {
+      if (trap_glob_ctx != NULL) {
+         trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
+         trap_last_error = trap_glob_ctx->trap_last_error;
+      } else {
+         trap_last_error_msg = "No allocated global context.";
+         trap_last_error = ret;
+      }
+   }
+   return ret;
+}
+
+
+/**
+ * \brief Get pointer to data stored in buffer (with headers) and mark buffer as clean.
+ *
+ */
+void trap_get_internal_buffer(trap_ctx_priv_t *ctx, uint16_t ifc_idx, const void **data, uint32_t *size)
+{
+   (*data) = ctx->in_ifc_list[ifc_idx].buffer;
+   (*size) = ctx->in_ifc_list[ifc_idx].buffer_full;
+
+   /* mark internal buffer as free for next reading */
+   ctx->in_ifc_list[ifc_idx].buffer_pointer = ctx->in_ifc_list[ifc_idx].buffer;
+   ctx->in_ifc_list[ifc_idx].buffer_full = 0;
+}
+
+/** Read data from input interface.
+ * Read a record from one of interfaces specified by `ifc_mask` and store
+ * pointer to it into `data`. If `ifc_mask` contains more than 1 interface,
+ * data are retrieve via parallel threads. In this case, resulting `data` is array
+ * of `trap_multi_result` number of elements same as number of interfaces (returned `size` is size of
+ * array in bytes --- number_of_interfaces * sizeof(trap_multi_result)).
+ * If data are not available on any of specified
+ * interfaces, wait until data are available or `timeout` microseconds elapses.
+ * If `timeout` is equal to TRAP_WAIT, wait indefinitely. If `timeout` is equal to TRAP_NO_WAIT,
+ * function is non-blocking with no timeout.
+ * When function returns due to timeout, contents of `data` and `size` are undefined.
+ * @param[in] ifc_mask Mask of interfaces to listen on (if *i*-th bit is set, interface *i* is enabled).
+ * @param[out] data Pointer to data, you have to cast it to appropriate structure.
+ * @param[out] size Number of bytes of data.
+ * @param[in] timeout Timeout in microseconds.
+ * @return Error code - 0 on success, TRAP_E_TIMEOUT if timeout elapses.
+ */
+int trap_get_data(uint32_t ifc_mask, const void **data, uint16_t *size, int timeout)
+{
+   int counter;
+   int selected_mask = 0x1;
+   int res;
+   /* timeout */
+   for (counter = 0; counter < trap_glob_ctx->num_ifc_in; ++counter) {
+      if ((ifc_mask & selected_mask) != 0) {
+         trap_glob_ctx->in_ifc_list[counter].datatimeout = timeout;
+      }
+      selected_mask <<= 1;
+   }
+   /* receive data */
+   if (trap_glob_ctx->num_ifc_in > 1) {
+      res = trap_ctx_multi_recv((trap_ctx_t *) trap_glob_ctx, ifc_mask, data, size);
+      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
+      trap_last_error = trap_glob_ctx->trap_last_error;
+   } else {
+      /* libtrap initialized with only one IFC */
+      res = trap_ctx_recv((trap_ctx_t *) trap_glob_ctx, 0, data, size);
+      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
+      trap_last_error = trap_glob_ctx->trap_last_error;
+   }
+   return res;
+}
+
+#define SEND_DATA() do { \
+   int res = trap_ctx_send((trap_ctx_t *) trap_glob_ctx, ifcidx, data, size); \
+   if (res != TRAP_E_NOT_INITIALIZED) { \
+      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;  \
+      trap_last_error = trap_glob_ctx->trap_last_error; \
+   } \
+   return res; \
+} while (0);
+
+int trap_send_data(unsigned int ifcidx, const void *data, uint16_t size, int timeout)
+{
+   trap_glob_ctx->out_ifc_list[ifcidx].datatimeout = timeout;
+   SEND_DATA()
+}
+
+int trap_send(uint32_t ifcidx, const void *data, uint16_t size)
+{
+   SEND_DATA()
+}
+
+#undef SEND_DATA
+
+int trap_recv(uint32_t ifcidx, const void **data, uint16_t *size)
+{
+   int res;
+   res = trap_ctx_recv((trap_ctx_t *) trap_glob_ctx, ifcidx, data, size);
+   if (res != TRAP_E_NOT_INITIALIZED) {
+      trap_last_error_msg = trap_glob_ctx->trap_last_error_msg;
+      trap_last_error = trap_glob_ctx->trap_last_error;
+   }
+   return res;
+}
+
+
+/** Set verbosity level.
+ * Verbosity levels are:
+ *   - -3 - errors
+ *   - -2 - warnings
+ *   - -1 - notices (default)
+ *   -  0 - verbose
+ *   -  1 - more verbose
+ *   -  2 - even more verbose
+ *
+ * @param[in] level Desired level of verbosity.
+ */
+void trap_set_verbose_level(int level)
+{
+   trap_verbose = level;
+}
+
+/** Get verbosity level.
+ * See trap_set_verbose_level for list of levels.
+ * @return Verbosity level currently set in the library.
+ */
+int trap_get_verbose_level()
+{
+   return trap_verbose;
+}
+
+extern char *environ[];
+
+void trap_json_print_string(char *str)
+{
+   printf("\"");
+   if (str != NULL) {
+      while (*str != 0) {
+         if (*str == '\n') {
+            printf("\\n");
+         } else if (*str == '\t') {
+            printf(" ");
+         } else {
+            printf("%c", *str);
+         }
+         str++;
+      }
+   }
+   printf("\"");
+}
+
+void trap_convert_module_info_to_json(const trap_module_info_t *info)
+{
+   int i = 0;
+
+   printf("{\"name\":");
+   trap_json_print_string(info->name);
+   printf(",\"description\":");
+   trap_json_print_string(info->description);
+   printf(",\"num_ifc_in\":%u,\"num_ifc_out\":%u,\"params\":[",
+         info->num_ifc_in, info->num_ifc_out);
+
+   while (info->params[i] != NULL) {
+      if (i != 0) {
+         printf(",");
+      }
+      printf("{\"short_opt\":\"%c\",\"long_opt\":", info->params[i]->short_opt);
+      trap_json_print_string(info->params[i]->long_opt);
+      printf(",\"description\":");
+      trap_json_print_string(info->params[i]->description);
+      printf(",\"argument_type\":");
+      trap_json_print_string(info->params[i]->argument_type);
+      printf(",\"mandatory_argument\": %d}", info->params[i]->param_required_argument);
+      i++;
+   }
+   printf("]}\n");
+}
+
+/**
+ * Print helper for formatting text of help.
+ *
+ * \param[in] s String to print (e.g. description).
+ * \param[in] align The number of spaces that should be add after line-break.
+ * \param[in] cut Approximate (minimal) length of string that is printed on the line.
+ * Line-break is added if needed, after the current word.
+ */
+static void print_aligned(const char *s, uint16_t align, uint16_t cut)
+{
+   int32_t tmp = 0, rest, written;
+   const char *p = s;
+
+   rest = strlen(s);
+   if (rest < cut) {
+      printf("%s\n", s);
+   } else {
+      written = 0;
+      while (rest > 0) {
+         /* print alignment spaces */
+         if (p != s) {
+            printf("%*s", align, " ");
+         }
+         /* skip leading spaces of text */
+         while ((*p == ' ' || *p == '\t') && *p != 0) {
+            p++;
+            rest--;
+         }
+         /* find word boundary */
+         if (rest > cut) {
+            for (tmp = cut; tmp > 0; tmp--) {
+               switch (p[tmp]) {
+               case '.':
+               case ',':
+               case ';':
+                  /* let this character on the end of line */
+                  tmp += 1;
+                  goto write;
+               case ' ':
+               case '\t':
+               case '\n':
+                  goto write;
+               default:
+                  break;
+               }
+            }
+         } else {
+            tmp = cut;
+         }
+write:
+         if (tmp == 0) {
+            /* failed to find word separator and it is useless
+             * to write 0 chars -> write the whole line */
+            tmp = cut;
+         }
+         written = printf("%.*s\n", tmp, p);
+         rest -= written;
+         p += written - 1;
+      }
+   }
+}
+
+/**
+ * Print helper for formatting multiline text of help.
+ *
+ * Multiline text means that the string contains '\n'.
+ * print_aligned() is used for line breaking.
+ *
+ * \param[in] s String to print (e.g. description).
+ * \param[in] align The number of spaces that should be add after line-break.
+ * \param[in] cut Approximate (minimal) length of string that is printed on the line.
+ * Line-break is added if needed, after the current word.
+ */
+static void print_aligned_multiline(const char *s, uint16_t align, uint16_t cut)
+{
+   const char *eol = NULL, *sol = s;
+   int bufsize = 512, linewidth;
+   char *buffer = calloc(1, bufsize);
+   if (buffer == NULL) {
+      VERBOSE(CL_ERROR, "Failed to allocate buffer for printing.");
+      goto failed;
+   }
+   do {
+      eol = strchr(sol, '\n');
+      if (eol == NULL) {
+         /* end of text */
+         linewidth = strlen(sol);
+      } else {
+         linewidth = eol - sol;
+      }
+
+      if (linewidth >= bufsize) {
+         buffer = realloc(buffer, linewidth + 1);
+         bufsize = linewidth + 1;
+         if (buffer == NULL) {
+            VERBOSE(CL_ERROR, "Failed to allocate buffer for printing.");
+            goto failed;
+         }
+      }
+      strncpy(buffer, sol, linewidth);
+      if (buffer[linewidth - 1] == '\n') {
+         buffer[linewidth - 1] = 0;
+      } else {
+         buffer[linewidth] = 0;
+      }
+      print_aligned(buffer, 0, cut);
+      sol = eol + 1;
+   } while (eol != NULL);
+
+failed:
+   free(buffer);
+}
+
+/**
+ * Get size of terminal.
+ *
+ * \return Returns columns of terminal.
+ */
+static uint16_t get_terminal_width()
+{
+   struct winsize ws;
+   if (ioctl(1, TIOCGWINSZ, &ws) == 0) {
+      if (ws.ws_col > 0) {
+         return ws.ws_col - 1;
+      } else {
+         return 0;
+      }
+   }
+   return 0;
+}
+
+/**
+ * Get name of this process/module.
+ *
+ * \return Allocated string. If it is not possible to get the name,
+ * "module" is returned.
+ */
+char *get_module_name(void)
+{
+   size_t bufsize = 1024, rv;
+   char buffer[bufsize], *p, *ret;
+   FILE *f = fopen("/proc/self/cmdline", "r");
+   if (f == NULL) {
+      /* unknown name */
+      return strdup("module");
+   }
+   rv = fread(buffer, 1, bufsize - 1, f);
+   buffer[rv] = 0;
+   if (rv > 0) {
+      p = buffer;
+      /* skip to the next argument if this one matches regex /^python[23]?/ */
+      ret = strstr(p, "python");
+      if (ret != NULL && ((ret[6] == 0) || (ret[6] == '2') || (ret[6] == '3'))) {
+         p = strchr(p, 0);
+         p += 1;
+      }
+      ret = strrchr(p, '/');
+      if (ret == NULL) {
+         /* '/' was not found, module_name does not contain path */
+         ret = strdup(p);
+      } else {
+         /* skip found '/' */
+         p = ret + 1;
+         /* skip "lt-" prefix of libtool */
+         if (p[0] == 'l' && p[1] == 't' && p[2] == '-') {
+            p += 3;
+         }
+         /* return the result */
+         ret = strdup(p);
+      }
+   } else {
+      /* unknown name */
+      ret = strdup("module");
+   }
+   fclose(f);
+   return ret;
+}
+
+/** Print common TRAP help message.
+ * The help message contains information from module_info and describes common
+ * TRAP command-line parameters.
+ * @param[in] module_info Pointer to struct containing info about the module.
+ */
+void trap_print_help(const trap_module_info_t *module_info)
+{
+   char *pager = NULL, *output_format = NULL;
+   const char *temp_env;
+   int pager_fds[2];
+   uint32_t i, written = 0, tmp = 0, cols;
+   pid_t p;
+   uint8_t adit_param = 0, opt_param = 0;
+   uint16_t align_def = 0, align_opt = 0;
+
+   /* Decide which format of output will be used according to the environment variable */
+   temp_env = getenv("LIBTRAP_OUTPUT_FORMAT");
+   if (temp_env != NULL) {
+      output_format = strdup(temp_env);
+   }
+   if (output_format != NULL) {
+      if (strcmp(output_format, "json") == 0) {
+         trap_convert_module_info_to_json(module_info);
+         free(output_format);
+         return;
+      }
+   }
+   /* output format is useless by now */
+   free(output_format);
+
+   cols = get_terminal_width();
+   if (cols == 0) {
+      cols = DEFAULT_MAX_TERMINAL_WIDTH;
+   }
+
+   temp_env = getenv("PAGER");
+   if (temp_env != NULL) {
+      pager = strdup(temp_env);
+   }
+
+   if ((pager == NULL) || (strcmp(pager, "") == 0)) {
+      goto output;
+   }
+
+   if (pipe(pager_fds) < 0) {
       fprintf(stderr, "pipe() failed.");
       goto output;
    }
 
-   p = fork();
-   if (p < 0) {
-      fprintf(stderr, "fork() failed.");
-      goto output;
-   } else if (p == 0) {
-      /* child - pager */
-      close(pager_fds[0]); /* close unused read end!!! important */
-      /* set write end of pipe as stdout for this child process */
-      dup2(pager_fds[1], STDOUT_FILENO);
-      close(pager_fds[1]); /* important */
-      goto output;
-   } else {
-      /* parent */
-      char *args[] = {pager, NULL};
-      close(pager_fds[1]); /* close unused write end!!! important */
-      /* set read end of pipe as stdin for this process */
-      dup2(pager_fds[0], STDIN_FILENO);
-      close(pager_fds[0]); /* already redirected to stdin */
-      execvp(args[0], args);
-      free(pager);
-      perror("exec failed");
-      exit(EXIT_FAILURE);
+   p = fork();
+   if (p < 0) {
+      fprintf(stderr, "fork() failed.");
+      goto output;
+   } else if (p == 0) {
+      /* child - pager */
+      close(pager_fds[0]); /* close unused read end!!! important */
+      /* set write end of pipe as stdout for this child process */
+      dup2(pager_fds[1], STDOUT_FILENO);
+      close(pager_fds[1]); /* important */
+      goto output;
+   } else {
+      /* parent */
+      char *args[] = {pager, NULL};
+      close(pager_fds[1]); /* close unused write end!!! important */
+      /* set read end of pipe as stdin for this process */
+      dup2(pager_fds[0], STDIN_FILENO);
+      close(pager_fds[0]); /* already redirected to stdin */
+      execvp(args[0], args);
+      free(pager);
+      perror("exec failed");
+      exit(EXIT_FAILURE);
+   }
+   return;
+output:
+   /* pager is useless by now */
+   free(pager);
+   printf("TRAP module, libtrap version: %s %s\n", trap_version, trap_git_version);
+   puts("===========================================");
+   if (trap_help_spec == 0) {
+      printf("Name: %s\n", module_info->name);
+      if (module_info->num_ifc_in == -1) {
+         printf("Inputs: variable\n");
+      } else {
+         printf("Inputs: %u\n", (module_info->num_ifc_in));
+      }
+      if (module_info->num_ifc_out == -1) {
+         printf("Outputs: variable\n");
+      } else {
+         printf("Outputs: %u\n", module_info->num_ifc_out);
+      }
+      printf("Description:\n  ");
+      print_aligned(module_info->description, 2, cols - 2);
+
+
+      /* print basic usage with module name */
+      char *module_name = get_module_name();
+      printf("\nUsage:  %s [COMMON]... ", module_name);
+      free(module_name);
+
+      if (module_info->params != NULL) {
+         i = 0;
+         while (module_info->params[i] != NULL) {
+            if (module_info->params[i]->short_opt == '-') {
+               adit_param = 1;
+            } else if ((module_info->params[i]->short_opt >= 'a' && module_info->params[i]->short_opt <= 'z')
+                       || (module_info->params[i]->short_opt >= 'A' && module_info->params[i]->short_opt <= 'Z')) {
+               opt_param = 1;
+            }
+            i++;
+         }
+      }
+
+      if (opt_param == 1) {
+         printf("[OPTIONS]... ");
+      }
+      if (adit_param == 1) {
+         printf("[ADDITIONAL]... ");
+      }
+      printf("\n");
+
+      align_def = strlen("LIBTRAP_OUTPUT_FORMAT") + 4;
+      align_opt = 0;
+
+      if (opt_param == 1) {
+         for (i = 0; module_info->params[i] != NULL; i++) {
+            if (module_info->params[i]->argument_type == NULL) {
+               continue;
+            }
+            if (HAVE_GETOPT_LONG && module_info->params[i]->long_opt != NULL) {
+               tmp = strlen(module_info->params[i]->long_opt) + strlen(module_info->params[i]->argument_type);
+            } else {
+               tmp = strlen(module_info->params[i]->argument_type);
+            }
+            if (tmp > align_opt) {
+               align_opt = tmp;
+            }
+         }
+         /* add additional chars as a space: */
+         align_opt += 14;
+
+         if (align_opt > align_def) {
+            align_def = align_opt;
+         }
+
+         printf("\nParameters of module [OPTIONS]:\n-------------------------------\n");
+
+         i = 0;
+         while (module_info->params[i] != NULL) {
+            /* Position parameters (params without option, instead of "-o arg" it is only "arg") are specified with '-' in short-opt */
+            if (module_info->params[i]->short_opt == '-') {
+               i++;
+               continue;
+            } else if (HAVE_GETOPT_LONG) {
+               if (isprint(module_info->params[i]->short_opt)) {
+                  written = printf("  -%c  --%s ", module_info->params[i]->short_opt,
+                                   module_info->params[i]->long_opt);
+               } else {
+                  written = printf("       --%s ", module_info->params[i]->long_opt);
+               }
+            } else {
+               written = printf("  -%c ", module_info->params[i]->short_opt);
+            }
+            switch (module_info->params[i]->param_required_argument) {
+            case required_argument:
+               written += printf("<%s>", module_info->params[i]->argument_type);
+               break;
+            case optional_argument:
+               written += printf("[%s]", module_info->params[i]->argument_type);
+               break;
+            case no_argument:
+               written += printf(" ");
+               break;
+            }
+            if (written < align_def) {
+               printf("%*s", align_def - written, " ");
+            }
+
+            print_aligned(module_info->params[i]->description, align_def, cols - align_def);
+            /* empty line after param */
+            puts("");
+
+            i++;
+         }
+      }
+
+      /* If the module has some position parameters, their section is printed */
+      if (adit_param == 1) {
+         printf("\nAdditional parameters of module [ADDITIONAL]:\n---------------------------------------------\n");
+
+         i = 0;
+         while (module_info->params[i] != NULL) {
+            if (module_info->params[i]->short_opt == '-') {
+               printf("  %s", module_info->params[i]->description);
+               if (module_info->params[i]->param_required_argument == required_argument) {
+                  printf(" (data type: <%s>)", module_info->params[i]->argument_type);
+               }
+               printf("\n\n");
+            }
+            i++;
+         }
+      }
+
+      printf("\nCommon TRAP parameters [COMMON]:\n--------------------------------\n");
+
+#define X(param, text, align, cut) do { \
+  written = printf(param); \
+  if (written < align_def) { \
+    printf("%*s", align - written, " "); \
+  } \
+  print_aligned(text, align, cut); \
+  puts(""); \
+} while (0)
+
+      X("  -h [trap,1]",
+        "If no argument, print this message. If \"trap\" or 1 is given, print "
+        "TRAP help.",
+        align_def, cols - align_def);
+
+      X("  -i IFC_SPEC",
+        "Specification of interface types and their parameters, "
+        "see \"-h trap\" (mandatory parameter).",
+        align_def, cols - align_def);
+
+      X("  -v", "Be verbose.", align_def, cols - align_def);
+      X("  -vv", "Be more verbose.", align_def, cols - align_def);
+      X("  -vvv", "Be even more verbose.", align_def, cols - align_def);
+
+      puts("\nEnvironment variables that affects output:\n------------------------------------------");
+      X("  LIBTRAP_OUTPUT_FORMAT", "If set to \"json\", information about module is printed in JSON format.",
+        align_def, cols - align_def);
+      X("  PAGER", "Show the help output in the set PAGER.",
+        align_def, cols - align_def);
+      X("  TRAP_SOCKET_DIR", "Change path to socket directory (default: " DEFAULTSOCKETDIR ").",
+        align_def, cols - align_def);
+
+#undef X
+   } else if (trap_help_spec != 0) {
+      trap_print_ifc_spec_help();
+   }
+}
+
+/** Print help about interface specifier.
+ * Prints help message about format of interface specifier and description of
+ * all available interface types.
+ */
+void trap_print_ifc_spec_help()
+{
+   extern const char *trap_help_ifcspec;
+   uint32_t cols = get_terminal_width();
+   if (cols == 0) {
+      cols = DEFAULT_MAX_TERMINAL_WIDTH;
+   }
+
+   print_aligned_multiline(trap_help_ifcspec, 0, cols - 2);
+}
+
+////////////////////////////
+
+/**
+ * \brief Splitter of *params* string.
+ * Cut the first param, copy it into *dest* and returns pointer to the start of following
+ * parameter.
+ * \param[in] source  source string, typically *params*
+ * \param[out] dest  destination string, target of first parameter copying
+ * \param[in] delimiter  separator of values in *params*
+ * \return Pointer to the start of following parameter (char after delimiter). \note If NULL, no other parameter is present or error during allocation occured.
+ */
+char *trap_get_param_by_delimiter(const char *source, char **dest, const char delimiter)
+{
+   char *param_end = NULL;
+   unsigned int param_size = 0;
+
+   if (source == NULL) {
+      return NULL;
+   }
+
+   param_end = strchr(source, delimiter);
+   if (param_end == NULL) {
+      /* no delimiter found, copy the whole source */
+      *dest = strdup(source);
+      return NULL;
+   }
+
+   param_size = param_end - source;
+   *dest = (char *) calloc(1, param_size + 1);
+   if (*dest == NULL) {
+      return (NULL);
+   }
+   strncpy(*dest, source, param_size);
+   return param_end + 1;
+}
+
+inline char *get_param_by_delimiter(const char *source, char **dest, const char delimiter)
+{
+   return trap_get_param_by_delimiter(source, dest, delimiter);
+}
+
+void trap_set_abs_timespec(struct timeval *tm, struct timespec *tmnblk)
+{
+   if (tmnblk == NULL) {
+      /* we do not need tmnblk */
+      return;
+   }
+   /* tmnblk is used for timed wait on semaphore, this needs absolute time... */
+   if (clock_gettime(CLOCK_REALTIME, tmnblk) == -1) {
+      /* handle error */
+      tmnblk->tv_sec = 0;
+      tmnblk->tv_nsec = 0;
+   }
+
+   /* add relative timeout to the current time, tv_nsec must stay below 1 second */
+   tmnblk->tv_nsec += (long) (tm->tv_usec % 1000000) * 1000;
+   tmnblk->tv_sec += (time_t) (tm->tv_sec + (tm->tv_usec / 1000000) + (tmnblk->tv_nsec / 1000000000));
+   tmnblk->tv_nsec %= 1000000000;
+}
+
+void trap_set_timeouts(int timeout, struct timeval *tm, struct timespec *tmnblk)
+{
+   if ((timeout == TRAP_NO_WAIT) || (timeout == TRAP_HALFWAIT)) {
+      tm->tv_sec  = 0;
+      tm->tv_usec = 0;
+   } else if (timeout > TRAP_HALFWAIT) {
+      if (timeout == TRAP_WAIT) {
+         tm->tv_sec  = 0;
+         tm->tv_usec = 0;
+      } else {
+         tm->tv_sec  = timeout / 1000000;
+         tm->tv_usec = timeout % 1000000;
+      }
+   } else {
+      VERBOSE(CL_ERROR, "Setting timeout to %d failed", timeout);
+      return;
+   }
+   trap_set_abs_timespec(tm, tmnblk);
+}
+
+int trap_ifcctl(int8_t type, uint32_t ifcidx, int32_t request, ... /* arg */)
+{
+   va_list ap;
+   int res;
+   va_start(ap, request);
+   res = trap_ctx_vifcctl(trap_glob_ctx, type, ifcidx, request, ap);
+   va_end(ap);
+   return res;
+}
+
+void trap_send_flush(uint32_t ifc)
+{
+   trap_ctx_send_flush((trap_ctx_t *) trap_glob_ctx, ifc);
+}
+
+/**
+ * \addtogroup contextapi Context API
+ * @{
+ */
+
+trap_ctx_priv_t *trap_create_ctx_t()
+{
+        trap_ctx_priv_t *ctx = calloc(1, sizeof(trap_ctx_priv_t));
+        /* space for vars init with non-zero values */
+        return ctx;
+}
+
+void trap_free_ctx_t(trap_ctx_priv_t **ctx)
+{
+   int i;
+   trap_ctx_priv_t *c;
+
+   if (ctx == NULL) {
+      return;
+   }
+   c = (*ctx);
+   if (c == NULL) {
+      return;
+   }
+
+   /* free allocated counters */
+   free(c->in_ifc_stats);
+   c->in_ifc_stats = NULL;
+   free(c->out_ifc_stats);
+   c->out_ifc_stats = NULL;
+
+   // Destroy all interfaces
+   if ((c->num_ifc_in > 0) && (c->in_ifc_list != NULL)) {
+      for (i = 0; i < c->num_ifc_in; i++) {
+         if (c->in_ifc_list[i].buffer != NULL) {
+            trap_pool_put(c->in_ifc_list[i].buffer);
+            c->in_ifc_list[i].buffer = NULL;
+         }
+         trap_pool_put(c->in_ifc_list[i].compress_buf);
+         c->in_ifc_list[i].compress_buf = NULL;
+         trap_compress_free(c->in_ifc_list[i].compress, c->in_ifc_list[i].compress_state, 1);
+         c->in_ifc_list[i].compress_state = NULL;
+         if (c->in_ifc_list[i].data_fmt_spec != NULL) {
+            free(c->in_ifc_list[i].data_fmt_spec);
+            c->in_ifc_list[i].data_fmt_spec = NULL;
+         }
+         if (c->in_ifc_list[i].req_data_fmt_spec != NULL) {
+            free(c->in_ifc_list[i].req_data_fmt_spec);
+            c->in_ifc_list[i].req_data_fmt_spec = NULL;
+         }
+         if (c->in_ifc_list[i].destroy != NULL) {
+            c->in_ifc_list[i].destroy(c->in_ifc_list[i].priv);
+         }
+         pthread_mutex_destroy(&c->in_ifc_list[i].ifc_mtx);
+      }
+      free(c->in_ifc_list);
+      if (c->in_ifc_results != NULL) {
+         free(c->in_ifc_results);
+         c->in_ifc_results = NULL;
+      }
+   }
+
+   if ((c->num_ifc_out > 0) && (c->out_ifc_list != NULL)) {
+      for (i = 0; i < c->num_ifc_out; i++) {
+         trap_sendq_destroy(c, i);
+         if (c->out_ifc_list[i].destroy != NULL) {
+            c->out_ifc_list[i].destroy(c->out_ifc_list[i].priv);
+         }
+         trap_shard_free(&c->out_ifc_list[i]);
+         trap_stage_free(&c->out_ifc_list[i]);
+         tb_destroy(&c->out_ifc_list[i].tb);
+         c->out_ifc_list[i].buffer_header = NULL;
+         trap_pool_put(c->out_ifc_list[i].compress_buf);
+         c->out_ifc_list[i].compress_buf = NULL;
+         trap_compress_free(c->out_ifc_list[i].compress, c->out_ifc_list[i].compress_state, 0);
+         c->out_ifc_list[i].compress_state = NULL;
+         if (c->out_ifc_list[i].data_fmt_spec != NULL) {
+            free(c->out_ifc_list[i].data_fmt_spec);
+            c->out_ifc_list[i].data_fmt_spec = NULL;
+         }
+         pthread_mutex_destroy(&c->out_ifc_list[i].ifc_mtx);
+      }
+      free(c->out_ifc_list);
+      c->out_ifc_list = NULL;
+      free(c->ifc_autoflush_timeout);
+      c->ifc_autoflush_timeout = NULL;
+   }
+
+   free(c->in_ifc_results);
+   c->in_ifc_results = NULL;
+   free(c->in_ifc_pollfds);
+   c->in_ifc_pollfds = NULL;
+   free(c->in_ifc_pollidx);
+   c->in_ifc_pollidx = NULL;
+   free(c->in_ifc_retry);
+   c->in_ifc_retry = NULL;
+
+   if (c->service_ifc_name != NULL) {
+      free(c->service_ifc_name);
+      c->service_ifc_name = NULL;
+   }
+
+   pthread_rwlock_destroy(&c->context_lock);
+
+   free(c);
+   (*ctx) = NULL;
+}
+
+int trap_ctx_terminate(trap_ctx_t *ctx)
+{
+   int i;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   if ((c == NULL) || (c->terminated != 0)) {
+      return TRAP_E_OK;
    }
-   return;
-output:
-   /* pager is useless by now */
-   free(pager);
-   printf("TRAP module, libtrap version: %s %s\n", trap_version, trap_git_version);
-   puts("===========================================");
-   if (trap_help_spec == 0) {
-      printf("Name: %s\n", module_info->name);
-      if (module_info->num_ifc_in == -1) {
-         printf("Inputs: variable\n");
+
+   __sync_add_and_fetch(&c->terminated, 1);
+
+   for (i = 0; i < c->num_ifc_in; i++) {
+      if (c->in_ifc_list[i].terminate != NULL) {
+         c->in_ifc_list[i].terminate(c->in_ifc_list[i].priv);
       } else {
-         printf("Inputs: %u\n", (module_info->num_ifc_in));
+         return trap_errorf(c, TRAP_E_MEMORY, "IFC was not initialized.");
       }
-      if (module_info->num_ifc_out == -1) {
-         printf("Outputs: variable\n");
+   }
+   for (i = 0; i < c->num_ifc_out; i++) {
+      if (c->out_ifc_list[i].terminate != NULL) {
+         c->out_ifc_list[i].terminate(c->out_ifc_list[i].priv);
       } else {
-         printf("Outputs: %u\n", module_info->num_ifc_out);
+         return trap_errorf(c, TRAP_E_MEMORY, "IFC was not initialized.");
       }
-      printf("Description:\n  ");
-      print_aligned(module_info->description, 2, cols - 2);
-
+      if (c->out_ifc_list[i].sendq != NULL) {
+         /* wake up producer waiting for a free buffer */
+         pthread_mutex_lock(&c->out_ifc_list[i].sendq->mtx);
+         pthread_cond_broadcast(&c->out_ifc_list[i].sendq->cond_free);
+         pthread_mutex_unlock(&c->out_ifc_list[i].sendq->mtx);
+      }
+   }
+   return TRAP_E_OK;
+}
 
-      /* print basic usage with module name */
-      char *module_name = get_module_name();
-      printf("\nUsage:  %s [COMMON]... ", module_name);
-      free(module_name);
+/**
+ * Receive one message from input IFC, it is the body of trap_ctx_recv() with given timeout.
+ *
+ * \param[in,out] c    pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifcidx   index of input interface
+ * \param[out] data    pointer to received message
+ * \param[out] size    size of message
+ * \param[in] timeout  TRAP_WAIT | TRAP_NO_WAIT | timeout
+ * \return Error code, see trap_ctx_recv()
+ */
+static int trap_recv_ifc(trap_ctx_priv_t *c, uint32_t ifcidx, const void **data, uint16_t *size, int timeout)
+{
+   int ret_val = 0;
 
-      if (module_info->params != NULL) {
-         i = 0;
-         while (module_info->params[i] != NULL) {
-            if (module_info->params[i]->short_opt == '-') {
-               adit_param = 1;
-            } else if ((module_info->params[i]->short_opt >= 'a' && module_info->params[i]->short_opt <= 'z')
-                       || (module_info->params[i]->short_opt >= 'A' && module_info->params[i]->short_opt <= 'Z')) {
-               opt_param = 1;
-            }
-            i++;
+   if ((c->in_ifc_list[ifcidx].recv != NULL) && (c->in_ifc_list[ifcidx].priv != NULL)) {
+#ifndef DISABLE_BUFFERING
+       /* handle buffering */
+      ret_val = trap_read_from_buffer16(c, ifcidx, data, size, timeout);
+      return ret_val;
+#else
+      uint32_t newsize = 0;
+      ret_val = c->in_ifc_list[ifcidx].recv(c->in_ifc_list[ifcidx].priv, c->in_ifc_list[ifcidx].buffer, &newsize, timeout);
+      if (ret_val == TRAP_E_OK) {
+         TRAP_CNT_ADD(c->in_ifc_stats[ifcidx].recv_message, 1);
+         if (c->in_ifc_list[ifcidx].client_state == FMT_CHANGED) {
+            c->in_ifc_list[ifcidx].client_state = FMT_OK;
+            return TRAP_E_FORMAT_CHANGED;
          }
+      } else if (ret_val == TRAP_E_FORMAT_MISMATCH) {
+         return ret_val;
       }
+      (*size) = newsize;
+      (*data) = c->in_ifc_list[ifcidx].buffer;
+      return ret_val;
+#endif
+   } else {
+      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   }
+}
 
-      if (opt_param == 1) {
-         printf("[OPTIONS]... ");
-      }
-      if (adit_param == 1) {
-         printf("[ADDITIONAL]... ");
-      }
-      printf("\n");
+int trap_ctx_recv(trap_ctx_t *ctx, uint32_t ifcidx, const void **data, uint16_t *size)
+{
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   if ((c == NULL) || (c->initialized == 0)) {
+      return TRAP_E_NOT_INITIALIZED;
+   }
 
-      align_def = strlen("LIBTRAP_OUTPUT_FORMAT") + 4;
-      align_opt = 0;
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
 
-      if (opt_param == 1) {
-         for (i = 0; module_info->params[i] != NULL; i++) {
-            if (module_info->params[i]->argument_type == NULL) {
-               continue;
-            }
-            if (HAVE_GETOPT_LONG && module_info->params[i]->long_opt != NULL) {
-               tmp = strlen(module_info->params[i]->long_opt) + strlen(module_info->params[i]->argument_type);
-            } else {
-               tmp = strlen(module_info->params[i]->argument_type);
-            }
-            if (tmp > align_opt) {
-               align_opt = tmp;
-            }
-         }
-         /* add additional chars as a space: */
-         align_opt += 14;
+   if (ifcidx >= c->num_ifc_in) {
+      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   }
+   return trap_recv_ifc(c, ifcidx, data, size, c->in_ifc_list[ifcidx].datatimeout);
+}
 
-         if (align_opt > align_def) {
-            align_def = align_opt;
+int trap_ctx_recv_large(trap_ctx_t *ctx, uint32_t ifcidx, const void **data, uint32_t *size)
+{
+   int ret_val = 0;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   if ((c == NULL) || (c->initialized == 0)) {
+      return TRAP_E_NOT_INITIALIZED;
+   }
+
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
+
+   if (ifcidx >= c->num_ifc_in) {
+      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   }
+   if ((c->in_ifc_list[ifcidx].recv != NULL) && (c->in_ifc_list[ifcidx].priv != NULL)) {
+#ifndef DISABLE_BUFFERING
+      ret_val = trap_read_from_buffer(c, ifcidx, data, size, c->in_ifc_list[ifcidx].datatimeout);
+      return ret_val;
+#else
+      (*size) = 0;
+      ret_val = c->in_ifc_list[ifcidx].recv(c->in_ifc_list[ifcidx].priv, c->in_ifc_list[ifcidx].buffer, size, c->in_ifc_list[ifcidx].datatimeout);
+      (*data) = c->in_ifc_list[ifcidx].buffer;
+      if (ret_val == TRAP_E_OK) {
+         TRAP_CNT_ADD(c->in_ifc_stats[ifcidx].recv_message, 1);
+         if (c->in_ifc_list[ifcidx].client_state == FMT_CHANGED) {
+            c->in_ifc_list[ifcidx].client_state = FMT_OK;
+            return TRAP_E_FORMAT_CHANGED;
          }
+      }
+      return ret_val;
+#endif
+   } else {
+      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   }
+}
 
-         printf("\nParameters of module [OPTIONS]:\n-------------------------------\n");
+int trap_ctx_recv_burst(trap_ctx_t *ctx, uint32_t ifcidx, const void **data, uint16_t *sizes, unsigned int max, unsigned int *got)
+{
+   int ret_val = 0;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   if ((c == NULL) || (c->initialized == 0)) {
+      return TRAP_E_NOT_INITIALIZED;
+   }
 
-         i = 0;
-         while (module_info->params[i] != NULL) {
-            /* Position parameters (params without option, instead of "-o arg" it is only "arg") are specified with '-' in short-opt */
-            if (module_info->params[i]->short_opt == '-') {
-               i++;
+   if ((data == NULL) || (sizes == NULL) || (got == NULL) || (max == 0)) {
+      return trap_errorf(c, TRAP_E_BAD_FPARAMS, "Bad parameters of burst receive.");
+   }
+   (*got) = 0;
+
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
+
+   if (ifcidx >= c->num_ifc_in) {
+      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   }
+   if ((c->in_ifc_list[ifcidx].recv != NULL) && (c->in_ifc_list[ifcidx].priv != NULL)) {
+#ifndef DISABLE_BUFFERING
+      ret_val = trap_read_burst_from_buffer(c, ifcidx, data, sizes, max, got, c->in_ifc_list[ifcidx].datatimeout);
+      return ret_val;
+#else
+      /* without buffering, every received buffer contains just one message */
+      ret_val = trap_ctx_recv(ctx, ifcidx, data, sizes);
+      if ((ret_val == TRAP_E_OK) || (ret_val == TRAP_E_FORMAT_CHANGED)) {
+         (*got) = 1;
+      }
+      return ret_val;
+#endif
+   } else {
+      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   }
+}
+
+/**
+ * Get common timeout of input IFCs, it is the shortest timeout, TRAP_WAIT only if all IFCs wait.
+ *
+ * TRAP_HALFWAIT of input IFC is the same as TRAP_NO_WAIT.
+ *
+ * \param[in] c        pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifcs     array of indexes of input IFCs, NULL means all input IFCs
+ * \param[in] count    number of IFCs
+ * \return timeout
+ */
+static int trap_multi_timeout(trap_ctx_priv_t *c, const uint32_t *ifcs, uint32_t count)
+{
+   int timeout = TRAP_WAIT;
+   int t;
+   uint32_t i;
+
+   for (i = 0; i < count; i++) {
+      t = c->in_ifc_list[ifcs != NULL ? ifcs[i] : i].datatimeout;
+      if (t == TRAP_HALFWAIT) {
+         t = TRAP_NO_WAIT;
+      }
+      if ((t >= 0) && ((timeout == TRAP_WAIT) || (t < timeout))) {
+         timeout = t;
+      }
+   }
+   return timeout;
+}
+
+/**
+ * Receive messages from input IFCs that have data, wait until data arrive to any (or all) of them.
+ *
+ * IFCs are checked in the order of ifcs starting at position first.  At most
+ * one message is received from every IFC into ctx->in_ifc_results, IFCs
+ * without message keep their previous result.  Waiting is driven by poll()
+ * on descriptors of IFCs (#ifc_get_pollfd_func_t), other IFCs are checked
+ * after TRAP_MULTI_RECV_SLICE microseconds, the interval doubles up to
+ * TRAP_MULTI_RECV_SLICE_MAX while no data arrive; reader threads are not needed.
+ *
+ * In TRAP_MULTI_RECV_ALL mode, result_code of IFCs must be set to
+ * TRAP_E_TIMEOUT by the caller, IFCs with other result are not read again.
+ *
+ * \param[in,out] c    pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifcs     array of indexes of input IFCs, NULL means all input IFCs
+ * \param[in] count    number of IFCs
+ * \param[in] first    position in ifcs where to start
+ * \param[in] timeout  TRAP_WAIT | TRAP_NO_WAIT | timeout
+ * \param[in] mode     TRAP_MULTI_RECV_ONE | TRAP_MULTI_RECV_ANY | TRAP_MULTI_RECV_ALL
+ * \param[out] last    position in ifcs of the last received message
+ * \return TRAP_E_OK when at least one result was received (all results in
+ * TRAP_MULTI_RECV_ALL mode), TRAP_E_TIMEOUT, or TRAP_E_TERMINATED
+ */
+static int trap_multi_recv_ready(trap_ctx_priv_t *c, const uint32_t *ifcs, uint32_t count, uint32_t first,
+                                 int timeout, int mode, uint32_t *last)
+{
+   uint64_t entry_time = trap_monotonic_us();
+   uint64_t now, wait = 0, slice = TRAP_MULTI_RECV_SLICE;
+   uint32_t k, idx, ifc, got = 0, done = 0;
+   int res, ready, unpollable;
+   struct pollfd *pfd;
+   trap_input_ifc_t *in;
+   trap_multi_result_t *r;
+
+   while (__sync_add_and_fetch(&c->terminated, 0) == 0) {
+      /* pollfds are in the order of checking, negative fd (TRAP_IFC_POLL_*) is ignored by poll() */
+      ready = 0;
+      unpollable = 0;
+      for (k = 0; k < count; k++) {
+         idx = (first + k) % count;
+         ifc = (ifcs != NULL) ? ifcs[idx] : idx;
+         in = &c->in_ifc_list[ifc];
+         pfd = &c->in_ifc_pollfds[k];
+         c->in_ifc_pollidx[k] = idx;
+         pfd->events = POLLIN;
+         pfd->revents = 0;
+         if ((mode == TRAP_MULTI_RECV_ALL) && (c->in_ifc_results[ifc].result_code != TRAP_E_TIMEOUT)) {
+            /* the IFC has its result, it is ignored by poll() and skipped below */
+            pfd->fd = TRAP_IFC_POLL_NONE;
+            continue;
+         }
+         if (in->buffer_full > 0) {
+            pfd->fd = TRAP_IFC_POLL_READY;
+         } else if (in->get_pollfd != NULL) {
+            pfd->fd = in->get_pollfd(in->priv);
+         } else {
+            pfd->fd = TRAP_IFC_POLL_NONE;
+         }
+         ready |= (pfd->fd == TRAP_IFC_POLL_READY);
+         unpollable |= (pfd->fd == TRAP_IFC_POLL_NONE);
+      }
+      /* the first pass only checks what is ready */
+      if (ready != 0) {
+         wait = 0;
+      } else if (unpollable != 0 && wait > slice) {
+         wait = slice;
+      }
+      if (poll(c->in_ifc_pollfds, count, (wait + 999) / 1000) < 0 && errno != EINTR) {
+         return trap_errorf(c, TRAP_E_IO_ERROR, "poll() failed (%s)", strerror(errno));
+      }
+
+      now = trap_monotonic_us();
+      for (k = 0; k < count; k++) {
+         pfd = &c->in_ifc_pollfds[k];
+         idx = c->in_ifc_pollidx[k];
+         ifc = (ifcs != NULL) ? ifcs[idx] : idx;
+         in = &c->in_ifc_list[ifc];
+         r = &c->in_ifc_results[ifc];
+         if ((mode == TRAP_MULTI_RECV_ALL) && (r->result_code != TRAP_E_TIMEOUT)) {
+            continue;
+         }
+         if (pfd->fd == TRAP_IFC_POLL_NONE) {
+            if (c->in_ifc_retry[ifc] > now) {
                continue;
-            } else if (HAVE_GETOPT_LONG) {
-               if (isprint(module_info->params[i]->short_opt)) {
-                  written = printf("  -%c  --%s ", module_info->params[i]->short_opt,
-                                   module_info->params[i]->long_opt);
-               } else {
-                  written = printf("       --%s ", module_info->params[i]->long_opt);
-               }
-            } else {
-               written = printf("  -%c ", module_info->params[i]->short_opt);
-            }
-            switch (module_info->params[i]->param_required_argument) {
-            case required_argument:
-               written += printf("<%s>", module_info->params[i]->argument_type);
-               break;
-            case optional_argument:
-               written += printf("[%s]", module_info->params[i]->argument_type);
-               break;
-            case no_argument:
-               written += printf(" ");
-               break;
-            }
-            if (written < align_def) {
-               printf("%*s", align_def - written, " ");
             }
-
-            print_aligned(module_info->params[i]->description, align_def, cols - align_def);
-            /* empty line after param */
-            puts("");
-
-            i++;
+         } else if ((pfd->fd != TRAP_IFC_POLL_READY) && (pfd->revents == 0)) {
+            continue;
+         }
+         /* errors and hangup are reported by recv of the IFC */
+         res = trap_recv_ifc(c, ifc, (const void **) &r->message, &r->message_size, TRAP_NO_WAIT);
+         if (res != TRAP_E_TIMEOUT) {
+            r->result_code = res;
+            (*last) = idx;
+            got++;
+            if (mode == TRAP_MULTI_RECV_ONE) {
+               return TRAP_E_OK;
+            }
+         } else if ((pfd->fd == TRAP_IFC_POLL_NONE) && (in->is_conn(in->priv) == 0)) {
+            /* every receive tries to connect, don't do it too often */
+            c->in_ifc_retry[ifc] = now + TRAP_MULTI_RECV_RETRY;
+         }
+      }
+      if (got > 0) {
+         if (mode != TRAP_MULTI_RECV_ALL) {
+            return TRAP_E_OK;
+         }
+         done += got;
+         if (done == count) {
+            return TRAP_E_OK;
+         }
+         got = 0;
+         slice = TRAP_MULTI_RECV_SLICE;
+      } else if (unpollable != 0 && slice < TRAP_MULTI_RECV_SLICE_MAX) {
+         /* back off, the IFCs are rechecked less often while they have no data */
+         slice *= 2;
+      }
+
+      wait = TRAP_MULTI_RECV_TERM_CHECK;
+      if (timeout != TRAP_WAIT) {
+         now = trap_monotonic_us();
+         if (now - entry_time >= (uint64_t) timeout) {
+            /* IFCs that have not received keep TRAP_E_TIMEOUT, all results are returned as by older versions */
+            return (mode == TRAP_MULTI_RECV_ALL) ? TRAP_E_OK : TRAP_E_TIMEOUT;
+         }
+         if (wait > timeout - (now - entry_time)) {
+            wait = timeout - (now - entry_time);
          }
       }
+   }
+   return TRAP_E_TERMINATED;
+}
 
-      /* If the module has some position parameters, their section is printed */
-      if (adit_param == 1) {
-         printf("\nAdditional parameters of module [ADDITIONAL]:\n---------------------------------------------\n");
+/**
+ * Receive one message from every given input IFC into ctx->in_ifc_results, see trap_multi_recv_ready().
+ *
+ * \param[in,out] c    pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifcs     array of indexes of input IFCs
+ * \param[in] count    number of IFCs
+ * \param[in] timeout  TRAP_WAIT | TRAP_NO_WAIT | TRAP_HALFWAIT | timeout
+ * \param[in] mode     TRAP_MULTI_RECV_ANY | TRAP_MULTI_RECV_ALL
+ * \param[out] data    pointer to the array of results
+ * \param[out] size    size of the array of results
+ * \return Error code, see trap_ctx_multi_recv_ifcs()
+ */
+static int trap_multi_recv_results(trap_ctx_priv_t *c, const uint32_t *ifcs, uint32_t count, int timeout, int mode,
+                                   const void **data, uint16_t *size)
+{
+   uint32_t i, last;
+   int res;
 
-         i = 0;
-         while (module_info->params[i] != NULL) {
-            if (module_info->params[i]->short_opt == '-') {
-               printf("  %s", module_info->params[i]->description);
-               if (module_info->params[i]->param_required_argument == required_argument) {
-                  printf(" (data type: <%s>)", module_info->params[i]->argument_type);
-               }
-               printf("\n\n");
-            }
-            i++;
-         }
+   if ((ifcs == NULL) || (count == 0)) {
+      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   }
+   if (count > c->num_ifc_in) {
+      return trap_errorf(c, TRAP_E_BAD_FPARAMS, "More IFCs selected than the number of input IFCs.");
+   }
+   for (i = 0; i < count; i++) {
+      if (ifcs[i] >= c->num_ifc_in) {
+         return trap_errorf(c, TRAP_E_NOT_SELECTED, "Input IFC %"PRIu32" does not exist.", ifcs[i]);
       }
+   }
 
-      printf("\nCommon TRAP parameters [COMMON]:\n--------------------------------\n");
+   for (i = 0; i < c->num_ifc_in; i++) {
+      c->in_ifc_results[i].result_code = TRAP_E_TIMEOUT;
+   }
+   if (timeout == TRAP_HALFWAIT) {
+      /* the same as TRAP_NO_WAIT for input IFCs */
+      timeout = TRAP_NO_WAIT;
+   }
+   res = trap_multi_recv_ready(c, ifcs, count, 0, timeout, mode, &last);
+   if (res == TRAP_E_OK || res == TRAP_E_TIMEOUT) {
+      (*data) = c->in_ifc_results;
+      (*size) = IN_IFC_RESULTS_SIZE(c);
+   }
+   return trap_error(c, res);
+}
 
-#define X(param, text, align, cut) do { \
-  written = printf(param); \
-  if (written < align_def) { \
-    printf("%*s", align - written, " "); \
-  } \
-  print_aligned(text, align, cut); \
-  puts(""); \
-} while (0)
+int trap_ctx_multi_recv_ifcs(trap_ctx_t *ctx, const uint32_t *ifcs, uint32_t count, int timeout, const void **data, uint16_t *size)
+{
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
 
-      X("  -h [trap,1]",
-        "If no argument, print this message. If \"trap\" or 1 is given, print "
-        "TRAP help.",
-        align_def, cols - align_def);
+   if ((c == NULL) || (c->initialized == 0)) {
+      return TRAP_E_NOT_INITIALIZED;
+   }
 
-      X("  -i IFC_SPEC",
-        "Specification of interface types and their parameters, "
-        "see \"-h trap\" (mandatory parameter).",
-        align_def, cols - align_def);
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
 
-      X("  -v", "Be verbose.", align_def, cols - align_def);
-      X("  -vv", "Be more verbose.", align_def, cols - align_def);
-      X("  -vvv", "Be even more verbose.", align_def, cols - align_def);
+   return trap_multi_recv_results(c, ifcs, count, timeout, TRAP_MULTI_RECV_ANY, data, size);
+}
 
-      puts("\nEnvironment variables that affects output:\n------------------------------------------");
-      X("  LIBTRAP_OUTPUT_FORMAT", "If set to \"json\", information about module is printed in JSON format.",
-        align_def, cols - align_def);
-      X("  PAGER", "Show the help output in the set PAGER.",
-        align_def, cols - align_def);
-      X("  TRAP_SOCKET_DIR", "Change path to socket directory (default: " DEFAULTSOCKETDIR ").",
-        align_def, cols - align_def);
+int trap_ctx_multi_recv(trap_ctx_t *ctx, uint32_t ifc_mask, const void **data, uint16_t *size)
+{
+   uint32_t counter = 0;
+   uint32_t selected_ifcs = 0;
+   /* max number of interfaces (given by mask size) = 32 */
+   uint32_t selected_ifc_arr[sizeof(ifc_mask) * 8];
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
 
-#undef X
-   } else if (trap_help_spec != 0) {
-      trap_print_ifc_spec_help();
+   if (!c->initialized) {
+      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   }
+
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
+
+   if (ifc_mask == 0) {
+      /* no interface selected by mask... */
+      return trap_errorf(c, TRAP_E_OK, "No interface selected by mask that is probably wrong.");
+   }
+
+   for (counter = 0; counter < c->num_ifc_in && counter < sizeof(ifc_mask) * 8; ++counter) {
+      if ((ifc_mask & (1u << counter)) != 0) {
+         selected_ifc_arr[selected_ifcs++] = counter;
+      }
+      c->in_ifc_results[counter].result_code = TRAP_E_TIMEOUT;
+   }
+   if (selected_ifcs == 1) {
+      /* get data from one IFC */
+      counter = selected_ifc_arr[0];
+      c->in_ifc_results[counter].result_code = trap_ctx_recv(ctx, counter,
+            (const void **) &c->in_ifc_results[counter].message, &c->in_ifc_results[counter].message_size);
+      (*data) = c->in_ifc_results;
+      (*size) = IN_IFC_RESULTS_SIZE(c);
+      return trap_error(c, c->in_ifc_results[counter].result_code);
+   } else if (selected_ifcs > 1) {
+      /* wait for all selected IFCs */
+      return trap_multi_recv_results(c, selected_ifc_arr, selected_ifcs,
+                                     trap_multi_timeout(c, selected_ifc_arr, selected_ifcs), TRAP_MULTI_RECV_ALL, data, size);
    }
+   return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
 }
 
-/** Print help about interface specifier.
- * Prints help message about format of interface specifier and description of
- * all available interface types.
- */
-void trap_print_ifc_spec_help()
+int trap_ctx_recv_any(trap_ctx_t *ctx, uint32_t *ifc, const void **data, uint16_t *size)
 {
-   extern const char *trap_help_ifcspec;
-   uint32_t cols = get_terminal_width();
-   if (cols == 0) {
-      cols = DEFAULT_MAX_TERMINAL_WIDTH;
+   uint32_t last = 0;
+   int res;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+
+   if ((c == NULL) || (c->initialized == 0)) {
+      return TRAP_E_NOT_INITIALIZED;
    }
 
-   print_aligned_multiline(trap_help_ifcspec, 0, cols - 2);
-}
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
 
-////////////////////////////
+   if (c->num_ifc_in == 0) {
+      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   }
+
+   res = trap_multi_recv_ready(c, NULL, c->num_ifc_in, c->recv_any_next, trap_multi_timeout(c, NULL, c->num_ifc_in),
+                               TRAP_MULTI_RECV_ONE, &last);
+   if (res == TRAP_E_OK) {
+      /* the next call starts with the following IFC */
+      c->recv_any_next = (last + 1) % c->num_ifc_in;
+      res = c->in_ifc_results[last].result_code;
+      (*ifc) = last;
+      (*data) = c->in_ifc_results[last].message;
+      (*size) = c->in_ifc_results[last].message_size;
+   }
+   return trap_error(c, res);
+}
 
 /**
- * \brief Splitter of *params* string.
- * Cut the first param, copy it into *dest* and returns pointer to the start of following
- * parameter.
- * \param[in] source  source string, typically *params*
- * \param[out] dest  destination string, target of first parameter copying
- * \param[in] delimiter  separator of values in *params*
- * \return Pointer to the start of following parameter (char after delimiter). \note If NULL, no other parameter is present or error during allocation occured.
+ * Receive a buffer of input IFC and swap its memory with the given buffer of worker pool.
+ *
+ * The whole received buffer (or its rest if some messages were already read
+ * by trap_ctx_recv()) is moved into b, the input IFC gets the memory of b.
+ *
+ * \param[in,out] ctx   pointer to the private libtrap context data (trap_ctx_init())
+ * \param[in] ifc_idx   index of input interface
+ * \param[in,out] b     free buffer of worker pool, it contains the received data on success
+ * \param[in] timeout   TRAP_WAIT | TRAP_NO_WAIT | timeout
+ * \return TRAP_E_OK on success, otherwise the error code of recv()
  */
-char *trap_get_param_by_delimiter(const char *source, char **dest, const char delimiter)
+static int trap_recv_workers_fill(trap_ctx_priv_t *ctx, uint32_t ifc_idx, struct trap_recv_buffer_s *b, int timeout)
 {
-   char *param_end = NULL;
-   unsigned int param_size = 0;
-
-   if (source == NULL) {
-      return NULL;
-   }
+   trap_input_ifc_t *ifc = &ctx->in_ifc_list[ifc_idx];
+   uint32_t size = 0;
+   char *p;
+   int result;
 
-   param_end = strchr(source, delimiter);
-   if (param_end == NULL) {
-      /* no delimiter found, copy the whole source */
-      *dest = strdup(source);
-      return NULL;
+   pthread_mutex_lock(&ifc->ifc_mtx);
+#ifndef DISABLE_BUFFERING
+   result = trap_fill_in_buffer(ctx, ifc_idx, timeout);
+   if (result == TRAP_E_OK) {
+      size = ifc->buffer_full;
    }
-
-   param_size = param_end - source;
-   *dest = (char *) calloc(1, param_size + 1);
-   if (*dest == NULL) {
-      return (NULL);
+#else
+   result = ifc->recv(ifc->priv, ifc->buffer, &size, timeout);
+#endif
+   if (result != TRAP_E_OK) {
+      goto exit;
+   }
+   if (b->size < ifc->buffer_size) {
+      /* the buffer of IFC grew during negotiation */
+      p = trap_pool_resize(b->data, ifc->buffer_size + 1);
+      if (p == NULL) {
+         result = trap_errorf(ctx, TRAP_E_MEMORY, "Reallocation of buffer of worker pool failed.");
+         goto exit;
+      }
+      b->data = p;
+      b->size = ifc->buffer_size;
    }
-   strncpy(*dest, source, param_size);
-   return param_end + 1;
+#ifndef DISABLE_BUFFERING
+   b->pointer = ifc->buffer_pointer;
+   b->single = 0;
+#else
+   b->pointer = ifc->buffer;
+   b->single = 1;
+#endif
+   b->end = b->pointer + size;
+   b->large_msgs = ifc->large_msgs;
+   b->fmt_changed = 0;
+   if (ifc->client_state == FMT_CHANGED) {
+      ifc->client_state = FMT_OK;
+      b->fmt_changed = 1;
+   }
+   p = ifc->buffer;
+   ifc->buffer = b->data;
+   b->data = p;
+   /* b->size >= buffer_size, the IFC keeps its buffer_size */
+   ifc->buffer_pointer = ifc->buffer;
+   ifc->buffer_full = 0;
+exit:
+   pthread_mutex_unlock(&ifc->ifc_mtx);
+   return result;
 }
 
-inline char *get_param_by_delimiter(const char *source, char **dest, const char delimiter)
+/**
+ * Thread of worker pool, it calls the user function for every queued buffer.
+ *
+ * \param[in] arg   struct trap_recv_worker_s
+ * \return NULL
+ */
+static void *trap_recv_worker_thread(void *arg)
 {
-   return trap_get_param_by_delimiter(source, dest, delimiter);
+   struct trap_recv_worker_s *w = (struct trap_recv_worker_s *) arg;
+   struct trap_recv_workers_s *pool = w->pool;
+   struct trap_recv_buffer_s *b;
+   int stop;
+
+   pthread_mutex_lock(&pool->mtx);
+   while (1) {
+      while ((pool->head == NULL) && (pool->stop == 0) && (pool->done == 0)) {
+         pthread_cond_wait(&pool->cond_work, &pool->mtx);
+      }
+      if ((pool->stop != 0) || (pool->head == NULL)) {
+         break;
+      }
+      b = pool->head;
+      pool->head = b->next;
+      if (pool->head == NULL) {
+         pool->tail = NULL;
+      }
+      pthread_mutex_unlock(&pool->mtx);
+
+      b->worker = w->index;
+      b->messages = 0;
+      stop = pool->func((trap_recv_buffer_t *) b, pool->arg);
+      TRAP_CNT_ADD(*pool->recv_message, b->messages);
+
+      pthread_mutex_lock(&pool->mtx);
+      b->next = pool->free;
+      pool->free = b;
+      if (stop != 0) {
+         pool->stop = 1;
+         pthread_cond_broadcast(&pool->cond_work);
+         pthread_cond_broadcast(&pool->cond_free);
+      } else {
+         pthread_cond_signal(&pool->cond_free);
+      }
+   }
+   pthread_mutex_unlock(&pool->mtx);
+   return NULL;
 }
 
-void trap_set_abs_timespec(struct timeval *tm, struct timespec *tmnblk)
+int trap_ctx_recv_workers(trap_ctx_t *ctx, uint32_t ifcidx, unsigned int workers, unsigned int buffers,
+                          trap_recv_worker_func_t func, void *arg)
 {
-   if (tmnblk == NULL) {
-      /* we do not need tmnblk */
-      return;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   struct trap_recv_workers_s pool;
+   struct trap_recv_worker_s *w = NULL;
+   struct trap_recv_buffer_s *b = NULL;
+   trap_input_ifc_t *ifc;
+   unsigned int i, started = 0;
+   int result = TRAP_E_OK;
+
+   if ((c == NULL) || (c->initialized == 0)) {
+      return TRAP_E_NOT_INITIALIZED;
    }
-   /* tmnblk is used for timed wait on semaphore, this needs absolute time... */
-   if (clock_gettime(CLOCK_REALTIME, tmnblk) == -1) {
-      /* handle error */
-      tmnblk->tv_sec = 0;
-      tmnblk->tv_nsec = 0;
+   if ((func == NULL) || (workers == 0)) {
+      return trap_errorf(c, TRAP_E_BAD_FPARAMS, "Bad parameters of worker pool.");
+   }
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
+   if (ifcidx >= c->num_ifc_in) {
+      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   }
+   ifc = &c->in_ifc_list[ifcidx];
+   if ((ifc->recv == NULL) || (ifc->priv == NULL)) {
+      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   }
+   if (buffers == 0) {
+      buffers = 2 * workers;
    }
 
-   if (tm->tv_usec != 0) {
-      tmnblk->tv_nsec = (long) tm->tv_usec * 1000;
-   } else {
-      tmnblk->tv_nsec = 0;
+   memset(&pool, 0, sizeof(pool));
+   pool.func = func;
+   pool.arg = arg;
+   pool.recv_message = &c->in_ifc_stats[ifcidx].recv_message;
+   pthread_mutex_init(&pool.mtx, NULL);
+   pthread_cond_init(&pool.cond_work, NULL);
+   pthread_cond_init(&pool.cond_free, NULL);
+
+   /* all buffers are allocated in advance, the receiver only swaps them with the buffer of IFC */
+   pool.bufs = (struct trap_recv_buffer_s *) calloc(buffers, sizeof(struct trap_recv_buffer_s));
+   w = (struct trap_recv_worker_s *) calloc(workers, sizeof(struct trap_recv_worker_s));
+   if ((pool.bufs == NULL) || (w == NULL)) {
+      result = trap_errorf(c, TRAP_E_MEMORY, "Allocation of worker pool failed.");
+      goto free_pool;
+   }
+   for (i = 0; i < buffers; i++) {
+      pool.bufs[i].data = (char *) trap_pool_calloc(ifc->buffer_size + 1);
+      if (pool.bufs[i].data == NULL) {
+         result = trap_errorf(c, TRAP_E_MEMORY, "Allocation of worker pool failed.");
+         goto free_pool;
+      }
+      pool.bufs[i].size = ifc->buffer_size;
+      pool.bufs[i].next = pool.free;
+      pool.free = &pool.bufs[i];
+   }
+   for (started = 0; started < workers; started++) {
+      w[started].pool = &pool;
+      w[started].index = started;
+      if (pthread_create(&w[started].thr, NULL, trap_recv_worker_thread, &w[started]) != 0) {
+         result = trap_errorf(c, TRAP_E_MEMORY, "Starting of worker thread failed.");
+         goto stop_workers;
+      }
    }
-   tmnblk->tv_sec += (time_t) (tm->tv_sec + (tm->tv_usec / 1000000));
-}
 
-void trap_set_timeouts(int timeout, struct timeval *tm, struct timespec *tmnblk)
-{
-   if ((timeout == TRAP_NO_WAIT) || (timeout == TRAP_HALFWAIT)) {
-      tm->tv_sec  = 0;
-      tm->tv_usec = 0;
-   } else if (timeout > TRAP_HALFWAIT) {
-      if (timeout == TRAP_WAIT) {
-         tm->tv_sec  = 0;
-         tm->tv_usec = 0;
+   while (1) {
+      if (b == NULL) {
+         pthread_mutex_lock(&pool.mtx);
+         while ((pool.free == NULL) && (pool.stop == 0)) {
+            pthread_cond_wait(&pool.cond_free, &pool.mtx);
+         }
+         if (pool.stop == 0) {
+            b = pool.free;
+            pool.free = b->next;
+         }
+         pthread_mutex_unlock(&pool.mtx);
+         if (b == NULL) {
+            break;
+         }
+      }
+      if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+         result = trap_error(c, TRAP_E_TERMINATED);
+         break;
+      }
+      /* bounded wait, so that the receiver notices the stop of pool */
+      result = trap_recv_workers_fill(c, ifcidx, b, TRAP_RECV_WORKERS_SLICE);
+      if (result == TRAP_E_TIMEOUT) {
+         result = TRAP_E_OK;
+         pthread_mutex_lock(&pool.mtx);
+         if (pool.stop != 0) {
+            pthread_mutex_unlock(&pool.mtx);
+            break;
+         }
+         pthread_mutex_unlock(&pool.mtx);
+         continue;
+      } else if (result != TRAP_E_OK) {
+         break;
+      }
+      pthread_mutex_lock(&pool.mtx);
+      b->next = NULL;
+      if (pool.tail != NULL) {
+         pool.tail->next = b;
       } else {
-         tm->tv_sec  = timeout / 1000000;
-         tm->tv_usec = timeout % 1000000;
+         pool.head = b;
+      }
+      pool.tail = b;
+      pthread_cond_signal(&pool.cond_work);
+      pthread_mutex_unlock(&pool.mtx);
+      b = NULL;
+   }
+
+stop_workers:
+   pthread_mutex_lock(&pool.mtx);
+   pool.done = 1;
+   pthread_cond_broadcast(&pool.cond_work);
+   pthread_mutex_unlock(&pool.mtx);
+   for (i = 0; i < started; i++) {
+      pthread_join(w[i].thr, NULL);
+   }
+free_pool:
+   if (pool.bufs != NULL) {
+      for (i = 0; i < buffers; i++) {
+         trap_pool_put(pool.bufs[i].data);
       }
-   } else {
-      VERBOSE(CL_ERROR, "Setting timeout to %d failed", timeout);
-      return;
+      free(pool.bufs);
    }
-   trap_set_abs_timespec(tm, tmnblk);
+   free(w);
+   pthread_cond_destroy(&pool.cond_free);
+   pthread_cond_destroy(&pool.cond_work);
+   pthread_mutex_destroy(&pool.mtx);
+   return result;
 }
 
-int trap_ifcctl(int8_t type, uint32_t ifcidx, int32_t request, ... /* arg */)
+int trap_recv_buffer_next(trap_recv_buffer_t *buf, const void **data, uint32_t *size)
 {
-   va_list ap;
-   int res;
-   va_start(ap, request);
-   res = trap_ctx_vifcctl(trap_glob_ctx, type, ifcidx, request, ap);
-   va_end(ap);
-   return res;
+   struct trap_recv_buffer_s *b = (struct trap_recv_buffer_s *) buf;
+   uint32_t hsize, msize;
+
+   if (b->pointer >= b->end) {
+      return 0;
+   }
+   if (b->single != 0) {
+      (*data) = b->pointer;
+      (*size) = b->end - b->pointer;
+      b->pointer = b->end;
+      b->messages++;
+      return 1;
+   }
+   hsize = TRAP_MSG_HEADER_SIZE(b);
+   if (b->end - b->pointer < hsize) {
+      msize = UINT32_MAX;
+   } else if (b->large_msgs != 0) {
+      msize = ntohl(*((uint32_t *) b->pointer));
+   } else {
+      msize = ntohs(*((uint16_t *) b->pointer));
+   }
+   if ((uint64_t) msize + hsize > (uint64_t) (b->end - b->pointer)) {
+      VERBOSE(CL_ERROR, "Malformed message header in buffer of worker %"PRIu32", dropping rest of the buffer.", b->worker);
+      b->pointer = b->end;
+      return 0;
+   }
+   (*data) = b->pointer + hsize;
+   (*size) = msize;
+   b->pointer += hsize + msize;
+   b->messages++;
+   return 1;
 }
 
-void trap_send_flush(uint32_t ifc)
+int trap_recv_buffer_format_changed(const trap_recv_buffer_t *buf)
 {
-   trap_ctx_send_flush((trap_ctx_t *) trap_glob_ctx, ifc);
+   return ((const struct trap_recv_buffer_s *) buf)->fmt_changed;
 }
 
-static int compare_timeouts (const void *a, const void *b)
+uint32_t trap_recv_buffer_worker(const trap_recv_buffer_t *buf)
 {
-   return ((*(struct out_ifc_timeout_s *)a).tm - (*(struct out_ifc_timeout_s *)b).tm);
+   return ((const struct trap_recv_buffer_s *) buf)->worker;
 }
 
-/**
- * \addtogroup contextapi Context API
- * @{
+/** Cleanup function.
+ * Disconnect all interfaces and do all necessary cleanup.
+ * @return Error code
  */
-
-trap_ctx_priv_t *trap_create_ctx_t()
-{
-        trap_ctx_priv_t *ctx = calloc(1, sizeof(trap_ctx_priv_t));
-        /* space for vars init with non-zero values */
-        return ctx;
-}
-
-void trap_free_ctx_t(trap_ctx_priv_t **ctx)
+int trap_ctx_finalize(trap_ctx_t **ctx)
 {
    int i;
-   trap_ctx_priv_t *c;
-
-   if (ctx == NULL) {
-      return;
+   if ((ctx == NULL) || (*ctx == NULL)) {
+      return TRAP_E_NOT_INITIALIZED;
    }
-   c = (*ctx);
+   trap_ctx_priv_t *c = *((trap_ctx_priv_t **)ctx);
    if (c == NULL) {
-      return;
+      return TRAP_E_NOT_INITIALIZED;
    }
-
-   /* free allocated counters */
-   free(c->counter_autoflush);
-   c->counter_autoflush = NULL;
-   free(c->counter_send_buffer);
-   c->counter_send_buffer = NULL;
-   free(c->counter_recv_message);
-   c->counter_recv_message = NULL;
-   free(c->counter_send_message);
-   c->counter_send_message = NULL;
-   free(c->counter_recv_buffer);
-   c->counter_recv_buffer = NULL;
-   free(c->counter_dropped_message);
-   c->counter_dropped_message = NULL;
-
-   // Destroy all interfaces
-   if ((c->num_ifc_in > 0) && (c->in_ifc_list != NULL)) {
-      for (i = 0; i < c->num_ifc_in; i++) {
-         if (c->in_ifc_list[i].buffer != NULL) {
-            free(c->in_ifc_list[i].buffer);
-            c->in_ifc_list[i].buffer = NULL;
-         }
-         if (c->in_ifc_list[i].data_fmt_spec != NULL) {
-            free(c->in_ifc_list[i].data_fmt_spec);
-            c->in_ifc_list[i].data_fmt_spec = NULL;
-         }
-         if (c->in_ifc_list[i].req_data_fmt_spec != NULL) {
-            free(c->in_ifc_list[i].req_data_fmt_spec);
-            c->in_ifc_list[i].req_data_fmt_spec = NULL;
-         }
-         if (c->in_ifc_list[i].destroy != NULL) {
-            c->in_ifc_list[i].destroy(c->in_ifc_list[i].priv);
-         }
-         pthread_mutex_destroy(&c->in_ifc_list[i].ifc_mtx);
-      }
-      free(c->in_ifc_list);
-      if (c->in_ifc_results != NULL) {
-         free(c->in_ifc_results);
-         c->in_ifc_results = NULL;
-      }
+   if (!c->initialized) {
+      free(c);
+      (*ctx) = NULL;
+      return TRAP_E_NOT_INITIALIZED;
    }
 
-   if ((c->num_ifc_out > 0) && (c->out_ifc_list != NULL)) {
+   /* force flush of buffer for every output ifc */
+   if (c->num_ifc_out > 0) {
       for (i = 0; i < c->num_ifc_out; i++) {
-         if (c->out_ifc_list[i].destroy != NULL) {
-            c->out_ifc_list[i].destroy(c->out_ifc_list[i].priv);
-         }
-         if (c->out_ifc_list[i].buffer_header != NULL) {
-            free(c->out_ifc_list[i].buffer_header);
-            c->out_ifc_list[i].buffer_header = NULL;
-         }
-         if (c->out_ifc_list[i].data_fmt_spec != NULL) {
-            free(c->out_ifc_list[i].data_fmt_spec);
-            c->out_ifc_list[i].data_fmt_spec = NULL;
-         }
-         pthread_mutex_destroy(&c->out_ifc_list[i].ifc_mtx);
+         trap_ctx_ifcctl((trap_ctx_t *) c, TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+         trap_ctx_ifcctl((trap_ctx_t *) c, TRAPIFC_OUTPUT, i, TRAPCTL_SETTIMEOUT, 100000);
+         trap_ctx_send_flush((trap_ctx_t *) c, i);
+         /* wait for buffers that were handed over to the sender thread */
+         trap_sendq_drain(c, i, 100000);
       }
-      free(c->out_ifc_list);
-      c->out_ifc_list = NULL;
-      free(c->ifc_autoflush_timeout);
-      c->ifc_autoflush_timeout = NULL;
    }
 
-   // Free threads and semaphores
-   if (c->reader_threads != NULL) {
-      for (i = 0; i < c->num_ifc_in; ++i) {
-         sem_post(&c->reader_threads[i].sem);
-         pthread_join(c->reader_threads[i].thr, NULL);
-         sem_destroy(&c->reader_threads[i].sem);
-      }
-      free(c->reader_threads);
+   /* check if libtrap is terminated and terminate if not */
+   if (__sync_add_and_fetch(&c->terminated, 0) == 0) {
+      trap_ctx_terminate(c);
    }
 
-   if (c->in_ifc_results != NULL) {
-      free(c->in_ifc_results);
-      c->in_ifc_results = NULL;
+   if (c->num_ifc_out > 0) {
+      for (i = 0; i < c->num_ifc_out; i++) {
+         trap_ctx_ifcctl((trap_ctx_t *) c, TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+      }
    }
-
-   if (c->service_ifc_name != NULL) {
-      free(c->service_ifc_name);
-      c->service_ifc_name = NULL;
+   // Destroy timeouts handling thread for output interfaces
+   if (c->timeout_thread_initialized == 1) {
+      pthread_cancel(c->timeout_thread);
+      pthread_join(c->timeout_thread, NULL);
+   }
+   if (c->service_thread_initialized == 1) {
+      pthread_join(c->service_thread, NULL);
    }
+   trap_free_ctx_t(&c);
+   (*ctx) = NULL;
 
-   pthread_rwlock_destroy(&c->context_lock);
+   trap_free_global_vars();
 
-   free(c);
-   (*ctx) = NULL;
+   return TRAP_E_OK;
 }
 
-int trap_ctx_terminate(trap_ctx_t *ctx)
+int trap_ctx_send(trap_ctx_t *ctx, unsigned int ifc, const void *data, uint16_t size)
 {
-   int i;
+   int ret_val = 0;
    trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
-   if ((c == NULL) || (c->terminated != 0)) {
-      return TRAP_E_OK;
+
+   if (c == NULL || c->initialized == 0) {
+      return TRAP_E_NOT_INITIALIZED;
    }
 
-   __sync_add_and_fetch(&c->terminated, 1);
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      return trap_error(c, TRAP_E_TERMINATED);
+   }
 
-   for (i = 0; i < c->num_ifc_in; i++) {
-      if (c->in_ifc_list[i].terminate != NULL) {
-         c->in_ifc_list[i].terminate(c->in_ifc_list[i].priv);
-      } else {
-         return trap_errorf(c, TRAP_E_MEMORY, "IFC was not initialized.");
-      }
+   if (ifc >= c->num_ifc_out) {
+      return trap_error(c, TRAP_E_BAD_IFC_INDEX);
    }
-   for (i = 0; i < c->num_ifc_out; i++) {
-      if (c->out_ifc_list[i].terminate != NULL) {
-         c->out_ifc_list[i].terminate(c->out_ifc_list[i].priv);
-      } else {
-         return trap_errorf(c, TRAP_E_MEMORY, "IFC was not initialized.");
-      }
+
+#ifndef DISABLE_BUFFERING
+   /* handle buffering */
+   ret_val = trap_store_into_buffer(c, ifc, data, size, c->out_ifc_list[ifc].datatimeout, 0);
+   if (ret_val == TRAP_E_OK) {
+      TRAP_CNT_ADD(c->out_ifc_stats[ifc].send_message, 1);
    }
-   return TRAP_E_OK;
+   return ret_val;
+#else
+   ret_val = c->out_ifc_list[ifc].send(c->out_ifc_list[ifc].priv, data, size, c->out_ifc_list[ifc].datatimeout);
+   if (ret_val == TRAP_E_OK) {
+      TRAP_CNT_ADD(c->out_ifc_stats[ifc].send_message, 1);
+   }
+   return ret_val;
+#endif
 }
 
-int trap_ctx_recv(trap_ctx_t *ctx, uint32_t ifcidx, const void **data, uint16_t *size)
+int trap_ctx_send_large(trap_ctx_t *ctx, unsigned int ifc, const void *data, uint32_t size)
 {
    int ret_val = 0;
    trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
-   if ((c == NULL) || (c->initialized == 0)) {
+
+   if (c == NULL || c->initialized == 0) {
       return TRAP_E_NOT_INITIALIZED;
    }
 
@@ -1787,182 +4076,206 @@ int trap_ctx_recv(trap_ctx_t *ctx, uint32_t ifcidx, const void **data, uint16_t
       return trap_error(c, TRAP_E_TERMINATED);
    }
 
-   if (ifcidx >= c->num_ifc_in) {
-      return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   if (ifc >= c->num_ifc_out) {
+      return trap_error(c, TRAP_E_BAD_IFC_INDEX);
    }
-   if ((c->in_ifc_list[ifcidx].recv != NULL) && (c->in_ifc_list[ifcidx].priv != NULL)) {
+
 #ifndef DISABLE_BUFFERING
-       /* handle buffering */
-      ret_val = trap_read_from_buffer(c, ifcidx, data, size, c->in_ifc_list[ifcidx].datatimeout);
-      return ret_val;
+   ret_val = trap_store_into_buffer(c, ifc, data, size, c->out_ifc_list[ifc].datatimeout, 0);
 #else
-      uint32_t newsize = 0;
-      ret_val = c->in_ifc_list[ifcidx].recv(c->in_ifc_list[ifcidx].priv, c->in_ifc_list[ifcidx].buffer, &newsize, c->in_ifc_list[ifcidx].datatimeout);
-      if (ret_val == TRAP_E_OK) {
-         c->counter_recv_message[ifcidx]++;
-         if (c->in_ifc_list[ifcidx].client_state == FMT_CHANGED) {
-            c->in_ifc_list[ifcidx].client_state = FMT_OK;
-            return TRAP_E_FORMAT_CHANGED;
-         }
-      } else if (ret_val == TRAP_E_FORMAT_MISMATCH) {
-         return ret_val;
-      }
-      (*size) = newsize;
-      (*data) = c->in_ifc_list[ifcidx].buffer;
-      return ret_val;
+   ret_val = c->out_ifc_list[ifc].send(c->out_ifc_list[ifc].priv, data, size, c->out_ifc_list[ifc].datatimeout);
 #endif
-   } else {
-      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   if (ret_val == TRAP_E_OK) {
+      TRAP_CNT_ADD(c->out_ifc_stats[ifc].send_message, 1);
    }
+   return ret_val;
 }
 
-int trap_ctx_multi_recv(trap_ctx_t *ctx, uint32_t ifc_mask, const void **data, uint16_t *size)
+int trap_ctx_send_burst(trap_ctx_t *ctx, unsigned int ifc, const void **data, const uint16_t *sizes, unsigned int count, unsigned int *sent)
 {
-   uint32_t counter = 0;
-   uint32_t selected_mask = 1;
-   uint32_t selected_ifcs = 0;
-   uint32_t selected_idx = 0;
-   /* max number of interfaces (given by mask size) = 32 */
-   uint32_t selected_ifc_arr[sizeof(ifc_mask) * 8];
+   int ret_val = TRAP_E_OK;
+   unsigned int accepted = 0;
    trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
 
-   if (!c->initialized) {
-      return trap_error(c, TRAP_E_NOT_INITIALIZED);
+   if (c == NULL || c->initialized == 0) {
+      return TRAP_E_NOT_INITIALIZED;
+   }
+
+   if ((data == NULL) || (sizes == NULL)) {
+      return trap_errorf(c, TRAP_E_BAD_FPARAMS, "Bad parameters of burst send.");
    }
 
    if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
       return trap_error(c, TRAP_E_TERMINATED);
    }
 
-   if (ifc_mask == 0) {
-      /* no interface selected by mask... */
-      return trap_errorf(c, TRAP_E_OK, "No interface selected by mask that is probably wrong.");
+   if (ifc >= c->num_ifc_out) {
+      return trap_error(c, TRAP_E_BAD_IFC_INDEX);
    }
 
-   for (counter = 0; counter < c->num_ifc_in; ++counter) {
-      if ((ifc_mask & selected_mask) != 0) {
-         selected_ifc_arr[selected_ifcs++] = counter;
-         selected_idx = counter;
+#ifndef DISABLE_BUFFERING
+   /* handle buffering */
+   ret_val = trap_store_burst_into_buffer(c, ifc, data, sizes, count, &accepted, c->out_ifc_list[ifc].datatimeout);
+#else
+   for (accepted = 0; accepted < count; accepted++) {
+      ret_val = c->out_ifc_list[ifc].send(c->out_ifc_list[ifc].priv, data[accepted], sizes[accepted], c->out_ifc_list[ifc].datatimeout);
+      if (ret_val != TRAP_E_OK) {
+         break;
       }
-      c->in_ifc_results[counter].result_code = TRAP_E_TIMEOUT;
-      selected_mask <<= 1;
    }
-   if (selected_ifcs == 1) {
-      /* get data from one IFC */
-      c->in_ifc_results[counter].result_code = trap_ctx_recv(ctx, selected_idx,
-            (const void **) &c->in_ifc_results[selected_idx].message, &c->in_ifc_results[selected_idx].message_size);
-      (*data) = c->in_ifc_results;
-      (*size) = IN_IFC_RESULTS_SIZE(c);
-      return trap_error(c, c->in_ifc_results[counter].result_code);
-   } else if (selected_ifcs > 1) {
-      // selected_ifcs initialized to 1
-      c->get_data_timeout = c->in_ifc_list[selected_ifc_arr[0]].datatimeout;
-      pthread_mutex_lock(&c->mut_sem_collector);
-      c->readers_count = selected_ifcs;
-      pthread_mutex_unlock(&c->mut_sem_collector);
-      for (counter = 0; counter < selected_ifcs; ++counter) {
-         // unblock all selected threads
-         /* get minimal timeout of selected ifcs */
-         if (c->get_data_timeout > c->in_ifc_list[selected_ifc_arr[counter]].datatimeout) {
-            c->get_data_timeout = c->in_ifc_list[selected_ifc_arr[counter]].datatimeout;
-         }
-         sem_post(&c->reader_threads[selected_ifc_arr[counter]].sem);
-      }
-      sem_wait(&c->sem_collector);
-
-      (*data) = c->in_ifc_results;
-      (*size) = IN_IFC_RESULTS_SIZE(c);
-      return trap_error(c, TRAP_E_OK);
+#endif
+   TRAP_CNT_ADD(c->out_ifc_stats[ifc].send_message, accepted);
+   if (sent != NULL) {
+      (*sent) = accepted;
    }
-   return trap_errorf(c, TRAP_E_NOT_SELECTED, "No input ifc to get data from...");
+   return ret_val;
 }
 
-/** Cleanup function.
- * Disconnect all interfaces and do all necessary cleanup.
- * @return Error code
- */
-int trap_ctx_finalize(trap_ctx_t **ctx)
+void *trap_ctx_send_reserve(trap_ctx_t *ctx, unsigned int ifc, uint16_t max_size)
 {
-   int i;
-   if ((ctx == NULL) || (*ctx == NULL)) {
-      return TRAP_E_NOT_INITIALIZED;
+   int result;
+   uint32_t freespace, needed_size;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   trap_output_ifc_t *o;
+
+   if (c == NULL || c->initialized == 0) {
+      return NULL;
    }
-   trap_ctx_priv_t *c = *((trap_ctx_priv_t **)ctx);
-   if (c == NULL) {
-      return TRAP_E_NOT_INITIALIZED;
+
+   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
+      trap_error(c, TRAP_E_TERMINATED);
+      return NULL;
+   }
+
+   if (ifc >= c->num_ifc_out) {
+      trap_error(c, TRAP_E_BAD_IFC_INDEX);
+      return NULL;
+   }
+   o = &c->out_ifc_list[ifc];
+
+   needed_size = max_size + TRAP_MSG_HEADER_SIZE(o);
+   if (needed_size > TRAP_OUT_BUFFER_SPACE(o)) {
+      trap_errorf(c, TRAP_E_MEMORY, "Buffer is too small for this message.");
+      return NULL;
+   }
+   if (o->shard == TRAP_SHARD_HASH) {
+      /* the buffer is chosen by the content of message */
+      trap_errorf(c, TRAP_E_BAD_FPARAMS, "Reservation is not supported with \"shard=hash\".");
+      return NULL;
    }
-   if (!c->initialized) {
-      free(c);
-      (*ctx) = NULL;
-      return TRAP_E_NOT_INITIALIZED;
+   if (o->threadbufs != 0) {
+      trap_errorf(c, TRAP_E_BAD_FPARAMS, "Reservation is not supported with \"threadbufs=on\".");
+      return NULL;
    }
 
-   /* force flush of buffer for every output ifc */
-   if (c->num_ifc_out > 0) {
-      for (i = 0; i < c->num_ifc_out; i++) {
-         trap_ctx_ifcctl((trap_ctx_t *) c, TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
-         trap_ctx_ifcctl((trap_ctx_t *) c, TRAPIFC_OUTPUT, i, TRAPCTL_SETTIMEOUT, 100000);
-         trap_ctx_send_flush((trap_ctx_t *) c, i);
+   /* The lock is not recursive, a second reservation by the same thread would wait forever.
+    * reserved_owner is written before reserved is set, so it is valid whenever reserved is 1. */
+   if (__atomic_load_n(&o->reserved, __ATOMIC_ACQUIRE) != 0 && pthread_equal(o->reserved_owner, pthread_self())) {
+      trap_errorf(c, TRAP_E_BAD_FPARAMS, "Previous reservation was not committed.");
+      return NULL;
+   }
+
+   /* The lock is held until trap_ctx_send_commit(), autoflush skips the interface meanwhile. */
+   trap_out_buffer_lock(o);
+
+   if (o->ifc_type != TRAP_IFC_TYPE_BLACKHOLE) {
+      if (o->buffer_index <= TRAP_OUT_BUFFER_SPACE(o)) {
+         freespace = TRAP_OUT_BUFFER_SPACE(o) - o->buffer_index;
+      } else {
+         freespace = 0;
+      }
+      /* buffer that was not sent yet must not be modified, try to send it again */
+      if ((freespace < needed_size) || (o->buffer_occupied != 0)) {
+         result = trap_send_out_buffer(c, ifc, o->datatimeout);
+         if (result != TRAP_E_OK && result != TRAP_E_IO_ERROR) {
+            if (result == TRAP_E_TIMEOUT) {
+               TRAP_CNT_ADD(c->out_ifc_stats[ifc].dropped_message, 1);
+            }
+            trap_out_buffer_unlock(o);
+            trap_error(c, result);
+            return NULL;
+         }
       }
+   } else {
+      /* nothing is sent via blackhole, just reuse the beginning of the buffer */
+      o->buffer_index = 0;
    }
 
-   /* check if libtrap is terminated and terminate if not */
-   if (__sync_add_and_fetch(&c->terminated, 0) == 0) {
-      trap_ctx_terminate(c);
+   o->reserved_size = max_size;
+   o->reserved_owner = pthread_self();
+   __atomic_store_n(&o->reserved, 1, __ATOMIC_RELEASE);
+   return &o->buffer[o->buffer_index + TRAP_MSG_HEADER_SIZE(o)];
+}
+
+int trap_ctx_send_commit(trap_ctx_t *ctx, unsigned int ifc, uint16_t size)
+{
+   int result = TRAP_E_OK;
+   trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   trap_output_ifc_t *o;
+
+   if (c == NULL || c->initialized == 0) {
+      return TRAP_E_NOT_INITIALIZED;
    }
 
-   if (c->num_ifc_out > 0) {
-      for (i = 0; i < c->num_ifc_out; i++) {
-         trap_ctx_ifcctl((trap_ctx_t *) c, TRAPIFC_OUTPUT, i, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
-      }
+   if (ifc >= c->num_ifc_out) {
+      return trap_error(c, TRAP_E_BAD_IFC_INDEX);
    }
-   // Destroy timeouts handling thread for output interfaces
-   if (c->timeout_thread_initialized == 1) {
-      pthread_cancel(c->timeout_thread);
-      pthread_join(c->timeout_thread, NULL);
+   o = &c->out_ifc_list[ifc];
+
+   if (__atomic_load_n(&o->reserved, __ATOMIC_ACQUIRE) == 0 || !pthread_equal(o->reserved_owner, pthread_self())) {
+      /* the lock is held by the reserving thread, only that thread may release it */
+      return trap_errorf(c, TRAP_E_BAD_FPARAMS, "No reservation to commit.");
    }
-   if (c->service_thread_initialized == 1) {
-      pthread_join(c->service_thread, NULL);
+   if (size > o->reserved_size) {
+      /* do not release the lock, the reservation is still valid */
+      return trap_errorf(c, TRAP_E_BAD_FPARAMS, "Committed size exceeds the reserved size.");
    }
-   trap_free_ctx_t(&c);
-   (*ctx) = NULL;
 
-   trap_free_global_vars();
+   __atomic_store_n(&o->reserved, 0, __ATOMIC_RELEASE);
+   if (o->ifc_type != TRAP_IFC_TYPE_BLACKHOLE) {
+      /* message is already in place, finish it in the same way as insert_into_buffer() */
+      trap_set_msg_size(o, &o->buffer[o->buffer_index], size);
+      o->buffer_index += size + TRAP_MSG_HEADER_SIZE(o);
+      TRAP_CNT_ADD(o->stored_bytes, size + TRAP_MSG_HEADER_SIZE(o));
+      __atomic_store_n(&o->bufferflush, 1, __ATOMIC_RELAXED);
 
-   return TRAP_E_OK;
+      if (o->bufferswitch == 0) {
+         result = trap_send_out_buffer(c, ifc, o->datatimeout);
+         if (result == TRAP_E_IO_ERROR) {
+            /* we had no client but we can propagate either OK or TIMEOUT: */
+            result = TRAP_E_TIMEOUT;
+         } else if (result == TRAP_E_TIMEOUT) {
+            TRAP_CNT_ADD(c->out_ifc_stats[ifc].dropped_message, 1);
+         }
+      }
+   }
+   trap_out_buffer_unlock(o);
+
+   if (result == TRAP_E_OK) {
+      TRAP_CNT_ADD(c->out_ifc_stats[ifc].send_message, 1);
+   }
+   return result;
 }
 
-int trap_ctx_send(trap_ctx_t *ctx, unsigned int ifc, const void *data, uint16_t size)
+int trap_ctx_set_shard_key(trap_ctx_t *ctx, unsigned int ifc, trap_shard_key_func_t func, void *arg)
 {
-   int ret_val = 0;
    trap_ctx_priv_t *c = (trap_ctx_priv_t *) ctx;
+   trap_output_ifc_t *o;
 
    if (c == NULL || c->initialized == 0) {
       return TRAP_E_NOT_INITIALIZED;
    }
 
-   if (__sync_add_and_fetch(&c->terminated, 0) != 0) {
-      return trap_error(c, TRAP_E_TERMINATED);
-   }
-
    if (ifc >= c->num_ifc_out) {
       return trap_error(c, TRAP_E_BAD_IFC_INDEX);
    }
+   o = &c->out_ifc_list[ifc];
 
-#ifndef DISABLE_BUFFERING
-   /* handle buffering */
-   ret_val = trap_store_into_buffer(c, ifc, data, size, c->out_ifc_list[ifc].datatimeout, 0);
-   if (ret_val == TRAP_E_OK) {
-      c->counter_send_message[ifc]++;
-   }
-   return ret_val;
-#else
-   ret_val = c->out_ifc_list[ifc].send(c->out_ifc_list[ifc].priv, data, size, c->out_ifc_list[ifc].datatimeout);
-   if (ret_val == TRAP_E_OK) {
-      c->counter_send_message[ifc]++;
-   }
-   return ret_val;
-#endif
+   trap_out_buffer_lock(o);
+   o->shard_key = func;
+   o->shard_key_arg = arg;
+   trap_out_buffer_unlock(o);
+   return TRAP_E_OK;
 }
 
 /**
@@ -1989,6 +4302,69 @@ static inline void remove_setter_from_param(char *params, char *setter)
    }
 }
 
+/**
+ * Find setters of socket options in IFC parameters and set values if found.
+ *
+ * \param[out] opts  Socket options of the IFC.
+ * \param[in,out] params  String passed as argument of -i, found setters are
+ * removed after their processing.
+ */
+static void handle_sockopt_setters(trap_sockopts_t *opts, char *params)
+{
+   char *strval, *p;
+
+   /* look for sndbuf setter and set size of socket send buffer if found */
+   p = strstr(params, "sndbuf=");
+   if (p != NULL) {
+      strval = p + sizeof("sndbuf=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &opts->sndbuf) != 1) || (opts->sndbuf > INT32_MAX)) {
+         VERBOSE(CL_ERROR, "Bad value for setter \"sndbuf\".");
+         opts->sndbuf = 0;
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for rcvbuf setter and set size of socket receive buffer if found */
+   p = strstr(params, "rcvbuf=");
+   if (p != NULL) {
+      strval = p + sizeof("rcvbuf=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &opts->rcvbuf) != 1) || (opts->rcvbuf > INT32_MAX)) {
+         VERBOSE(CL_ERROR, "Bad value for setter \"rcvbuf\".");
+         opts->rcvbuf = 0;
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for nodelay setter and disable Nagle's algorithm if found */
+   p = strstr(params, "nodelay=");
+   if (p != NULL) {
+      strval = p + sizeof("nodelay=") - 1;
+      if (strncmp(strval, "on", 2) == 0) {
+         opts->nodelay = 1;
+      } else if (strncmp(strval, "off", 3) == 0) {
+         opts->nodelay = 0;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"nodelay\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for busypoll setter and set busy polling of the socket if found */
+   p = strstr(params, "busypoll=");
+   if (p != NULL) {
+      strval = p + sizeof("busypoll=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &opts->busypoll) != 1) || (opts->busypoll > INT32_MAX)) {
+         VERBOSE(CL_ERROR, "Bad value for setter \"busypoll\".");
+         opts->busypoll = 0;
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+}
+
 /**
  * Find setters in IFC parameters and set values if needed.
  *
@@ -2022,6 +4398,39 @@ static inline void handle_inifc_setters(trap_input_ifc_t *ifc, char *params)
       /* clean the parameter because it was processed */
       remove_setter_from_param(params, p);
    }
+
+   /* look for bufsize setter and set the initial size of buffer if found */
+   p = strstr(params, "bufsize=");
+   if (p != NULL) {
+      uint32_t bufsize;
+      strval = p + sizeof("bufsize=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &bufsize) == 1) &&
+          (bufsize >= TRAP_IFC_MIN_BUFFER_SIZE) && (bufsize <= TRAP_IFC_MAX_BUFFER_SIZE)) {
+         ifc->buffer_size = bufsize;
+      } else {
+         VERBOSE(CL_ERROR, "Bad value for setter \"bufsize\", it must be between %d and %d.",
+                 TRAP_IFC_MIN_BUFFER_SIZE, TRAP_IFC_MAX_BUFFER_SIZE);
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for uring setter and enable io_uring in TCP/UNIX IFC if found */
+   p = strstr(params, "uring=");
+   if (p != NULL) {
+      strval = p + sizeof("uring=") - 1;
+      if (strncmp(strval, "on", 2) == 0) {
+         ifc->uring = 1;
+      } else if (strncmp(strval, "off", 3) == 0) {
+         ifc->uring = 0;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"uring\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   handle_sockopt_setters(&ifc->sockopts, params);
 }
 
 /**
@@ -2066,6 +4475,12 @@ static inline int trapifc_in_construct(trap_ctx_priv_t *ctx, trap_ifc_spec_t *if
          goto error;
       }
       break;
+   case TRAP_IFC_TYPE_SHM:
+      if ((ret = create_tcpip_receiver_ifc(ctx, ifc_spec->params[idx], &ctx->in_ifc_list[idx], idx, TRAP_IFC_TCPIP_SHM)) != TRAP_E_OK) {
+         VERBOSE(CL_ERROR, "Initialization of SHM input interface no. %i failed.", idx);
+         goto error;
+      }
+      break;
    case TRAP_IFC_TYPE_FILE:
       if ((ret = create_file_recv_ifc(ctx, ifc_spec->params[idx], &ctx->in_ifc_list[idx], idx)) != TRAP_E_OK) {
          VERBOSE(CL_ERROR, "Initialization of FILE input interface no. %i failed.", idx);
@@ -2077,84 +4492,297 @@ static inline int trapifc_in_construct(trap_ctx_priv_t *ctx, trap_ifc_spec_t *if
       ret = TRAP_E_BADPARAMS;
       goto error;
    }
-   return EXIT_SUCCESS;
-error:
-   trap_error(ctx, ret);
-   return EXIT_FAILURE;
-}
+   return EXIT_SUCCESS;
+error:
+   trap_error(ctx, ret);
+   return EXIT_FAILURE;
+}
+
+/**
+ * Find setters in IFC parameters and set values if needed.
+ *
+ * \param[in,out] ifc Pointer to IFC structure from the array in context.
+ * \param[in,out] params  String passed as argument of -i, found setters are
+ * removed after their processing.
+ */
+static inline void handle_outifc_setters(trap_output_ifc_t *ifc, char *params)
+{
+   char *strval, *p;
+
+   /* look for timeout setter and set the datatimeout if found */
+   p = strstr(params, "timeout=");
+   if (p != NULL) {
+
+#define X(val) do { \
+   ifc->datatimeout = val; \
+   ifc->datatimeout_fixed = 1; \
+} while (0)
+      strval = p + sizeof("timeout=") - 1;
+      if (strncmp(strval, "WAIT", 4) == 0) {
+         X(TRAP_WAIT);
+      } else if (strncmp(strval, "NO_WAIT", 7) == 0) {
+         X(TRAP_NO_WAIT);
+      } else if (strncmp(strval, "HALF_WAIT", 9) == 0) {
+         X(TRAP_HALFWAIT);
+      } else {
+         if (sscanf(strval, "%"SCNi32, &ifc->datatimeout) == 1) {
+            ifc->datatimeout_fixed = 1;
+         }
+      }
+#undef X
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for bufferswitch setter and set it if found */
+   p = strstr(params, "buffer=");
+   if (p != NULL) {
+
+#define X(val) do { \
+   ifc->bufferswitch = val; \
+   ifc->bufferswitch_fixed = 1; \
+} while (0)
+      char *strval = p + sizeof("buffer=") - 1;
+      if (strncmp(strval, "on", 2) == 0) {
+         X(1);
+      } else if (strncmp(strval, "off", 3) == 0) {
+         X(0);
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"buffer\".");
+      }
+#undef X
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for autoflush setter and set the it if found */
+   p = strstr(params, "autoflush=");
+   if (p != NULL) {
+      strval = p + sizeof("autoflush=") - 1;
+      if (strncmp(strval, "off", 3) == 0) {
+         ifc->timeout = TRAP_NO_AUTO_FLUSH;
+         ifc->timeout_fixed = 1;
+      } else if (strncmp(strval, "adaptive", 8) == 0) {
+         /* timeout is set according to flushlatency below */
+         ifc->autoflush_adaptive = 1;
+         ifc->timeout_fixed = 1;
+      } else {
+         if (sscanf(strval, "%"SCNi64, &ifc->timeout) == 1) {
+            ifc->datatimeout_fixed = 1;
+         }
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for bufsize setter and set the size of buffer if found */
+   p = strstr(params, "bufsize=");
+   if (p != NULL) {
+      uint32_t bufsize;
+      strval = p + sizeof("bufsize=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &bufsize) == 1) &&
+          (bufsize >= TRAP_IFC_MIN_BUFFER_SIZE) && (bufsize <= TRAP_IFC_MAX_BUFFER_SIZE)) {
+         ifc->buffer_size = bufsize;
+      } else {
+         VERBOSE(CL_ERROR, "Bad value for setter \"bufsize\", it must be between %d and %d.",
+                 TRAP_IFC_MIN_BUFFER_SIZE, TRAP_IFC_MAX_BUFFER_SIZE);
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for sendbufs setter and set the number of buffers for sender thread if found */
+   p = strstr(params, "sendbufs=");
+   if (p != NULL) {
+      uint32_t sendbufs;
+      strval = p + sizeof("sendbufs=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &sendbufs) == 1) && (sendbufs <= TRAP_IFC_MAX_SENDBUFS)) {
+         ifc->sendbufs = sendbufs;
+      } else {
+         VERBOSE(CL_ERROR, "Bad value for setter \"sendbufs\", it must be between 0 and %d.", TRAP_IFC_MAX_SENDBUFS);
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for sendpolicy setter and set behavior when all buffers are in flight if found */
+   p = strstr(params, "sendpolicy=");
+   if (p != NULL) {
+      strval = p + sizeof("sendpolicy=") - 1;
+      if (strncmp(strval, "block", 5) == 0) {
+         ifc->sendq_drop = 0;
+      } else if (strncmp(strval, "drop", 4) == 0) {
+         ifc->sendq_drop = 1;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"sendpolicy\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for clientq setter and set the length of client queues if found */
+   p = strstr(params, "clientq=");
+   if (p != NULL) {
+      uint32_t clientq;
+      strval = p + sizeof("clientq=") - 1;
+      if ((sscanf(strval, "%"SCNu32, &clientq) == 1) && (clientq <= TRAP_IFC_MAX_CLIENT_QUEUE)) {
+         ifc->client_queue = clientq;
+      } else {
+         VERBOSE(CL_ERROR, "Bad value for setter \"clientq\", it must be between 0 and %d.", TRAP_IFC_MAX_CLIENT_QUEUE);
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for clientpolicy setter and set behavior when a client queue is full if found */
+   p = strstr(params, "clientpolicy=");
+   if (p != NULL) {
+      strval = p + sizeof("clientpolicy=") - 1;
+      if (strncmp(strval, "block", 5) == 0) {
+         ifc->client_policy = TRAP_CLIENT_POLICY_BLOCK;
+      } else if (strncmp(strval, "drop", 4) == 0) {
+         ifc->client_policy = TRAP_CLIENT_POLICY_DROP;
+      } else if (strncmp(strval, "disconnect", 10) == 0) {
+         ifc->client_policy = TRAP_CLIENT_POLICY_DISCONNECT;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"clientpolicy\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for clientlag setter and set time before disconnection of a slow client if found */
+   p = strstr(params, "clientlag=");
+   if (p != NULL) {
+      uint32_t clientlag;
+      strval = p + sizeof("clientlag=") - 1;
+      if (sscanf(strval, "%"SCNu32, &clientlag) == 1) {
+         ifc->client_lag = clientlag;
+      } else {
+         VERBOSE(CL_ERROR, "Bad value for setter \"clientlag\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
+
+   /* look for largemsg setter and set 32-bit framing of messages if found */
+   p = strstr(params, "largemsg=");
+   if (p != NULL) {
+      strval = p + sizeof("largemsg=") - 1;
+      if (strncmp(strval, "on", 2) == 0) {
+         ifc->large_msgs = 1;
+      } else if (strncmp(strval, "off", 3) == 0) {
+         ifc->large_msgs = 0;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"largemsg\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
 
-/**
- * Find setters in IFC parameters and set values if needed.
- *
- * \param[in,out] ifc Pointer to IFC structure from the array in context.
- * \param[in,out] params  String passed as argument of -i, found setters are
- * removed after their processing.
- */
-static inline void handle_outifc_setters(trap_output_ifc_t *ifc, char *params)
-{
-   char *strval, *p;
+   /* look for timestamp setter and append the time of sending to buffers if found */
+   p = strstr(params, "timestamp=");
+   if (p != NULL) {
+      strval = p + sizeof("timestamp=") - 1;
+      if (strncmp(strval, "on", 2) == 0) {
+         ifc->timestamp = 1;
+      } else if (strncmp(strval, "off", 3) == 0) {
+         ifc->timestamp = 0;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"timestamp\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
 
-   /* look for timeout setter and set the datatimeout if found */
-   p = strstr(params, "timeout=");
+   /* look for compress setter and set compression of buffers if found */
+   p = strstr(params, "compress=");
    if (p != NULL) {
+      uint8_t method = TRAP_COMPRESS_OFF;
+      strval = p + sizeof("compress=") - 1;
+      if (strncmp(strval, "lz4", 3) == 0) {
+         method = TRAP_COMPRESS_LZ4;
+      } else if (strncmp(strval, "zstd", 4) == 0) {
+         method = TRAP_COMPRESS_ZSTD;
+      } else if (strncmp(strval, "off", 3) != 0) {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"compress\".");
+      }
+      if (trap_compress_available(method)) {
+         ifc->compress = method;
+      } else {
+         VERBOSE(CL_ERROR, "Libtrap was built without %s, buffers will not be compressed.", trap_compress_name(method));
+         ifc->compress = TRAP_COMPRESS_OFF;
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
 
-#define X(val) do { \
-   ifc->datatimeout = val; \
-   ifc->datatimeout_fixed = 1; \
-} while (0)
-      strval = p + sizeof("timeout=") - 1;
-      if (strncmp(strval, "WAIT", 4) == 0) {
-         X(TRAP_WAIT);
-      } else if (strncmp(strval, "NO_WAIT", 7) == 0) {
-         X(TRAP_NO_WAIT);
-      } else if (strncmp(strval, "HALF_WAIT", 9) == 0) {
-         X(TRAP_HALFWAIT);
+   /* look for shard setter and set distribution of buffers among clients if found */
+   p = strstr(params, "shard=");
+   if (p != NULL) {
+      strval = p + sizeof("shard=") - 1;
+      if (strncmp(strval, "rr", 2) == 0) {
+         ifc->shard = TRAP_SHARD_RR;
+      } else if (strncmp(strval, "hash", 4) == 0) {
+         ifc->shard = TRAP_SHARD_HASH;
+      } else if (strncmp(strval, "off", 3) == 0) {
+         ifc->shard = TRAP_SHARD_OFF;
       } else {
-         if (sscanf(strval, "%"SCNi32, &ifc->datatimeout) == 1) {
-            ifc->datatimeout_fixed = 1;
-         }
+         VERBOSE(CL_ERROR, "Unknown value for setter \"shard\".");
       }
-#undef X
       /* clean the parameter because it was processed */
       remove_setter_from_param(params, p);
    }
 
-   /* look for bufferswitch setter and set it if found */
-   p = strstr(params, "buffer=");
+   /* look for threadbufs setter and give every producer thread its own buffer if found */
+   p = strstr(params, "threadbufs=");
    if (p != NULL) {
+      strval = p + sizeof("threadbufs=") - 1;
+      if (strncmp(strval, "on", 2) == 0) {
+         ifc->threadbufs = 1;
+      } else if (strncmp(strval, "off", 3) == 0) {
+         ifc->threadbufs = 0;
+      } else {
+         VERBOSE(CL_ERROR, "Unknown value for setter \"threadbufs\".");
+      }
+      /* clean the parameter because it was processed */
+      remove_setter_from_param(params, p);
+   }
 
-#define X(val) do { \
-   ifc->bufferswitch = val; \
-   ifc->bufferswitch_fixed = 1; \
-} while (0)
-      char *strval = p + sizeof("buffer=") - 1;
+   /* look for uring setter and enable io_uring in TCP/UNIX IFC if found */
+   p = strstr(params, "uring=");
+   if (p != NULL) {
+      strval = p + sizeof("uring=") - 1;
       if (strncmp(strval, "on", 2) == 0) {
-         X(1);
+         ifc->uring = 1;
       } else if (strncmp(strval, "off", 3) == 0) {
-         X(0);
+         ifc->uring = 0;
       } else {
-         VERBOSE(CL_ERROR, "Unknown value for setter \"buffer\".");
+         VERBOSE(CL_ERROR, "Unknown value for setter \"uring\".");
       }
-#undef X
       /* clean the parameter because it was processed */
       remove_setter_from_param(params, p);
    }
 
-   /* look for autoflush setter and set the it if found */
-   p = strstr(params, "autoflush=");
+   /* look for flushlatency setter and set target latency of adaptive autoflush if found */
+   p = strstr(params, "flushlatency=");
    if (p != NULL) {
-      strval = p + sizeof("autoflush=") - 1;
-      if (strncmp(strval, "off", 3) == 0) {
-         ifc->timeout = TRAP_NO_AUTO_FLUSH;
-         ifc->timeout_fixed = 1;
+      int64_t latency;
+      strval = p + sizeof("flushlatency=") - 1;
+      if ((sscanf(strval, "%"SCNi64, &latency) == 1) && (latency > 0)) {
+         ifc->flush_latency = latency;
       } else {
-         if (sscanf(strval, "%"SCNi64, &ifc->timeout) == 1) {
-            ifc->datatimeout_fixed = 1;
-         }
+         VERBOSE(CL_ERROR, "Bad value for setter \"flushlatency\".");
       }
       /* clean the parameter because it was processed */
       remove_setter_from_param(params, p);
    }
+   if (ifc->autoflush_adaptive != 0) {
+      /* the first check when the rate is not known yet */
+      ifc->timeout = ifc->flush_latency / 2;
+   }
+
+   handle_sockopt_setters(&ifc->sockopts, params);
 }
 
 /**
@@ -2172,6 +4800,22 @@ static inline int trapifc_out_construct(trap_ctx_priv_t *ctx, trap_ifc_spec_t *i
    handle_outifc_setters(&ctx->out_ifc_list[idx],
                          ifc_spec->params[ctx->num_ifc_in + idx]);
 
+   if (ctx->out_ifc_list[idx].shard != TRAP_SHARD_OFF) {
+      if ((ifc_spec->types[ctx->num_ifc_in + idx] != TRAP_IFC_TYPE_TCPIP) &&
+          (ifc_spec->types[ctx->num_ifc_in + idx] != TRAP_IFC_TYPE_UNIX)) {
+         VERBOSE(CL_ERROR, "Parameter \"shard\" is supported only by TCP and UNIX output IFC, it is ignored.");
+         ctx->out_ifc_list[idx].shard = TRAP_SHARD_OFF;
+      } else if ((ctx->out_ifc_list[idx].shard == TRAP_SHARD_HASH) && (ctx->out_ifc_list[idx].sendbufs > 1)) {
+         /* buffers of clients are switched in place of the current block */
+         VERBOSE(CL_ERROR, "Parameter \"sendbufs\" cannot be used with \"shard=hash\", buffers are sent directly.");
+         ctx->out_ifc_list[idx].sendbufs = 0;
+      }
+   }
+   if ((ctx->out_ifc_list[idx].threadbufs != 0) && (ctx->out_ifc_list[idx].shard == TRAP_SHARD_HASH)) {
+      VERBOSE(CL_ERROR, "Parameter \"threadbufs\" cannot be used with \"shard=hash\", it is ignored.");
+      ctx->out_ifc_list[idx].threadbufs = 0;
+   }
+
    /* call correct constructor of interface */
    switch (ifc_spec->types[ctx->num_ifc_in + idx]) {
    case TRAP_IFC_TYPE_BLACKHOLE:
@@ -2203,6 +4847,13 @@ static inline int trapifc_out_construct(trap_ctx_priv_t *ctx, trap_ifc_spec_t *i
          goto error;
       }
       break;
+   case TRAP_IFC_TYPE_SHM:
+      if ((ret = create_tcpip_sender_ifc(ctx, ifc_spec->params[ctx->num_ifc_in + idx],
+                                  &ctx->out_ifc_list[idx], idx, TRAP_IFC_TCPIP_SHM)) != TRAP_E_OK) {
+         VERBOSE(CL_ERROR, "Initialization of SHM output interface no. %i failed.", idx);
+         goto error;
+      }
+      break;
    case TRAP_IFC_TYPE_FILE:
       if ((ret = create_file_send_ifc(ctx, ifc_spec->params[ctx->num_ifc_in + idx], &ctx->out_ifc_list[idx], idx)) != TRAP_E_OK) {
          VERBOSE(CL_ERROR, "Initialization of FILE output interface no. %i failed.", idx);
@@ -2292,9 +4943,28 @@ trap_ctx_t *trap_ctx_init(trap_module_info_t *module_info, trap_ifc_spec_t ifc_s
    return res;
 }
 
+/**
+ * Allocate zeroed array of stat blocks (#trap_in_ifc_stats_t, #trap_out_ifc_stats_t) aligned to cache line.
+ *
+ * \param[in] count   number of blocks
+ * \param[in] size    size of one block
+ * \return pointer to the array, NULL when count is 0 or allocation failed
+ */
+static void *trap_alloc_stats(uint32_t count, size_t size)
+{
+   void *p = NULL;
+
+   if (count == 0 || posix_memalign(&p, TRAP_CACHE_LINE_SIZE, count * size) != 0) {
+      return NULL;
+   }
+   memset(p, 0, count * size);
+   return p;
+}
+
 trap_ctx_t *trap_ctx_init2(trap_module_info_t *module_info, trap_ifc_spec_t ifc_spec, const char *service_ifc_name)
 {
    int i;
+   uint16_t nblocks;
    if ((ifc_spec.types == NULL) || (ifc_spec.params == NULL)) {
       return NULL;
    }
@@ -2342,12 +5012,12 @@ trap_ctx_t *trap_ctx_init2(trap_module_info_t *module_info, trap_ifc_spec_t ifc_
       return ctx;
    }
 
-   ctx->counter_send_message = (uint64_t *) calloc(ctx->num_ifc_out, sizeof(uint64_t));
-   ctx->counter_recv_message = (uint64_t *) calloc(ctx->num_ifc_in, sizeof(uint64_t));
-   ctx->counter_send_buffer = (uint64_t *) calloc(ctx->num_ifc_out, sizeof(uint64_t));
-   ctx->counter_autoflush = (uint64_t *) calloc(ctx->num_ifc_out, sizeof(uint64_t));
-   ctx->counter_recv_buffer = (uint64_t *) calloc(ctx->num_ifc_in, sizeof(uint64_t));
-   ctx->counter_dropped_message = (uint64_t *) calloc(ctx->num_ifc_out, sizeof(uint64_t));
+   ctx->in_ifc_stats = (trap_in_ifc_stats_t *) trap_alloc_stats(ctx->num_ifc_in, sizeof(trap_in_ifc_stats_t));
+   ctx->out_ifc_stats = (trap_out_ifc_stats_t *) trap_alloc_stats(ctx->num_ifc_out, sizeof(trap_out_ifc_stats_t));
+   if ((ctx->num_ifc_in > 0 && ctx->in_ifc_stats == NULL) || (ctx->num_ifc_out > 0 && ctx->out_ifc_stats == NULL)) {
+      trap_error(ctx, TRAP_E_MEMORY);
+      goto alloc_counter_failed;
+   }
 
    // Create input interfaces
    if (ctx->num_ifc_in > 0) {
@@ -2360,27 +5030,16 @@ trap_ctx_t *trap_ctx_init2(trap_module_info_t *module_info, trap_ifc_spec_t ifc_
       for (i=0; i<ctx->num_ifc_in; ++i) {
          ctx->in_ifc_list[i].datatimeout = TRAP_WAIT;
       }
-      if (ctx->num_ifc_in > 1) {
-         ctx->in_ifc_results = (trap_multi_result_t *) calloc(1, IN_IFC_RESULTS_SIZE(ctx));
-         if (ctx->in_ifc_results == NULL) {
-            trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for multi-result storage.");
-            goto freein_list;
-         }
-         ctx->reader_threads = (struct reader_threads_s *) calloc(ctx->num_ifc_in, sizeof(struct reader_threads_s));
-         if (ctx->reader_threads == NULL) {
-            trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for reader-threads.");
-            goto freein_results;
-         }
-      }
-      ctx->readers_count = 0;
-      if (sem_init(&ctx->sem_collector, SEM_PSHARED, 0) != 0) {
-         goto freein_readers;
-      }
-      if (pthread_mutex_init(&ctx->mut_sem_collector, NULL) != 0) {
-         sem_destroy(&ctx->sem_collector);
-         goto freein_readers;
+      /* results and descriptors for reading from more IFCs at once */
+      ctx->in_ifc_results = (trap_multi_result_t *) calloc(1, IN_IFC_RESULTS_SIZE(ctx));
+      ctx->in_ifc_pollfds = (struct pollfd *) calloc(ctx->num_ifc_in, sizeof(struct pollfd));
+      ctx->in_ifc_pollidx = (uint32_t *) calloc(ctx->num_ifc_in, sizeof(uint32_t));
+      ctx->in_ifc_retry = (uint64_t *) calloc(ctx->num_ifc_in, sizeof(uint64_t));
+      if ((ctx->in_ifc_results == NULL) || (ctx->in_ifc_pollfds == NULL) ||
+          (ctx->in_ifc_pollidx == NULL) || (ctx->in_ifc_retry == NULL)) {
+         trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for multi-result storage.");
+         goto freein_results;
       }
-
    }
 
    for (i = 0; i < ctx->num_ifc_in; i++) {
@@ -2392,42 +5051,25 @@ trap_ctx_t *trap_ctx_init2(trap_module_info_t *module_info, trap_ifc_spec_t ifc_
       ctx->in_ifc_list[i].req_data_fmt_spec = NULL;
 
       if (pthread_mutex_init(&ctx->in_ifc_list[i].ifc_mtx, NULL) != 0) {
-         goto freein_readers;
+         goto freein_terminated;
       }
-      /* initialize reader-threads and their semaphores */
-      if (ctx->num_ifc_in > 1) {
-         struct reader_threads_arg *dataarg = (struct reader_threads_arg *) calloc(1, sizeof(struct reader_threads_arg));
-         if (dataarg == NULL) {
-            goto freein_readers;
-         }
-         dataarg->ctx = ctx;
-         dataarg->thread_index = i;
-         if (pthread_create(&ctx->reader_threads[i].thr, NULL, reader_threads_fn, (void *) dataarg) != 0) {
-            VERBOSE(CL_ERROR, "Creation of reader thread failed.");
-            trap_errorf(ctx, TRAP_E_MEMORY, "Creation of reader thread failed.");
-            free(dataarg);
-            goto freein_readers;
-         }
-         if (sem_init(&ctx->reader_threads[i].sem, SEM_PSHARED, 0) != 0) {
-            VERBOSE(CL_ERROR, "Creation of reader semaphore failed.");
-            trap_errorf(ctx, TRAP_E_MEMORY, "Creation of reader semaphore failed.");
-            goto freein_readers;
-         }
+      /* default size, it can be changed by setter or during negotiation */
+      ctx->in_ifc_list[i].buffer_size = TRAP_IFC_MESSAGEQ_SIZE;
+      ctx->in_ifc_list[i].ifc_type = ifc_spec.types[i];
+
+      /* call input IFC constructor, it handles setters (e.g. size of buffer) */
+      if (trapifc_in_construct(ctx, &ifc_spec, i) == EXIT_FAILURE) {
+         goto freein_on_failed;
       }
+
       /* allocate extra bytes for TCPIP IFC checksum */
-      ctx->in_ifc_list[i].buffer = (void *) calloc(1, TRAP_IFC_MESSAGEQ_SIZE + 1);
+      ctx->in_ifc_list[i].buffer = (void *) trap_pool_calloc(ctx->in_ifc_list[i].buffer_size + 1);
       if (ctx->in_ifc_list[i].buffer == NULL) {
          trap_errorf(ctx, TRAP_E_MEMORY, "Not enought memory for input ifc buffer.");
          goto freein_on_failed;
       }
       ctx->in_ifc_list[i].buffer_full = 0;
       ctx->in_ifc_list[i].buffer_pointer = ctx->in_ifc_list[i].buffer;
-      ctx->in_ifc_list[i].ifc_type = ifc_spec.types[i];
-
-      /* call input IFC constructor */
-      if (trapifc_in_construct(ctx, &ifc_spec, i) == EXIT_FAILURE) {
-         goto freein_on_failed;
-      }
    }
 
    // Create output interfaces
@@ -2447,26 +5089,80 @@ trap_ctx_t *trap_ctx_init2(trap_module_info_t *module_info, trap_ifc_spec_t ifc_
       ctx->out_ifc_list[i].data_type = TRAP_FMT_UNKNOWN;
       ctx->out_ifc_list[i].data_fmt_spec = NULL;
 
-      ctx->out_ifc_list[i].buffer_header = (void *) calloc(1, TRAP_IFC_MESSAGEQ_SIZE + sizeof(trap_buffer_header_t) + 1);
-      if (ctx->out_ifc_list[i].buffer_header == NULL) {
-         trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for input ifc buffer.");
-         goto freein_on_failed;
-      }
-      ctx->out_ifc_list[i].buffer = ((trap_buffer_header_t *) ctx->out_ifc_list[i].buffer_header)->data;
+      ctx->out_ifc_list[i].buffer_size = TRAP_IFC_MESSAGEQ_SIZE;
+      ctx->out_ifc_list[i].client_lag = TRAP_IFC_DEFAULT_CLIENT_LAG;
       ctx->out_ifc_list[i].buffer_index = 0;
       ctx->out_ifc_list[i].bufferflush = 0;
       if (pthread_mutex_init(&ctx->out_ifc_list[i].ifc_mtx, NULL) != 0) {
          goto freein_on_failed;
       }
       ctx->out_ifc_list[i].timeout = TRAP_IFC_TIMEOUT;
+      ctx->out_ifc_list[i].flush_latency = TRAP_IFC_TIMEOUT;
       ctx->out_ifc_list[i].bufferswitch = 1;
       ctx->out_ifc_list[i].ifc_type = ifc_spec.types[ctx->num_ifc_in + i];
 
-      /* call output IFC constructor */
+      /* call output IFC constructor, it handles setters (e.g. size of buffer) */
       if (trapifc_out_construct(ctx, &ifc_spec, i) == EXIT_FAILURE) {
          goto freeall_on_failed;
       }
 
+      /* messages are written into the current block, others are in flight when sender thread is used */
+      if (ctx->out_ifc_list[i].sendbufs > 1 && ctx->out_ifc_list[i].ifc_type != TRAP_IFC_TYPE_BLACKHOLE) {
+         nblocks = ctx->out_ifc_list[i].sendbufs;
+      } else {
+         nblocks = 1;
+      }
+      ctx->out_ifc_list[i].tb = tb_init_ext(nblocks, TRAP_OUT_BLOCK_SIZE(ctx->out_ifc_list[i].buffer_size), trap_pool_get, trap_pool_put);
+      if (ctx->out_ifc_list[i].tb == NULL) {
+         trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for output ifc buffer.");
+         goto freeall_on_failed;
+      }
+      ctx->out_ifc_list[i].buffer_header = (unsigned char *) ctx->out_ifc_list[i].tb->cur_wr_block->data;
+      ctx->out_ifc_list[i].buffer = ((trap_buffer_header_t *) ctx->out_ifc_list[i].buffer_header)->data;
+
+      if (ctx->out_ifc_list[i].shard == TRAP_SHARD_HASH) {
+         /* buffers of other clients are allocated when they connect */
+         ctx->out_ifc_list[i].shard_slots = calloc(1, sizeof(struct trap_shard_slot_s));
+         if (ctx->out_ifc_list[i].shard_slots == NULL) {
+            trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for output ifc buffer.");
+            goto freeall_on_failed;
+         }
+         ctx->out_ifc_list[i].shard_slots[0].header = ctx->out_ifc_list[i].buffer_header;
+         ctx->out_ifc_list[i].shard_nslots = 1;
+      }
+
+      if (ctx->out_ifc_list[i].ifc_type == TRAP_IFC_TYPE_BLACKHOLE) {
+         /* nothing is stored */
+         ctx->out_ifc_list[i].threadbufs = 0;
+      }
+      if (ctx->out_ifc_list[i].threadbufs != 0) {
+         /* buffers of threads are allocated by the first send of every thread */
+         if (pthread_key_create(&ctx->out_ifc_list[i].stage_key, trap_stage_release) != 0) {
+            trap_errorf(ctx, TRAP_E_MEMORY, "Creation of thread-specific key of output ifc %d failed.", i);
+            goto freeall_on_failed;
+         }
+         pthread_mutex_init(&ctx->out_ifc_list[i].stage_mtx, NULL);
+         ctx->out_ifc_list[i].stage_key_created = 1;
+      }
+
+      if (ctx->out_ifc_list[i].ifc_type == TRAP_IFC_TYPE_BLACKHOLE) {
+         /* nothing is sent */
+         ctx->out_ifc_list[i].compress = TRAP_COMPRESS_OFF;
+      }
+      if (ctx->out_ifc_list[i].compress != TRAP_COMPRESS_OFF) {
+         ctx->out_ifc_list[i].compress_buf = trap_pool_get(ctx->out_ifc_list[i].buffer_size + sizeof(trap_buffer_header_t));
+         if (ctx->out_ifc_list[i].compress_buf == NULL) {
+            trap_errorf(ctx, TRAP_E_MEMORY, "Not enough memory for compression of output ifc buffer.");
+            goto freeall_on_failed;
+         }
+      }
+
+      if (nblocks > 1) {
+         if (trap_sendq_init(ctx, i) != TRAP_E_OK) {
+            trap_errorf(ctx, TRAP_E_MEMORY, "Creation of sender thread of output ifc %d failed.", i);
+            goto freeall_on_failed;
+         }
+      }
    }
 
    if (ctx->num_ifc_out > 0) {
@@ -2510,10 +5206,17 @@ trap_ctx_t *trap_ctx_init2(trap_module_info_t *module_info, trap_ifc_spec_t ifc_
 freeall_on_failed:
    if (ctx->out_ifc_list != NULL) {
       for (i=0; i<ctx->num_ifc_out; ++i) {
+         trap_sendq_destroy(ctx, i);
          pthread_mutex_destroy(&ctx->out_ifc_list[i].ifc_mtx);
          if (ctx->out_ifc_list[i].destroy != NULL && ctx->out_ifc_list[i].priv != NULL) {
             ctx->out_ifc_list[i].destroy(ctx->out_ifc_list[i].priv);
          }
+         trap_shard_free(&ctx->out_ifc_list[i]);
+         trap_stage_free(&ctx->out_ifc_list[i]);
+         tb_destroy(&ctx->out_ifc_list[i].tb);
+         ctx->out_ifc_list[i].buffer_header = NULL;
+         trap_pool_put(ctx->out_ifc_list[i].compress_buf);
+         trap_compress_free(ctx->out_ifc_list[i].compress, ctx->out_ifc_list[i].compress_state, 0);
       }
 
       free(ctx->out_ifc_list);
@@ -2528,58 +5231,33 @@ freein_on_failed:
          }
 
          if (ctx->in_ifc_list[i].buffer != NULL) {
-            free(ctx->in_ifc_list[i].buffer);
+            trap_pool_put(ctx->in_ifc_list[i].buffer);
             ctx->in_ifc_list[i].buffer = NULL;
          }
       }
    }
-freein_readers:
+freein_terminated:
    __sync_add_and_fetch(&ctx->terminated, 1);
-
-   if (ctx->reader_threads != NULL) {
-      for (i = 0; i < ctx->num_ifc_in; i++) {
-         pthread_kill(ctx->reader_threads[i].thr, 1);
-         pthread_join(ctx->reader_threads[i].thr, NULL);
-         sem_destroy(&ctx->reader_threads[i].sem);
-      }
-      free(ctx->reader_threads);
-      ctx->reader_threads = NULL;
-   }
 freein_results:
+   free(ctx->in_ifc_pollfds);
+   ctx->in_ifc_pollfds = NULL;
+   free(ctx->in_ifc_pollidx);
+   ctx->in_ifc_pollidx = NULL;
+   free(ctx->in_ifc_retry);
+   ctx->in_ifc_retry = NULL;
    if (ctx->in_ifc_results) {
       free(ctx->in_ifc_results);
       ctx->in_ifc_results = NULL;
    }
-freein_list:
    if (ctx->in_ifc_list) {
       free(ctx->in_ifc_list);
       ctx->in_ifc_list = NULL;
    }
 alloc_counter_failed:
-   if (ctx->counter_send_message) {
-      free(ctx->counter_send_message);
-      ctx->counter_send_message = NULL;
-   }
-   if (ctx->counter_recv_message) {
-      free(ctx->counter_recv_message);
-      ctx->counter_recv_message = NULL;
-   }
-   if (ctx->counter_send_buffer) {
-      free(ctx->counter_send_buffer);
-      ctx->counter_send_buffer = NULL;
-   }
-   if (ctx->counter_autoflush) {
-      free(ctx->counter_autoflush);
-      ctx->counter_autoflush = NULL;
-   }
-   if (ctx->counter_recv_buffer) {
-      free(ctx->counter_recv_buffer);
-      ctx->counter_recv_buffer = NULL;
-   }
-   if (ctx->counter_dropped_message) {
-      free(ctx->counter_dropped_message);
-      ctx->counter_dropped_message = NULL;
-   }
+   free(ctx->in_ifc_stats);
+   ctx->in_ifc_stats = NULL;
+   free(ctx->out_ifc_stats);
+   ctx->out_ifc_stats = NULL;
 
    trap_free_global_vars();
 
@@ -2769,14 +5447,116 @@ int service_send_data(int sock_d, uint32_t size, void **data)
 }
 
 
+/**
+ * Add array of counters of connected clients into JSON object of output IFC.
+ *
+ * \param[in,out] ifc_cnts  JSON object with counters of the IFC
+ * \param[in] ifc           output IFC with get_client_stats() function
+ * \return 0 on success, -1 on error
+ */
+static int encode_client_stats_to_json(json_t *ifc_cnts, trap_output_ifc_t *ifc)
+{
+   int32_t i, n;
+   trap_client_stats_t *stats = NULL;
+   json_t *clients_arr = json_array();
+   json_t *client_cnts = NULL;
+
+   if (clients_arr == NULL) {
+      return -1;
+   }
+   n = ifc->get_client_count(ifc->priv);
+   if (n > 0) {
+      stats = (trap_client_stats_t *) calloc(n, sizeof(trap_client_stats_t));
+      if (stats == NULL) {
+         goto clean_up;
+      }
+      n = ifc->get_client_stats(ifc->priv, stats, n);
+      for (i = 0; i < n; i++) {
+         client_cnts = json_pack("{sisisIsIsI}", "id", stats[i].id, "queued", stats[i].queued, "sent-buffers", stats[i].sent_buffers, "sent-bytes", stats[i].sent_bytes, "dropped-buffers", stats[i].dropped_buffers);
+         if (json_array_append_new(clients_arr, client_cnts) == -1) {
+            goto clean_up;
+         }
+      }
+      free(stats);
+   }
+   return json_object_set_new(ifc_cnts, "clients", clients_arr);
+
+clean_up:
+   free(stats);
+   json_decref(clients_arr);
+   return -1;
+}
+
+/**
+ * Add histogram of autoflush latency of output IFC to its json object.
+ *
+ * \param[in,out] ifc_cnts  json object with counters of the IFC
+ * \param[in] hist          #TRAP_AUTOFLUSH_LATENCY_BINS bins of the IFC
+ * \return 0 on success, -1 on error
+ */
+static int encode_autoflush_latency_to_json(json_t *ifc_cnts, const uint64_t *hist)
+{
+   int i;
+   json_t *hist_arr = json_array();
+
+   if (hist_arr == NULL) {
+      return -1;
+   }
+   for (i = 0; i < TRAP_AUTOFLUSH_LATENCY_BINS; i++) {
+      if (json_array_append_new(hist_arr, json_integer(TRAP_CNT_GET(hist[i]))) == -1) {
+         json_decref(hist_arr);
+         return -1;
+      }
+   }
+   return json_object_set_new(ifc_cnts, "autoflush-latency", hist_arr);
+}
+
+/**
+ * Add histogram of buffer latency of input IFC into JSON object with its counters.
+ *
+ * Only non-empty bins are added as pairs [lowest latency of the bin in us, count].
+ *
+ * \param[in,out] ifc_cnts   JSON object of the interface
+ * \param[in] st   counters of the interface
+ * \return 0 on success, -1 on error
+ */
+static int encode_buffer_latency_to_json(json_t *ifc_cnts, const trap_in_ifc_stats_t *st)
+{
+   uint32_t i;
+   uint64_t cnt;
+   json_t *lat, *bins = json_array();
+
+   if (bins == NULL) {
+      return -1;
+   }
+   for (i = 0; i < TRAP_LATENCY_BINS; i++) {
+      cnt = TRAP_CNT_GET(st->latency[i]);
+      if (cnt != 0 && json_array_append_new(bins, json_pack("[II]", (json_int_t) trap_latency_bin_min(i), (json_int_t) cnt)) == -1) {
+         json_decref(bins);
+         return -1;
+      }
+   }
+   lat = json_pack("{sIsIsIso}", "count", (json_int_t) TRAP_CNT_GET(st->latency_count), "sum", (json_int_t) TRAP_CNT_GET(st->latency_sum),
+                   "max", (json_int_t) TRAP_CNT_GET(st->latency_max), "bins", bins);
+   if (lat == NULL) {
+      return -1;
+   }
+   return json_object_set_new(ifc_cnts, "buffer-latency", lat);
+}
+
 int encode_cnts_to_json(char **data, trap_ctx_priv_t *ctx)
 {
    uint32_t x = 0;
+   trap_in_ifc_stats_t *in_st;
+   trap_out_ifc_stats_t *out_st;
+   uint64_t buffers;
    char *ifc_id = NULL;
    char none_ifc_id[] = "none";
 
    json_t *in_ifc_cnts  = NULL;
    json_t *out_ifc_cnts = NULL;
+   json_t *pool_cnts = NULL;
+   trap_pool_stats_t pool_st;
 
    uint32_t in_cnt = (ctx->num_ifc_in > 0) ? ctx->num_ifc_in : 0;
    uint32_t out_cnt = (ctx->num_ifc_out > 0) ? ctx->num_ifc_out : 0;
@@ -2799,7 +5579,13 @@ int encode_cnts_to_json(char **data, trap_ctx_priv_t *ctx)
       if (ifc_id == NULL) {
          ifc_id = none_ifc_id;
       }
-      in_ifc_cnts = json_pack("{sisssisIsI}", "ifc_state", ctx->in_ifc_list[x].is_conn(ctx->in_ifc_list[x].priv), "ifc_id", ifc_id, "ifc_type", (int) (ctx->in_ifc_list[x].ifc_type), "messages", ctx->counter_recv_message[x], "buffers", ctx->counter_recv_buffer[x]);
+      in_st = &ctx->in_ifc_stats[x];
+      in_ifc_cnts = json_pack("{sisssisIsIsIsI}", "ifc_state", ctx->in_ifc_list[x].is_conn(ctx->in_ifc_list[x].priv), "ifc_id", ifc_id, "ifc_type", (int) (ctx->in_ifc_list[x].ifc_type), "messages", (json_int_t) TRAP_CNT_GET(in_st->recv_message), "buffers", (json_int_t) TRAP_CNT_GET(in_st->recv_buffer), "bytes", (json_int_t) TRAP_CNT_GET(in_st->recv_bytes),
+                              "uncompressed-bytes", (json_int_t) TRAP_CNT_GET(in_st->recv_raw_bytes));
+      /* latency is known only when the sender uses timestamp=on */
+      if (TRAP_CNT_GET(in_st->latency_count) != 0 && encode_buffer_latency_to_json(in_ifc_cnts, in_st) != 0) {
+         VERBOSE(CL_ERROR, "Service thread - could not add buffer latency while creating json string with counters.");
+      }
       if (json_array_append_new(in_ifces_arr, in_ifc_cnts) == -1) {
          VERBOSE(CL_ERROR, "Service thread - could not append new item to out_ifces_arr while creating json string with counters..\n");
          goto clean_up;
@@ -2811,14 +5597,37 @@ int encode_cnts_to_json(char **data, trap_ctx_priv_t *ctx)
       if (ifc_id == NULL) {
          ifc_id = none_ifc_id;
       }
-      out_ifc_cnts = json_pack("{sisssisIsIsIsI}", "num_clients", ctx->out_ifc_list[x].get_client_count(ctx->out_ifc_list[x].priv), "ifc_id", ifc_id, "ifc_type", (int) (ctx->out_ifc_list[x].ifc_type), "sent-messages", ctx->counter_send_message[x], "dropped-messages", ctx->counter_dropped_message[x], "buffers", ctx->counter_send_buffer[x], "autoflushes", ctx->counter_autoflush[x]);
+      out_st = &ctx->out_ifc_stats[x];
+      buffers = TRAP_CNT_GET(out_st->send_buffer);
+      out_ifc_cnts = json_pack("{sisssisIsIsIsIsIsIsIsIsI}", "num_clients", ctx->out_ifc_list[x].get_client_count(ctx->out_ifc_list[x].priv), "ifc_id", ifc_id, "ifc_type", (int) (ctx->out_ifc_list[x].ifc_type),
+                               "sent-messages", (json_int_t) TRAP_CNT_GET(out_st->send_message), "dropped-messages", (json_int_t) TRAP_CNT_GET(out_st->dropped_message),
+                               "buffers", (json_int_t) buffers, "autoflushes", (json_int_t) TRAP_CNT_GET(out_st->autoflush), "autoflush-timeout", (json_int_t) ctx->out_ifc_list[x].timeout,
+                               "sent-bytes", (json_int_t) TRAP_CNT_GET(out_st->send_bytes), "uncompressed-bytes", (json_int_t) TRAP_CNT_GET(out_st->send_raw_bytes),
+                               "send-blocked-time", (json_int_t) TRAP_CNT_GET(out_st->send_blocked),
+                               "buffer-fill", (json_int_t) (buffers != 0 ? TRAP_CNT_GET(out_st->send_fill) / buffers : 0));
+      if (encode_autoflush_latency_to_json(out_ifc_cnts, out_st->autoflush_latency) != 0) {
+         VERBOSE(CL_ERROR, "Service thread - could not add autoflush latency while creating json string with counters.");
+      }
+      if (ctx->out_ifc_list[x].get_client_stats != NULL && encode_client_stats_to_json(out_ifc_cnts, &ctx->out_ifc_list[x]) != 0) {
+         VERBOSE(CL_ERROR, "Service thread - could not add client counters while creating json string with counters.");
+      }
       if (json_array_append_new(out_ifces_arr, out_ifc_cnts) == -1) {
          VERBOSE(CL_ERROR, "Service thread - could not append new item to out_ifces_arr while creating json string with counters..\n");
          goto clean_up;
       }
    }
 
-   result_json = json_pack("{sisisoso}", "in_cnt", in_cnt, "out_cnt", out_cnt, "in", in_ifces_arr, "out", out_ifces_arr);
+   trap_pool_get_stats(&pool_st);
+   pool_cnts = json_pack("{sIsIsIsIsIsI}", "buffers", (json_int_t) pool_st.buffers, "used", (json_int_t) pool_st.used,
+                         "used-bytes", (json_int_t) pool_st.used_bytes, "max-used-bytes", (json_int_t) pool_st.max_used_bytes,
+                         "mapped-bytes", (json_int_t) pool_st.mapped_bytes, "huge-bytes", (json_int_t) pool_st.huge_bytes);
+   if (pool_cnts == NULL) {
+      VERBOSE(CL_ERROR, "Service thread - could not create pool counters while creating json string with counters.");
+      goto clean_up;
+   }
+
+   result_json = json_pack("{sisisososo}", "in_cnt", in_cnt, "out_cnt", out_cnt, "in", in_ifces_arr, "out", out_ifces_arr,
+                           "pool", pool_cnts);
    if (result_json == NULL) {
       VERBOSE(CL_ERROR, "Service thread - could not create final json object while creating json string with counters.");
       goto clean_up;
@@ -3386,22 +6195,28 @@ int output_ifc_negotiation(void *ifc_priv_data, char ifc_type, uint32_t client_i
    uint8_t data_type = TRAP_FMT_UNKNOWN;
    char *data_fmt_spec = NULL;
    uint32_t ifc_idx = 0;
+   trap_output_ifc_t *out_ifc = NULL;
+   hello_msg_ext_t hello_ext;
+   int send_ext = 0;
 
    // Decide which structure can be used for interfaces private data
    if (ifc_type == TRAP_IFC_TYPE_FILE) {
       file_ifc_priv = (file_private_t *) ifc_priv_data;
+      out_ifc = &file_ifc_priv->ctx->out_ifc_list[file_ifc_priv->ifc_idx];
       data_type = file_ifc_priv->ctx->out_ifc_list[file_ifc_priv->ifc_idx].data_type;
       data_fmt_spec = file_ifc_priv->ctx->out_ifc_list[file_ifc_priv->ifc_idx].data_fmt_spec;
       ifc_idx = file_ifc_priv->ifc_idx;
 #if HAVE_OPENSSL
    } else if (ifc_type == TRAP_IFC_TYPE_TLS) {
       tls_ifc_priv = (tls_sender_private_t *) ifc_priv_data;
+      out_ifc = &tls_ifc_priv->ctx->out_ifc_list[tls_ifc_priv->ifc_idx];
       data_type = tls_ifc_priv->ctx->out_ifc_list[tls_ifc_priv->ifc_idx].data_type;
       data_fmt_spec = tls_ifc_priv->ctx->out_ifc_list[tls_ifc_priv->ifc_idx].data_fmt_spec;
       ifc_idx = tls_ifc_priv->ifc_idx;
 #endif
    } else if (ifc_type == TRAP_IFC_TYPE_TCPIP || ifc_type == TRAP_IFC_TYPE_UNIX) {
       tcp_ifc_priv = (tcpip_sender_private_t *) ifc_priv_data;
+      out_ifc = &tcp_ifc_priv->ctx->out_ifc_list[tcp_ifc_priv->ifc_idx];
       data_type = tcp_ifc_priv->ctx->out_ifc_list[tcp_ifc_priv->ifc_idx].data_type;
       data_fmt_spec = tcp_ifc_priv->ctx->out_ifc_list[tcp_ifc_priv->ifc_idx].data_fmt_spec;
       ifc_idx = tcp_ifc_priv->ifc_idx;
@@ -3435,10 +6250,19 @@ int output_ifc_negotiation(void *ifc_priv_data, char ifc_type, uint32_t client_i
       } else {
          hello_msg_header->data_fmt_spec_size = strlen(data_fmt_spec);
       }
+      /* Announce non-default buffer parameters only when they are used, so that
+       * the negotiation stays compatible with older receivers otherwise. */
+      if (out_ifc->buffer_size != TRAP_IFC_MESSAGEQ_SIZE || out_ifc->large_msgs != 0 || out_ifc->timestamp != 0 ||
+          out_ifc->compress != TRAP_COMPRESS_OFF) {
+         send_ext = 1;
+      }
    }
 
    hello_msg_header_t tmp = *hello_msg_header;
    tmp.data_fmt_spec_size = htonl(hello_msg_header->data_fmt_spec_size);
+   if (send_ext) {
+      tmp.data_type |= TRAP_HELLO_EXT;
+   }
 
    memcpy(buffer, &tmp, sizeof(hello_msg_header_t));
    size = sizeof(hello_msg_header_t);
@@ -3470,6 +6294,40 @@ int output_ifc_negotiation(void *ifc_priv_data, char ifc_type, uint32_t client_i
       VERBOSE(CL_VERBOSE_LIBRARY, "OK");
    }
 
+   if (send_ext) {
+      VERBOSE(CL_VERBOSE_LIBRARY, "Step 1b: sending hello msg extension...   ");
+      hello_ext.buffer_size = htonl(out_ifc->buffer_size);
+      hello_ext.flags = (out_ifc->large_msgs != 0 ? TRAP_HELLO_FLAG_LARGE_MSGS : 0) |
+                        (out_ifc->timestamp != 0 ? TRAP_HELLO_FLAG_TIMESTAMP : 0) |
+                        (out_ifc->compress == TRAP_COMPRESS_LZ4 ? TRAP_HELLO_FLAG_LZ4 : 0) |
+                        (out_ifc->compress == TRAP_COMPRESS_ZSTD ? TRAP_HELLO_FLAG_ZSTD : 0);
+      size = sizeof(hello_msg_ext_t);
+      p = (char *) &hello_ext;
+      if (ifc_type == TRAP_IFC_TYPE_FILE) {
+         ret_val = fwrite((void *) p, sizeof(char), size, file_ifc_priv->fd);
+         compare = size;
+#if HAVE_OPENSSL
+      } else if (ifc_type == TRAP_IFC_TYPE_TLS) {
+         ret_val = SSL_write(tls_ifc_priv->clients[client_idx].ssl, p, size);
+         if (ret_val > 0) {
+            compare = ret_val;
+         } else {
+            compare = ret_val + 1;
+         }
+#endif
+      } else if (ifc_type == TRAP_IFC_TYPE_TCPIP || ifc_type == TRAP_IFC_TYPE_UNIX) {
+         ret_val = service_send_data(sock_d, size, (void **)&p);
+         compare = TRAP_E_OK;
+      }
+      if (ret_val != compare) {
+         VERBOSE(CL_VERBOSE_LIBRARY, "ERROR");
+         neg_result = NEG_RES_FAILED;
+         goto out_neg_exit;
+      } else {
+         VERBOSE(CL_VERBOSE_LIBRARY, "OK");
+      }
+   }
+
    // Data format specifier is sent only if the data format is set to JSON or UNIREC
    if ((data_type == TRAP_FMT_UNIREC || data_type == TRAP_FMT_JSON) && data_fmt_spec != NULL) {
       VERBOSE(CL_VERBOSE_LIBRARY, "Step 2: sending data_fmt_spec...   ");
@@ -3547,22 +6405,28 @@ int input_ifc_negotiation(void *ifc_priv_data, char ifc_type)
    char *req_data_fmt_spec = NULL;
    char *current_data_fmt_spec = NULL;
    char *recv_data_fmt_spec = NULL;
+   trap_input_ifc_t *in_ifc = NULL;
+   hello_msg_ext_t hello_ext;
+   uint8_t compress = TRAP_COMPRESS_OFF;
 
    // Decide which structure can be used for interfaces private data
    if (ifc_type == TRAP_IFC_TYPE_FILE) {
       file_ifc_priv = (file_private_t *) ifc_priv_data;
+      in_ifc = &file_ifc_priv->ctx->in_ifc_list[file_ifc_priv->ifc_idx];
       req_data_type = file_ifc_priv->ctx->in_ifc_list[file_ifc_priv->ifc_idx].req_data_type;
       req_data_fmt_spec = file_ifc_priv->ctx->in_ifc_list[file_ifc_priv->ifc_idx].req_data_fmt_spec;
       current_data_fmt_spec = file_ifc_priv->ctx->in_ifc_list[file_ifc_priv->ifc_idx].data_fmt_spec;
 #if HAVE_OPENSSL
    } else if (ifc_type == TRAP_IFC_TYPE_TLS) {
       tls_ifc_priv = (tls_receiver_private_t *) ifc_priv_data;
+      in_ifc = &tls_ifc_priv->ctx->in_ifc_list[tls_ifc_priv->ifc_idx];
       req_data_type = tls_ifc_priv->ctx->in_ifc_list[tls_ifc_priv->ifc_idx].req_data_type;
       req_data_fmt_spec = tls_ifc_priv->ctx->in_ifc_list[tls_ifc_priv->ifc_idx].req_data_fmt_spec;
       current_data_fmt_spec = tls_ifc_priv->ctx->in_ifc_list[tls_ifc_priv->ifc_idx].data_fmt_spec;
 #endif
    } else if (ifc_type == TRAP_IFC_TYPE_TCPIP || ifc_type == TRAP_IFC_TYPE_UNIX) {
       tcp_ifc_priv = (tcpip_receiver_private_t *) ifc_priv_data;
+      in_ifc = &tcp_ifc_priv->ctx->in_ifc_list[tcp_ifc_priv->ifc_idx];
       req_data_type = tcp_ifc_priv->ctx->in_ifc_list[tcp_ifc_priv->ifc_idx].req_data_type;
       req_data_fmt_spec = tcp_ifc_priv->ctx->in_ifc_list[tcp_ifc_priv->ifc_idx].req_data_fmt_spec;
       current_data_fmt_spec = tcp_ifc_priv->ctx->in_ifc_list[tcp_ifc_priv->ifc_idx].data_fmt_spec;
@@ -3623,6 +6487,67 @@ int input_ifc_negotiation(void *ifc_priv_data, char ifc_type)
       VERBOSE(CL_VERBOSE_LIBRARY, "receiver's data_type: %"PRIu8, req_data_type);
    }
 
+   /** Receive optional extension with sender's buffer parameters */
+   if ((hello_msg_header->data_type & TRAP_HELLO_EXT) != 0) {
+      hello_msg_header->data_type &= ~TRAP_HELLO_EXT;
+      VERBOSE(CL_VERBOSE_LIBRARY, "Step 1b: reading hello msg extension...   ");
+      size = sizeof(hello_msg_ext_t);
+      p_p = (void *) &hello_ext;
+
+      if (ifc_type == TRAP_IFC_TYPE_FILE) {
+         ret_val = fread(p_p, sizeof(char), size, file_ifc_priv->fd);
+         compare = size;
+      } else if (ifc_type == TRAP_IFC_TYPE_TCPIP || ifc_type == TRAP_IFC_TYPE_UNIX) {
+         ret_val = service_get_data(tcp_ifc_priv->sd, size, &p_p);
+         compare = TRAP_E_OK;
+#if HAVE_OPENSSL
+      } else if (ifc_type == TRAP_IFC_TYPE_TLS) {
+         ret_val = SSL_read(tls_ifc_priv->ssl, p_p, size);
+         if (ret_val > 0) {
+            compare = ret_val;
+         } else {
+            compare = ret_val + 1;
+         }
+#endif
+      }
+      if (ret_val == compare) {
+         hello_ext.buffer_size = ntohl(hello_ext.buffer_size);
+         VERBOSE(CL_VERBOSE_LIBRARY, "sender's buffer size: %"PRIu32", flags: %"PRIu8,
+                 hello_ext.buffer_size, hello_ext.flags);
+         if (hello_ext.buffer_size > TRAP_IFC_MAX_BUFFER_SIZE ||
+             trap_in_ifc_resize_buffer(in_ifc, hello_ext.buffer_size) != TRAP_E_OK) {
+            VERBOSE(CL_ERROR, "Input IFC negotiation - could not accept sender's buffer size %"PRIu32" B.",
+                    hello_ext.buffer_size);
+            ret_val = compare + 1;
+         }
+         compress = TRAP_COMPRESS_OFF;
+         if ((hello_ext.flags & TRAP_HELLO_FLAG_LZ4) != 0) {
+            compress = TRAP_COMPRESS_LZ4;
+         } else if ((hello_ext.flags & TRAP_HELLO_FLAG_ZSTD) != 0) {
+            compress = TRAP_COMPRESS_ZSTD;
+         }
+         if (trap_compress_available(compress) == 0) {
+            VERBOSE(CL_ERROR, "Input IFC negotiation - sender compresses buffers by %s, libtrap was built without it.",
+                    trap_compress_name(compress));
+            ret_val = compare + 1;
+         }
+      }
+      if (ret_val != compare) {
+         VERBOSE(CL_VERBOSE_LIBRARY, "ERROR");
+         in_ifc->client_state = FMT_WAITING;
+         neg_result = NEG_RES_FAILED;
+         goto in_neg_exit;
+      }
+      in_ifc->large_msgs = ((hello_ext.flags & TRAP_HELLO_FLAG_LARGE_MSGS) != 0);
+      in_ifc->timestamp = ((hello_ext.flags & TRAP_HELLO_FLAG_TIMESTAMP) != 0);
+      trap_in_ifc_set_compress(in_ifc, compress);
+      VERBOSE(CL_VERBOSE_LIBRARY, "OK");
+   } else {
+      in_ifc->large_msgs = 0;
+      in_ifc->timestamp = 0;
+      trap_in_ifc_set_compress(in_ifc, TRAP_COMPRESS_OFF);
+   }
+
 
    /** Compare data_type */
    // What if input interface has no specified data format or data specifier? TODO!!!
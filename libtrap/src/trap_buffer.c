@@ -94,12 +94,6 @@ static int _tb_block_destroy(tb_block_t *b)
    }
 }
 
-static inline tb_block_t *tb_computenext_blockp(trap_buffer_t *tb, uint16_t curidx)
-{
-   uint16_t bi = (curidx + 1) % tb->nblocks;
-   return (tb_block_t *) (tb->mem + (BLOCKSIZE_TOTAL(tb) * bi));
-}
-
 void tb_next_wr_block(trap_buffer_t *tb)
 {
    uint16_t bi = (tb->cur_wr_block_idx + 1) % tb->nblocks;
@@ -122,14 +116,14 @@ void tb_next_rd_block(trap_buffer_t *tb)
 
 void tb_first_rd_block(trap_buffer_t *b)
 {
-   b->cur_rd_block = (tb_block_t *) b->mem;
+   b->cur_rd_block = b->blocks[0];
    b->cur_rd_block_idx = 0;
    DBG_PRINT("move block %p\n", b->cur_rd_block);
 }
 
 void tb_first_wr_block(trap_buffer_t *b)
 {
-   b->cur_wr_block = (tb_block_t *) b->mem;
+   b->cur_wr_block = b->blocks[0];
    b->cur_wr_block_idx = 0;
    DBG_PRINT("move block %p\n", b->cur_wr_block);
 }
@@ -143,10 +137,13 @@ int tb_isblockfree(tb_block_t *b)
    }
 }
 
-trap_buffer_t *tb_init(uint16_t nblocks, uint32_t blocksize)
+static trap_buffer_t *_tb_init(uint16_t nblocks, uint32_t blocksize, tb_alloc_func_t alloc_fn, tb_free_func_t free_fn)
 {
    uint16_t i = 0;
    trap_buffer_t *n = NULL;
+   tb_block_t *bl;
+   size_t stride;
+
    if (nblocks == 0 || blocksize == 0) {
       return NULL;
    }
@@ -157,7 +154,10 @@ trap_buffer_t *tb_init(uint16_t nblocks, uint32_t blocksize)
 
    n->blocksize = blocksize;
    n->nblocks = nblocks;
-   n->mem = malloc(nblocks * BLOCKSIZE_TOTAL(n));
+   n->free_data = free_fn;
+   /* without alloc_fn, data follow their block */
+   stride = (alloc_fn == NULL) ? BLOCKSIZE_TOTAL(n) : sizeof(tb_block_t);
+   n->mem = malloc(nblocks * stride);
    if (n->mem == NULL) {
       free(n);
       return NULL;
@@ -170,22 +170,57 @@ trap_buffer_t *tb_init(uint16_t nblocks, uint32_t blocksize)
       return NULL;
    }
 
+   for (i = 0; i < nblocks; i++) {
+      bl = (tb_block_t *) (n->mem + (stride * i));
+      if (alloc_fn == NULL) {
+         bl->data = (struct tb_block_data_s *) (bl + 1);
+      } else {
+         bl->data = alloc_fn(blocksize);
+         if (bl->data == NULL) {
+            while (i-- > 0) {
+               _tb_block_destroy(n->blocks[i]);
+               free_fn(n->blocks[i]->data);
+            }
+            free(n->blocks);
+            free(n->mem);
+            free(n);
+            return NULL;
+         }
+      }
+      _tb_block_init(bl);
+      n->blocks[i] = bl;
+   }
+
    if (pthread_mutex_init(&n->lock, NULL) != 0) {
-      free(n->mem);
-      free(n);
+      tb_destroy(&n);
       return NULL;
    }
    tb_first_wr_block(n);
    tb_first_rd_block(n);
 
-   tb_block_t *bl = n->cur_wr_block;
-   for (i = 0; i < nblocks; i++) {
-      _tb_block_init(bl);
-      n->blocks[i] = bl;
-      bl = tb_computenext_blockp(n, i);
+   return n;
+}
+
+trap_buffer_t *tb_init(uint16_t nblocks, uint32_t blocksize)
+{
+   return _tb_init(nblocks, blocksize, NULL, NULL);
+}
+
+trap_buffer_t *tb_init_ext(uint16_t nblocks, uint32_t blocksize, tb_alloc_func_t alloc_fn, tb_free_func_t free_fn)
+{
+   if (alloc_fn == NULL || free_fn == NULL) {
+      return NULL;
    }
+   return _tb_init(nblocks, blocksize, alloc_fn, free_fn);
+}
 
-   return n;
+void *tb_block_set_data(tb_block_t *bl, void *data)
+{
+   void *old = bl->data;
+
+   bl->data = (struct tb_block_data_s *) data;
+   _tb_block_clear(bl);
+   return old;
 }
 
 void tb_destroy(trap_buffer_t **b)
@@ -197,10 +232,11 @@ void tb_destroy(trap_buffer_t **b)
 
    trap_buffer_t *p = (*b);
 
-   tb_first_wr_block(p);
    for (i = 0; i < p->nblocks; i++) {
-      _tb_block_destroy(p->cur_wr_block);
-      tb_next_wr_block(p);
+      _tb_block_destroy(p->blocks[i]);
+      if (p->free_data != NULL) {
+         p->free_data(p->blocks[i]->data);
+      }
    }
 
    free(p->mem);
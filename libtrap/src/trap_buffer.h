@@ -93,16 +93,34 @@ typedef struct tb_block_s {
 
    /**
     * Pointer to data in the block (to the header of the first message)
+    *
+    * Data follow the block in memory of tb_init(), they are allocated
+    * separately by tb_init_ext() and can be replaced by tb_block_set_data().
     */
-   struct tb_block_data_s data[0];
+   struct tb_block_data_s *data;
 } tb_block_t;
 
+/**
+ * Function allocating data of a block, see tb_init_ext().
+ */
+typedef void *(*tb_alloc_func_t)(size_t size);
+
+/**
+ * Function freeing data of a block, see tb_init_ext().
+ */
+typedef void (*tb_free_func_t)(void *data);
+
 typedef struct trap_buffer_s {
    /**
     * Pointer to internal memory containing the whole ring buffer.
     */
    char *mem;
 
+   /**
+    * Function freeing data of blocks, NULL if data are in mem.
+    */
+   tb_free_func_t free_data;
+
    /**
     * Pointer to current block
     */
@@ -156,6 +174,30 @@ typedef struct trap_buffer_s {
  */
 trap_buffer_t *tb_init(uint16_t nblocks, uint32_t blocksize);
 
+/**
+ * Create a new buffer like tb_init(), data of every block are allocated separately.
+ *
+ * \param[in] nblocks   Number of blocks that will be stored in the ring buffer.
+ * \param[in] blocksize Maximal size of each block.
+ * \param[in] alloc_fn  Function allocating data of a block.
+ * \param[in] free_fn   Function freeing data of a block (called by tb_destroy()).
+ * \return Pointer to the buffer struct, NULL on error.
+ */
+trap_buffer_t *tb_init_ext(uint16_t nblocks, uint32_t blocksize, tb_alloc_func_t alloc_fn, tb_free_func_t free_fn);
+
+/**
+ * Replace data of the block, the previous data are returned to the caller.
+ *
+ * The block must not be used by the reader, the new data must have the
+ * size of blocks.  The block becomes free (size is set to 0), the rest of
+ * data is kept.  It is allowed only for buffers created by tb_init_ext().
+ *
+ * \param[in] bl    Pointer to the block.
+ * \param[in] data  New data allocated by alloc_fn of tb_init_ext().
+ * \return Previous data of the block, the caller frees them.
+ */
+void *tb_block_set_data(tb_block_t *bl, void *data);
+
 /**
  * Free memory and set the pointer to NULL.
  * \param[in] tb Pointer to the TRAP buffer.
@@ -200,6 +242,12 @@ int tb_isblockfree(tb_block_t *bl);
 /**
  * \defgroup trap_buffer_send    Output IFC
  * A set of functions used for output IFC (module sends messages).
+ *
+ * Output IFCs of libtrap use the ring only as storage of blocks between
+ * the module and the sender thread (out_ifc_list[ifc].tb), messages are
+ * stored by trap.c and the functions of this group are not used there.
+ * The ring has a single read position (cur_rd_block), it does not track
+ * clients of the IFC.
  * @{
  */
 /**
@@ -0,0 +1,173 @@
+/**
+ * \file trap_compress.c
+ * \brief Compression of buffers of output IFCs (LZ4, Zstandard)
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "../include/libtrap/trap.h"
+#include "trap_compress.h"
+
+/**
+ * \addtogroup trap_compress
+ * @{
+ */
+
+int trap_compress_available(uint8_t method)
+{
+   switch (method) {
+   case TRAP_COMPRESS_OFF:
+      return 1;
+#if HAVE_LZ4
+   case TRAP_COMPRESS_LZ4:
+      return 1;
+#endif
+#if HAVE_ZSTD
+   case TRAP_COMPRESS_ZSTD:
+      return 1;
+#endif
+   default:
+      return 0;
+   }
+}
+
+const char *trap_compress_name(uint8_t method)
+{
+   switch (method) {
+   case TRAP_COMPRESS_OFF:
+      return "off";
+   case TRAP_COMPRESS_LZ4:
+      return "lz4";
+   case TRAP_COMPRESS_ZSTD:
+      return "zstd";
+   default:
+      return "unknown";
+   }
+}
+
+uint32_t trap_compress(uint8_t method, void **state, void *dst, uint32_t dst_size, const void *src, uint32_t src_size)
+{
+#if HAVE_ZSTD
+   size_t zs;
+#endif
+
+   switch (method) {
+#if HAVE_LZ4
+   case TRAP_COMPRESS_LZ4:
+      /* LZ4 state would take 16 kB of stack otherwise */
+      if (*state == NULL && (*state = malloc(LZ4_sizeofState())) == NULL) {
+         return 0;
+      }
+      return LZ4_compress_fast_extState(*state, src, dst, src_size, dst_size, 1);
+#endif
+#if HAVE_ZSTD
+   case TRAP_COMPRESS_ZSTD:
+      if (*state == NULL && (*state = ZSTD_createCCtx()) == NULL) {
+         return 0;
+      }
+      zs = ZSTD_compressCCtx(*state, dst, dst_size, src, src_size, TRAP_COMPRESS_ZSTD_LEVEL);
+      return ZSTD_isError(zs) ? 0 : zs;
+#endif
+   default:
+      return 0;
+   }
+}
+
+int trap_decompress(uint8_t method, void **state, void *dst, uint32_t dst_size, const void *src, uint32_t src_size)
+{
+#if HAVE_ZSTD
+   size_t zs;
+#endif
+
+   switch (method) {
+#if HAVE_LZ4
+   case TRAP_COMPRESS_LZ4:
+      if (LZ4_decompress_safe(src, dst, src_size, dst_size) != (int) dst_size) {
+         return TRAP_E_IO_ERROR;
+      }
+      return TRAP_E_OK;
+#endif
+#if HAVE_ZSTD
+   case TRAP_COMPRESS_ZSTD:
+      if (*state == NULL && (*state = ZSTD_createDCtx()) == NULL) {
+         return TRAP_E_IO_ERROR;
+      }
+      zs = ZSTD_decompressDCtx(*state, dst, dst_size, src, src_size);
+      if (ZSTD_isError(zs) || zs != dst_size) {
+         return TRAP_E_IO_ERROR;
+      }
+      return TRAP_E_OK;
+#endif
+   default:
+      return TRAP_E_IO_ERROR;
+   }
+}
+
+void trap_compress_free(uint8_t method, void *state, int decompress)
+{
+   if (state == NULL) {
+      return;
+   }
+   switch (method) {
+#if HAVE_ZSTD
+   case TRAP_COMPRESS_ZSTD:
+      if (decompress != 0) {
+         ZSTD_freeDCtx(state);
+      } else {
+         ZSTD_freeCCtx(state);
+      }
+      break;
+#endif
+   default:
+      free(state);
+      break;
+   }
+}
+
+/**
+ * @}
+ */
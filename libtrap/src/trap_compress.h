@@ -0,0 +1,125 @@
+/**
+ * \file trap_compress.h
+ * \brief Compression of buffers of output IFCs (LZ4, Zstandard)
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TRAP_COMPRESS_H
+#define TRAP_COMPRESS_H
+
+#include <stdint.h>
+
+/**
+ * \defgroup trap_compress compression
+ *
+ * Whole buffers are compressed by the output IFC with "compress=" parameter
+ * and decompressed by the input IFC before messages are read from them.
+ * Libraries of compression methods are optional, when libtrap is built
+ * without them, trap_compress_available() returns 0.
+ * @{
+ */
+
+/** Compression method of buffers of an IFC ("compress=" IFC parameter) */
+enum trap_compress_method {
+   TRAP_COMPRESS_OFF = 0, ///< Buffers are sent as they are
+   TRAP_COMPRESS_LZ4 = 1, ///< LZ4 (fast)
+   TRAP_COMPRESS_ZSTD = 2 ///< Zstandard (better ratio)
+};
+
+/**
+ * Level of Zstandard compression, the lowest one is fast enough for the sender.
+ */
+#define TRAP_COMPRESS_ZSTD_LEVEL 1
+
+/**
+ * \brief Check whether libtrap was built with the library of compression method.
+ *
+ * \param[in] method  #trap_compress_method
+ * \return 1 if the method can be used, 0 otherwise
+ */
+int trap_compress_available(uint8_t method);
+
+/**
+ * \brief Get name of compression method as used by "compress=" IFC parameter.
+ *
+ * \param[in] method  #trap_compress_method
+ * \return name of the method
+ */
+const char *trap_compress_name(uint8_t method);
+
+/**
+ * \brief Compress data.
+ *
+ * \param[in] method     #trap_compress_method
+ * \param[in,out] state  state of the method kept between calls, pointer to NULL for the first call
+ * \param[out] dst       buffer for compressed data
+ * \param[in] dst_size   size of dst
+ * \param[in] src        data to compress
+ * \param[in] src_size   size of data
+ * \return size of compressed data, 0 if the data do not fit into dst or compression failed
+ */
+uint32_t trap_compress(uint8_t method, void **state, void *dst, uint32_t dst_size, const void *src, uint32_t src_size);
+
+/**
+ * \brief Decompress data compressed by trap_compress().
+ *
+ * \param[in] method     #trap_compress_method
+ * \param[in,out] state  state of the method kept between calls, pointer to NULL for the first call
+ * \param[out] dst       buffer for decompressed data
+ * \param[in] dst_size   expected size of decompressed data
+ * \param[in] src        compressed data
+ * \param[in] src_size   size of compressed data
+ * \return TRAP_E_OK on success, TRAP_E_IO_ERROR if the data are corrupted or the method is not available
+ */
+int trap_decompress(uint8_t method, void **state, void *dst, uint32_t dst_size, const void *src, uint32_t src_size);
+
+/**
+ * \brief Release state of compression method, it is safe to call it with NULL state.
+ *
+ * \param[in] method  #trap_compress_method
+ * \param[in] state   state created by trap_compress() or trap_decompress()
+ * \param[in] decompress  1 if the state was created by trap_decompress()
+ */
+void trap_compress_free(uint8_t method, void *state, int decompress);
+
+/**
+ * @}
+ */
+
+#endif
@@ -99,6 +99,21 @@ typedef int (*ifc_recv_func_t)(void *p, void *d, uint32_t *s, int t);
  */
 typedef int (*ifc_send_func_t)(void *p, const void *d, uint32_t s, int t);
 
+/**
+ * Send buffer to the client given by index of the buffer ("shard=hash").
+ *
+ * The same as ifc_send_func_t, the buffer is sent to the client with order
+ * `slot` modulo the number of connected clients (see ifc_get_client_count_func_t).
+ *
+ * \param[in] p     pointer to IFC's private memory allocated by constructor
+ * \param[in] d     pointer to message that will be sent
+ * \param[in] s     size (in bytes) of message that will be sent
+ * \param[in] slot  index of the buffer
+ * \param[in] t     timeout, see \ref trap_timeout
+ * \returns TRAP_E_OK on success
+ */
+typedef int (*ifc_send_slot_func_t)(void *p, const void *d, uint32_t s, uint32_t slot, int t);
+
 /**
  * Disconnect all connected clients to output IFC.
  *
@@ -156,6 +171,74 @@ typedef char * (*ifc_get_id_func_t)(void *priv);
  */
 typedef uint8_t (*ifc_is_conn_func_t)(void *priv);
 
+#define TRAP_IFC_POLL_NONE (-1)  ///< IFC cannot be waited for by poll(), see #ifc_get_pollfd_func_t
+#define TRAP_IFC_POLL_READY (-2) ///< IFC has data that can be received without waiting, see #ifc_get_pollfd_func_t
+
+/**
+ * Get file descriptor to wait for data of input IFC.
+ *
+ * It is used to wait for more input IFCs at once, the function is optional.
+ *
+ * \param[in] p   pointer to IFC's private memory allocated by constructor
+ * \returns file descriptor that becomes readable (POLLIN) when recv can make
+ * progress without waiting, #TRAP_IFC_POLL_READY when data are already
+ * available, or #TRAP_IFC_POLL_NONE when the IFC cannot be waited for
+ * (e.g. it is not connected)
+ */
+typedef int (*ifc_get_pollfd_func_t)(void *p);
+
+
+/**
+ * Counters of one client connected to output IFC.
+ */
+typedef struct trap_client_stats_s {
+   int32_t id;                ///< Index of the client in the IFC
+   uint32_t queued;           ///< Number of buffers waiting for sending to the client
+   uint64_t sent_buffers;     ///< Number of buffers sent to the client
+   uint64_t sent_bytes;       ///< Number of bytes sent to the client
+   uint64_t dropped_buffers;  ///< Number of buffers dropped because the client was too slow
+} trap_client_stats_t;
+
+/**
+ * Get counters of connected clients.
+ *
+ * \param[in] p   pointer to IFC's private memory allocated by constructor
+ * \param[out] s  array of at least n elements to fill
+ * \param[in] n   maximal number of clients to fill
+ * \returns number of filled elements
+ */
+typedef int32_t (*ifc_get_client_stats_func_t)(void *p, trap_client_stats_t *s, int32_t n);
+
+/**
+ * Behavior of output IFC when a client does not keep up with other clients,
+ * it can be set by "clientpolicy=" IFC parameter.
+ */
+enum trap_client_policy {
+   TRAP_CLIENT_POLICY_BLOCK,     ///< wait until the slowest client has space in its queue
+   TRAP_CLIENT_POLICY_DROP,      ///< drop the oldest buffer from the full queue of the client
+   TRAP_CLIENT_POLICY_DISCONNECT ///< drop like TRAP_CLIENT_POLICY_DROP, disconnect the client when it is behind for too long
+};
+
+/**
+ * Distribution of buffers among clients of output IFC, it can be set by
+ * "shard=" IFC parameter.
+ */
+enum trap_shard_mode {
+   TRAP_SHARD_OFF,  ///< every buffer is sent to all clients
+   TRAP_SHARD_RR,   ///< every buffer is sent to one client, clients take turns
+   TRAP_SHARD_HASH  ///< messages are distributed by the key returned by the function set by trap_ctx_set_shard_key()
+};
+
+/**
+ * Options of sockets of TCP, TLS and UNIX IFC, 0 means the system default.
+ * They can be set by "sndbuf=", "rcvbuf=", "nodelay=" and "busypoll=" IFC parameters.
+ */
+typedef struct trap_sockopts_s {
+   uint32_t sndbuf;   ///< SO_SNDBUF in bytes
+   uint32_t rcvbuf;   ///< SO_RCVBUF in bytes
+   uint8_t nodelay;   ///< If 1, set TCP_NODELAY (TCP and TLS only)
+   uint32_t busypoll; ///< SO_BUSY_POLL in microseconds
+} trap_sockopts_t;
 
 /**
  * @}
@@ -166,6 +249,7 @@ typedef struct trap_input_ifc_s {
    ifc_is_conn_func_t is_conn; ///< Pointer to is_connected function
    ifc_get_id_func_t get_id;       ///< Pointer to get_id function
    ifc_recv_func_t recv;           ///< Pointer to receive function
+   ifc_get_pollfd_func_t get_pollfd; ///< Pointer to function returning file descriptor to wait for data (optional)
    ifc_terminate_func_t terminate; ///< Pointer to terminate function
    ifc_destroy_func_t destroy;     ///< Pointer to destructor function
    ifc_create_dump_func_t create_dump; ///< Pointer to function for generating of dump
@@ -173,6 +257,15 @@ typedef struct trap_input_ifc_s {
    char *buffer;                   ///< Internal pointer to buffer for messages
    char *buffer_pointer;           ///< Internal pointer to current message in buffer
    uint32_t buffer_full;           ///< Internal used space in message buffer (0 for empty buffer)
+   uint32_t buffer_size;           ///< Size of allocated message buffer, it grows according to the negotiated size of sender's buffer
+   uint8_t large_msgs;             ///< If 1, messages in buffer are preceded by 32-bit length (negotiated), otherwise by 16-bit length
+   uint8_t timestamp;              ///< If 1, data of received buffers end with the time of sending (negotiated)
+   uint8_t compress;               ///< Compression method of received buffers (#trap_compress_method, negotiated)
+   void *compress_state;           ///< State of decompression, see trap_decompress()
+   char *compress_buf;             ///< Buffer for decompressed data, it is swapped with buffer after decompression
+   uint32_t compress_buf_size;     ///< Size of allocated compress_buf
+   uint8_t uring;                  ///< If 1, TCP/UNIX IFC receives data using io_uring, it can be set by "uring=" IFC parameter
+   trap_sockopts_t sockopts;       ///< Options of the socket of TCP/TLS/UNIX IFC
    int32_t datatimeout;            ///< Timeout for *_recv() calls
 
    /**
@@ -222,17 +315,52 @@ typedef struct trap_output_ifc_s {
    ifc_get_id_func_t get_id;       ///< Pointer to get_id function
    ifc_disconn_clients_func_t disconn_clients; ///< Pointer to disconnect_clients function
    ifc_send_func_t send;           ///< Pointer to send function
+   ifc_send_slot_func_t send_slot; ///< Pointer to send function of "shard=hash", NULL if the IFC does not support it
    ifc_terminate_func_t terminate; ///< Pointer to terminate function
    ifc_destroy_func_t destroy;     ///< Pointer to destructor function
    ifc_create_dump_func_t create_dump; ///< Pointer to function for generating of dump
    ifc_get_client_count_func_t get_client_count;  ///< Pointer to get_client_count function
+   ifc_get_client_stats_func_t get_client_stats;  ///< Pointer to get_client_stats function, NULL if the IFC does not have per-client counters
    void *priv;                     ///< Pointer to instance's private data
    unsigned char *buffer;          ///< Internal pointer to buffer for messages
    unsigned char *buffer_header;   ///< Internal pointer to header of buffer followed by payload
    uint32_t buffer_index;          ///< Internal index in buffer for new message
+   uint32_t buffer_size;           ///< Size of buffer for messages (without trap_buffer_header_t), it can be set by "bufsize=" IFC parameter
+   uint8_t large_msgs;             ///< If 1, messages in buffer are preceded by 32-bit length instead of 16-bit, it can be set by "largemsg=" IFC parameter
+   uint8_t timestamp;              ///< If 1, the time of sending is appended to data of every buffer, it can be set by "timestamp=" IFC parameter
+   uint8_t compress;               ///< Compression method of buffers (#trap_compress_method), it can be set by "compress=" IFC parameter
+   void *compress_state;           ///< State of compression, see trap_compress()
+   unsigned char *compress_buf;    ///< Header and compressed data of the buffer being sent (buffer_size + header)
+   uint32_t compress_len;          ///< Size of data in compress_buf, 0 if the buffer was not compressed yet
    uint8_t buffer_occupied;        ///< If 0, buffer can be modified, otherwise drop message and don't move with buffer.
+   uint8_t reserved;               ///< If 1, space in buffer was reserved by trap_ctx_send_reserve() and ifc_mtx is held until trap_ctx_send_commit().
+   uint32_t reserved_size;         ///< Maximal size of message reserved by trap_ctx_send_reserve().
+   pthread_t reserved_owner;       ///< Thread that holds the reservation, valid if reserved is 1.
+   uint32_t sendbufs;              ///< Number of buffers for sending by a dedicated thread, it can be set by "sendbufs=" IFC parameter (0 - send directly)
+   uint8_t sendq_drop;             ///< If 1, drop messages when all buffers are in flight, otherwise wait; it can be set by "sendpolicy=" IFC parameter
+   uint32_t client_queue;          ///< Number of buffers that can wait for a slow client, it can be set by "clientq=" IFC parameter (0 - every client must receive the buffer before the next one)
+   uint8_t client_policy;          ///< Behavior when a client queue is full (#trap_client_policy), it can be set by "clientpolicy=" IFC parameter
+   uint32_t client_lag;            ///< Time in seconds the client can be behind with TRAP_CLIENT_POLICY_DISCONNECT, it can be set by "clientlag=" IFC parameter
+   uint8_t uring;                  ///< If 1, TCP/UNIX IFC sends data to all clients by batched io_uring submissions, it can be set by "uring=" IFC parameter
+   uint8_t shard;                  ///< Distribution of buffers among clients of TCP/UNIX IFC (#trap_shard_mode), it can be set by "shard=" IFC parameter
+   trap_shard_key_func_t shard_key; ///< Function returning the key of message with TRAP_SHARD_HASH
+   void *shard_key_arg;            ///< Argument passed to shard_key
+   struct trap_shard_slot_s *shard_slots; ///< Buffers of clients with TRAP_SHARD_HASH, the current one is used by buffer_header and buffer_index
+   uint32_t shard_nslots;          ///< Number of elements of shard_slots
+   uint32_t shard_slot;            ///< Index of the current buffer in shard_slots, it is passed to send_slot
+   uint8_t threadbufs;             ///< If 1, every producer thread stores messages into its own buffer, it can be set by "threadbufs=" IFC parameter
+   uint8_t stage_key_created;      ///< If 1, stage_key and stage_mtx are initialized
+   pthread_key_t stage_key;        ///< Thread-specific pointer to the buffer of producer (struct trap_stage_s)
+   struct trap_stage_s *stages;    ///< List of buffers of producer threads, protected by stage_mtx
+   pthread_mutex_t stage_mtx;      ///< Lock of the list stages
+   trap_sockopts_t sockopts;       ///< Options of sockets of clients of TCP/TLS/UNIX IFC
+   struct trap_buffer_s *tb;       ///< Ring of buffers (blocks), buffer_header points to the current block; it has sendbufs blocks when sendq is used, 1 otherwise
+   struct trap_sendq_s *sendq;     ///< Sender thread of full blocks of tb, NULL if messages are sent directly
    pthread_mutex_t ifc_mtx;        ///< Locking mutex for interface.
    int64_t timeout;                ///< Internal structure to send partial data after timeout (autoflush).
+   uint8_t autoflush_adaptive;     ///< If 1, timeout is chosen by the autoflush thread according to the rate of messages ("autoflush=adaptive")
+   int64_t flush_latency;          ///< Target latency (us) of messages for adaptive autoflush, it can be set by "flushlatency=" IFC parameter
+   uint64_t stored_bytes;          ///< Total size of messages stored into the buffer, used by adaptive autoflush, see TRAP_CNT_ADD()
 
    /**
     * If 1 do not allow to change autoflush timeout by module.  If 0 - autoflush can
@@ -248,7 +376,9 @@ typedef struct trap_output_ifc_s {
     */
    char bufferswitch_fixed;
 
-   char bufferflush;               ///< Flag (1) whether the buffer was sent before timeout has elapsed or not (0)
+   char bufferflush;               ///< Flag (1) whether the buffer was sent before timeout has elapsed or not (0), accessed atomically
+   uint32_t buffer_owned;          ///< 1 while a thread works with the buffer, see trap_out_buffer_lock()
+   uint32_t flush_req;             ///< Set by autoflush when the producer owned the buffer, the next send of the producer flushes it; accessed atomically
    int32_t datatimeout;            ///< Timeout for *_send() calls
 
    /**
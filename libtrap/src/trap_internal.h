@@ -53,6 +53,7 @@
 #include <config.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <poll.h>
 #include "../include/libtrap/trap.h"
 #include "trap_ifc.h"
 
@@ -111,6 +112,42 @@ typedef struct hello_msg_header_s {
    uint32_t data_fmt_spec_size;
 } hello_msg_header_t;
 
+/**
+ * Flag set in data_type of #hello_msg_header_t when #hello_msg_ext_t follows the header.
+ *
+ * The extension is sent only if the output interface uses non-default buffer size or
+ * framing, so that the hello message stays compatible with older input interfaces.
+ */
+#define TRAP_HELLO_EXT 0x80
+
+/**
+ * Flag of #hello_msg_ext_t: messages in buffers are preceded by 32-bit length instead of 16-bit.
+ */
+#define TRAP_HELLO_FLAG_LARGE_MSGS 0x01
+
+/**
+ * Flag of #hello_msg_ext_t: data of every buffer end with the time of sending (#TRAP_BUFFER_TIMESTAMP_SIZE).
+ */
+#define TRAP_HELLO_FLAG_TIMESTAMP 0x02
+
+/**
+ * Flag of #hello_msg_ext_t: data of buffers are compressed by LZ4 (#TRAP_BUFFER_COMPRESS_SIZE).
+ */
+#define TRAP_HELLO_FLAG_LZ4 0x04
+
+/**
+ * Flag of #hello_msg_ext_t: data of buffers are compressed by Zstandard (#TRAP_BUFFER_COMPRESS_SIZE).
+ */
+#define TRAP_HELLO_FLAG_ZSTD 0x08
+
+/**
+ * Extension of the hello message (sent in network byte order right after #hello_msg_header_t).
+ */
+typedef struct hello_msg_ext_s {
+   uint32_t buffer_size; ///< Size of buffer of the output interface (maximal size of received data)
+   uint8_t flags;        ///< TRAP_HELLO_FLAG_*
+} __attribute__ ((__packed__)) hello_msg_ext_t;
+
 
 /*!
 \brief VERBOSE/MSG levels
@@ -193,17 +230,6 @@ void trap_verbose_msg(int level, char *string);
 
 /** @} */
 
-/**
- * List of threads and their semaphores.
- *
- * It is used for multi-result reading when _get_data() is called
- * with ifc_mask including more than one ifc.
- */
-struct reader_threads_s {
-   pthread_t thr;    /**< thread of reader */
-   sem_t sem;        /**< semaphore used when thread is ought to sleep */
-};
-
 /**
  * List of all output interfaces and their timeouts.
  *
@@ -212,7 +238,199 @@ struct reader_threads_s {
  */
 struct out_ifc_timeout_s {
    int idx;            /**< index of output interface */
-   int64_t tm;        /**< timeout to be elapsed */
+   int64_t tm;        /**< autoflush timeout of the interface (period) */
+   uint64_t deadline; /**< time (CLOCK_MONOTONIC, us) of the next check of the interface */
+   uint64_t last_check; /**< time (CLOCK_MONOTONIC, us) of the last check, used by adaptive autoflush */
+   uint64_t last_bytes; /**< trap_output_ifc_t.stored_bytes at the last check */
+   double rate;       /**< smoothed rate of stored bytes (B/us) */
+   int periodic;      /**< if 1, the buffer is flushed at every check even if messages were sent meanwhile */
+};
+
+/**
+ * Number of bins of histogram of autoflush latency (#trap_out_ifc_stats_s.autoflush_latency).
+ *
+ * Bin 0 counts flushes done less than 1 us after their deadline, bin i counts
+ * latency in [2^(i-1), 2^i) us, the last bin counts everything above.
+ */
+#define TRAP_AUTOFLUSH_LATENCY_BINS 16
+
+/**
+ * Number of bits of sub-bins of histogram of buffer latency (#trap_in_ifc_stats_s.latency).
+ *
+ * The histogram is log-linear as HDR histogram: values below 2^TRAP_LATENCY_SUB_BITS us have
+ * their own bins, every higher power of two is split into 2^TRAP_LATENCY_SUB_BITS bins, so
+ * the relative error is at most 1/2^TRAP_LATENCY_SUB_BITS.
+ */
+#define TRAP_LATENCY_SUB_BITS 3
+
+/**
+ * Number of bins of histogram of buffer latency, values above 2^32 us are in the last bin.
+ */
+#define TRAP_LATENCY_BINS ((32 - TRAP_LATENCY_SUB_BITS + 1) << TRAP_LATENCY_SUB_BITS)
+
+/**
+ * Size of cache line, stat blocks of IFCs are aligned to it.
+ */
+#define TRAP_CACHE_LINE_SIZE 64
+
+/**
+ * Add to a counter of IFC, the counters are updated by several threads and
+ * read by the service thread, no ordering is needed.
+ */
+#define TRAP_CNT_ADD(cnt, n) __atomic_fetch_add(&(cnt), (n), __ATOMIC_RELAXED)
+
+/**
+ * Read a counter of IFC updated by TRAP_CNT_ADD().
+ */
+#define TRAP_CNT_GET(cnt) __atomic_load_n(&(cnt), __ATOMIC_RELAXED)
+
+/**
+ * Counters of input IFC (#trap_ctx_priv_s.in_ifc_stats).
+ *
+ * Every IFC has its own cache line so that threads receiving from different
+ * IFCs do not share it.
+ */
+typedef struct trap_in_ifc_stats_s {
+   uint64_t recv_message;  /**< incremented within trap_ctx_recv() */
+   uint64_t recv_buffer;   /**< incremented within trap_read_from_buffer() after successful receiving buffer */
+   uint64_t recv_bytes;    /**< bytes of received buffers (without buffer header) */
+   uint64_t recv_raw_bytes; /**< bytes of received buffers after decompression */
+   uint64_t latency_count; /**< number of buffers with time of sending (#TRAP_HELLO_FLAG_TIMESTAMP) */
+   uint64_t latency_sum;   /**< sum of latency (us) of buffers with time of sending */
+   uint64_t latency_max;   /**< maximal latency (us) */
+   /**
+    * Histogram of time (us) from sending to receiving of buffers, see #TRAP_LATENCY_SUB_BITS.
+    */
+   uint64_t latency[TRAP_LATENCY_BINS];
+} __attribute__((aligned(TRAP_CACHE_LINE_SIZE))) trap_in_ifc_stats_t;
+
+/**
+ * Counters of output IFC (#trap_ctx_priv_s.out_ifc_stats), aligned as #trap_in_ifc_stats_t.
+ */
+typedef struct trap_out_ifc_stats_s {
+   uint64_t send_message;     /**< incremented within trap_ctx_send() */
+   uint64_t dropped_message;  /**< incremented within trap_ctx_send() */
+   uint64_t send_buffer;      /**< incremented after sending buffer */
+   uint64_t send_bytes;       /**< bytes of sent buffers (without buffer header) */
+   uint64_t send_raw_bytes;   /**< bytes of sent buffers before compression */
+   uint64_t send_fill;        /**< sum of fill of sent buffers in per mille of buffer size */
+   uint64_t send_blocked;     /**< time (us) the producer waited in sending of full buffers */
+   uint64_t autoflush;        /**< incremented within trap_automatic_flush_thr() after flushing buffer */
+   /**
+    * Histogram of delay of autoflushes after their deadline, updated within trap_automatic_flush_thr().
+    */
+   uint64_t autoflush_latency[TRAP_AUTOFLUSH_LATENCY_BINS];
+} __attribute__((aligned(TRAP_CACHE_LINE_SIZE))) trap_out_ifc_stats_t;
+
+/**
+ * Minimal timeout (in microseconds) of send() called by the sender thread of output IFC.
+ */
+#define TRAP_SENDQ_MIN_TIMEOUT 100000
+
+/**
+ * Period (in microseconds) of checks whether the IFC dropped its reference to
+ * the sent buffer, it is used only when the pool has no memory for a new buffer.
+ */
+#define TRAP_UNSHARE_WAIT 1000
+
+/**
+ * Sender thread of one output interface.
+ *
+ * It is used when "sendbufs=" IFC parameter is set.  Instead of calling
+ * send() of the interface, the producer hands the full block of
+ * out_ifc_list[ifc].tb over to the sender thread and continues with the
+ * next free block.
+ *
+ * The thread is the only reader of the ring, a block is released when
+ * send() of the interface returns.  The ring does not keep positions of
+ * clients: without "clientq=", send() returns when all clients have the
+ * block.  With "clientq=", the TCP/UNIX IFC only takes a reference of the
+ * block for the queue of every client (its sequence number is the position
+ * of the client) and the block is unshared before it is reused, see
+ * trap_out_buffer_unshare().
+ */
+struct trap_sendq_s {
+   trap_ctx_priv_t *ctx;        /**< libtrap context */
+   uint32_t ifc;                /**< index of output interface */
+   pthread_t thr;               /**< sender thread */
+   pthread_mutex_t mtx;         /**< lock of read/write positions in out_ifc_list[ifc].tb */
+   pthread_cond_t cond_queued;  /**< signaled when a block was filled or stop was requested */
+   pthread_cond_t cond_free;    /**< signaled when a block was sent and released */
+   uint8_t stop;                /**< request to send the rest of blocks and finish the thread */
+};
+
+/**
+ * Buffer of one client of output IFC with "shard=hash".
+ *
+ * Messages are stored into the buffer of the client chosen by their key, the
+ * buffer being filled is switched into out_ifc_list[ifc].buffer_header, see
+ * trap_shard_switch().  The first slot uses the block of out_ifc_list[ifc].tb.
+ */
+struct trap_shard_slot_s {
+   unsigned char *header;       /**< header of buffer followed by payload */
+   uint32_t index;              /**< size of stored messages (buffer_index) while the buffer is not current */
+};
+
+/**
+ * Buffer of one producer thread of output IFC with "threadbufs=on".
+ *
+ * The thread stores messages into its buffer without locking of the IFC.
+ * The full buffer is swapped with the buffer of the IFC and sent under
+ * ifc_mtx, see trap_stage_send(), so messages of one thread keep their order.
+ */
+struct trap_stage_s {
+   unsigned char *header;       /**< header of buffer followed by payload (same layout as out_ifc_list[ifc].buffer_header) */
+   uint32_t index;              /**< size of stored messages */
+   uint32_t owned;              /**< 1 while the owner stores a message or autoflush sends the buffer */
+   uint32_t flush_req;          /**< set by autoflush when the owner held the buffer, the owner hands it over in its next call; accessed atomically */
+   uint32_t exited;             /**< 1 when the owner thread finished, the buffer can be taken by another thread */
+   struct trap_stage_s *next;   /**< next buffer of the IFC */
+};
+
+/**
+ * Received buffer handed to a worker thread by trap_ctx_recv_workers().
+ *
+ * The memory of data is swapped with in_ifc_list[].buffer when a buffer is
+ * received, so both are borrowed from the buffer pool with size + 1 bytes.
+ */
+struct trap_recv_buffer_s {
+   char *data;                  /**< allocated memory, size + 1 B */
+   uint32_t size;               /**< size of data (without the terminating byte) */
+   const char *pointer;         /**< header of the next message */
+   const char *end;             /**< end of received data */
+   uint32_t messages;           /**< number of messages returned by trap_recv_buffer_next() */
+   uint32_t worker;             /**< index of worker thread processing the buffer */
+   uint8_t large_msgs;          /**< 32-bit message headers */
+   uint8_t single;              /**< buffer contains one message without header (DISABLE_BUFFERING) */
+   uint8_t fmt_changed;         /**< data format changed before this buffer */
+   struct trap_recv_buffer_s *next;   /**< next buffer in the free-list or queue */
+};
+
+/**
+ * Pool of worker threads of trap_ctx_recv_workers().
+ */
+struct trap_recv_workers_s {
+   pthread_mutex_t mtx;
+   pthread_cond_t cond_work;    /**< signalled when a buffer is queued or the pool stops */
+   pthread_cond_t cond_free;    /**< signalled when a buffer returns to the free-list or the pool stops */
+   struct trap_recv_buffer_s *bufs;   /**< array of all buffers */
+   struct trap_recv_buffer_s *free;   /**< free-list of buffers */
+   struct trap_recv_buffer_s *head;   /**< the oldest queued buffer */
+   struct trap_recv_buffer_s *tail;   /**< the newest queued buffer */
+   trap_recv_worker_func_t func;
+   void *arg;
+   uint64_t *recv_message;      /**< counter of received messages of the input IFC */
+   int stop;                    /**< set when a worker stopped the pool */
+   int done;                    /**< set when the receiver finished, workers process the queued buffers and exit */
+};
+
+/**
+ * Worker thread of trap_ctx_recv_workers().
+ */
+struct trap_recv_worker_s {
+   pthread_t thr;
+   struct trap_recv_workers_s *pool;
+   uint32_t index;
 };
 
 /**
@@ -277,33 +495,25 @@ struct trap_ctx_priv_s {
    trap_multi_result_t *in_ifc_results;
 
    /**
-    * Timeout common to all readers for multiread feature
-    */
-   int get_data_timeout;
-
-   /**
-    * Reader threads for multiread feature
+    * Array of num_ifc_in descriptors for poll() when waiting for more input IFCs
     */
-   struct reader_threads_s *reader_threads;
+   struct pollfd *in_ifc_pollfds;
 
    /**
-    * Semaphore used when collector (main thread, caller of ifc's recv)
-    * waits for incoming data from all threads.
+    * Index of input IFC of every item of in_ifc_pollfds
     */
-   sem_t sem_collector;
+   uint32_t *in_ifc_pollidx;
 
    /**
-    * Mutex for manipulation with readers_count.
+    * Time (CLOCK_MONOTONIC, us) of the next attempt to receive from input
+    * IFC that is not connected, when waiting for more input IFCs
     */
-   pthread_mutex_t mut_sem_collector;
+   uint64_t *in_ifc_retry;
 
    /**
-    * Number of reader threads that will read messages during multiread (set
-    * by collector thread).  Every client decreases this value and the last
-    * reader (readers_count equals 0 after decrementation) wakes the collector
-    * thread.
+    * Input IFC that is checked first by the next trap_ctx_recv_any()
     */
-   int32_t readers_count;
+   uint32_t recv_any_next;
 
    /**
     * Thread to handle timeouts on output interfaces.
@@ -342,29 +552,13 @@ struct trap_ctx_priv_s {
     * @{
     */
    /**
-    * counter_send_message is incremented within trap_ctx_send().
-    */
-   uint64_t *counter_send_message;
-   /**
-    * counter_dropped_message is incremented within trap_ctx_send().
+    * Counters of input IFCs, array of num_ifc_in blocks.
     */
-   uint64_t *counter_dropped_message;
+   trap_in_ifc_stats_t *in_ifc_stats;
    /**
-    * counter_recv_message is incremented within trap_ctx_recv().
+    * Counters of output IFCs, array of num_ifc_out blocks.
     */
-   uint64_t *counter_recv_message;
-   /**
-    * counter_send_buffer is incremented within trap_store_into_buffer() after sending buffer.
-    */
-   uint64_t *counter_send_buffer;
-   /**
-    * counter_autoflush is incremented within trap_automatic_flush_thr() after flushing buffer.
-    */
-   uint64_t *counter_autoflush;
-   /**
-    * counter_recv_buffer is incremented within trap_read_from_buffer() after successful receiving buffer.
-    */
-   uint64_t *counter_recv_buffer;
+   trap_out_ifc_stats_t *out_ifc_stats;
    /**
     * @}
     */
@@ -388,12 +582,42 @@ trap_ctx_priv_t *trap_create_ctx_t();
 
 struct trap_buffer_header_s {
    uint32_t data_length;  /**< size of data in the data unit */
-#ifdef ENABLE_HEADER_TIMESTAMP
-   uint64_t timestamp;
-#endif
    uint8_t data[0];
 } __attribute__ ((__packed__));
 typedef struct trap_buffer_header_s trap_buffer_header_t;
 
+/**
+ * Size of the time of sending appended to data of every buffer by output IFC with "timestamp=on".
+ *
+ * The time is the number of microseconds since the Epoch (CLOCK_REALTIME) as two 32-bit
+ * numbers in network byte order (seconds would not be precise enough, receivers on other
+ * hosts need synchronized clocks).  It is included in data_length of #trap_buffer_header_t,
+ * the receiver learns about it by #TRAP_HELLO_FLAG_TIMESTAMP.
+ */
+#define TRAP_BUFFER_TIMESTAMP_SIZE (2 * sizeof(uint32_t))
+
+/**
+ * Size of the trailer of every buffer sent by output IFC with "compress=".
+ *
+ * It is the size of data before compression (including the time of sending) as
+ * a 32-bit number in network byte order, 0 means the data are not compressed
+ * (they did not fit into the buffer after compression).  The trailer is included
+ * in data_length of #trap_buffer_header_t, the receiver learns about it by
+ * #TRAP_HELLO_FLAG_LZ4 or #TRAP_HELLO_FLAG_ZSTD.
+ */
+#define TRAP_BUFFER_COMPRESS_SIZE sizeof(uint32_t)
+
+/**
+ * Space for messages in buffer of output IFC, the time of sending and the trailer of compression are stored behind them.
+ */
+#define TRAP_OUT_BUFFER_SPACE(o) ((o)->buffer_size - ((o)->timestamp != 0 ? TRAP_BUFFER_TIMESTAMP_SIZE : 0) - \
+                                  ((o)->compress != 0 ? TRAP_BUFFER_COMPRESS_SIZE : 0))
+
+/**
+ * Size of header of each message stored in buffer of the given (input or output) IFC.
+ * It is 16-bit length by default or 32-bit length when large messages are enabled.
+ */
+#define TRAP_MSG_HEADER_SIZE(ifc) ((ifc)->large_msgs != 0 ? sizeof(uint32_t) : sizeof(uint16_t))
+
 #endif
 
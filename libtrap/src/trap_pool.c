@@ -0,0 +1,441 @@
+/**
+ * \file trap_pool.c
+ * \brief Shared pool of buffers of IFCs
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../include/libtrap/trap.h"
+#include "trap_internal.h"
+#include "trap_pool.h"
+
+/**
+ * \addtogroup trap_pool
+ * @{
+ */
+
+/** The smallest class of buffers is 2^TRAP_POOL_MIN_SHIFT B (including the header). */
+#define TRAP_POOL_MIN_SHIFT 12
+/** The biggest class of buffers is 2^TRAP_POOL_MAX_SHIFT B, enough for buffers of 32-bit size. */
+#define TRAP_POOL_MAX_SHIFT 33
+#define TRAP_POOL_CLASSES (TRAP_POOL_MAX_SHIFT - TRAP_POOL_MIN_SHIFT + 1)
+#define TRAP_POOL_CLASS_SIZE(cls) ((size_t) 1 << ((cls) + TRAP_POOL_MIN_SHIFT))
+
+/** Size of header of buffer, it keeps the buffer aligned to cache line. */
+#define TRAP_POOL_HEADER_SIZE 64
+
+/** MPOL_PREFERRED of set_mempolicy(2), linux/mempolicy.h is not needed for this one constant. */
+#define TRAP_POOL_MPOL_PREFERRED 1
+
+/**
+ * Maximal number of free buffers kept mapped in a class of large buffers
+ * (#TRAP_POOL_CHUNK_SIZE B or more), further returned buffers are unmapped.
+ */
+#define TRAP_POOL_LARGE_FREE 2
+
+/** Buffers of the class are mapped one by one, not in chunks. */
+#define TRAP_POOL_LARGE_CLASS(cls) (TRAP_POOL_CLASS_SIZE(cls) >= TRAP_POOL_CHUNK_SIZE)
+
+/** Header stored before every buffer. */
+struct trap_pool_buf_s {
+   uint32_t refcnt;               /**< number of references, 0 in the free-list */
+   uint16_t cls;                  /**< index of class */
+   uint8_t dirty;                 /**< 1 if the buffer was used, memory of new chunks is zeroed by the kernel */
+   uint8_t huge;                  /**< 1 if the buffer of large class is mapped with MAP_HUGETLB */
+   struct trap_pool_buf_s *next;  /**< next buffer in the free-list */
+};
+
+/** Free-list of one class, every class has its own lock. */
+struct trap_pool_class_s {
+   pthread_mutex_t mtx;
+   struct trap_pool_buf_s *free;
+   uint32_t nfree;           /**< number of buffers in the free-list */
+} __attribute__((aligned(64)));
+
+/** Chunk of mapped memory divided into buffers of one class. */
+struct trap_pool_chunk_s {
+   void *mem;
+   size_t size;
+   struct trap_pool_chunk_s *next;
+};
+
+/*
+ * Lock order: trap_pool.mtx, mtx of class, chunk_mtx.  Statistics are
+ * updated by atomic operations.
+ */
+static struct {
+   pthread_mutex_t mtx;      /**< lock of users and configuration */
+   int users;                /**< number of libtrap contexts */
+   int hugepages;            /**< map chunks with MAP_HUGETLB */
+   int numa_node;            /**< preferred NUMA node, -1 for none */
+   struct trap_pool_class_s cls[TRAP_POOL_CLASSES];
+   pthread_mutex_t chunk_mtx;  /**< lock of chunks */
+   struct trap_pool_chunk_s *chunks;  /**< chunks of small classes */
+   trap_pool_stats_t stats;
+} trap_pool = {
+   .mtx = PTHREAD_MUTEX_INITIALIZER,
+   .numa_node = -1,
+   .cls = { [0 ... TRAP_POOL_CLASSES - 1] = { .mtx = PTHREAD_MUTEX_INITIALIZER } },
+   .chunk_mtx = PTHREAD_MUTEX_INITIALIZER
+};
+
+#define TRAP_POOL_HEADER(buf) ((struct trap_pool_buf_s *) ((char *) (buf) - TRAP_POOL_HEADER_SIZE))
+
+void trap_pool_init(void)
+{
+   const char *e;
+
+   pthread_mutex_lock(&trap_pool.mtx);
+   if (trap_pool.users++ == 0) {
+      trap_pool.hugepages = 0;
+      trap_pool.numa_node = -1;
+      /* the same condition as in trap_check_global_vars() */
+      if ((getuid() == geteuid()) && (getgid() == getegid())) {
+         e = getenv("TRAP_POOL_HUGEPAGES");
+         if ((e != NULL) && (atoi(e) != 0)) {
+            trap_pool.hugepages = 1;
+         }
+         e = getenv("TRAP_POOL_NUMA_NODE");
+         if ((e != NULL) && (*e != 0)) {
+            trap_pool.numa_node = atoi(e);
+         }
+      }
+   }
+   pthread_mutex_unlock(&trap_pool.mtx);
+}
+
+void trap_pool_release(void)
+{
+   struct trap_pool_chunk_s *c;
+   struct trap_pool_buf_s *b;
+   uint64_t used;
+   int i;
+
+   pthread_mutex_lock(&trap_pool.mtx);
+   if ((trap_pool.users > 0) && (--trap_pool.users == 0)) {
+      used = TRAP_CNT_GET(trap_pool.stats.used);
+      if (used != 0) {
+         VERBOSE(CL_ERROR, "Buffer pool: %"PRIu64" buffers were not returned, the memory is kept.", used);
+      } else {
+         for (i = 0; i < TRAP_POOL_CLASSES; i++) {
+            pthread_mutex_lock(&trap_pool.cls[i].mtx);
+            while (TRAP_POOL_LARGE_CLASS(i) && trap_pool.cls[i].free != NULL) {
+               /* buffers of large classes are not in chunks */
+               b = trap_pool.cls[i].free;
+               trap_pool.cls[i].free = b->next;
+               munmap(b, TRAP_POOL_CLASS_SIZE(i));
+            }
+            trap_pool.cls[i].free = NULL;
+            trap_pool.cls[i].nfree = 0;
+            pthread_mutex_unlock(&trap_pool.cls[i].mtx);
+         }
+         pthread_mutex_lock(&trap_pool.chunk_mtx);
+         while (trap_pool.chunks != NULL) {
+            c = trap_pool.chunks;
+            trap_pool.chunks = c->next;
+            munmap(c->mem, c->size);
+            free(c);
+         }
+         pthread_mutex_unlock(&trap_pool.chunk_mtx);
+         memset(&trap_pool.stats, 0, sizeof(trap_pool.stats));
+      }
+   }
+   pthread_mutex_unlock(&trap_pool.mtx);
+}
+
+/**
+ * Map a chunk of memory according to the configuration of pool.
+ *
+ * \param[in] size   size of chunk, a multiple of #TRAP_POOL_CHUNK_SIZE
+ * \param[out] huge  set to 1 if the chunk is mapped with MAP_HUGETLB
+ * \return pointer to the chunk, NULL on error
+ */
+static void *trap_pool_map(size_t size, int *huge)
+{
+   void *p = MAP_FAILED;
+
+   (*huge) = 0;
+#ifdef MAP_HUGETLB
+   if (trap_pool.hugepages != 0) {
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED) {
+         (*huge) = 1;
+      }
+   }
+#endif
+   if (p == MAP_FAILED) {
+      p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED) {
+         return NULL;
+      }
+#ifdef MADV_HUGEPAGE
+      if (trap_pool.hugepages != 0) {
+         /* no reserved huge pages left, try transparent ones */
+         madvise(p, size, MADV_HUGEPAGE);
+      }
+#endif
+   }
+#ifdef SYS_mbind
+   if ((trap_pool.numa_node >= 0) && (trap_pool.numa_node < (int) (8 * sizeof(unsigned long)))) {
+      /* memory is not touched yet, pages will be allocated on the node */
+      unsigned long mask = 1UL << trap_pool.numa_node;
+      if (syscall(SYS_mbind, p, size, TRAP_POOL_MPOL_PREFERRED, &mask, 8 * sizeof(mask), 0) != 0) {
+         VERBOSE(CL_VERBOSE_LIBRARY, "Buffer pool: mbind() to NUMA node %d failed.", trap_pool.numa_node);
+      }
+   }
+#endif
+   return p;
+}
+
+/**
+ * Map a new chunk for the class and put its buffers into the free-list.
+ *
+ * A buffer of large class is mapped alone, it is not recorded in chunks,
+ * see trap_pool_unmap().  The caller must hold mtx of the class.
+ *
+ * \param[in] cls   index of class
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY on error
+ */
+static int trap_pool_grow(uint32_t cls)
+{
+   size_t bsize = TRAP_POOL_CLASS_SIZE(cls);
+   size_t size = (bsize > TRAP_POOL_CHUNK_SIZE) ? bsize : TRAP_POOL_CHUNK_SIZE;
+   struct trap_pool_class_s *pc = &trap_pool.cls[cls];
+   struct trap_pool_chunk_s *c = NULL;
+   struct trap_pool_buf_s *b;
+   size_t offset;
+   void *mem;
+   int huge;
+
+   if (!TRAP_POOL_LARGE_CLASS(cls)) {
+      c = (struct trap_pool_chunk_s *) malloc(sizeof(struct trap_pool_chunk_s));
+      if (c == NULL) {
+         return TRAP_E_MEMORY;
+      }
+   }
+   mem = trap_pool_map(size, &huge);
+   if (mem == NULL) {
+      free(c);
+      return TRAP_E_MEMORY;
+   }
+   if (c != NULL) {
+      c->mem = mem;
+      c->size = size;
+      pthread_mutex_lock(&trap_pool.chunk_mtx);
+      c->next = trap_pool.chunks;
+      trap_pool.chunks = c;
+      pthread_mutex_unlock(&trap_pool.chunk_mtx);
+   }
+   /* the first buffer of chunk is used first */
+   for (offset = size; offset >= bsize; offset -= bsize) {
+      b = (struct trap_pool_buf_s *) ((char *) mem + offset - bsize);
+      b->refcnt = 0;
+      b->cls = cls;
+      b->dirty = 0;
+      b->huge = huge;
+      b->next = pc->free;
+      pc->free = b;
+      pc->nfree++;
+      TRAP_CNT_ADD(trap_pool.stats.buffers, 1);
+   }
+   TRAP_CNT_ADD(trap_pool.stats.mapped_bytes, size);
+   if (huge != 0) {
+      TRAP_CNT_ADD(trap_pool.stats.huge_bytes, size);
+   }
+   return TRAP_E_OK;
+}
+
+/**
+ * Unmap a returned buffer of large class.
+ *
+ * \param[in] b   header of buffer
+ */
+static void trap_pool_unmap(struct trap_pool_buf_s *b)
+{
+   size_t size = TRAP_POOL_CLASS_SIZE(b->cls);
+
+   __atomic_fetch_sub(&trap_pool.stats.buffers, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_sub(&trap_pool.stats.mapped_bytes, size, __ATOMIC_RELAXED);
+   if (b->huge != 0) {
+      __atomic_fetch_sub(&trap_pool.stats.huge_bytes, size, __ATOMIC_RELAXED);
+   }
+   munmap(b, size);
+}
+
+void *trap_pool_get(size_t size)
+{
+   struct trap_pool_class_s *pc;
+   struct trap_pool_buf_s *b;
+   uint64_t used, max;
+   uint32_t cls = 0;
+
+   while (TRAP_POOL_CLASS_SIZE(cls) < size + TRAP_POOL_HEADER_SIZE) {
+      if (++cls == TRAP_POOL_CLASSES) {
+         return NULL;
+      }
+   }
+
+   pc = &trap_pool.cls[cls];
+   pthread_mutex_lock(&pc->mtx);
+   if (pc->free != NULL) {
+      TRAP_CNT_ADD(trap_pool.stats.reuses, 1);
+   } else if (trap_pool_grow(cls) != TRAP_E_OK) {
+      pthread_mutex_unlock(&pc->mtx);
+      return NULL;
+   }
+   b = pc->free;
+   pc->free = b->next;
+   pc->nfree--;
+   pthread_mutex_unlock(&pc->mtx);
+
+   TRAP_CNT_ADD(trap_pool.stats.gets, 1);
+   TRAP_CNT_ADD(trap_pool.stats.used, 1);
+   used = __atomic_add_fetch(&trap_pool.stats.used_bytes, TRAP_POOL_CLASS_SIZE(cls) - TRAP_POOL_HEADER_SIZE, __ATOMIC_RELAXED);
+   max = TRAP_CNT_GET(trap_pool.stats.max_used_bytes);
+   while ((used > max) &&
+          !__atomic_compare_exchange_n(&trap_pool.stats.max_used_bytes, &max, used, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+   }
+
+   b->next = NULL;
+   __atomic_store_n(&b->refcnt, 1, __ATOMIC_RELAXED);
+   return (char *) b + TRAP_POOL_HEADER_SIZE;
+}
+
+void *trap_pool_calloc(size_t size)
+{
+   void *p = trap_pool_get(size);
+
+   /* pages of unused buffers are not touched, so they are not allocated until they are needed */
+   if ((p != NULL) && (TRAP_POOL_HEADER(p)->dirty != 0)) {
+      memset(p, 0, size);
+   }
+   return p;
+}
+
+void *trap_pool_ref(void *buf)
+{
+   __atomic_add_fetch(&TRAP_POOL_HEADER(buf)->refcnt, 1, __ATOMIC_RELAXED);
+   return buf;
+}
+
+int trap_pool_shared(const void *buf)
+{
+   /* acquire pairs with trap_pool_put(), the other holder finished reading */
+   return (__atomic_load_n(&TRAP_POOL_HEADER(buf)->refcnt, __ATOMIC_ACQUIRE) > 1);
+}
+
+void trap_pool_put(void *buf)
+{
+   struct trap_pool_class_s *pc;
+   struct trap_pool_buf_s *b;
+
+   if (buf == NULL) {
+      return;
+   }
+   b = TRAP_POOL_HEADER(buf);
+   if (__atomic_sub_fetch(&b->refcnt, 1, __ATOMIC_ACQ_REL) != 0) {
+      return;
+   }
+   b->dirty = 1;
+   __atomic_fetch_sub(&trap_pool.stats.used, 1, __ATOMIC_RELAXED);
+   __atomic_fetch_sub(&trap_pool.stats.used_bytes, TRAP_POOL_CLASS_SIZE(b->cls) - TRAP_POOL_HEADER_SIZE, __ATOMIC_RELAXED);
+   pc = &trap_pool.cls[b->cls];
+   pthread_mutex_lock(&pc->mtx);
+   if (TRAP_POOL_LARGE_CLASS(b->cls) && (pc->nfree >= TRAP_POOL_LARGE_FREE)) {
+      /* do not keep many large buffers mapped until the pool is released */
+      pthread_mutex_unlock(&pc->mtx);
+      trap_pool_unmap(b);
+      return;
+   }
+   b->next = pc->free;
+   pc->free = b;
+   pc->nfree++;
+   pthread_mutex_unlock(&pc->mtx);
+}
+
+size_t trap_pool_size(const void *buf)
+{
+   return TRAP_POOL_CLASS_SIZE(TRAP_POOL_HEADER(buf)->cls) - TRAP_POOL_HEADER_SIZE;
+}
+
+void *trap_pool_resize(void *buf, size_t size)
+{
+   size_t old;
+   void *p;
+
+   if (buf == NULL) {
+      return trap_pool_get(size);
+   }
+   old = trap_pool_size(buf);
+   if (size <= old) {
+      return buf;
+   }
+   p = trap_pool_get(size);
+   if (p == NULL) {
+      return NULL;
+   }
+   memcpy(p, buf, old);
+   trap_pool_put(buf);
+   return p;
+}
+
+void trap_pool_get_stats(trap_pool_stats_t *stats)
+{
+   /* counters are read one by one, they need not be consistent with each other */
+   stats->buffers = TRAP_CNT_GET(trap_pool.stats.buffers);
+   stats->used = TRAP_CNT_GET(trap_pool.stats.used);
+   stats->used_bytes = TRAP_CNT_GET(trap_pool.stats.used_bytes);
+   stats->max_used_bytes = TRAP_CNT_GET(trap_pool.stats.max_used_bytes);
+   stats->mapped_bytes = TRAP_CNT_GET(trap_pool.stats.mapped_bytes);
+   stats->huge_bytes = TRAP_CNT_GET(trap_pool.stats.huge_bytes);
+   stats->gets = TRAP_CNT_GET(trap_pool.stats.gets);
+   stats->reuses = TRAP_CNT_GET(trap_pool.stats.reuses);
+}
+
+/**
+ * @}
+ */
@@ -0,0 +1,181 @@
+/**
+ * \file trap_pool.h
+ * \brief Shared pool of buffers of IFCs
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TRAP_POOL_H
+#define TRAP_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \defgroup trap_pool buffer pool
+ *
+ * Buffers of IFCs (buffers of input IFCs, rings of output IFCs, buffers of
+ * clients of TCP/UNIX and TLS IFC, ...) are borrowed from one pool shared by
+ * all IFCs and libtrap contexts of the process and returned to it.  Buffers
+ * are grouped into classes by their size (powers of two), a returned buffer
+ * is kept in the free-list of its class and reused, memory is mapped in
+ * chunks of #TRAP_POOL_CHUNK_SIZE B and unmapped when the last context is
+ * finalized.  Buffers of #TRAP_POOL_CHUNK_SIZE B or more are mapped one by
+ * one and only a few of them are kept in the free-list, the others are
+ * unmapped when they are returned.  Every class has its own lock.  Every
+ * buffer has a reference count, it returns to the pool when the last
+ * reference is dropped by trap_pool_put().
+ *
+ * Buffers of output IFCs are passed on without copying: client queues of
+ * TCP/UNIX IFC ("clientq=") hold a reference to the sent buffer until all
+ * clients get it, libtrap continues with a new buffer while the sent one is
+ * shared (trap_pool_shared()), and buffers of producer threads
+ * ("threadbufs=on") are swapped with the buffer of the IFC.
+ *
+ * The pool is configured by environment variables read by trap_ctx_init():
+ * - TRAP_POOL_HUGEPAGES=1 maps chunks with MAP_HUGETLB, if there are not
+ *   enough reserved huge pages, transparent huge pages are requested by madvise(),
+ * - TRAP_POOL_NUMA_NODE=n places chunks preferably into the memory of NUMA node n (mbind()).
+ * Without them, chunks are placed by the kernel (first touch).
+ * @{
+ */
+
+/**
+ * Size of chunks of memory mapped for classes of small buffers, it is the size of huge page.
+ */
+#define TRAP_POOL_CHUNK_SIZE (2 * 1024 * 1024)
+
+/**
+ * Statistics of buffer pool.
+ */
+typedef struct trap_pool_stats_s {
+   uint64_t buffers;      /**< number of allocated buffers */
+   uint64_t used;         /**< number of borrowed buffers */
+   uint64_t used_bytes;   /**< size of borrowed buffers */
+   uint64_t max_used_bytes;  /**< maximal size of borrowed buffers */
+   uint64_t mapped_bytes; /**< size of mapped memory */
+   uint64_t huge_bytes;   /**< size of memory mapped with MAP_HUGETLB */
+   uint64_t gets;         /**< number of trap_pool_get() calls */
+   uint64_t reuses;       /**< number of trap_pool_get() calls served from a free-list */
+} trap_pool_stats_t;
+
+/**
+ * \brief Start using the pool (called by trap_ctx_init()), read configuration from environment on the first call.
+ */
+void trap_pool_init(void);
+
+/**
+ * \brief Stop using the pool (called by trap_ctx_finalize()), memory is unmapped by the last user.
+ */
+void trap_pool_release(void);
+
+/**
+ * \brief Borrow a buffer from the pool.
+ *
+ * \param[in] size  required size of buffer
+ * \return pointer to the buffer with reference count 1 (aligned to 64 B), NULL if memory could not be mapped
+ */
+void *trap_pool_get(size_t size);
+
+/**
+ * \brief Borrow a buffer from the pool and fill it by zeros.
+ *
+ * \param[in] size  required size of buffer
+ * \return see trap_pool_get()
+ */
+void *trap_pool_calloc(size_t size);
+
+/**
+ * \brief Add a reference to the buffer.
+ *
+ * The buffer is shared by all holders of references, nobody can write into it.
+ *
+ * \param[in] buf  buffer from trap_pool_get()
+ * \return buf
+ */
+void *trap_pool_ref(void *buf);
+
+/**
+ * \brief Check whether somebody else holds a reference to the buffer too.
+ *
+ * The holder of a shared buffer must not write into it, see trap_pool_ref().
+ *
+ * \param[in] buf  buffer from trap_pool_get()
+ * \return 1 if the buffer has more than one reference, 0 otherwise
+ */
+int trap_pool_shared(const void *buf);
+
+/**
+ * \brief Drop a reference to the buffer, the last one returns it to the pool, it is safe to call it with NULL.
+ *
+ * \param[in] buf  buffer from trap_pool_get()
+ */
+void trap_pool_put(void *buf);
+
+/**
+ * \brief Get usable size of buffer, it can be bigger than the size requested from trap_pool_get().
+ *
+ * \param[in] buf  buffer from trap_pool_get()
+ * \return size of buffer
+ */
+size_t trap_pool_size(const void *buf);
+
+/**
+ * \brief Resize buffer like realloc(), the content is kept up to the smaller of both sizes.
+ *
+ * The buffer is kept if it is big enough, otherwise a new buffer is borrowed
+ * and the old one is returned.  The caller must hold the only reference.
+ *
+ * \param[in] buf   buffer from trap_pool_get() or NULL
+ * \param[in] size  required size of buffer
+ * \return pointer to the buffer, NULL if memory could not be mapped (buf is kept)
+ */
+void *trap_pool_resize(void *buf, size_t size);
+
+/**
+ * \brief Get statistics of the pool.
+ *
+ * \param[out] stats  statistics
+ */
+void trap_pool_get_stats(trap_pool_stats_t *stats);
+
+/**
+ * @}
+ */
+
+#endif
@@ -0,0 +1,361 @@
+/**
+ * \file trap_shm_ring.c
+ * \brief Ring of buffers in shared memory used by the shared memory IFC
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+
+#define _GNU_SOURCE
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "../include/libtrap/trap.h"
+#include "trap_internal.h"
+#include "trap_shm_ring.h"
+
+/**
+ * \addtogroup shm_ring
+ * @{
+ */
+
+#define SHM_RING_MAGIC 0x54524150
+
+/**
+ * Value of data_length that marks the unused end of data area, the next buffer starts at its beginning.
+ */
+#define SHM_RING_WRAP 0xffffffff
+
+/**
+ * Buffers in the ring are aligned to 8 B.
+ */
+#define SHM_RING_ALIGN(x) (((uint64_t) (x) + 7) & ~((uint64_t) 7))
+
+#define SHM_LOAD(x) (*(volatile __typeof__(x) *) &(x))
+#define SHM_STORE(x, v) (*(volatile __typeof__(x) *) &(x) = (v))
+
+static inline void shm_futex_wait(uint32_t *addr, uint32_t val, uint32_t timeout)
+{
+   struct timespec ts;
+
+   ts.tv_sec = timeout / 1000000;
+   ts.tv_nsec = (timeout % 1000000) * 1000;
+   syscall(SYS_futex, addr, FUTEX_WAIT, val, &ts, NULL, 0);
+}
+
+static inline void shm_futex_wake(uint32_t *addr)
+{
+   __sync_add_and_fetch(addr, 1);
+   syscall(SYS_futex, addr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/**
+ * \brief Create anonymous shared memory that can be passed to other processes by its file descriptor.
+ * \return file descriptor, -1 on error
+ */
+static int shm_ring_open_memory(void)
+{
+#ifdef HAVE_MEMFD_CREATE
+   return memfd_create("trap-shm-ring", MFD_CLOEXEC);
+#else
+   static uint32_t counter = 0;
+   char name[64];
+   int fd;
+
+   snprintf(name, sizeof(name), "/trap-shm-ring-%d-%"PRIu32, (int) getpid(), __sync_add_and_fetch(&counter, 1));
+   fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+   if (fd != -1) {
+      shm_unlink(name);
+   }
+   return fd;
+#endif
+}
+
+int shm_ring_create(shm_ring_t *r, uint32_t slots, uint32_t buffer_size)
+{
+   uint64_t offset = (sizeof(struct shm_ring_hdr_s) + slots * sizeof(struct shm_ring_slot_s) + 63) & ~((uint64_t) 63);
+   uint64_t capacity = SHM_RING_BUFFERS * SHM_RING_ALIGN(buffer_size);
+
+   memset(r, 0, sizeof(*r));
+   r->fd = shm_ring_open_memory();
+   if (r->fd == -1) {
+      VERBOSE(CL_ERROR, "Creating of shared memory failed (%s).", strerror(errno));
+      return TRAP_E_IO_ERROR;
+   }
+   r->map_size = offset + capacity;
+   if (ftruncate(r->fd, r->map_size) == -1) {
+      VERBOSE(CL_ERROR, "Allocation of %zu B of shared memory failed (%s).", r->map_size, strerror(errno));
+      goto failure;
+   }
+   r->hdr = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+   if (r->hdr == MAP_FAILED) {
+      VERBOSE(CL_ERROR, "Mapping of shared memory failed (%s).", strerror(errno));
+      r->hdr = NULL;
+      goto failure;
+   }
+   /* the memory is zeroed, all slots are inactive */
+   r->hdr->slots = slots;
+   r->hdr->capacity = capacity;
+   r->hdr->data_offset = offset;
+   r->hdr->magic = SHM_RING_MAGIC;
+   r->data = (char *) r->hdr + offset;
+   return TRAP_E_OK;
+failure:
+   close(r->fd);
+   r->fd = -1;
+   return TRAP_E_MEMORY;
+}
+
+int shm_ring_attach(shm_ring_t *r, int fd)
+{
+   struct stat st;
+
+   memset(r, 0, sizeof(*r));
+   r->fd = fd;
+   if ((fstat(fd, &st) == -1) || (st.st_size < (off_t) sizeof(struct shm_ring_hdr_s))) {
+      goto failure;
+   }
+   r->map_size = st.st_size;
+   r->hdr = mmap(NULL, r->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   if (r->hdr == MAP_FAILED) {
+      VERBOSE(CL_ERROR, "Mapping of shared memory failed (%s).", strerror(errno));
+      r->hdr = NULL;
+      goto failure;
+   }
+   if ((r->hdr->magic != SHM_RING_MAGIC) ||
+       (r->hdr->data_offset < sizeof(struct shm_ring_hdr_s) + r->hdr->slots * sizeof(struct shm_ring_slot_s)) ||
+       (r->hdr->data_offset + r->hdr->capacity > r->map_size)) {
+      goto failure;
+   }
+   r->data = (char *) r->hdr + r->hdr->data_offset;
+   return TRAP_E_OK;
+failure:
+   VERBOSE(CL_ERROR, "Received shared memory is not a valid ring.");
+   shm_ring_close(r);
+   return TRAP_E_IO_ERROR;
+}
+
+void shm_ring_close(shm_ring_t *r)
+{
+   if (r->hdr != NULL) {
+      munmap(r->hdr, r->map_size);
+      r->hdr = NULL;
+      r->data = NULL;
+   }
+   if (r->fd != -1) {
+      close(r->fd);
+      r->fd = -1;
+   }
+}
+
+uint32_t shm_ring_join(shm_ring_t *r, uint32_t slot)
+{
+   struct shm_ring_slot_s *s = &r->hdr->slot[slot];
+
+   /*
+    * The producer may publish a buffer concurrently, it does not
+    * overwrite anything behind the position read here in that case.
+    */
+   SHM_STORE(s->read, __sync_add_and_fetch(&r->hdr->write, 0));
+   SHM_STORE(s->waiting, 0);
+   __sync_synchronize();
+   SHM_STORE(s->active, 1);
+   return __sync_add_and_fetch(&s->gen, 1);
+}
+
+void shm_ring_leave(shm_ring_t *r, uint32_t slot)
+{
+   struct shm_ring_slot_s *s = &r->hdr->slot[slot];
+
+   SHM_STORE(s->active, 0);
+   __sync_add_and_fetch(&s->gen, 1);
+   shm_futex_wake(&r->hdr->data_futex);
+}
+
+/**
+ * \brief Check that all active consumers read data that would be overwritten by a new buffer.
+ *
+ * \param[in] r       ring
+ * \param[in] size    size of buffer
+ * \param[out] skip   number of bytes at the end of data area that must be skipped
+ * \return 1 if the buffer can be written, 0 otherwise
+ */
+static int shm_ring_has_space(shm_ring_t *r, uint32_t size, uint64_t *skip)
+{
+   struct shm_ring_hdr_s *hdr = r->hdr;
+   uint64_t w = hdr->write, off = w % hdr->capacity, end;
+   uint32_t i;
+
+   *skip = 0;
+   if (off + SHM_RING_ALIGN(size) > hdr->capacity) {
+      *skip = hdr->capacity - off;
+   }
+   end = w + *skip + SHM_RING_ALIGN(size);
+   for (i = 0; i < hdr->slots; i++) {
+      if ((SHM_LOAD(hdr->slot[i].active) != 0) && (end - SHM_LOAD(hdr->slot[i].read) > hdr->capacity)) {
+         return 0;
+      }
+   }
+   return 1;
+}
+
+int shm_ring_put(shm_ring_t *r, const void *data, uint32_t size)
+{
+   struct shm_ring_hdr_s *hdr = r->hdr;
+   uint64_t w = hdr->write, skip;
+   uint32_t i, wake = 0;
+
+   if (shm_ring_has_space(r, size, &skip) == 0) {
+      return TRAP_E_TIMEOUT;
+   }
+   /* consumers finished reading before the data are overwritten */
+   __sync_synchronize();
+   if (skip != 0) {
+      *(uint32_t *) (r->data + w % hdr->capacity) = SHM_RING_WRAP;
+      w += skip;
+   }
+   memcpy(r->data + w % hdr->capacity, data, size);
+   __sync_synchronize();
+   SHM_STORE(hdr->write, w + SHM_RING_ALIGN(size));
+   __sync_synchronize();
+
+   for (i = 0; i < hdr->slots; i++) {
+      if ((SHM_LOAD(hdr->slot[i].active) != 0) && (SHM_LOAD(hdr->slot[i].waiting) != 0)) {
+         wake = 1;
+         break;
+      }
+   }
+   if (wake != 0) {
+      shm_futex_wake(&hdr->data_futex);
+   }
+   return TRAP_E_OK;
+}
+
+void shm_ring_wait_space(shm_ring_t *r, uint32_t size, uint32_t timeout)
+{
+   struct shm_ring_hdr_s *hdr = r->hdr;
+   uint32_t val = SHM_LOAD(hdr->space_futex);
+   uint64_t skip;
+
+   SHM_STORE(hdr->space_waiters, 1);
+   __sync_synchronize();
+   if (shm_ring_has_space(r, size, &skip) == 0) {
+      shm_futex_wait(&hdr->space_futex, val, timeout);
+   }
+   SHM_STORE(hdr->space_waiters, 0);
+}
+
+int shm_ring_get(shm_ring_t *r, uint32_t slot, uint32_t gen, uint64_t *pos, void *data, uint32_t *size)
+{
+   struct shm_ring_hdr_s *hdr = r->hdr;
+   struct shm_ring_slot_s *s = &hdr->slot[slot];
+   uint64_t p = *pos, off;
+   uint32_t len;
+
+   if (SHM_LOAD(s->gen) != gen) {
+      return TRAP_E_IO_ERROR;
+   }
+   if (SHM_LOAD(hdr->write) == p) {
+      return TRAP_E_TIMEOUT;
+   }
+   __sync_synchronize();
+   off = p % hdr->capacity;
+   len = *(uint32_t *) (r->data + off);
+   if (len == SHM_RING_WRAP) {
+      p += hdr->capacity - off;
+      off = 0;
+      len = *(uint32_t *) r->data;
+   }
+   len = ntohl(len);
+   if ((len > *size) || (off + sizeof(trap_buffer_header_t) + len > hdr->capacity)) {
+      VERBOSE(CL_ERROR, "Buffer of %"PRIu32" B in shared memory exceeds the size of input buffer.", len);
+      return TRAP_E_IO_ERROR;
+   }
+   memcpy(data, r->data + off + sizeof(trap_buffer_header_t), len);
+   __sync_synchronize();
+   if (SHM_LOAD(s->gen) != gen) {
+      /* the slot was given to another consumer, data could be overwritten */
+      return TRAP_E_IO_ERROR;
+   }
+   p += SHM_RING_ALIGN(sizeof(trap_buffer_header_t) + len);
+   SHM_STORE(s->read, p);
+   *pos = p;
+   *size = len;
+   __sync_synchronize();
+   if (SHM_LOAD(hdr->space_waiters) != 0) {
+      shm_futex_wake(&hdr->space_futex);
+   }
+   return TRAP_E_OK;
+}
+
+void shm_ring_wait_data(shm_ring_t *r, uint32_t slot, uint64_t pos, uint32_t timeout)
+{
+   struct shm_ring_hdr_s *hdr = r->hdr;
+   struct shm_ring_slot_s *s = &hdr->slot[slot];
+   uint32_t val = SHM_LOAD(hdr->data_futex);
+
+   SHM_STORE(s->waiting, 1);
+   __sync_synchronize();
+   if (SHM_LOAD(hdr->write) == pos) {
+      shm_futex_wait(&hdr->data_futex, val, timeout);
+   }
+   SHM_STORE(s->waiting, 0);
+}
+
+void shm_ring_wake(shm_ring_t *r)
+{
+   shm_futex_wake(&r->hdr->data_futex);
+   shm_futex_wake(&r->hdr->space_futex);
+}
+
+/**
+ * @}
+ */
+
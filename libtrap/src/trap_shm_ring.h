@@ -0,0 +1,201 @@
+/**
+ * \file trap_shm_ring.h
+ * \brief Ring of buffers in shared memory used by the shared memory IFC
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TRAP_SHM_RING_H
+#define TRAP_SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * \defgroup shm_ring Shared memory ring
+ *
+ * Single-producer multi-consumer ring of TRAP buffers (trap_buffer_header_t
+ * with payload) in a memory shared by processes.  Output IFC is the producer,
+ * every connected input IFC is a consumer with its own slot that holds its
+ * read position.  The producer overwrites data only when all active consumers
+ * read them.  Waiting processes are woken by futexes placed in the ring.
+ * @{
+ */
+
+/**
+ * Number of buffers of the maximal size that fit into the ring.
+ */
+#define SHM_RING_BUFFERS 8
+
+/**
+ * Slot of one consumer, each slot has its own cache line.
+ */
+struct shm_ring_slot_s {
+   uint64_t read; /**< Position of the next buffer to read (bytes since the creation of ring) */
+   uint32_t active; /**< Non-zero when the slot is used by a connected consumer */
+   uint32_t gen; /**< Incremented on every join and leave, consumer must stop reading when it changes */
+   uint32_t waiting; /**< Non-zero when the consumer waits for data */
+} __attribute__((aligned(64)));
+
+/**
+ * Header of the ring at the beginning of shared memory.
+ */
+struct shm_ring_hdr_s {
+   uint32_t magic; /**< SHM_RING_MAGIC */
+   uint32_t slots; /**< Number of consumer slots */
+   uint64_t capacity; /**< Size of the data area in bytes */
+   uint64_t data_offset; /**< Offset of the data area from the beginning of the ring */
+
+   uint64_t write __attribute__((aligned(64))); /**< Position behind the last published buffer */
+   uint32_t data_futex; /**< Changed when buffers are published and some consumer waits */
+
+   uint32_t space_futex __attribute__((aligned(64))); /**< Changed when consumers read and the producer waits */
+   uint32_t space_waiters; /**< Non-zero when the producer waits */
+
+   struct shm_ring_slot_s slot[]; /**< Slots of consumers */
+};
+
+/**
+ * Mapping of the ring in a process.
+ */
+typedef struct shm_ring_s {
+   int fd; /**< File descriptor of the shared memory, -1 if not mapped */
+   size_t map_size; /**< Size of mapping */
+   struct shm_ring_hdr_s *hdr; /**< Mapped ring */
+   char *data; /**< Data area */
+} shm_ring_t;
+
+/**
+ * \brief Create a new ring for the given maximal size of buffer.
+ *
+ * \param[out] r            ring
+ * \param[in] slots         maximal number of consumers
+ * \param[in] buffer_size   maximal size of buffer including trap_buffer_header_t
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY or TRAP_E_IO_ERROR
+ */
+int shm_ring_create(shm_ring_t *r, uint32_t slots, uint32_t buffer_size);
+
+/**
+ * \brief Map a ring created by another process.
+ *
+ * \param[out] r   ring
+ * \param[in] fd   file descriptor of the shared memory, the ring takes the ownership
+ * \return TRAP_E_OK on success, TRAP_E_IO_ERROR if the memory is not a valid ring
+ */
+int shm_ring_attach(shm_ring_t *r, int fd);
+
+/**
+ * \brief Unmap the ring and close its file descriptor.
+ *
+ * \param[in,out] r   ring
+ */
+void shm_ring_close(shm_ring_t *r);
+
+/**
+ * \brief Activate slot of a new consumer, it starts reading at the current position.
+ *
+ * \param[in] r     ring
+ * \param[in] slot  index of slot
+ * \return generation of the slot that the consumer must check
+ */
+uint32_t shm_ring_join(shm_ring_t *r, uint32_t slot);
+
+/**
+ * \brief Deactivate slot of a disconnected consumer and wake it if it waits.
+ *
+ * \param[in] r     ring
+ * \param[in] slot  index of slot
+ */
+void shm_ring_leave(shm_ring_t *r, uint32_t slot);
+
+/**
+ * \brief Copy a buffer into the ring and wake waiting consumers.
+ *
+ * \param[in] r     ring
+ * \param[in] data  trap_buffer_header_t with payload
+ * \param[in] size  size of data
+ * \return TRAP_E_OK on success, TRAP_E_TIMEOUT when some consumer did not read enough data yet
+ */
+int shm_ring_put(shm_ring_t *r, const void *data, uint32_t size);
+
+/**
+ * \brief Wait until there is space for a buffer of the given size.
+ *
+ * \param[in] r        ring
+ * \param[in] size     size of buffer
+ * \param[in] timeout  timeout in microseconds
+ */
+void shm_ring_wait_space(shm_ring_t *r, uint32_t size, uint32_t timeout);
+
+/**
+ * \brief Copy payload of the next buffer out of the ring.
+ *
+ * \param[in] r          ring
+ * \param[in] slot       index of slot of the consumer
+ * \param[in] gen        generation of the slot returned by shm_ring_join()
+ * \param[in,out] pos    read position of the consumer
+ * \param[out] data      memory for payload
+ * \param[in,out] size   size of memory for payload, size of payload on success
+ * \return TRAP_E_OK on success, TRAP_E_TIMEOUT when there is no buffer,
+ * TRAP_E_IO_ERROR when the consumer was disconnected or the buffer does not fit
+ */
+int shm_ring_get(shm_ring_t *r, uint32_t slot, uint32_t gen, uint64_t *pos, void *data, uint32_t *size);
+
+/**
+ * \brief Wait until a buffer behind the given position is published.
+ *
+ * \param[in] r        ring
+ * \param[in] slot     index of slot of the consumer
+ * \param[in] pos      read position of the consumer
+ * \param[in] timeout  timeout in microseconds
+ */
+void shm_ring_wait_data(shm_ring_t *r, uint32_t slot, uint64_t pos, uint32_t timeout);
+
+/**
+ * \brief Wake all processes waiting on the ring.
+ *
+ * \param[in] r  ring
+ */
+void shm_ring_wake(shm_ring_t *r);
+
+/**
+ * @}
+ */
+
+#endif
+
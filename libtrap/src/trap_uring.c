@@ -0,0 +1,340 @@
+/**
+ * \file trap_uring.c
+ * \brief Minimal io_uring wrapper used by the TCP/UNIX IFC
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define TRAP_URING_SUPPORTED
+#endif
+
+#include "../include/libtrap/trap.h"
+#include "trap_internal.h"
+#include "trap_uring.h"
+
+/**
+ * \addtogroup trap_uring
+ * @{
+ */
+
+#ifdef TRAP_URING_SUPPORTED
+
+#define URING_LOAD(x) (*(volatile __typeof__(x) *) &(x))
+#define URING_STORE(x, v) (*(volatile __typeof__(x) *) &(x) = (v))
+
+int trap_uring_init(trap_uring_t *u, unsigned entries)
+{
+   struct io_uring_params p;
+   size_t sq_size, cq_size;
+   unsigned i;
+   char *ring;
+
+   memset(u, 0, sizeof(*u));
+   memset(&p, 0, sizeof(p));
+   p.flags = IORING_SETUP_CLAMP;
+   u->fd = syscall(__NR_io_uring_setup, entries, &p);
+   if (u->fd == -1) {
+      VERBOSE(CL_ERROR, "io_uring is not available (%s), using plain syscalls.", strerror(errno));
+      return TRAP_E_IO_ERROR;
+   }
+   if (((p.features & IORING_FEAT_SINGLE_MMAP) == 0) || ((p.features & IORING_FEAT_EXT_ARG) == 0)) {
+      VERBOSE(CL_ERROR, "io_uring of this kernel is too old, using plain syscalls.");
+      goto failure;
+   }
+
+   sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+   cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+   u->ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+   u->ring = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+   if (u->ring == MAP_FAILED) {
+      u->ring = NULL;
+      goto failure;
+   }
+   u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+   u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+   if (u->sqes == MAP_FAILED) {
+      u->sqes = NULL;
+      goto failure;
+   }
+
+   ring = u->ring;
+   u->sq_head = (unsigned *) (ring + p.sq_off.head);
+   u->sq_tail = (unsigned *) (ring + p.sq_off.tail);
+   u->sq_mask = *(unsigned *) (ring + p.sq_off.ring_mask);
+   u->sq_array = (unsigned *) (ring + p.sq_off.array);
+   u->cq_head = (unsigned *) (ring + p.cq_off.head);
+   u->cq_tail = (unsigned *) (ring + p.cq_off.tail);
+   u->cq_mask = *(unsigned *) (ring + p.cq_off.ring_mask);
+   u->cqes = ring + p.cq_off.cqes;
+
+   /* entries are submitted in order, index in array is the index of entry */
+   for (i = 0; i < p.sq_entries; i++) {
+      u->sq_array[i] = i;
+   }
+   return TRAP_E_OK;
+failure:
+   VERBOSE(CL_ERROR, "Initialization of io_uring failed, using plain syscalls.");
+   trap_uring_destroy(u);
+   return TRAP_E_IO_ERROR;
+}
+
+void trap_uring_destroy(trap_uring_t *u)
+{
+   if (u->sqes != NULL) {
+      munmap(u->sqes, u->sqes_size);
+      u->sqes = NULL;
+   }
+   if (u->ring != NULL) {
+      munmap(u->ring, u->ring_size);
+      u->ring = NULL;
+   }
+   if (u->fd != -1) {
+      close(u->fd);
+      u->fd = -1;
+   }
+}
+
+/**
+ * \brief Get a cleared entry of submission queue, it is submitted by the next trap_uring_submit_and_wait().
+ * \return entry, NULL when the queue is full
+ */
+static struct io_uring_sqe *trap_uring_get_sqe(trap_uring_t *u)
+{
+   unsigned tail = *u->sq_tail;
+   struct io_uring_sqe *sqe;
+
+   if (tail - URING_LOAD(*u->sq_head) > u->sq_mask) {
+      return NULL;
+   }
+   sqe = &((struct io_uring_sqe *) u->sqes)[tail & u->sq_mask];
+   memset(sqe, 0, sizeof(*sqe));
+   return sqe;
+}
+
+/**
+ * \brief Make the entry filled after trap_uring_get_sqe() visible to the kernel.
+ */
+static inline void trap_uring_queue_sqe(trap_uring_t *u)
+{
+   __sync_synchronize();
+   URING_STORE(*u->sq_tail, *u->sq_tail + 1);
+   u->to_submit++;
+}
+
+int trap_uring_prep_send(trap_uring_t *u, int sd, const void *data, uint32_t size, int flags, uint64_t user_data)
+{
+   struct io_uring_sqe *sqe = trap_uring_get_sqe(u);
+
+   if (sqe == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   sqe->opcode = IORING_OP_SEND;
+   sqe->fd = sd;
+   sqe->addr = (uint64_t) (uintptr_t) data;
+   sqe->len = size;
+   sqe->msg_flags = flags;
+   sqe->user_data = user_data;
+   trap_uring_queue_sqe(u);
+   return TRAP_E_OK;
+}
+
+int trap_uring_prep_readv(trap_uring_t *u, int fd, const struct iovec *iov, unsigned iovcnt, uint64_t user_data)
+{
+   struct io_uring_sqe *sqe = trap_uring_get_sqe(u);
+
+   if (sqe == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   sqe->opcode = IORING_OP_READV;
+   sqe->fd = fd;
+   sqe->addr = (uint64_t) (uintptr_t) iov;
+   sqe->len = iovcnt;
+   sqe->user_data = user_data;
+   trap_uring_queue_sqe(u);
+   return TRAP_E_OK;
+}
+
+int trap_uring_prep_poll(trap_uring_t *u, int fd, uint32_t events, uint64_t user_data)
+{
+   struct io_uring_sqe *sqe = trap_uring_get_sqe(u);
+
+   if (sqe == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   sqe->opcode = IORING_OP_POLL_ADD;
+   sqe->fd = fd;
+   sqe->poll32_events = events;
+   sqe->user_data = user_data;
+   trap_uring_queue_sqe(u);
+   return TRAP_E_OK;
+}
+
+int trap_uring_prep_cancel(trap_uring_t *u, uint64_t target, uint64_t user_data)
+{
+   struct io_uring_sqe *sqe = trap_uring_get_sqe(u);
+
+   if (sqe == NULL) {
+      return TRAP_E_MEMORY;
+   }
+   sqe->opcode = IORING_OP_ASYNC_CANCEL;
+   sqe->fd = -1;
+   sqe->addr = target;
+   sqe->user_data = user_data;
+   trap_uring_queue_sqe(u);
+   return TRAP_E_OK;
+}
+
+int trap_uring_submit_and_wait(trap_uring_t *u, unsigned wait_nr, struct timeval *tv)
+{
+   struct io_uring_getevents_arg arg;
+   struct __kernel_timespec ts;
+   unsigned flags = IORING_ENTER_EXT_ARG;
+   int ret;
+
+   memset(&arg, 0, sizeof(arg));
+   if (tv != NULL) {
+      ts.tv_sec = tv->tv_sec;
+      ts.tv_nsec = tv->tv_usec * 1000;
+      arg.ts = (uint64_t) (uintptr_t) &ts;
+   }
+   if (wait_nr > 0) {
+      flags |= IORING_ENTER_GETEVENTS;
+   }
+   ret = syscall(__NR_io_uring_enter, u->fd, u->to_submit, wait_nr, flags, &arg, sizeof(arg));
+   if (ret >= 0) {
+      /* waiting could time out even when entries were submitted */
+      u->to_submit -= ((unsigned) ret < u->to_submit) ? (unsigned) ret : u->to_submit;
+      return TRAP_E_OK;
+   }
+   if ((errno == ETIME) || (errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY)) {
+      return TRAP_E_OK;
+   }
+   VERBOSE(CL_ERROR, "io_uring_enter() failed (%s).", strerror(errno));
+   return TRAP_E_IO_ERROR;
+}
+
+unsigned trap_uring_drop(trap_uring_t *u)
+{
+   /* without SQPOLL, the kernel reads entries only inside io_uring_enter() and moves sq_head */
+   unsigned dropped = *u->sq_tail - URING_LOAD(*u->sq_head);
+
+   URING_STORE(*u->sq_tail, *u->sq_tail - dropped);
+   u->to_submit = 0;
+   return dropped;
+}
+
+int trap_uring_get_cqe(trap_uring_t *u, uint64_t *user_data, int32_t *res)
+{
+   unsigned head = *u->cq_head;
+   struct io_uring_cqe *cqe;
+
+   if (head == URING_LOAD(*u->cq_tail)) {
+      return 0;
+   }
+   __sync_synchronize();
+   cqe = &((struct io_uring_cqe *) u->cqes)[head & u->cq_mask];
+   *user_data = cqe->user_data;
+   *res = cqe->res;
+   __sync_synchronize();
+   URING_STORE(*u->cq_head, head + 1);
+   return 1;
+}
+
+#else
+
+int trap_uring_init(trap_uring_t *u, unsigned entries)
+{
+   memset(u, 0, sizeof(*u));
+   u->fd = -1;
+   VERBOSE(CL_ERROR, "libtrap was built without io_uring, using plain syscalls.");
+   return TRAP_E_IO_ERROR;
+}
+
+void trap_uring_destroy(trap_uring_t *u)
+{
+}
+
+int trap_uring_prep_send(trap_uring_t *u, int sd, const void *data, uint32_t size, int flags, uint64_t user_data)
+{
+   return TRAP_E_IO_ERROR;
+}
+
+int trap_uring_prep_readv(trap_uring_t *u, int fd, const struct iovec *iov, unsigned iovcnt, uint64_t user_data)
+{
+   return TRAP_E_IO_ERROR;
+}
+
+int trap_uring_prep_poll(trap_uring_t *u, int fd, uint32_t events, uint64_t user_data)
+{
+   return TRAP_E_IO_ERROR;
+}
+
+int trap_uring_prep_cancel(trap_uring_t *u, uint64_t target, uint64_t user_data)
+{
+   return TRAP_E_IO_ERROR;
+}
+
+int trap_uring_submit_and_wait(trap_uring_t *u, unsigned wait_nr, struct timeval *tv)
+{
+   return TRAP_E_IO_ERROR;
+}
+
+unsigned trap_uring_drop(trap_uring_t *u)
+{
+   return 0;
+}
+
+int trap_uring_get_cqe(trap_uring_t *u, uint64_t *user_data, int32_t *res)
+{
+   return 0;
+}
+
+#endif
+
+/**
+ * @}
+ */
+
@@ -0,0 +1,157 @@
+/**
+ * \file trap_uring.h
+ * \brief Minimal io_uring wrapper used by the TCP/UNIX IFC
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#ifndef TRAP_URING_H
+#define TRAP_URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+/**
+ * \defgroup trap_uring io_uring
+ *
+ * Submission and completion queues of io_uring accessed by raw syscalls,
+ * only operations used by the TCP/UNIX IFC are provided.  Operations are
+ * queued by trap_uring_prep_*() and submitted together by the next call of
+ * trap_uring_submit_and_wait().  When libtrap is built without
+ * linux/io_uring.h, trap_uring_init() fails and callers use plain syscalls.
+ * @{
+ */
+
+typedef struct trap_uring_s {
+   int fd; /**< io_uring instance, -1 when not used */
+   unsigned to_submit; /**< Number of queued and not yet submitted entries */
+   unsigned *sq_head;
+   unsigned *sq_tail;
+   unsigned sq_mask;
+   unsigned *sq_array;
+   void *sqes; /**< Array of submission queue entries */
+   unsigned *cq_head;
+   unsigned *cq_tail;
+   unsigned cq_mask;
+   void *cqes; /**< Array of completion queue entries */
+   void *ring; /**< Mapped submission and completion rings */
+   size_t ring_size;
+   size_t sqes_size;
+} trap_uring_t;
+
+/**
+ * \brief Create io_uring instance.
+ *
+ * \param[out] u       ring, u->fd is -1 on failure
+ * \param[in] entries  number of entries of submission queue
+ * \return TRAP_E_OK on success, TRAP_E_IO_ERROR when io_uring is not available
+ */
+int trap_uring_init(trap_uring_t *u, unsigned entries);
+
+/**
+ * \brief Release io_uring instance, it is safe to call it on a failed or destroyed ring.
+ *
+ * \param[in,out] u  ring
+ */
+void trap_uring_destroy(trap_uring_t *u);
+
+/**
+ * \brief Queue send() of the given memory.
+ *
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY when submission queue is full
+ */
+int trap_uring_prep_send(trap_uring_t *u, int sd, const void *data, uint32_t size, int flags, uint64_t user_data);
+
+/**
+ * \brief Queue readv() into the given vector, it must be valid until the completion.
+ *
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY when submission queue is full
+ */
+int trap_uring_prep_readv(trap_uring_t *u, int fd, const struct iovec *iov, unsigned iovcnt, uint64_t user_data);
+
+/**
+ * \brief Queue one-shot poll of the descriptor.
+ *
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY when submission queue is full
+ */
+int trap_uring_prep_poll(trap_uring_t *u, int fd, uint32_t events, uint64_t user_data);
+
+/**
+ * \brief Queue cancellation of the operation identified by target.
+ *
+ * \return TRAP_E_OK on success, TRAP_E_MEMORY when submission queue is full
+ */
+int trap_uring_prep_cancel(trap_uring_t *u, uint64_t target, uint64_t user_data);
+
+/**
+ * \brief Submit queued operations and wait for completions.
+ *
+ * \param[in,out] u    ring
+ * \param[in] wait_nr  number of completions to wait for, 0 only submits
+ * \param[in] tv       timeout, NULL means blocking
+ * \return TRAP_E_OK on success or timeout (check completions), TRAP_E_IO_ERROR on error
+ */
+int trap_uring_submit_and_wait(trap_uring_t *u, unsigned wait_nr, struct timeval *tv);
+
+/**
+ * \brief Withdraw queued operations that were not consumed by the kernel yet.
+ *
+ * They will never complete, it is used when trap_uring_submit_and_wait() failed.
+ *
+ * \param[in,out] u  ring
+ * \return number of withdrawn operations
+ */
+unsigned trap_uring_drop(trap_uring_t *u);
+
+/**
+ * \brief Take the next completion.
+ *
+ * \param[in,out] u        ring
+ * \param[out] user_data   user_data of the completed operation
+ * \param[out] res         result of the operation (number of bytes or -errno)
+ * \return 1 if a completion was taken, 0 if there is none
+ */
+int trap_uring_get_cqe(trap_uring_t *u, uint64_t *user_data, int32_t *res);
+
+/**
+ * @}
+ */
+
+#endif
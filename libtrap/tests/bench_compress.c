@@ -0,0 +1,230 @@
+/**
+ * \file bench_compress.c
+ * \brief Compare CPU time and transferred bytes of UNIX IFC with compress=off|lz4|zstd.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "trap_internal.h"
+#include "trap_compress.h"
+
+#define SOCKET_NAME "bench_compress"
+
+/** Flow record similar to the ones sent by flow exporters */
+struct flow_rec {
+   uint8_t src_ip[16];
+   uint8_t dst_ip[16];
+   uint64_t time_first;
+   uint64_t time_last;
+   uint64_t bytes;
+   uint32_t packets;
+   uint16_t src_port;
+   uint16_t dst_port;
+   uint8_t protocol;
+   uint8_t tcp_flags;
+   uint8_t dir_bit_field;
+   uint8_t link_bit_field;
+} __attribute__((packed));
+
+static uint64_t count = 2000000;
+static const char *bufsize = "100000";
+
+struct receiver {
+   trap_ctx_t *ctx;
+   uint64_t received;
+   double cpu;
+};
+
+static double cpu_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double wall_time(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_rec(struct flow_rec *r, uint64_t i)
+{
+   uint32_t h = (uint32_t) (i * 2654435761u);
+
+   memset(r, 0, sizeof(*r));
+   /* IPv4 mapped addresses from a few networks */
+   r->src_ip[10] = r->src_ip[11] = 0xff;
+   r->src_ip[12] = 10;
+   r->src_ip[14] = h >> 8;
+   r->src_ip[15] = h;
+   memcpy(r->dst_ip, r->src_ip, 12);
+   r->dst_ip[12] = 192;
+   r->dst_ip[13] = 168;
+   r->dst_ip[15] = h >> 16;
+   r->time_first = 1700000000000ULL + i;
+   r->time_last = r->time_first + (h & 0xfff);
+   r->packets = 1 + (h & 0x1f);
+   r->bytes = r->packets * (40 + (h >> 20));
+   r->src_port = 1024 + (h & 0x7fff);
+   r->dst_port = (h & 1) ? 443 : 53;
+   r->protocol = (h & 1) ? 6 : 17;
+   r->tcp_flags = (h & 1) ? 0x1b : 0;
+}
+
+static void *receiver_thr(void *arg)
+{
+   struct receiver *r = (struct receiver *) arg;
+   const void *data;
+   uint16_t size;
+   int res;
+
+   while (1) {
+      res = trap_ctx_recv(r->ctx, 0, &data, &size);
+      if (res == TRAP_E_FORMAT_CHANGED) {
+         continue;
+      } else if (res != TRAP_E_OK || size <= 1) {
+         /* end of data is marked by message of size 1 */
+         break;
+      }
+      r->received++;
+   }
+   r->cpu = cpu_time();
+   return NULL;
+}
+
+/**
+ * Send flow records to a receiver via UNIX IFC with the given compression.
+ *
+ * \param[in] method  value of compress= IFC parameter
+ * \return 0 on success, 1 on error
+ */
+static int run(const char *method)
+{
+   char ifcspec[256];
+   struct flow_rec rec;
+   struct receiver r;
+   pthread_t thr;
+   trap_ctx_t *ctx;
+   trap_out_ifc_stats_t *st;
+   uint64_t i;
+   double start, wall, cpu;
+
+   memset(&r, 0, sizeof(r));
+   snprintf(ifcspec, sizeof(ifcspec), "u:" SOCKET_NAME ":bufsize=%s:compress=%s", bufsize, method);
+   ctx = trap_ctx_init3("bench", "sender", 0, 1, ifcspec, NULL);
+   r.ctx = trap_ctx_init3("bench", "receiver", 1, 0, "u:" SOCKET_NAME, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK ||
+       r.ctx == NULL || trap_ctx_get_last_error(r.ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+   trap_ctx_set_required_fmt(r.ctx, 0, TRAP_FMT_RAW);
+   if (pthread_create(&thr, NULL, receiver_thr, &r) != 0) {
+      fprintf(stderr, "Failed pthread_create.\n");
+      return 1;
+   }
+
+   start = wall_time();
+   cpu = cpu_time();
+   for (i = 0; i < count; i++) {
+      fill_rec(&rec, i);
+      if (trap_ctx_send(ctx, 0, &rec, sizeof(rec)) != TRAP_E_OK) {
+         break;
+      }
+   }
+   trap_ctx_send(ctx, 0, "", 1);
+   trap_ctx_send_flush(ctx, 0);
+   cpu = cpu_time() - cpu;
+   pthread_join(thr, NULL);
+   wall = wall_time() - start;
+
+   st = &((trap_ctx_priv_t *) ctx)->out_ifc_stats[0];
+   printf("%-5s %10" PRIu64 " %8.3f %8.3f %8.3f %10.1f %10.1f %7.3f\n", method, r.received, wall, cpu, r.cpu,
+          st->send_raw_bytes / wall / 1e6, st->send_bytes / wall / 1e6,
+          (double) st->send_bytes / (st->send_raw_bytes != 0 ? st->send_raw_bytes : 1));
+
+   trap_ctx_finalize(&r.ctx);
+   trap_ctx_finalize(&ctx);
+   return (r.received == count) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+   int opt, ret = 0;
+
+   while ((opt = getopt(argc, argv, "n:b:")) != -1) {
+      switch (opt) {
+      case 'n':
+         count = strtoull(optarg, NULL, 10);
+         break;
+      case 'b':
+         bufsize = optarg;
+         break;
+      default:
+         fprintf(stderr, "Usage: %s [-n records] [-b bufsize]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   printf("%-5s %10s %8s %8s %8s %10s %10s %7s\n", "mode", "records", "time[s]", "snd-cpu", "rcv-cpu",
+          "data[MB/s]", "wire[MB/s]", "ratio");
+   ret |= run("off");
+   if (trap_compress_available(TRAP_COMPRESS_LZ4)) {
+      ret |= run("lz4");
+   }
+   if (trap_compress_available(TRAP_COMPRESS_ZSTD)) {
+      ret |= run("zstd");
+   }
+   return ret;
+}
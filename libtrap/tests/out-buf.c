@@ -196,7 +196,7 @@ static inline int my_trap_store_into_buffer(trap_ctx_priv_t *ctx, unsigned int i
             break; /* one client only - debug only */
          }
          if (result == TRAP_E_OK) {
-            ctx->counter_send_buffer[ifc]++;
+            ctx->out_ifc_stats[ifc].send_buffer++;
             ctx->out_ifc_list[ifc].buffer_index = 0;
             DEBUG_BUF(VERBOSE(CL_VERBOSE_LIBRARY, "Sending partial buffer invoked by autoflush timeout on iterface %d", ifc));
          } else {
@@ -238,7 +238,7 @@ static inline int my_trap_store_into_buffer(trap_ctx_priv_t *ctx, unsigned int i
       /* if the buffer was successfuly sent OR we have no client: */
       if (result == TRAP_E_OK || result == TRAP_E_IO_ERROR) {
          if (result == TRAP_E_OK) {
-            ctx->counter_send_buffer[ifc]++;
+            ctx->out_ifc_stats[ifc].send_buffer++;
          } else {
             /* we had no client but we can propagate either OK or TIMEOUT: */
             result = TRAP_E_TIMEOUT;
@@ -284,11 +284,11 @@ int main(int argc, char **argv)
       messsize %= 90;
       messsize += 88;
       my_trap_store_into_buffer(ctx, 0, buffer, messsize, TRAP_NO_WAIT, 0);
-      cp->counter_send_message[0]++;
+      cp->out_ifc_stats[0].send_message++;
    }
    my_trap_store_into_buffer(ctx, 0, buffer, 1, TRAP_NO_WAIT, 1);
    printf("Stored messages: %"PRIu64"\nSent buffers: %"PRIu64"\n",
-          cp->counter_send_message[0], cp->counter_send_buffer[0]);
+          cp->out_ifc_stats[0].send_message, cp->out_ifc_stats[0].send_buffer);
 
   return 0;
 }
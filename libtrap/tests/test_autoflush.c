@@ -0,0 +1,167 @@
+/**
+ * \file test_autoflush.c
+ * \brief Check that autoflush sends partial buffers on time with several output IFCs.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define NO_MESSAGES 100
+#define MAX_LATENCY 100000
+#define SKIP_MESSAGES 10
+#define SOCKET_SLOW "test_autoflush_slow"
+#define SOCKET_FAST "test_autoflush_fast"
+
+/*
+ * Messages are never enough to fill the buffer, they are sent by autoflush
+ * only.  The first output IFC has a long autoflush timeout, the second one
+ * a short one; the deadline of the first must not delay the second.
+ *
+ * With autoflush=adaptive, messages come more often than the check of
+ * the output IFC, so the buffer is never idle; it must be flushed within
+ * flushlatency anyway.
+ */
+static volatile int stop;
+
+static uint64_t now_us(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void *sender(void *arg)
+{
+   trap_ctx_t *ctx = (trap_ctx_t *) arg;
+   uint64_t t;
+
+   while (__sync_add_and_fetch(&stop, 0) == 0) {
+      t = now_us();
+      trap_ctx_send(ctx, 0, &t, sizeof(t));
+      trap_ctx_send(ctx, 1, &t, sizeof(t));
+      usleep(5000);
+   }
+   return NULL;
+}
+
+static int run(const char *fast_params, uint64_t max_allowed)
+{
+   char ifcspec[256];
+   trap_ctx_t *sctx, *rctx;
+   pthread_t thr;
+   const void *data;
+   uint16_t size;
+   uint64_t t, latency, max_latency = 0;
+   int i, res, ret = 0;
+
+   stop = 0;
+   /* HALF_WAIT: the slow IFC has no client, autoflush must not block on it */
+   snprintf(ifcspec, sizeof(ifcspec), "u:" SOCKET_SLOW ":autoflush=300000:timeout=HALF_WAIT,"
+            "u:" SOCKET_FAST ":%s:timeout=HALF_WAIT", fast_params);
+   sctx = trap_ctx_init3("test_autoflush sender", "", 0, 2, ifcspec, NULL);
+   if (sctx == NULL || trap_ctx_get_last_error(sctx) != TRAP_E_OK) {
+      fprintf(stderr, "Initialization of sender failed.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(sctx, 0, TRAP_FMT_RAW);
+   trap_ctx_set_data_fmt(sctx, 1, TRAP_FMT_RAW);
+
+   rctx = trap_ctx_init3("test_autoflush receiver", "", 1, 0, "u:" SOCKET_FAST, NULL);
+   if (rctx == NULL || trap_ctx_get_last_error(rctx) != TRAP_E_OK) {
+      fprintf(stderr, "Initialization of receiver failed.\n");
+      trap_ctx_finalize(&sctx);
+      return 1;
+   }
+   trap_ctx_set_required_fmt(rctx, 0, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(rctx, TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, 2000000);
+
+   if (pthread_create(&thr, NULL, sender, sctx) != 0) {
+      trap_ctx_finalize(&rctx);
+      trap_ctx_finalize(&sctx);
+      return 1;
+   }
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv(rctx, 0, &data, &size);
+      if (res == TRAP_E_FORMAT_CHANGED) {
+         /* the first message after connection */
+         continue;
+      }
+      if (res != TRAP_E_OK || size != sizeof(t)) {
+         fprintf(stderr, "%s: trap_ctx_recv() failed (%d) after %d messages.\n", fast_params, res, i);
+         ret = 1;
+         break;
+      }
+      memcpy(&t, data, sizeof(t));
+      latency = now_us() - t;
+      /* messages sent before the receiver connected waited for it */
+      if (i >= SKIP_MESSAGES && latency > max_latency) {
+         max_latency = latency;
+      }
+   }
+   if (ret == 0 && max_latency > max_allowed) {
+      fprintf(stderr, "%s: maximal latency of messages is %" PRIu64 " us.\n", fast_params, max_latency);
+      ret = 1;
+   }
+
+   __sync_add_and_fetch(&stop, 1);
+   pthread_join(thr, NULL);
+   trap_ctx_finalize(&rctx);
+   trap_ctx_finalize(&sctx);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   if (run("autoflush=1000", MAX_LATENCY) != 0) {
+      return 1;
+   }
+   if (run("autoflush=adaptive:flushlatency=20000", MAX_LATENCY) != 0) {
+      return 1;
+   }
+   return 0;
+}
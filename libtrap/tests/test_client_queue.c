@@ -0,0 +1,185 @@
+/**
+ * \file test_client_queue.c
+ * \brief Check that a slow client of output IFC with client queues (clientq=) does not block other clients.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+
+#define NO_MESSAGES 50000
+#define MESSAGE_SIZE 100
+#define SOCKET_NAME "test_client_queue"
+
+static void fill_message(char *msg, uint32_t index)
+{
+   memset(msg, (uint8_t) index, MESSAGE_SIZE);
+   memcpy(msg, &index, sizeof(index));
+}
+
+/**
+ * Receive available messages and check that they are complete and in order.
+ *
+ * \param[in] ctx       receiver
+ * \param[in] timeout   timeout of trap_ctx_recv()
+ * \param[in,out] next  expected index of the next message, lower indexes are errors
+ * \param[in,out] count number of received messages
+ * \return 0 on success, 1 on error
+ */
+static int recv_messages(trap_ctx_t *ctx, int timeout, uint32_t *next, uint32_t *count)
+{
+   const void *read_m;
+   uint16_t read_size;
+   uint32_t m;
+   int res;
+
+   trap_ctx_ifcctl(ctx, TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, timeout);
+   while (1) {
+      res = trap_ctx_recv(ctx, 0, &read_m, &read_size);
+      if (res == TRAP_E_TIMEOUT) {
+         return 0;
+      } else if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "trap_ctx_recv() failed (%d).\n", res);
+         return 1;
+      }
+      memcpy(&m, read_m, sizeof(m));
+      if (read_size != MESSAGE_SIZE || m < *next || ((const uint8_t *) read_m)[read_size - 1] != (uint8_t) m) {
+         fprintf(stderr, "Message #%" PRIu32 " doesn't match, expected #%" PRIu32 " or higher.\n", m, *next);
+         return 1;
+      }
+      *next = m + 1;
+      (*count)++;
+   }
+}
+
+/**
+ * Send messages to a fast and a slow client of the IFC with the given parameters.
+ *
+ * \param[in] params  parameters appended to the IFC specifier
+ * \return 0 on success, 1 on error
+ */
+static int run(const char *params)
+{
+   char ifc_spec[128];
+   uint32_t i, fast_next = 0, fast_count = 0, slow_next = 0, slow_count = 0;
+   char msg[MESSAGE_SIZE];
+   int ret = 0, res;
+   trap_ctx_t *ctx, *fast = NULL, *slow = NULL;
+
+
+   snprintf(ifc_spec, sizeof(ifc_spec), "u:" SOCKET_NAME ":bufsize=4096:clientq=4:clientpolicy=drop%s", params);
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 1, ifc_spec, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+
+   fast = trap_ctx_init3("fast", "test description", 1, 0, "u:" SOCKET_NAME, NULL);
+   slow = trap_ctx_init3("slow", "test description", 1, 0, "u:" SOCKET_NAME, NULL);
+   if (fast == NULL || trap_ctx_get_last_error(fast) != TRAP_E_OK ||
+       slow == NULL || trap_ctx_get_last_error(slow) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init of receivers.\n");
+      ret = 1;
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(fast, 0, TRAP_FMT_RAW);
+   trap_ctx_set_required_fmt(slow, 0, TRAP_FMT_RAW);
+
+   /* receivers answer negotiation in trap_ctx_recv() */
+   while (trap_ctx_get_client_count(ctx, 0) < 2) {
+      recv_messages(fast, TRAP_NO_WAIT, &fast_next, &fast_count);
+      recv_messages(slow, TRAP_NO_WAIT, &slow_next, &slow_count);
+      usleep(10000);
+   }
+
+   /* slow client does not read at all, its queue gets full */
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_message(msg, i);
+      res = trap_ctx_send(ctx, 0, msg, MESSAGE_SIZE);
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu32 " failed (%d).\n", i, res);
+         ret = 1;
+         goto exit;
+      }
+      if (recv_messages(fast, TRAP_NO_WAIT, &fast_next, &fast_count) != 0) {
+         ret = 1;
+         goto exit;
+      }
+   }
+   trap_ctx_send_flush(ctx, 0);
+
+   if (recv_messages(fast, 500000, &fast_next, &fast_count) != 0 ||
+       recv_messages(slow, 500000, &slow_next, &slow_count) != 0) {
+      ret = 1;
+      goto exit;
+   }
+   if (fast_count != NO_MESSAGES) {
+      fprintf(stderr, "Fast client received %" PRIu32 " of %d messages.\n", fast_count, NO_MESSAGES);
+      ret = 1;
+   }
+   if (slow_count == 0 || slow_count >= NO_MESSAGES) {
+      fprintf(stderr, "Slow client received %" PRIu32 " of %d messages, some buffers should be dropped.\n", slow_count, NO_MESSAGES);
+      ret = 1;
+   }
+
+exit:
+   trap_ctx_finalize(&fast);
+   trap_ctx_finalize(&slow);
+   trap_ctx_finalize(&ctx);
+
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   /* a blocked send would stop the test */
+   alarm(60);
+
+   /* queued buffers are referenced, the producer, the sender thread and threads with own buffers must not overwrite them */
+   if (run("") != 0 || run(":sendbufs=4") != 0 || run(":threadbufs=on") != 0) {
+      return 1;
+   }
+   return 0;
+}
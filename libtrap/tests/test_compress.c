@@ -0,0 +1,344 @@
+/**
+ * \file test_compress.c
+ * \brief Send compressed buffers (compress=lz4|zstd) via file IFC and read them again.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+#include "trap_internal.h"
+#include "trap_compress.h"
+
+#define NO_MESSAGES 20000
+#define MESSAGE_SIZE 100
+#define DATAFILE "/tmp/testcompressfile"
+#define SOCKET_NAME "test_compress"
+
+
+/**
+ * Fill message, the first half of messages is compressible, the second one is random.
+ */
+static void fill_msg(char *msg, uint64_t i)
+{
+   int j;
+
+   if (i < NO_MESSAGES / 2) {
+      memset(msg, 0, MESSAGE_SIZE);
+      snprintf(msg, MESSAGE_SIZE, "flow %" PRIu64 " 10.0.0.1 -> 10.0.0.2 proto 6", i);
+   } else {
+      srand(i);
+      for (j = 0; j < MESSAGE_SIZE; j++) {
+         msg[j] = rand();
+      }
+   }
+}
+
+/**
+ * Send messages via file IFC with compression and read them again.
+ *
+ * \param[in] method  name of compression method
+ * \param[in] params  other parameters of output IFC
+ * \return 0 on success, 1 on error
+ */
+static int run(const char *method, const char *params)
+{
+   char ifcspec[256], msg[MESSAGE_SIZE];
+   const void *data;
+   uint16_t size;
+   /* message header of output buffer is 32-bit with largemsg=on */
+   uint64_t i, stored_size = MESSAGE_SIZE + (strstr(params, "largemsg=on") != NULL ? sizeof(uint32_t) : sizeof(uint16_t));
+   int ret = 1, res;
+   trap_ctx_priv_t *c;
+   trap_in_ifc_stats_t *in;
+
+   snprintf(ifcspec, sizeof(ifcspec), "f:" DATAFILE ":w:compress=%s:%s", method, params);
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, ifcspec, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_msg(msg, i);
+      res = trap_ctx_send(ctx, 0, msg, sizeof(msg));
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu64 " failed (%d).\n", i, res);
+         goto exit;
+      }
+   }
+   trap_ctx_send_flush(ctx, 0);
+   /* sender thread (sendbufs=) sends the last buffer asynchronously */
+   trap_ctx_finalize(&ctx);
+   ctx = NULL;
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_msg(msg, i);
+      res = trap_ctx_recv(ctx, 0, &data, &size);
+      if ((res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) || size != MESSAGE_SIZE ||
+          memcmp(data, msg, MESSAGE_SIZE) != 0) {
+         fprintf(stderr, "%s: trap_ctx_recv() failed (%d) after %" PRIu64 " messages.\n", method, res, i);
+         goto exit;
+      }
+   }
+   c = (trap_ctx_priv_t *) ctx;
+   in = &c->in_ifc_stats[0];
+   if (in->recv_raw_bytes != NO_MESSAGES * stored_size || in->recv_bytes >= in->recv_raw_bytes) {
+      fprintf(stderr, "%s: input counters don't match: bytes %" PRIu64 ", uncompressed %" PRIu64 ".\n",
+              method, in->recv_bytes, in->recv_raw_bytes);
+      goto exit;
+   }
+   printf("%s %s: %" PRIu64 " B compressed to %" PRIu64 " B\n", method, params, in->recv_raw_bytes, in->recv_bytes);
+   ret = 0;
+exit:
+   if (ctx != NULL) {
+      trap_ctx_finalize(&ctx);
+   }
+   unlink(DATAFILE);
+   return ret;
+}
+
+#if HAVE_LZ4
+/**
+ * Send messages via UNIX IFC with compression, the method is negotiated by the socket.
+ *
+ * \param[in] method  name of compression method
+ * \return 0 on success, 1 on error
+ */
+static int run_socket(const char *method)
+{
+   char ifcspec[256], msg[MESSAGE_SIZE];
+   const void *data;
+   uint16_t size;
+   uint64_t i, next = 0;
+   int ret = 1, res;
+   trap_ctx_t *ctx, *recv_ctx = NULL;
+   trap_in_ifc_stats_t *in;
+
+   /* a blocked send would stop the test */
+   alarm(60);
+
+   /* all buffers fit into the queue of client, sending does not wait for the receiver */
+   snprintf(ifcspec, sizeof(ifcspec), "u:" SOCKET_NAME ":compress=%s:bufsize=16384:clientq=256", method);
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 1, ifcspec, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+
+   recv_ctx = trap_ctx_init3("receiver", "test description", 1, 0, "u:" SOCKET_NAME, NULL);
+   if (recv_ctx == NULL || trap_ctx_get_last_error(recv_ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init of receiver.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(recv_ctx, 0, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(recv_ctx, TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_NO_WAIT);
+
+   /* the receiver answers negotiation in trap_ctx_recv() */
+   while (trap_ctx_get_client_count(ctx, 0) < 1) {
+      trap_ctx_recv(recv_ctx, 0, &data, &size);
+      usleep(10000);
+   }
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_msg(msg, i);
+      res = trap_ctx_send(ctx, 0, msg, sizeof(msg));
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "%s: sending of message #%" PRIu64 " failed (%d).\n", method, i, res);
+         goto exit;
+      }
+   }
+   trap_ctx_send_flush(ctx, 0);
+
+   trap_ctx_ifcctl(recv_ctx, TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, 1000000);
+   for (next = 0; next < NO_MESSAGES; next++) {
+      fill_msg(msg, next);
+      res = trap_ctx_recv(recv_ctx, 0, &data, &size);
+      if ((res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) || size != MESSAGE_SIZE ||
+          memcmp(data, msg, MESSAGE_SIZE) != 0) {
+         fprintf(stderr, "%s: trap_ctx_recv() via socket failed (%d) after %" PRIu64 " messages.\n", method, res, next);
+         goto exit;
+      }
+   }
+   in = &((trap_ctx_priv_t *) recv_ctx)->in_ifc_stats[0];
+   if (in->recv_bytes >= in->recv_raw_bytes) {
+      fprintf(stderr, "%s: buffers received via socket were not compressed.\n", method);
+      goto exit;
+   }
+   printf("%s socket: %" PRIu64 " B compressed to %" PRIu64 " B\n", method, in->recv_raw_bytes, in->recv_bytes);
+   ret = 0;
+exit:
+   alarm(0);
+   if (recv_ctx != NULL) {
+      trap_ctx_finalize(&recv_ctx);
+   }
+   trap_ctx_finalize(&ctx);
+   return ret;
+}
+#endif
+
+/**
+ * Check that unavailable compression method is not used by output IFC.
+ *
+ * \param[in] method  name of compression method
+ * \return 0 on success, 1 on error
+ */
+static int run_unavailable(const char *method)
+{
+   char ifcspec[256];
+   int ret = 0;
+
+   snprintf(ifcspec, sizeof(ifcspec), "f:" DATAFILE ":w:compress=%s", method);
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, ifcspec, NULL);
+   if (ctx == NULL || ((trap_ctx_priv_t *) ctx)->out_ifc_list[0].compress != TRAP_COMPRESS_OFF) {
+      fprintf(stderr, "%s is used without its library.\n", method);
+      ret = 1;
+   }
+   if (ctx != NULL) {
+      trap_ctx_finalize(&ctx);
+   }
+   unlink(DATAFILE);
+   return ret;
+}
+
+#if !HAVE_LZ4 || !HAVE_ZSTD
+/**
+ * Check that input IFC built without the library of compression method refuses a sender that uses it.
+ *
+ * Such sender cannot be created by this build, so the method is set in hello
+ * message of a file written without compression.
+ *
+ * \param[in] method  name of compression method
+ * \param[in] flag    TRAP_HELLO_FLAG_* of the method
+ * \return 0 on success, 1 on error
+ */
+static int run_rejected(const char *method, uint8_t flag)
+{
+   const long flags_offset = sizeof(hello_msg_header_t) + offsetof(hello_msg_ext_t, flags);
+   char msg[MESSAGE_SIZE];
+   const void *data;
+   uint16_t size;
+   hello_msg_ext_t ext;
+   FILE *f;
+   int ret = 1, res;
+
+   /* bufsize differs from the default, so the hello message has the extension */
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" DATAFILE ":w:bufsize=16384", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   fill_msg(msg, 0);
+   trap_ctx_send(ctx, 0, msg, sizeof(msg));
+   trap_ctx_send_flush(ctx, 0);
+   trap_ctx_finalize(&ctx);
+
+   f = fopen(DATAFILE, "r+");
+   if (f == NULL || fseek(f, sizeof(hello_msg_header_t), SEEK_SET) != 0 || fread(&ext, sizeof(ext), 1, f) != 1 ||
+       ntohl(ext.buffer_size) != 16384) {
+      fprintf(stderr, "%s: hello message extension was not found in " DATAFILE ".\n", method);
+      goto exit;
+   }
+   ext.flags |= flag;
+   if (fseek(f, flags_offset, SEEK_SET) != 0 || fwrite(&ext.flags, 1, 1, f) != 1) {
+      fprintf(stderr, "%s: unable to modify " DATAFILE ".\n", method);
+      goto exit;
+   }
+   fclose(f);
+   f = NULL;
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+   res = trap_ctx_recv(ctx, 0, &data, &size);
+   trap_ctx_finalize(&ctx);
+   if (res != TRAP_E_FORMAT_MISMATCH) {
+      fprintf(stderr, "%s: input IFC without the library did not refuse the sender (%d).\n", method, res);
+      goto exit;
+   }
+   ret = 0;
+exit:
+   if (f != NULL) {
+      fclose(f);
+   }
+   unlink(DATAFILE);
+   return ret;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+   int ret = 0;
+
+#if HAVE_LZ4
+   ret |= run("lz4", "bufsize=16384");
+   ret |= run("lz4", "bufsize=16384:timestamp=on:largemsg=on");
+   ret |= run("lz4", "bufsize=16384:sendbufs=4");
+   ret |= run_socket("lz4");
+#else
+   ret |= run_unavailable("lz4");
+   ret |= run_rejected("lz4", TRAP_HELLO_FLAG_LZ4);
+#endif
+#if HAVE_ZSTD
+   ret |= run("zstd", "bufsize=16384");
+   ret |= run("zstd", "bufsize=16384:timestamp=on:sendbufs=4");
+#else
+   ret |= run_unavailable("zstd");
+   ret |= run_rejected("zstd", TRAP_HELLO_FLAG_ZSTD);
+#endif
+   return ret;
+}
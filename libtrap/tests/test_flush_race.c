@@ -0,0 +1,162 @@
+/**
+ * \file test_flush_race.c
+ * \brief Send messages while autoflush and another thread flush the buffer, read them again.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NO_MESSAGES 200000
+#define MAX_MESSAGE_SIZE 300
+#define DATAFILE "/tmp/testflushracefile"
+
+/*
+ * Messages that fit into the buffer are stored without the lock of the
+ * output IFC.  Autoflush with the shortest period and another thread
+ * calling trap_ctx_send_flush() try to send the buffer meanwhile, every
+ * message must be stored exactly once and in order.
+ */
+static volatile int stop;
+
+static uint16_t message_size(uint64_t index)
+{
+   return sizeof(index) + (index % (MAX_MESSAGE_SIZE - sizeof(index)));
+}
+
+static void fill_message(char *msg, uint64_t index)
+{
+   memset(msg, (uint8_t) index, message_size(index));
+   memcpy(msg, &index, sizeof(index));
+}
+
+static void *flusher(void *arg)
+{
+   trap_ctx_t *ctx = (trap_ctx_t *) arg;
+
+   while (__sync_add_and_fetch(&stop, 0) == 0) {
+      trap_ctx_send_flush(ctx, 0);
+   }
+   return NULL;
+}
+
+/**
+ * Send messages via the given IFC and check the file.
+ *
+ * \param[in] ifcspec   output IFC, it must be a file IFC writing DATAFILE
+ * \return 0 on success, 1 on error
+ */
+static int run(const char *ifcspec)
+{
+   uint64_t i, m;
+   char msg[MAX_MESSAGE_SIZE];
+   const void *read_m;
+   uint16_t read_size;
+   pthread_t thr;
+   int ret = 0, res;
+
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, ifcspec, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   stop = 0;
+   if (pthread_create(&thr, NULL, flusher, ctx) != 0) {
+      trap_ctx_finalize(&ctx);
+      return 1;
+   }
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_message(msg, i);
+      res = trap_ctx_send(ctx, 0, msg, message_size(i));
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu64 " failed (%d).\n", i, res);
+         ret = 1;
+         break;
+      }
+   }
+   __sync_add_and_fetch(&stop, 1);
+   pthread_join(thr, NULL);
+   trap_ctx_finalize(&ctx);
+   if (ret != 0) {
+      unlink(DATAFILE);
+      return ret;
+   }
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv(ctx, 0, &read_m, &read_size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "%s: trap_ctx_recv() failed (%d) after %" PRIu64 " messages.\n", ifcspec, res, i);
+         ret = 1;
+         break;
+      }
+      memcpy(&m, read_m, sizeof(m));
+      if (read_size != message_size(i) || m != i ||
+          (read_size > sizeof(m) && ((const uint8_t *) read_m)[read_size - 1] != (uint8_t) i)) {
+         fprintf(stderr, "%s: message #%" PRIu64 " doesn't match.\n", ifcspec, i);
+         ret = 1;
+         break;
+      }
+   }
+
+   trap_ctx_finalize(&ctx);
+   unlink(DATAFILE);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   int ret;
+
+   ret = run("f:" DATAFILE ":w:bufsize=4096:autoflush=1");
+   ret |= run("f:" DATAFILE ":w:bufsize=4096:autoflush=1:sendbufs=4");
+   return ret;
+}
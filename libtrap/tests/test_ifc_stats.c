@@ -0,0 +1,187 @@
+/**
+ * \file test_ifc_stats.c
+ * \brief Check counters of IFCs and buffer latency exported by the service IFC.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include "trap_internal.h"
+
+#define NO_MESSAGES 10000
+#define MESSAGE_SIZE 100
+#define BUFFER_SIZE 4096
+#define DATAFILE "/tmp/testifcstatsfile"
+
+int encode_cnts_to_json(char **data, trap_ctx_priv_t *ctx);
+
+/* message header of output buffer (uint16_t size) */
+#define STORED_SIZE (MESSAGE_SIZE + sizeof(uint16_t))
+
+static int check_json(trap_ctx_t *ctx, const char *key)
+{
+   char *json = NULL;
+   int ret = 0;
+
+   if (encode_cnts_to_json(&json, (trap_ctx_priv_t *) ctx) != 0 || json == NULL) {
+      fprintf(stderr, "encode_cnts_to_json() failed.\n");
+      return 1;
+   }
+   if (strstr(json, key) == NULL) {
+      fprintf(stderr, "Counter \"%s\" is missing in %s\n", key, json);
+      ret = 1;
+   }
+   free(json);
+   return ret;
+}
+
+/**
+ * Send messages via file IFC and read them again, check the counters.
+ *
+ * \param[in] timestamp   if 1, the time of sending is appended to buffers (timestamp=on)
+ * \return 0 on success, 1 on error
+ */
+static int run(int timestamp)
+{
+   char msg[MESSAGE_SIZE];
+   const void *data;
+   uint16_t size;
+   uint64_t i, fill, per_buffer, buffers, stamp = (timestamp ? TRAP_BUFFER_TIMESTAMP_SIZE : 0);
+   int ret = 1, res;
+   trap_ctx_priv_t *c;
+   trap_out_ifc_stats_t *out;
+   trap_in_ifc_stats_t *in;
+
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 2,
+                                    timestamp ? "f:" DATAFILE ":w:bufsize=4096:autoflush=off:timestamp=on,b:" :
+                                    "f:" DATAFILE ":w:bufsize=4096:autoflush=off,b:", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   c = (trap_ctx_priv_t *) ctx;
+   /* stat blocks of neighbouring IFCs must not share a cache line */
+   if (((uintptr_t) &c->out_ifc_stats[0]) % TRAP_CACHE_LINE_SIZE != 0 ||
+       ((uintptr_t) &c->out_ifc_stats[1]) % TRAP_CACHE_LINE_SIZE != 0) {
+      fprintf(stderr, "Stat blocks are not aligned to cache line.\n");
+      goto exit;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   memset(msg, 'x', sizeof(msg));
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_send(ctx, 0, msg, sizeof(msg));
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu64 " failed (%d).\n", i, res);
+         goto exit;
+      }
+   }
+   trap_ctx_send_flush(ctx, 0);
+
+   out = &c->out_ifc_stats[0];
+   /* every buffer except the last one is full up to the last whole message, the time of sending is behind it */
+   per_buffer = (BUFFER_SIZE - stamp) / STORED_SIZE;
+   buffers = (NO_MESSAGES + per_buffer - 1) / per_buffer;
+   fill = (per_buffer * STORED_SIZE + stamp) * 1000 / BUFFER_SIZE;
+   if (out->send_message != NO_MESSAGES || out->send_bytes != NO_MESSAGES * STORED_SIZE + buffers * stamp ||
+       out->send_buffer != buffers || out->send_fill / out->send_buffer > fill || out->send_fill / out->send_buffer + 10 < fill) {
+      fprintf(stderr, "Output counters don't match: messages %" PRIu64 ", bytes %" PRIu64 ", buffers %" PRIu64 ", fill %" PRIu64 ".\n",
+              out->send_message, out->send_bytes, out->send_buffer, out->send_fill);
+      goto exit;
+   }
+   if (c->out_ifc_stats[1].send_message != 0) {
+      fprintf(stderr, "Counters of unused IFC were changed.\n");
+      goto exit;
+   }
+   if (check_json(ctx, "\"sent-bytes\"") != 0 || check_json(ctx, "\"send-blocked-time\"") != 0 ||
+       check_json(ctx, "\"buffer-fill\"") != 0) {
+      goto exit;
+   }
+   trap_ctx_finalize(&ctx);
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv(ctx, 0, &data, &size);
+      if ((res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) || size != MESSAGE_SIZE ||
+          memcmp(data, msg, MESSAGE_SIZE) != 0) {
+         fprintf(stderr, "trap_ctx_recv() failed (%d) after %" PRIu64 " messages.\n", res, i);
+         goto exit;
+      }
+   }
+   c = (trap_ctx_priv_t *) ctx;
+   in = &c->in_ifc_stats[0];
+   /* the time of sending is not counted as received data */
+   if (in->recv_message != NO_MESSAGES || in->recv_bytes != NO_MESSAGES * STORED_SIZE) {
+      fprintf(stderr, "Input counters don't match: messages %" PRIu64 ", bytes %" PRIu64 ".\n",
+              in->recv_message, in->recv_bytes);
+      goto exit;
+   }
+   if (in->latency_count != (timestamp ? buffers : 0)) {
+      fprintf(stderr, "Latency was counted for %" PRIu64 " buffers.\n", in->latency_count);
+      goto exit;
+   }
+   if (check_json(ctx, "\"bytes\"") != 0 || (timestamp && check_json(ctx, "\"buffer-latency\"") != 0)) {
+      goto exit;
+   }
+   ret = 0;
+exit:
+   if (ctx != NULL) {
+      trap_ctx_finalize(&ctx);
+   }
+   unlink(DATAFILE);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   int ret;
+
+   ret = run(0);
+   ret |= run(1);
+   return ret;
+}
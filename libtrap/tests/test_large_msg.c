@@ -0,0 +1,150 @@
+/**
+ * \file test_large_msg.c
+ * \brief Send messages bigger than 64 kB with largemsg=on and read them again.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+
+#define NO_MESSAGES 500
+#define BUFFER_SIZE 1000000
+#define MAX_MESSAGE_SIZE (BUFFER_SIZE - sizeof(uint32_t))
+#define DATAFILE "/tmp/testlargemsgfile"
+
+static uint32_t message_size(uint64_t index)
+{
+   if (index % 2 == 0) {
+      /* small message sent by the standard trap_ctx_send() */
+      return sizeof(index) + (index % 1000);
+   }
+   return 65536 + (index * 1777) % (MAX_MESSAGE_SIZE - 65536);
+}
+
+int main(int argc, char **argv)
+{
+   uint64_t i, m;
+   char *msg;
+   const void *read_m;
+   uint32_t read_size;
+   int ret = 0, res;
+
+   msg = malloc(BUFFER_SIZE + 1);
+   if (msg == NULL) {
+      return 1;
+   }
+
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1,
+                                    "f:" DATAFILE ":w:bufsize=1000000:largemsg=on", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      free(msg);
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      memset(msg, (uint8_t) i, message_size(i));
+      memcpy(msg, &i, sizeof(i));
+      if (i % 2 == 0) {
+         res = trap_ctx_send(ctx, 0, msg, message_size(i));
+      } else {
+         res = trap_ctx_send_large(ctx, 0, msg, message_size(i));
+      }
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu64 " failed (%d).\n", i, res);
+         ret = 1;
+         break;
+      }
+   }
+   if (ret == 0 && trap_ctx_send_large(ctx, 0, msg, BUFFER_SIZE + 1) == TRAP_E_OK) {
+      fprintf(stderr, "Message bigger than the buffer was accepted.\n");
+      ret = 1;
+   }
+   trap_ctx_finalize(&ctx);
+   if (ret != 0) {
+      unlink(DATAFILE);
+      free(msg);
+      return ret;
+   }
+
+   /* input IFC uses the default buffer size, it must adopt the announced one */
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      free(msg);
+      return 1;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv_large(ctx, 0, &read_m, &read_size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "trap_ctx_recv_large() failed (%d) after %" PRIu64 " messages.\n", res, i);
+         ret = 1;
+         break;
+      }
+      memcpy(&m, read_m, sizeof(m));
+      if (read_size != message_size(i) || m != i ||
+          (read_size > sizeof(m) && ((const uint8_t *) read_m)[read_size - 1] != (uint8_t) i)) {
+         fprintf(stderr, "Message #%" PRIu64 " doesn't match.\n", i);
+         ret = 1;
+         break;
+      }
+   }
+   if (ret == 0) {
+      /* end of file is signaled by an empty message */
+      res = trap_ctx_recv_large(ctx, 0, &read_m, &read_size);
+      if (res != TRAP_E_OK || read_size != 0) {
+         fprintf(stderr, "Missing end of data (%d, %" PRIu32 " B).\n", res, read_size);
+         ret = 1;
+      }
+   }
+
+   trap_ctx_finalize(&ctx);
+
+   unlink(DATAFILE);
+   free(msg);
+
+   return ret;
+}
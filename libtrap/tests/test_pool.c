@@ -0,0 +1,289 @@
+/**
+ * \file test_pool.c
+ * \brief Check borrowing and returning of buffers of the shared buffer pool.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <pthread.h>
+#include "trap_internal.h"
+#include "trap_pool.h"
+
+#define DATAFILE "/tmp/testpoolfile"
+#define LARGE_SIZE (4 * TRAP_POOL_CHUNK_SIZE)
+#define NO_LARGE 8
+#define NO_THREADS 4
+#define NO_ROUNDS 100000
+
+int encode_cnts_to_json(char **data, trap_ctx_priv_t *ctx);
+
+/**
+ * Check reuse, reference counting and resizing of buffers.
+ *
+ * \return 0 on success, 1 on error
+ */
+static int check_buffers(void)
+{
+   trap_pool_stats_t st;
+   uint64_t reuses;
+   char *a, *b;
+   size_t i;
+
+   a = trap_pool_get(100);
+   if (a == NULL || ((uintptr_t) a) % 64 != 0 || trap_pool_size(a) < 100) {
+      fprintf(stderr, "trap_pool_get() returned wrong buffer.\n");
+      return 1;
+   }
+   memset(a, 'a', trap_pool_size(a));
+   trap_pool_get_stats(&st);
+   reuses = st.reuses;
+   trap_pool_put(a);
+   /* the last returned buffer is used first */
+   b = trap_pool_calloc(100);
+   trap_pool_get_stats(&st);
+   if (b != a || st.reuses != reuses + 1) {
+      fprintf(stderr, "Returned buffer was not reused.\n");
+      return 1;
+   }
+   for (i = 0; i < 100; i++) {
+      if (b[i] != 0) {
+         fprintf(stderr, "trap_pool_calloc() returned dirty buffer.\n");
+         return 1;
+      }
+   }
+
+   if (trap_pool_shared(b) != 0) {
+      fprintf(stderr, "Buffer with one reference is shared.\n");
+      return 1;
+   }
+   trap_pool_ref(b);
+   if (trap_pool_shared(b) == 0) {
+      fprintf(stderr, "Buffer with two references is not shared.\n");
+      return 1;
+   }
+   trap_pool_put(b);
+   trap_pool_get_stats(&st);
+   if (st.used == 0 || trap_pool_shared(b) != 0) {
+      fprintf(stderr, "Buffer with reference was returned.\n");
+      return 1;
+   }
+
+   memset(b, 'b', trap_pool_size(b));
+   a = trap_pool_resize(b, 100000);
+   if (a == NULL || a == b || trap_pool_size(a) < 100000 || a[0] != 'b' || a[99] != 'b') {
+      fprintf(stderr, "trap_pool_resize() failed.\n");
+      return 1;
+   }
+   trap_pool_put(a);
+
+   trap_pool_get_stats(&st);
+   if (st.used != 0 || st.used_bytes != 0 || st.huge_bytes > st.mapped_bytes) {
+      fprintf(stderr, "Wrong statistics: %" PRIu64 " buffers used, %" PRIu64 " B.\n", st.used, st.used_bytes);
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * Check that returned large buffers do not stay mapped.
+ *
+ * \return 0 on success, 1 on error
+ */
+static int check_large(void)
+{
+   trap_pool_stats_t st;
+   uint64_t mapped, size = 0;
+   char *b[NO_LARGE];
+   int i;
+
+   trap_pool_get_stats(&st);
+   mapped = st.mapped_bytes;
+   for (i = 0; i < NO_LARGE; i++) {
+      b[i] = trap_pool_get(LARGE_SIZE);
+      if (b[i] == NULL) {
+         fprintf(stderr, "trap_pool_get() of large buffer failed.\n");
+         return 1;
+      }
+      b[i][LARGE_SIZE - 1] = 1;
+      size = trap_pool_size(b[i]);
+   }
+   for (i = 0; i < NO_LARGE; i++) {
+      trap_pool_put(b[i]);
+   }
+   trap_pool_get_stats(&st);
+   /* a few buffers are kept for reuse */
+   if (st.used != 0 || st.mapped_bytes >= mapped + NO_LARGE / 2 * size) {
+      fprintf(stderr, "Returned large buffers stay mapped (%" PRIu64 " B).\n", st.mapped_bytes - mapped);
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * Borrow and return buffers of several classes.
+ *
+ * \param[in] arg   unused
+ * \return NULL on success, arg on error
+ */
+static void *get_put(void *arg)
+{
+   char *a, *b;
+   int i;
+
+   for (i = 0; i < NO_ROUNDS; i++) {
+      a = trap_pool_get(100 + i % 8000);
+      b = trap_pool_get(100000);
+      if (a == NULL || b == NULL) {
+         return arg;
+      }
+      a[0] = 'a';
+      b[0] = 'b';
+      trap_pool_ref(a);
+      trap_pool_put(a);
+      trap_pool_put(b);
+      if (a[0] != 'a') {
+         return arg;
+      }
+      trap_pool_put(a);
+   }
+   return NULL;
+}
+
+/**
+ * Check that concurrent threads get and return buffers consistently.
+ *
+ * \return 0 on success, 1 on error
+ */
+static int check_threads(void)
+{
+   trap_pool_stats_t st;
+   pthread_t thr[NO_THREADS];
+   void *res;
+   int i, n, ret = 0;
+
+   for (n = 0; n < NO_THREADS; n++) {
+      if (pthread_create(&thr[n], NULL, get_put, &ret) != 0) {
+         break;
+      }
+   }
+   for (i = 0; i < n; i++) {
+      pthread_join(thr[i], &res);
+      if (res != NULL) {
+         ret = 1;
+      }
+   }
+   trap_pool_get_stats(&st);
+   if (n != NO_THREADS || ret != 0 || st.used != 0 || st.used_bytes != 0) {
+      fprintf(stderr, "Concurrent use of pool failed (%" PRIu64 " buffers used).\n", st.used);
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * Check that IFCs borrow their buffers from the pool and return all of them.
+ *
+ * \return 0 on success, 1 on error
+ */
+static int check_ifcs(void)
+{
+   trap_pool_stats_t st;
+   char *json = NULL;
+   int ret = 1;
+   trap_ctx_t *ctx;
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 1, "f:" DATAFILE ",u:testpool:4", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      goto exit;
+   }
+   trap_pool_get_stats(&st);
+   /* buffer of input IFC, backup buffer and buffers of 4 clients of output IFC */
+   if (st.used < 6) {
+      fprintf(stderr, "IFCs borrowed only %" PRIu64 " buffers.\n", st.used);
+      goto exit;
+   }
+   if (encode_cnts_to_json(&json, (trap_ctx_priv_t *) ctx) != 0 || json == NULL || strstr(json, "\"pool\"") == NULL) {
+      fprintf(stderr, "Pool counters are missing.\n");
+      goto exit;
+   }
+   trap_ctx_finalize(&ctx);
+
+   trap_pool_get_stats(&st);
+   if (st.used != 0) {
+      fprintf(stderr, "%" PRIu64 " buffers were not returned by IFCs.\n", st.used);
+      goto exit;
+   }
+   ret = 0;
+exit:
+   free(json);
+   if (ctx != NULL) {
+      trap_ctx_finalize(&ctx);
+   }
+   remove(DATAFILE);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   FILE *f;
+   int ret;
+
+   /* falls back to normal pages when there are no huge pages reserved */
+   setenv("TRAP_POOL_HUGEPAGES", "1", 1);
+   /* input file IFC needs an existing file */
+   f = fopen(DATAFILE, "w");
+   if (f != NULL) {
+      fclose(f);
+   }
+
+   /* keep the pool mapped between contexts */
+   trap_pool_init();
+   ret = check_buffers();
+   ret |= check_large();
+   ret |= check_threads();
+   ret |= check_ifcs();
+   trap_pool_release();
+   return ret;
+}
@@ -0,0 +1,277 @@
+/**
+ * \file test_recv_any.c
+ * \brief Receive messages of more than 32 input IFCs in round-robin order.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+/* more than the 32 IFCs of ifc_mask of trap_ctx_multi_recv() */
+#define NO_IFCS 40
+#define NO_ROUNDS 10
+#define SOCKET_FMT "test_recv_any_%d"
+
+struct message_s {
+   uint32_t ifc;
+   uint32_t round;
+};
+
+static int send_round(trap_ctx_t *ctx, uint32_t round)
+{
+   struct message_s m;
+   uint32_t i;
+
+   for (i = 0; i < NO_IFCS; i++) {
+      m.ifc = i;
+      m.round = round;
+      if (trap_ctx_send(ctx, i, &m, sizeof(m)) != TRAP_E_OK) {
+         return 1;
+      }
+   }
+   return 0;
+}
+
+static void flush_all(trap_ctx_t *ctx)
+{
+   uint32_t i;
+
+   for (i = 0; i < NO_IFCS; i++) {
+      trap_ctx_send_flush(ctx, i);
+   }
+}
+
+static void *connect_sender(void *arg)
+{
+   trap_ctx_t *ctx = (trap_ctx_t *) arg;
+
+   /* flush blocks until the receiver connects to the IFC */
+   send_round(ctx, 0);
+   flush_all(ctx);
+   return NULL;
+}
+
+static void *late_sender(void *arg)
+{
+   trap_ctx_t *ctx = (trap_ctx_t *) arg;
+   struct message_s m;
+
+   usleep(200000);
+   m.ifc = 2;
+   m.round = NO_ROUNDS + 2;
+   trap_ctx_send(ctx, 2, &m, sizeof(m));
+   trap_ctx_send_flush(ctx, 2);
+   return NULL;
+}
+
+static int recv_message(trap_ctx_t *ctx, struct message_s *m, uint32_t *ifc)
+{
+   const void *data;
+   uint16_t size;
+   int res;
+
+   res = trap_ctx_recv_any(ctx, ifc, &data, &size);
+   if ((res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) || size != sizeof(*m)) {
+      fprintf(stderr, "trap_ctx_recv_any() failed (%d).\n", res);
+      return 1;
+   }
+   memcpy(m, data, sizeof(*m));
+   if (m->ifc != *ifc) {
+      fprintf(stderr, "Message of IFC %" PRIu32 " returned as IFC %" PRIu32 ".\n", m->ifc, *ifc);
+      return 1;
+   }
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   char ifcspec[NO_IFCS * 64];
+   int len = 0, i, ret = 1;
+   uint32_t ifc, round, start = 0, sel[3] = {5, 20, 35};
+   uint8_t connected[NO_IFCS];
+   struct message_s m;
+   trap_ctx_t *sctx = NULL, *rctx = NULL;
+   const trap_multi_result_t *mr;
+   const void *data;
+   uint16_t size;
+   pthread_t thr;
+
+   /* a blocked receive would stop the test */
+   alarm(60);
+
+   for (i = 0; i < NO_IFCS; i++) {
+      len += snprintf(ifcspec + len, sizeof(ifcspec) - len, "%su:" SOCKET_FMT ":autoflush=off", i ? "," : "", i);
+   }
+   sctx = trap_ctx_init3("test_recv_any sender", "", 0, NO_IFCS, ifcspec, NULL);
+   if (sctx == NULL || trap_ctx_get_last_error(sctx) != TRAP_E_OK) {
+      fprintf(stderr, "Initialization of sender failed.\n");
+      goto exit;
+   }
+   len = 0;
+   for (i = 0; i < NO_IFCS; i++) {
+      len += snprintf(ifcspec + len, sizeof(ifcspec) - len, "%su:" SOCKET_FMT, i ? "," : "", i);
+   }
+   rctx = trap_ctx_init3("test_recv_any receiver", "", NO_IFCS, 0, ifcspec, NULL);
+   if (rctx == NULL || trap_ctx_get_last_error(rctx) != TRAP_E_OK) {
+      fprintf(stderr, "Initialization of receiver failed.\n");
+      goto exit;
+   }
+   for (i = 0; i < NO_IFCS; i++) {
+      trap_ctx_set_data_fmt(sctx, i, TRAP_FMT_RAW);
+      trap_ctx_ifcctl(sctx, TRAPIFC_OUTPUT, i, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+      trap_ctx_set_required_fmt(rctx, i, TRAP_FMT_RAW);
+      trap_ctx_ifcctl(rctx, TRAPIFC_INPUT, i, TRAPCTL_SETTIMEOUT, 5000000);
+   }
+
+   /* the first message from every IFC, in any order */
+   if (pthread_create(&thr, NULL, connect_sender, sctx) != 0) {
+      goto exit;
+   }
+   memset(connected, 0, sizeof(connected));
+   for (i = 0; i < NO_IFCS; i++) {
+      if (recv_message(rctx, &m, &ifc) != 0) {
+         break;
+      }
+      if (m.round != 0 || connected[ifc] != 0) {
+         fprintf(stderr, "Unexpected message (IFC %" PRIu32 ", round %" PRIu32 ").\n", ifc, m.round);
+         break;
+      }
+      connected[ifc] = 1;
+   }
+   pthread_join(thr, NULL);
+   if (i != NO_IFCS) {
+      goto exit;
+   }
+
+   /* all IFCs have data, they must be served in round-robin order */
+   for (round = 1; round <= NO_ROUNDS; round++) {
+      if (send_round(sctx, round) != 0) {
+         fprintf(stderr, "trap_ctx_send() failed.\n");
+         goto exit;
+      }
+   }
+   flush_all(sctx);
+   for (round = 1; round <= NO_ROUNDS; round++) {
+      for (i = 0; i < NO_IFCS; i++) {
+         if (recv_message(rctx, &m, &ifc) != 0) {
+            goto exit;
+         }
+         if (round == 1 && i == 0) {
+            /* the first IFC follows the last one of the previous receive */
+            start = ifc;
+         }
+         if (ifc != (start + i) % NO_IFCS || m.round != round) {
+            fprintf(stderr, "Got message (IFC %" PRIu32 ", round %" PRIu32 "), expected (IFC %" PRIu32 ", round %" PRIu32 ").\n",
+                    ifc, m.round, (start + i) % NO_IFCS, round);
+            goto exit;
+         }
+      }
+   }
+
+   /* only the ready IFCs of the selected ones have results */
+   m.round = NO_ROUNDS + 1;
+   for (i = 0; i < 3; i += 2) {
+      m.ifc = sel[i];
+      trap_ctx_send(sctx, sel[i], &m, sizeof(m));
+      trap_ctx_send_flush(sctx, sel[i]);
+   }
+   if (trap_ctx_multi_recv_ifcs(rctx, sel, 3, 1000000, (const void **) &mr, &size) != TRAP_E_OK ||
+       size != NO_IFCS * sizeof(trap_multi_result_t)) {
+      fprintf(stderr, "trap_ctx_multi_recv_ifcs() failed.\n");
+      goto exit;
+   }
+   if (mr[sel[0]].result_code != TRAP_E_OK || mr[sel[1]].result_code != TRAP_E_TIMEOUT ||
+       mr[sel[2]].result_code != TRAP_E_OK || mr[sel[2]].message_size != sizeof(m)) {
+      fprintf(stderr, "Unexpected results of trap_ctx_multi_recv_ifcs() (%d %d %d).\n",
+              mr[sel[0]].result_code, mr[sel[1]].result_code, mr[sel[2]].result_code);
+      goto exit;
+   }
+
+   /* trap_ctx_multi_recv() waits for all selected IFCs */
+   m.ifc = 1;
+   trap_ctx_send(sctx, 1, &m, sizeof(m));
+   trap_ctx_send_flush(sctx, 1);
+   if (pthread_create(&thr, NULL, late_sender, sctx) != 0) {
+      goto exit;
+   }
+   i = trap_ctx_multi_recv(rctx, 0x6, (const void **) &mr, &size);
+   pthread_join(thr, NULL);
+   if (i != TRAP_E_OK || mr[1].result_code != TRAP_E_OK || mr[2].result_code != TRAP_E_OK ||
+       ((const struct message_s *) mr[2].message)->round != NO_ROUNDS + 2) {
+      fprintf(stderr, "trap_ctx_multi_recv() did not wait for all IFCs (%d %d %d).\n",
+              i, mr[1].result_code, mr[2].result_code);
+      goto exit;
+   }
+
+   /* nothing to receive */
+   for (i = 0; i < NO_IFCS; i++) {
+      trap_ctx_ifcctl(rctx, TRAPIFC_INPUT, i, TRAPCTL_SETTIMEOUT, 100000);
+   }
+   if (trap_ctx_recv_any(rctx, &ifc, &data, &size) != TRAP_E_TIMEOUT) {
+      fprintf(stderr, "trap_ctx_recv_any() did not time out.\n");
+      goto exit;
+   }
+   /* results of IFCs that timed out are returned, TRAP_HALFWAIT does not block */
+   m.ifc = 1;
+   trap_ctx_send(sctx, 1, &m, sizeof(m));
+   trap_ctx_send_flush(sctx, 1);
+   if (trap_ctx_multi_recv(rctx, 0x6, (const void **) &mr, &size) != TRAP_E_OK ||
+       mr[1].result_code != TRAP_E_OK || mr[2].result_code != TRAP_E_TIMEOUT) {
+      fprintf(stderr, "Unexpected results of trap_ctx_multi_recv() after timeout.\n");
+      goto exit;
+   }
+   trap_ctx_ifcctl(rctx, TRAPIFC_INPUT, 1, TRAPCTL_SETTIMEOUT, TRAP_HALFWAIT);
+   trap_ctx_ifcctl(rctx, TRAPIFC_INPUT, 2, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+   if (trap_ctx_multi_recv(rctx, 0x6, (const void **) &mr, &size) != TRAP_E_OK ||
+       mr[1].result_code != TRAP_E_TIMEOUT || mr[2].result_code != TRAP_E_TIMEOUT) {
+      fprintf(stderr, "trap_ctx_multi_recv() with TRAP_HALFWAIT failed.\n");
+      goto exit;
+   }
+   ret = 0;
+
+exit:
+   trap_ctx_finalize(&rctx);
+   trap_ctx_finalize(&sctx);
+   return ret;
+}
@@ -0,0 +1,114 @@
+/**
+ * \file test_recv_burst.c
+ * \brief Store messages and read them again using trap_ctx_recv_burst().
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+
+#define NO_MESSAGES 100000
+#define BURST_SIZE 64
+#define DATAFILE "/tmp/testburstfile"
+
+int main(int argc, char **argv)
+{
+   uint64_t i, m, expected = 0;
+   const void *msgs[BURST_SIZE];
+   uint16_t sizes[BURST_SIZE];
+   unsigned int got, j;
+   int ret = 0, res, fmt_changed = 0;
+
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" DATAFILE ":w", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      trap_ctx_send(ctx, 0, &i, sizeof(i));
+   }
+   trap_ctx_finalize(&ctx);
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   while (expected < NO_MESSAGES) {
+      res = trap_ctx_recv_burst(ctx, 0, msgs, sizes, BURST_SIZE, &got);
+      if (res == TRAP_E_FORMAT_CHANGED) {
+         fmt_changed++;
+      } else if (res != TRAP_E_OK) {
+         fprintf(stderr, "trap_ctx_recv_burst() failed (%d) after %" PRIu64 " messages.\n", res, expected);
+         ret = 1;
+         break;
+      }
+      if (got == 0 || got > BURST_SIZE) {
+         fprintf(stderr, "Unexpected number of messages in burst (%u).\n", got);
+         ret = 1;
+         break;
+      }
+      for (j = 0; j < got; j++, expected++) {
+         memcpy(&m, msgs[j], sizeof(m));
+         if (sizes[j] != sizeof(m) || m != expected) {
+            fprintf(stderr, "Message #%" PRIu64 " doesn't match.\n", expected);
+            ret = 1;
+            goto exit;
+         }
+      }
+   }
+   if (fmt_changed > 1) {
+      fprintf(stderr, "TRAP_E_FORMAT_CHANGED returned %d times.\n", fmt_changed);
+      ret = 1;
+   }
+
+exit:
+   trap_ctx_finalize(&ctx);
+
+   unlink(DATAFILE);
+
+   return ret;
+}
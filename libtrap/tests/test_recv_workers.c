@@ -0,0 +1,165 @@
+/**
+ * \file test_recv_workers.c
+ * \brief Check that a pool of worker threads receives every message exactly once.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+
+#define NO_WORKERS 4
+#define NO_MESSAGES 100000
+#define NO_FIRST 10
+#define MESSAGE_SIZE 32
+#define DATAFILE "/tmp/testrecvworkersfile"
+
+struct result_s {
+   uint8_t seen[NO_MESSAGES];
+   uint32_t count[NO_WORKERS];
+   uint32_t errors[NO_WORKERS];
+};
+
+static int process(trap_recv_buffer_t *buf, void *arg)
+{
+   struct result_s *r = (struct result_s *) arg;
+   uint32_t w = trap_recv_buffer_worker(buf);
+   const void *data;
+   uint32_t size, index;
+
+   if (w >= NO_WORKERS) {
+      return 1;
+   }
+   while (trap_recv_buffer_next(buf, &data, &size)) {
+      if (size <= 1) {
+         /* end of data */
+         return 1;
+      }
+      memcpy(&index, data, sizeof(index));
+      if (size != MESSAGE_SIZE || index >= NO_MESSAGES || r->seen[index] != 0 ||
+          ((const uint8_t *) data)[size - 1] != (uint8_t) index) {
+         r->errors[w]++;
+         continue;
+      }
+      r->seen[index] = 1;
+      r->count[w]++;
+   }
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   static struct result_s r;
+   char msg[MESSAGE_SIZE];
+   const void *data;
+   uint16_t size;
+   uint32_t i, index, total = 0, errors = 0;
+   trap_ctx_t *ctx;
+   int ret = 1, res;
+
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" DATAFILE ":w:bufsize=4096", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   for (i = 0; i < NO_MESSAGES; i++) {
+      memset(msg, (uint8_t) i, MESSAGE_SIZE);
+      memcpy(msg, &i, sizeof(i));
+      if (trap_ctx_send(ctx, 0, msg, MESSAGE_SIZE) != TRAP_E_OK) {
+         fprintf(stderr, "Sending failed.\n");
+         goto exit;
+      }
+   }
+   trap_ctx_send_flush(ctx, 0);
+   trap_ctx_finalize(&ctx);
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+   if (trap_ctx_recv_workers(ctx, 0, 0, 0, process, &r) != TRAP_E_BAD_FPARAMS) {
+      fprintf(stderr, "Pool without workers should fail.\n");
+      goto exit;
+   }
+   /* the rest of the first buffer must be handed over to the workers */
+   for (i = 0; i < NO_FIRST; i++) {
+      res = trap_ctx_recv(ctx, 0, &data, &size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "trap_ctx_recv() failed (%d).\n", res);
+         goto exit;
+      }
+      memcpy(&index, data, sizeof(index));
+      if (size != MESSAGE_SIZE || index != i) {
+         fprintf(stderr, "Unexpected message #%" PRIu32 " received by trap_ctx_recv().\n", i);
+         goto exit;
+      }
+      r.seen[index] = 1;
+   }
+   if (trap_ctx_recv_workers(ctx, 0, NO_WORKERS, 3, process, &r) != TRAP_E_OK) {
+      fprintf(stderr, "trap_ctx_recv_workers() failed: %s\n", trap_ctx_get_last_error_msg(ctx));
+      goto exit;
+   }
+   for (i = 0; i < NO_WORKERS; i++) {
+      printf("worker %" PRIu32 ": %" PRIu32 " messages\n", i, r.count[i]);
+      total += r.count[i];
+      errors += r.errors[i];
+   }
+   for (i = 0; i < NO_MESSAGES; i++) {
+      if (r.seen[i] == 0) {
+         fprintf(stderr, "Message #%" PRIu32 " was not received.\n", i);
+         goto exit;
+      }
+   }
+   if (errors != 0 || total != NO_MESSAGES - NO_FIRST) {
+      fprintf(stderr, "Received %" PRIu32 " messages with %" PRIu32 " errors, expected %d.\n", total, errors, NO_MESSAGES - NO_FIRST);
+      goto exit;
+   }
+   ret = 0;
+exit:
+   if (ctx != NULL) {
+      trap_ctx_finalize(&ctx);
+   }
+   remove(DATAFILE);
+   return ret;
+}
@@ -0,0 +1,178 @@
+/**
+ * \file test_send_burst.c
+ * \brief Store messages and using trap_ctx_send_burst() and read them again.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+
+#define NO_MESSAGES 100000
+#define BURST_SIZE 100
+#define MAX_MESSAGE_SIZE 1000
+#define DATAFILE "/tmp/testsendburstfile"
+/* writing fails, so buffers are not sent the same way as without any client */
+#define FULLFILE "/dev/full"
+#define FULL_BURST_SIZE 20
+
+static uint16_t message_size(uint64_t index)
+{
+   return sizeof(index) + (index % (MAX_MESSAGE_SIZE - sizeof(index)));
+}
+
+/**
+ * Compare the number of accepted messages with trap_ctx_send() when the buffer cannot be sent.
+ */
+static int check_failed_send(const void **msgs, const uint16_t *sizes)
+{
+   unsigned int j, sent, stored = 0;
+   int res;
+   trap_ctx_t *ctx;
+
+   /* trap_ctx_send() keeps the message that did not fit, although it returns TRAP_E_TIMEOUT */
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" FULLFILE ":w:bufsize=4096", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   for (j = 0; j < FULL_BURST_SIZE; j++) {
+      res = trap_ctx_send(ctx, 0, msgs[j], sizes[j]);
+      if (res != TRAP_E_OK) {
+         stored = j + 1;
+         break;
+      }
+   }
+   trap_ctx_finalize(&ctx);
+   if (stored == 0 || res != TRAP_E_TIMEOUT) {
+      fprintf(stderr, "trap_ctx_send() into " FULLFILE " did not time out (%d).\n", res);
+      return 1;
+   }
+
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" FULLFILE ":w:bufsize=4096", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   res = trap_ctx_send_burst(ctx, 0, msgs, sizes, FULL_BURST_SIZE, &sent);
+   trap_ctx_finalize(&ctx);
+   if (res != TRAP_E_TIMEOUT || sent != stored) {
+      fprintf(stderr, "trap_ctx_send_burst() into " FULLFILE " returned %d and accepted %u messages, expected %u.\n",
+              res, sent, stored);
+      return 1;
+   }
+   return 0;
+}
+
+int main(int argc, char **argv)
+{
+   uint64_t i, m;
+   static char msgs_data[BURST_SIZE][MAX_MESSAGE_SIZE];
+   const void *msgs[BURST_SIZE];
+   uint16_t sizes[BURST_SIZE];
+   const void *read_m;
+   uint16_t read_size;
+   unsigned int j, sent;
+   int ret = 0, res;
+
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" DATAFILE ":w", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i += BURST_SIZE) {
+      for (j = 0; j < BURST_SIZE; j++) {
+         m = i + j;
+         memset(msgs_data[j], (uint8_t) m, MAX_MESSAGE_SIZE);
+         memcpy(msgs_data[j], &m, sizeof(m));
+         msgs[j] = msgs_data[j];
+         sizes[j] = message_size(m);
+      }
+      res = trap_ctx_send_burst(ctx, 0, msgs, sizes, BURST_SIZE, &sent);
+      if (res != TRAP_E_OK || sent != BURST_SIZE) {
+         fprintf(stderr, "trap_ctx_send_burst() failed (%d), accepted %u messages.\n", res, sent);
+         trap_ctx_finalize(&ctx);
+         unlink(DATAFILE);
+         return 1;
+      }
+   }
+   trap_ctx_finalize(&ctx);
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv(ctx, 0, &read_m, &read_size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "trap_ctx_recv() failed (%d) after %" PRIu64 " messages.\n", res, i);
+         ret = 1;
+         break;
+      }
+      memcpy(&m, read_m, sizeof(m));
+      if (read_size != message_size(i) || m != i ||
+          (read_size > sizeof(m) && ((const uint8_t *) read_m)[read_size - 1] != (uint8_t) i)) {
+         fprintf(stderr, "Message #%" PRIu64 " doesn't match.\n", i);
+         ret = 1;
+         break;
+      }
+   }
+
+   trap_ctx_finalize(&ctx);
+
+   unlink(DATAFILE);
+
+   if (ret == 0) {
+      for (j = 0; j < FULL_BURST_SIZE; j++) {
+         sizes[j] = MAX_MESSAGE_SIZE;
+      }
+      ret = check_failed_send(msgs, sizes);
+   }
+
+   return ret;
+}
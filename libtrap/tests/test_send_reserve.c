@@ -0,0 +1,168 @@
+/**
+ * \file test_send_reserve.c
+ * \brief Build messages in place using trap_ctx_send_reserve() and read them again.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+
+#define NO_MESSAGES 50000
+#define MAX_MESSAGE_SIZE 1000
+#define DATAFILE "/tmp/testsendreservefile"
+
+static void *commit_thread(void *arg)
+{
+   /* the reservation belongs to the main thread */
+   static int res;
+   res = trap_ctx_send_commit((trap_ctx_t *) arg, 0, 1);
+   return &res;
+}
+
+static uint16_t message_size(uint64_t index)
+{
+   return sizeof(index) + (index % (MAX_MESSAGE_SIZE - sizeof(index)));
+}
+
+int main(int argc, char **argv)
+{
+   uint64_t i, m;
+   char msg[MAX_MESSAGE_SIZE];
+   void *p;
+   const void *read_m;
+   uint16_t read_size;
+   int ret = 0, res;
+   pthread_t thr;
+   void *thr_res;
+
+   /* autoflush is short to check that it does not interfere with an outstanding reservation */
+   trap_ctx_t *ctx = trap_ctx_init3("testmodule", "test description", 0, 1, "f:" DATAFILE ":w:autoflush=1000", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      if (i % 3 == 0) {
+         /* mix with the standard send */
+         memset(msg, (uint8_t) i, MAX_MESSAGE_SIZE);
+         memcpy(msg, &i, sizeof(i));
+         res = trap_ctx_send(ctx, 0, msg, message_size(i));
+      } else {
+         p = trap_ctx_send_reserve(ctx, 0, MAX_MESSAGE_SIZE);
+         if (p == NULL) {
+            fprintf(stderr, "trap_ctx_send_reserve() failed (%d).\n", trap_ctx_get_last_error(ctx));
+            ret = 1;
+            break;
+         }
+         memset(p, (uint8_t) i, message_size(i));
+         memcpy(p, &i, sizeof(i));
+         if (i % 10000 == 1) {
+            /* give autoflush a chance to run */
+            usleep(5000);
+            if (trap_ctx_send_commit(ctx, 0, MAX_MESSAGE_SIZE + 1) != TRAP_E_BAD_FPARAMS) {
+               fprintf(stderr, "trap_ctx_send_commit() accepted size bigger than reserved.\n");
+               ret = 1;
+               break;
+            }
+            if (trap_ctx_send_reserve(ctx, 0, MAX_MESSAGE_SIZE) != NULL ||
+                trap_ctx_get_last_error(ctx) != TRAP_E_BAD_FPARAMS) {
+               fprintf(stderr, "Second trap_ctx_send_reserve() of the same thread did not fail.\n");
+               ret = 1;
+               break;
+            }
+            if (pthread_create(&thr, NULL, commit_thread, ctx) != 0 || pthread_join(thr, &thr_res) != 0 ||
+                *((int *) thr_res) != TRAP_E_BAD_FPARAMS) {
+               fprintf(stderr, "trap_ctx_send_commit() from other thread did not fail.\n");
+               ret = 1;
+               break;
+            }
+         }
+         res = trap_ctx_send_commit(ctx, 0, message_size(i));
+      }
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu64 " failed (%d).\n", i, res);
+         ret = 1;
+         break;
+      }
+   }
+   if (ret == 0 && trap_ctx_send_commit(ctx, 0, 0) != TRAP_E_BAD_FPARAMS) {
+      fprintf(stderr, "trap_ctx_send_commit() without reservation succeeded.\n");
+      ret = 1;
+   }
+   trap_ctx_finalize(&ctx);
+   if (ret != 0) {
+      unlink(DATAFILE);
+      return ret;
+   }
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv(ctx, 0, &read_m, &read_size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "trap_ctx_recv() failed (%d) after %" PRIu64 " messages.\n", res, i);
+         ret = 1;
+         break;
+      }
+      memcpy(&m, read_m, sizeof(m));
+      if (read_size != message_size(i) || m != i ||
+          (read_size > sizeof(m) && ((const uint8_t *) read_m)[read_size - 1] != (uint8_t) i)) {
+         fprintf(stderr, "Message #%" PRIu64 " doesn't match.\n", i);
+         ret = 1;
+         break;
+      }
+   }
+
+   trap_ctx_finalize(&ctx);
+
+   unlink(DATAFILE);
+
+   return ret;
+}
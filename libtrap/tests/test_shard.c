@@ -0,0 +1,251 @@
+/**
+ * \file test_shard.c
+ * \brief Check distribution of buffers among clients of output IFC with "shard=rr" and "shard=hash".
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+
+#define NO_MESSAGES 20000
+#define MESSAGE_SIZE 100
+#define NO_CLIENTS 3
+#define NO_KEYS 16
+#define SOCKET_RR "test_shard_rr"
+#define SOCKET_HASH "test_shard_hash"
+
+static uint8_t received[NO_MESSAGES];
+static int key_owner[NO_KEYS];
+
+static void fill_message(char *msg, uint32_t index)
+{
+   memset(msg, (uint8_t) index, MESSAGE_SIZE);
+   memcpy(msg, &index, sizeof(index));
+}
+
+static uint64_t message_key(const void *data, uint32_t size, void *arg)
+{
+   uint32_t m;
+
+   (void) size;
+   (void) arg;
+   memcpy(&m, data, sizeof(m));
+   return m % NO_KEYS;
+}
+
+/**
+ * Receive available messages, check that every message is received once.
+ *
+ * \param[in] ctx        receiver
+ * \param[in] id         index of receiver
+ * \param[in] timeout    timeout of trap_ctx_recv()
+ * \param[in] keys       if not 0, check that every key is received by one receiver only
+ * \param[in,out] count  number of received messages
+ * \return 0 on success, 1 on error
+ */
+static int recv_messages(trap_ctx_t *ctx, int id, int timeout, int keys, uint32_t *count)
+{
+   const void *read_m;
+   uint16_t read_size;
+   uint32_t m;
+   int res;
+
+   trap_ctx_ifcctl(ctx, TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, timeout);
+   while (1) {
+      res = trap_ctx_recv(ctx, 0, &read_m, &read_size);
+      if (res == TRAP_E_TIMEOUT) {
+         return 0;
+      } else if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "trap_ctx_recv() failed (%d).\n", res);
+         return 1;
+      }
+      memcpy(&m, read_m, sizeof(m));
+      if (read_size != MESSAGE_SIZE || m >= NO_MESSAGES || ((const uint8_t *) read_m)[read_size - 1] != (uint8_t) m) {
+         fprintf(stderr, "Message #%" PRIu32 " is corrupted.\n", m);
+         return 1;
+      }
+      if (received[m] != 0) {
+         fprintf(stderr, "Message #%" PRIu32 " was received twice.\n", m);
+         return 1;
+      }
+      received[m] = 1;
+      if (keys != 0) {
+         if (key_owner[m % NO_KEYS] == -1) {
+            key_owner[m % NO_KEYS] = id;
+         } else if (key_owner[m % NO_KEYS] != id) {
+            fprintf(stderr, "Key %" PRIu32 " was received by clients %d and %d.\n", m % NO_KEYS, key_owner[m % NO_KEYS], id);
+            return 1;
+         }
+      }
+      (*count)++;
+   }
+}
+
+/**
+ * Send messages via output IFC and check that they are split among all receivers.
+ *
+ * \param[in] ctx     sender
+ * \param[in] ifc     index of output IFC
+ * \param[in] socket  name of UNIX socket of the output IFC
+ * \param[in] keys    0 for "shard=rr", 1 for "shard=hash"
+ * \return 0 on success, 1 on error
+ */
+static int test_shard(trap_ctx_t *ctx, unsigned int ifc, const char *socket, int keys)
+{
+   uint32_t i, total = 0, count[NO_CLIENTS] = {0};
+   char msg[MESSAGE_SIZE];
+   char ifc_spec[64];
+   trap_ctx_t *clients[NO_CLIENTS] = {NULL};
+   int c, ret = 0, res;
+
+   memset(received, 0, sizeof(received));
+   memset(key_owner, -1, sizeof(key_owner));
+   snprintf(ifc_spec, sizeof(ifc_spec), "u:%s", socket);
+   for (c = 0; c < NO_CLIENTS; c++) {
+      clients[c] = trap_ctx_init3("worker", "test description", 1, 0, ifc_spec, NULL);
+      if (clients[c] == NULL || trap_ctx_get_last_error(clients[c]) != TRAP_E_OK) {
+         fprintf(stderr, "Failed trap_ctx_init of receivers.\n");
+         ret = 1;
+         goto exit;
+      }
+      trap_ctx_set_required_fmt(clients[c], 0, TRAP_FMT_RAW);
+   }
+
+   /* receivers answer negotiation in trap_ctx_recv() */
+   while (trap_ctx_get_client_count(ctx, ifc) < NO_CLIENTS) {
+      for (c = 0; c < NO_CLIENTS; c++) {
+         recv_messages(clients[c], c, TRAP_NO_WAIT, keys, &count[c]);
+      }
+      usleep(10000);
+   }
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_message(msg, i);
+      res = trap_ctx_send(ctx, ifc, msg, MESSAGE_SIZE);
+      if (res != TRAP_E_OK) {
+         fprintf(stderr, "Sending of message #%" PRIu32 " failed (%d).\n", i, res);
+         ret = 1;
+         goto exit;
+      }
+      for (c = 0; c < NO_CLIENTS; c++) {
+         if (recv_messages(clients[c], c, TRAP_NO_WAIT, keys, &count[c]) != 0) {
+            ret = 1;
+            goto exit;
+         }
+      }
+   }
+   trap_ctx_send_flush(ctx, ifc);
+
+   for (c = 0; c < NO_CLIENTS; c++) {
+      if (recv_messages(clients[c], c, 500000, keys, &count[c]) != 0) {
+         ret = 1;
+         goto exit;
+      }
+      if (count[c] == 0) {
+         fprintf(stderr, "Client %d did not receive any message.\n", c);
+         ret = 1;
+      }
+      total += count[c];
+   }
+   if (total != NO_MESSAGES) {
+      fprintf(stderr, "Clients received %" PRIu32 " of %d messages.\n", total, NO_MESSAGES);
+      ret = 1;
+   }
+
+exit:
+   for (c = 0; c < NO_CLIENTS; c++) {
+      trap_ctx_finalize(&clients[c]);
+   }
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   char msg[MESSAGE_SIZE];
+   int ret = 0;
+   trap_ctx_t *ctx;
+
+   /* a blocked send would stop the test */
+   alarm(60);
+
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 2,
+                        "u:" SOCKET_RR ":bufsize=4096:shard=rr,"
+                        "u:" SOCKET_HASH ":bufsize=4096:shard=hash", NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   trap_ctx_set_data_fmt(ctx, 1, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 1, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 1, TRAPCTL_AUTOFLUSH_TIMEOUT, TRAP_NO_AUTO_FLUSH);
+
+   /* the key function is required, the buffer is not known before the message is written */
+   fill_message(msg, 0);
+   if (trap_ctx_send(ctx, 1, msg, MESSAGE_SIZE) != TRAP_E_BAD_FPARAMS) {
+      fprintf(stderr, "Sending without key function should fail.\n");
+      ret = 1;
+      goto exit;
+   }
+   trap_ctx_set_shard_key(ctx, 1, message_key, NULL);
+   if (trap_ctx_send_reserve(ctx, 1, MESSAGE_SIZE) != NULL) {
+      fprintf(stderr, "Reservation should fail with \"shard=hash\".\n");
+      ret = 1;
+      goto exit;
+   }
+
+   if (test_shard(ctx, 0, SOCKET_RR, 0) != 0) {
+      fprintf(stderr, "Test of shard=rr failed.\n");
+      ret = 1;
+   }
+   if (test_shard(ctx, 1, SOCKET_HASH, 1) != 0) {
+      fprintf(stderr, "Test of shard=hash failed.\n");
+      ret = 1;
+   }
+
+exit:
+   trap_ctx_finalize(&ctx);
+
+   return ret;
+}
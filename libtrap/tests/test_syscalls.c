@@ -0,0 +1,252 @@
+/**
+ * \file test_syscalls.c
+ * \brief Microbenchmark: number of socket syscalls per buffer of UNIX IFC.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+
+#define NO_MESSAGES 100000
+#define SOCKET_NAME "test_syscalls"
+
+/*
+ * Socket functions called by libtrap are wrapped here to count the calls
+ * made by each thread.  Only the thread that calls trap_ctx_send() or
+ * trap_ctx_recv() is measured, helper threads of libtrap are not counted.
+ */
+static __thread uint64_t syscalls;
+
+#define REAL(name) static __typeof__(name) *real = NULL; \
+   if (real == NULL) { \
+      real = (__typeof__(name) *) dlsym(RTLD_NEXT, #name); \
+   } \
+   syscalls++;
+
+ssize_t recv(int sd, void *buf, size_t len, int flags)
+{
+   REAL(recv);
+   return real(sd, buf, len, flags);
+}
+
+ssize_t recvmsg(int sd, struct msghdr *msg, int flags)
+{
+   REAL(recvmsg);
+   return real(sd, msg, flags);
+}
+
+ssize_t send(int sd, const void *buf, size_t len, int flags)
+{
+   REAL(send);
+   return real(sd, buf, len, flags);
+}
+
+ssize_t sendmsg(int sd, const struct msghdr *msg, int flags)
+{
+   REAL(sendmsg);
+   return real(sd, msg, flags);
+}
+
+int select(int nfds, fd_set *r, fd_set *w, fd_set *e, struct timeval *tv)
+{
+   REAL(select);
+   return real(nfds, r, w, e, tv);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout)
+{
+   REAL(epoll_wait);
+   return real(epfd, events, maxevents, timeout);
+}
+
+/* io_uring_enter() has no libc wrapper, libtrap calls it via syscall() */
+long syscall(long number, ...)
+{
+   va_list ap;
+   long a[6];
+   int i;
+
+   REAL(syscall);
+   va_start(ap, number);
+   for (i = 0; i < 6; i++) {
+      a[i] = va_arg(ap, long);
+   }
+   va_end(ap);
+   return real(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+struct bench_s {
+   const char *ifcspec;
+   uint16_t msg_size;
+   uint64_t syscalls;
+   int result;
+};
+
+static void *sender(void *arg)
+{
+   struct bench_s *b = (struct bench_s *) arg;
+   trap_ctx_t *ctx;
+   char *msg;
+   uint64_t start;
+   uint32_t i;
+
+   b->result = 1;
+   msg = calloc(1, b->msg_size);
+   ctx = trap_ctx_init3("test_syscalls sender", "", 0, 1, b->ifcspec, NULL);
+   if ((msg == NULL) || (ctx == NULL) || (trap_ctx_get_last_error(ctx) != TRAP_E_OK)) {
+      fprintf(stderr, "Initialization of sender failed.\n");
+      goto exit;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   /* every message is sent as a separate buffer */
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_BUFFERSWITCH, 0);
+   trap_ctx_ifcctl(ctx, TRAPIFC_OUTPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+
+   start = syscalls;
+   for (i = 0; i < NO_MESSAGES; i++) {
+      memcpy(msg, &i, sizeof(i));
+      if (trap_ctx_send(ctx, 0, msg, b->msg_size) != TRAP_E_OK) {
+         fprintf(stderr, "Sending failed.\n");
+         goto exit;
+      }
+   }
+   b->syscalls = syscalls - start;
+   b->result = 0;
+   /* let the receiver finish before disconnecting */
+   sleep(1);
+exit:
+   trap_ctx_finalize(&ctx);
+   free(msg);
+   return NULL;
+}
+
+/**
+ * Send NO_MESSAGES messages of the given size and print the number of syscalls per buffer.
+ *
+ * \param[in] ifcspec     output IFC
+ * \param[in] in_ifcspec  input IFC
+ * \param[in] msg_size    size of messages
+ * \return 0 on success, 1 on error
+ */
+static int bench(const char *ifcspec, const char *in_ifcspec, uint16_t msg_size)
+{
+   struct bench_s b;
+   pthread_t thr;
+   trap_ctx_t *ctx;
+   const void *data;
+   uint16_t size;
+   uint64_t start, recv_syscalls;
+   uint32_t i, recv_i;
+   int res, ret = 1;
+
+   memset(&b, 0, sizeof(b));
+   b.ifcspec = ifcspec;
+   b.msg_size = msg_size;
+   if (pthread_create(&thr, NULL, sender, &b) != 0) {
+      return 1;
+   }
+
+   ctx = trap_ctx_init3("test_syscalls receiver", "", 1, 0, in_ifcspec, NULL);
+   if ((ctx == NULL) || (trap_ctx_get_last_error(ctx) != TRAP_E_OK)) {
+      fprintf(stderr, "Initialization of receiver failed.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+   trap_ctx_ifcctl(ctx, TRAPIFC_INPUT, 0, TRAPCTL_SETTIMEOUT, TRAP_WAIT);
+
+   /* the first message includes connection and negotiation */
+   do {
+      res = trap_ctx_recv(ctx, 0, &data, &size);
+   } while (res == TRAP_E_FORMAT_CHANGED);
+   if (res != TRAP_E_OK) {
+      fprintf(stderr, "Receiving failed (%d).\n", res);
+      goto exit;
+   }
+
+   start = syscalls;
+   for (i = 1; i < NO_MESSAGES; i++) {
+      res = trap_ctx_recv(ctx, 0, &data, &size);
+      memcpy(&recv_i, data, sizeof(recv_i));
+      if ((res != TRAP_E_OK) || (size != msg_size) || (recv_i != i)) {
+         fprintf(stderr, "Receiving failed (%d) at message %" PRIu32 ".\n", res, i);
+         goto exit;
+      }
+   }
+   recv_syscalls = syscalls - start;
+   ret = 0;
+exit:
+   pthread_join(thr, NULL);
+   trap_ctx_finalize(&ctx);
+   if ((ret | b.result) == 0) {
+      printf("%-40s %6" PRIu16 " B   sender %.2f   receiver %.2f syscalls/buffer\n", ifcspec, msg_size,
+             (double) b.syscalls / NO_MESSAGES, (double) recv_syscalls / (NO_MESSAGES - 1));
+   }
+   return ret | b.result;
+}
+
+int main(int argc, char **argv)
+{
+   const char *ifcs[][2] = {
+      { "u:" SOCKET_NAME, "u:" SOCKET_NAME },
+      { "u:" SOCKET_NAME ":clientq=64", "u:" SOCKET_NAME },
+      { "u:" SOCKET_NAME ":uring=on", "u:" SOCKET_NAME ":uring=on" }
+   };
+   uint16_t sizes[] = { 64, 1024, 16384, 60000 };
+   int i, j, ret = 0;
+
+   for (i = 0; i < sizeof(ifcs) / sizeof(ifcs[0]); i++) {
+      for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); j++) {
+         ret |= bench(ifcs[i][0], ifcs[i][1], sizes[j]);
+      }
+   }
+   return ret;
+}
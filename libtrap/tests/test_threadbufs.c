@@ -0,0 +1,174 @@
+/**
+ * \file test_threadbufs.c
+ * \brief Check that messages of several producer threads with "threadbufs=on" keep their order.
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+
+#include <libtrap/trap.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+
+#define NO_THREADS 4
+#define NO_MESSAGES 50000
+#define MESSAGE_SIZE 64
+#define DATAFILE "/tmp/testthreadbufsfile"
+
+struct producer_s {
+   trap_ctx_t *ctx;
+   pthread_t thr;
+   uint32_t id;
+   int result;
+};
+
+static void fill_message(char *msg, uint32_t id, uint32_t index)
+{
+   memset(msg, (uint8_t) index, MESSAGE_SIZE);
+   memcpy(msg, &id, sizeof(id));
+   memcpy(msg + sizeof(id), &index, sizeof(index));
+}
+
+static void *producer(void *arg)
+{
+   struct producer_s *p = (struct producer_s *) arg;
+   char msg[MESSAGE_SIZE];
+   uint32_t i;
+
+   for (i = 0; i < NO_MESSAGES; i++) {
+      fill_message(msg, p->id, i);
+      p->result = trap_ctx_send(p->ctx, 0, msg, MESSAGE_SIZE);
+      if (p->result != TRAP_E_OK) {
+         fprintf(stderr, "Thread %" PRIu32 ": sending of message #%" PRIu32 " failed (%d).\n", p->id, i, p->result);
+         break;
+      }
+   }
+   return NULL;
+}
+
+/**
+ * Send messages by several threads via file IFC and read them again.
+ *
+ * \param[in] params  parameters of output IFC
+ * \return 0 on success, 1 on error
+ */
+static int run(const char *params)
+{
+   struct producer_s producers[NO_THREADS];
+   uint32_t next[NO_THREADS] = {0}, id, index, i;
+   char ifcspec[256];
+   const void *data;
+   uint16_t size;
+   int ret = 1, res;
+   trap_ctx_t *ctx;
+
+   snprintf(ifcspec, sizeof(ifcspec), "f:" DATAFILE ":w:threadbufs=on:%s", params);
+   ctx = trap_ctx_init3("testmodule", "test description", 0, 1, ifcspec, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      return 1;
+   }
+   trap_ctx_set_data_fmt(ctx, 0, TRAP_FMT_RAW);
+   if (trap_ctx_send_reserve(ctx, 0, MESSAGE_SIZE) != NULL) {
+      fprintf(stderr, "Reservation should fail with \"threadbufs=on\".\n");
+      goto exit;
+   }
+
+   for (i = 0; i < NO_THREADS; i++) {
+      producers[i].ctx = ctx;
+      producers[i].id = i;
+      producers[i].result = TRAP_E_OK;
+   }
+   for (i = 0; i < NO_THREADS; i++) {
+      if (pthread_create(&producers[i].thr, NULL, producer, &producers[i]) != 0) {
+         fprintf(stderr, "pthread_create() failed.\n");
+         goto exit;
+      }
+   }
+   for (i = 0; i < NO_THREADS; i++) {
+      pthread_join(producers[i].thr, NULL);
+      if (producers[i].result != TRAP_E_OK) {
+         goto exit;
+      }
+   }
+   trap_ctx_send_flush(ctx, 0);
+   trap_ctx_finalize(&ctx);
+
+   ctx = trap_ctx_init3("testmodule", "test description", 1, 0, "f:" DATAFILE, NULL);
+   if (ctx == NULL || trap_ctx_get_last_error(ctx) != TRAP_E_OK) {
+      fprintf(stderr, "Failed trap_ctx_init.\n");
+      goto exit;
+   }
+   trap_ctx_set_required_fmt(ctx, 0, TRAP_FMT_RAW);
+   for (i = 0; i < NO_THREADS * NO_MESSAGES; i++) {
+      res = trap_ctx_recv(ctx, 0, &data, &size);
+      if ((res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) || size != MESSAGE_SIZE) {
+         fprintf(stderr, "%s: trap_ctx_recv() failed (%d) after %" PRIu32 " messages.\n", params, res, i);
+         goto exit;
+      }
+      memcpy(&id, data, sizeof(id));
+      memcpy(&index, (const char *) data + sizeof(id), sizeof(index));
+      if (id >= NO_THREADS || index != next[id] || ((const uint8_t *) data)[size - 1] != (uint8_t) index) {
+         fprintf(stderr, "%s: message #%" PRIu32 " of thread %" PRIu32 " is out of order or corrupted.\n", params, index, id);
+         goto exit;
+      }
+      next[id]++;
+   }
+   ret = 0;
+exit:
+   if (ctx != NULL) {
+      trap_ctx_finalize(&ctx);
+   }
+   remove(DATAFILE);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   int ret = 0;
+
+   ret |= run("bufsize=4096");
+   /* full buffers of threads are handed to the sender thread */
+   ret |= run("bufsize=4096:sendbufs=4");
+   /* every message is handed over separately */
+   ret |= run("buffer=off");
+
+   return ret;
+}
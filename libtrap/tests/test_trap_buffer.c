@@ -343,6 +343,64 @@ static void test_ifcapproach(void **state)
    tb_destroy(&rdb);
 }
 
+static int ext_blocks = 0;
+
+static void *ext_alloc(size_t size)
+{
+   ext_blocks++;
+   return calloc(1, size);
+}
+
+static void ext_free(void *data)
+{
+   ext_blocks--;
+   free(data);
+}
+
+static void test_ext_data(void **state)
+{
+   trap_buffer_t *b = NULL;
+   tb_block_t *bl = NULL;
+   const void *data_pointer = NULL;
+   uint64_t data = 0xA0B0C0D001020304;
+   uint16_t data_size = sizeof(data);
+   uint16_t msize = htons(sizeof(data));
+   void *old;
+   int res;
+   (void) state; /* unused */
+
+   assert_null(tb_init_ext(10, 1000, NULL, ext_free));
+   assert_null(tb_init_ext(10, 1000, ext_alloc, NULL));
+
+   will_return(__wrap__test_malloc, 0);
+   will_return(__wrap__test_malloc, 0);
+   will_return(__wrap__test_malloc, 0);
+   b = tb_init_ext(10, 1000, ext_alloc, ext_free);
+   assert_non_null(b);
+   assert_int_equal(ext_blocks, 10);
+
+   /* data are moved with the replaced memory, the block becomes free */
+   assert_int_equal(tb_pushmess(b, &data, data_size), TB_SUCCESS);
+   bl = b->cur_wr_block;
+   old = tb_block_set_data(bl, ext_alloc(b->blocksize));
+   assert_true(tb_isblockfree(bl) == TB_SUCCESS);
+   assert_int_equal(((struct tb_block_data_s *) old)->size, sizeof(data) + sizeof(data_size));
+   ext_free(old);
+
+   /* the ring keeps working with the new memory */
+   TB_FILL_START(b, &bl, res);
+   assert_true(res == TB_SUCCESS);
+   memcpy(bl->data->data, &msize, sizeof(msize));
+   memcpy(bl->data->data + sizeof(msize), &data, sizeof(data));
+   TB_FILL_END(b, bl, sizeof(msize) + sizeof(data));
+   assert_int_equal(tb_getmess(b, &data_pointer, &data_size), TB_SUCCESS);
+   assert_int_equal(data_size, sizeof(data));
+   assert_memory_equal(data_pointer, &data, sizeof(data));
+
+   tb_destroy(&b);
+   assert_int_equal(ext_blocks, 0);
+}
+
 int main(void)
 {
     const struct CMUnitTest tests[] = {
@@ -351,7 +409,8 @@ int main(void)
        cmocka_unit_test(test_insert_message),
        cmocka_unit_test(test_insert_message2),
        cmocka_unit_test(test_insert_bigmessage),
-       cmocka_unit_test(test_ifcapproach)
+       cmocka_unit_test(test_ifcapproach),
+       cmocka_unit_test(test_ext_data)
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
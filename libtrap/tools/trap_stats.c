@@ -101,9 +101,57 @@ int connect_to_module_service_ifc()
    }
 }
 
+/**
+ * Get the lowest latency of the bin that contains the given quantile of buffers.
+ * Bins are pairs [lowest latency, count] sorted by latency.
+ */
+static uint64_t latency_quantile(json_t *bins, uint64_t count, double q)
+{
+   size_t idx;
+   json_t *bin;
+   uint64_t sum = 0, limit = (uint64_t) (q * count);
+
+   json_array_foreach(bins, idx, bin) {
+      sum += json_integer_value(json_array_get(bin, 1));
+      if (sum > limit || idx + 1 == json_array_size(bins)) {
+         return json_integer_value(json_array_get(bin, 0));
+      }
+   }
+   return 0;
+}
+
+/**
+ * Print histogram of latency of buffers of input interface (sent only with timestamp=on of the sender).
+ */
+static void print_buffer_latency(json_t *lat)
+{
+   json_t *bins = json_object_get(lat, "bins");
+   uint64_t count = json_integer_value(json_object_get(lat, "count"));
+
+   if (count == 0 || bins == NULL || !json_is_array(bins)) {
+      return;
+   }
+   printf("\t\tLATENCY (us): N: %" PRIu64 ", AVG: %" PRIu64 ", P50: %" PRIu64 ", P90: %" PRIu64 ", P99: %" PRIu64 ", MAX: %" PRIu64 "\n",
+          count, (uint64_t) json_integer_value(json_object_get(lat, "sum")) / count,
+          latency_quantile(bins, count, 0.5), latency_quantile(bins, count, 0.9), latency_quantile(bins, count, 0.99),
+          (uint64_t) json_integer_value(json_object_get(lat, "max")));
+}
+
+/**
+ * Print size of data before compression if the interface compresses buffers (compress=).
+ */
+static void print_uncompressed(json_t *ifc_cnts, uint64_t bytes)
+{
+   uint64_t raw = json_integer_value(json_object_get(ifc_cnts, "uncompressed-bytes"));
+
+   if (raw != 0 && raw != bytes) {
+      printf(", UNCOMPRESSED: %" PRIu64 " (RATIO: %.3f)", raw, (double) bytes / raw);
+   }
+}
+
 int decode_cnts_from_json(char **data)
 {
-   size_t arr_idx = 0;
+   size_t arr_idx = 0, hist_idx;
 
    uint64_t ifc_cnts[4];
    memset(ifc_cnts, 0, 4 * sizeof(uint64_t));
@@ -117,6 +165,7 @@ int decode_cnts_from_json(char **data)
    json_t *in_ifc_cnts  = NULL;
    json_t *out_ifc_cnts = NULL;
    json_t *cnt = NULL;
+   json_t *hist_bin = NULL;
    char ifc_type;
    const char *ifc_id = NULL;
    uint32_t ifc_cnt = 0;
@@ -217,6 +266,18 @@ int decode_cnts_from_json(char **data)
       ifc_state = (uint8_t)(json_integer_value(cnt));
 
       printf("\tID: %s, TYPE: %c, IS_CONN: %d, RM: %" PRIu64 ", RB: %" PRIu64 "\n", ifc_id, ifc_type, ifc_state, ifc_cnts[msg_idx], ifc_cnts[buffers_idx]);
+
+      // Byte counter is optional (older libtrap does not send it)
+      cnt = json_object_get(in_ifc_cnts, "bytes");
+      if (cnt != NULL) {
+         printf("\t\tRBY: %" PRIu64, (uint64_t) json_integer_value(cnt));
+         print_uncompressed(in_ifc_cnts, json_integer_value(cnt));
+         printf("\n");
+      }
+      cnt = json_object_get(in_ifc_cnts, "buffer-latency");
+      if (cnt != NULL) {
+         print_buffer_latency(cnt);
+      }
       memset(ifc_cnts, 0, 2 * sizeof(uint64_t));
    }
 
@@ -313,6 +374,32 @@ int decode_cnts_from_json(char **data)
       num_clients = (int32_t)(json_integer_value(cnt));
 
       printf("\tID: %s, TYPE: %c, NUM_CLI: %d, SM: %" PRIu64 ", DM: %" PRIu64 ", SB: %" PRIu64 ", AF: %" PRIu64 "\n", ifc_id, ifc_type, num_clients, ifc_cnts[msg_idx], ifc_cnts[dropped_msg_idx], ifc_cnts[buffers_idx], ifc_cnts[af_idx]);
+
+      // Byte counters are optional (older libtrap does not send them)
+      cnt = json_object_get(out_ifc_cnts, "sent-bytes");
+      if (cnt != NULL) {
+         printf("\t\tSBY: %" PRIu64 ", BLOCKED (us): %" PRIu64 ", FILL: %.1f%%", (uint64_t) json_integer_value(cnt),
+                (uint64_t) json_integer_value(json_object_get(out_ifc_cnts, "send-blocked-time")),
+                json_integer_value(json_object_get(out_ifc_cnts, "buffer-fill")) / 10.0);
+         print_uncompressed(out_ifc_cnts, json_integer_value(cnt));
+         printf("\n");
+      }
+
+      // Histogram of autoflush latency is optional (older libtrap does not send it), print only non-empty bins
+      cnt = json_object_get(out_ifc_cnts, "autoflush-latency");
+      if (cnt != NULL && json_is_array(cnt) && ifc_cnts[af_idx] != 0) {
+         printf("\t\tAF latency (us):");
+         json_array_foreach(cnt, hist_idx, hist_bin) {
+            if (json_integer_value(hist_bin) != 0) {
+               if (hist_idx + 1 == json_array_size(cnt)) {
+                  printf(" >=%lu: %" PRIu64, 1lu << (hist_idx - 1), (uint64_t) json_integer_value(hist_bin));
+               } else {
+                  printf(" <%lu: %" PRIu64, 1lu << hist_idx, (uint64_t) json_integer_value(hist_bin));
+               }
+            }
+         }
+         printf("\n");
+      }
       memset(ifc_cnts, 0, 4 * sizeof(uint64_t));
    }
 
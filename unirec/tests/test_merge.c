@@ -0,0 +1,339 @@
+/**
+ * \file test_merge.c
+ * \brief Test of reading input interfaces merged by time
+ * \date 2026
+ */
+/*
+ * Copyright (C) 2026 CESNET
+ *
+ * LICENSE TERMS
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ * 3. Neither the name of the Company nor the names of its contributors
+ *    may be used to endorse or promote products derived from this
+ *    software without specific prior written permission.
+ *
+ * ALTERNATIVELY, provided that this notice is retained in full, this
+ * product may be distributed under the terms of the GNU General Public
+ * License (GPL) version 2 or later, in which case the provisions
+ * of the GPL apply INSTEAD OF those given above.
+ *
+ * This software is provided ``as is'', and any express or implied
+ * warranties, including, but not limited to, the implied warranties of
+ * merchantability and fitness for a particular purpose are disclaimed.
+ * In no event shall the company or contributors be liable for any
+ * direct, indirect, incidental, special, exemplary, or consequential
+ * damages (including, but not limited to, procurement of substitute
+ * goods or services; loss of use, data, or profits; or business
+ * interruption) however caused and on any theory of liability, whether
+ * in contract, strict liability, or tort (including negligence or
+ * otherwise) arising in any way out of the use of this software, even
+ * if advised of the possibility of such damage.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <libtrap/trap.h>
+#include "../unirec.h"
+#include "fields.h"
+
+#define NO_IFCS 3
+#define NO_RECORDS 1000
+#define SOCKET_FMT "test_merge_%d"
+#define LATE_SOCKET_FMT "test_merge_late_%d"
+#define LATE_WINDOW 100 /* ms */
+#define LATE_RECORDS 5
+
+UR_FIELDS(
+   time TIME_FIRST,
+   uint32 MERGE_SEQ,
+)
+
+/* interleaved times, each interface is ordered on its own */
+static ur_time_t record_time(uint32_t ifc, uint32_t seq)
+{
+   static const uint32_t offset[NO_IFCS] = {500, 0, 750};
+
+   return ur_time_from_sec_msec(seq, offset[ifc]);
+}
+
+static void *sender(void *arg)
+{
+   trap_ctx_t *ctx = (trap_ctx_t *) arg;
+   ur_template_t *tmplt[NO_IFCS];
+   void *rec = NULL;
+   char dummy[1] = {0};
+   uint32_t i, seq;
+
+   for (i = 0; i < NO_IFCS; i++) {
+      tmplt[i] = ur_ctx_create_output_template(ctx, i, "TIME_FIRST,MERGE_SEQ", NULL);
+      if (tmplt[i] == NULL) {
+         fprintf(stderr, "Error when creating output template.\n");
+         return NULL;
+      }
+   }
+   rec = ur_create_record(tmplt[0], 0);
+   for (seq = 0; seq < NO_RECORDS; seq++) {
+      for (i = 0; i < NO_IFCS; i++) {
+         ur_set(tmplt[i], rec, F_TIME_FIRST, record_time(i, seq));
+         ur_set(tmplt[i], rec, F_MERGE_SEQ, seq);
+         trap_ctx_send(ctx, i, rec, ur_rec_size(tmplt[i], rec));
+      }
+   }
+   for (i = 0; i < NO_IFCS; i++) {
+      trap_ctx_send(ctx, i, dummy, 1);
+      trap_ctx_send_flush(ctx, i);
+      ur_free_template(tmplt[i]);
+   }
+   ur_free_record(rec);
+   return NULL;
+}
+
+struct late_arg {
+   trap_ctx_t *ctx;
+   sem_t received;   /* posted when records older than the window were returned */
+};
+
+static void late_send(trap_ctx_t *ctx, ur_template_t *tmplt, void *rec, uint32_t ifc, uint32_t msec)
+{
+   ur_set(tmplt, rec, F_TIME_FIRST, ur_time_from_sec_msec(msec / 1000, msec % 1000));
+   ur_set(tmplt, rec, F_MERGE_SEQ, msec);
+   trap_ctx_send(ctx, ifc, rec, ur_rec_size(tmplt, rec));
+   trap_ctx_send_flush(ctx, ifc);
+}
+
+/*
+ * IFC 0 is ahead (1000 ms), IFC 1 is behind it by more than the window
+ * (800, 850 ms) and later within the window (950 ms), IFC 2 is silent
+ * until the end (900 ms).
+ */
+static void *late_sender(void *arg)
+{
+   struct late_arg *a = (struct late_arg *) arg;
+   ur_template_t *tmplt[NO_IFCS];
+   void *rec = NULL;
+   char dummy[1] = {0};
+   uint32_t i;
+
+   for (i = 0; i < NO_IFCS; i++) {
+      tmplt[i] = ur_ctx_create_output_template(a->ctx, i, "TIME_FIRST,MERGE_SEQ", NULL);
+      if (tmplt[i] == NULL) {
+         fprintf(stderr, "Error when creating output template.\n");
+         return NULL;
+      }
+   }
+   rec = ur_create_record(tmplt[0], 0);
+   late_send(a->ctx, tmplt[0], rec, 0, 1000);
+   late_send(a->ctx, tmplt[1], rec, 1, 800);
+   late_send(a->ctx, tmplt[1], rec, 1, 850);
+   /* records beyond the window must not wait for IFC 2 */
+   sem_wait(&a->received);
+   /* the record within the window waits for IFC 2 */
+   late_send(a->ctx, tmplt[1], rec, 1, 950);
+   usleep(100000);
+   late_send(a->ctx, tmplt[2], rec, 2, 900);
+   for (i = 0; i < NO_IFCS; i++) {
+      trap_ctx_send(a->ctx, i, dummy, 1);
+      trap_ctx_send_flush(a->ctx, i);
+      ur_free_template(tmplt[i]);
+   }
+   ur_free_record(rec);
+   return NULL;
+}
+
+/* merge with lateness window while one IFC is silent */
+static int run_lateness(void)
+{
+   static const uint32_t expected[LATE_RECORDS] = {800, 850, 900, 950, 1000};
+   char ifcspec[NO_IFCS * 64];
+   int len = 0, i, ret = 1, res;
+   uint32_t ifc, received = 0, msec;
+   struct late_arg a;
+   trap_ctx_t *rctx = NULL;
+   ur_template_t *tmplt[NO_IFCS] = {NULL};
+   ur_merge_t *m = NULL;
+   const void *data;
+   uint16_t size;
+   pthread_t thr;
+   int started = 0;
+
+   sem_init(&a.received, 0, 0);
+   for (i = 0; i < NO_IFCS; i++) {
+      len += snprintf(ifcspec + len, sizeof(ifcspec) - len, "%su:" LATE_SOCKET_FMT, i ? "," : "", i);
+   }
+   a.ctx = trap_ctx_init3("test_merge late sender", "", 0, NO_IFCS, ifcspec, NULL);
+   rctx = trap_ctx_init3("test_merge late receiver", "", NO_IFCS, 0, ifcspec, NULL);
+   if (a.ctx == NULL || trap_ctx_get_last_error(a.ctx) != TRAP_E_OK ||
+       rctx == NULL || trap_ctx_get_last_error(rctx) != TRAP_E_OK) {
+      fprintf(stderr, "Initialization of libtrap failed.\n");
+      goto exit;
+   }
+   for (i = 0; i < NO_IFCS; i++) {
+      tmplt[i] = ur_ctx_create_input_template(rctx, i, "TIME_FIRST,MERGE_SEQ", NULL);
+      if (tmplt[i] == NULL) {
+         fprintf(stderr, "Error when creating input template.\n");
+         goto exit;
+      }
+   }
+   m = ur_ctx_create_merge(rctx, NULL, NO_IFCS, tmplt, F_TIME_FIRST, LATE_WINDOW, TRAP_WAIT);
+   if (m == NULL) {
+      fprintf(stderr, "Error when creating merging reader.\n");
+      goto exit;
+   }
+   pthread_create(&thr, NULL, late_sender, &a);
+   started = 1;
+
+   while (1) {
+      res = ur_merge_recv(m, &ifc, &data, &size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "ur_merge_recv() failed (%d).\n", res);
+         break;
+      }
+      if (size <= 1) {
+         break;
+      }
+      msec = ur_get(tmplt[ifc], data, F_MERGE_SEQ);
+      if (received >= LATE_RECORDS || msec != expected[received]) {
+         fprintf(stderr, "Record %" PRIu32 " ms of IFC %" PRIu32 " was returned as %" PRIu32 ". record.\n", msec, ifc, received + 1);
+         break;
+      }
+      if (++received == 2) {
+         sem_post(&a.received);
+      }
+   }
+   if (received != LATE_RECORDS) {
+      fprintf(stderr, "Received %" PRIu32 " records, expected %d.\n", received, LATE_RECORDS);
+      goto exit;
+   }
+   ret = 0;
+exit:
+   if (started != 0) {
+      if (received < 2) {
+         /* let the sender finish */
+         sem_post(&a.received);
+      }
+      if (a.ctx != NULL) {
+         trap_ctx_terminate(a.ctx);
+      }
+      pthread_join(thr, NULL);
+   }
+   ur_free_merge(m);
+   for (i = 0; i < NO_IFCS; i++) {
+      if (tmplt[i] != NULL) {
+         ur_free_template(tmplt[i]);
+      }
+   }
+   if (rctx != NULL) {
+      trap_ctx_finalize(&rctx);
+   }
+   if (a.ctx != NULL) {
+      trap_ctx_finalize(&a.ctx);
+   }
+   sem_destroy(&a.received);
+   return ret;
+}
+
+int main(int argc, char **argv)
+{
+   char ifcspec[NO_IFCS * 64];
+   int len = 0, i, ret = 1, res;
+   uint32_t ifc, received = 0, seq;
+   ur_time_t t, prev = 0;
+   trap_ctx_t *sctx = NULL, *rctx = NULL;
+   ur_template_t *tmplt[NO_IFCS] = {NULL};
+   ur_merge_t *m = NULL;
+   const void *data;
+   uint16_t size;
+   pthread_t thr;
+
+   /* a blocked receive would stop the test */
+   alarm(60);
+
+   for (i = 0; i < NO_IFCS; i++) {
+      len += snprintf(ifcspec + len, sizeof(ifcspec) - len, "%su:" SOCKET_FMT, i ? "," : "", i);
+   }
+   sctx = trap_ctx_init3("test_merge sender", "", 0, NO_IFCS, ifcspec, NULL);
+   rctx = trap_ctx_init3("test_merge receiver", "", NO_IFCS, 0, ifcspec, NULL);
+   if (sctx == NULL || trap_ctx_get_last_error(sctx) != TRAP_E_OK ||
+       rctx == NULL || trap_ctx_get_last_error(rctx) != TRAP_E_OK) {
+      fprintf(stderr, "Initialization of libtrap failed.\n");
+      goto exit;
+   }
+   for (i = 0; i < NO_IFCS; i++) {
+      tmplt[i] = ur_ctx_create_input_template(rctx, i, "TIME_FIRST,MERGE_SEQ", NULL);
+      if (tmplt[i] == NULL) {
+         fprintf(stderr, "Error when creating input template.\n");
+         goto exit;
+      }
+   }
+   if (ur_ctx_create_merge(rctx, NULL, NO_IFCS, tmplt, F_MERGE_SEQ, 0, TRAP_WAIT) != NULL) {
+      fprintf(stderr, "Merging by a field that is not of type time must fail.\n");
+      goto exit;
+   }
+   m = ur_ctx_create_merge(rctx, NULL, NO_IFCS, tmplt, F_TIME_FIRST, 0, TRAP_WAIT);
+   if (m == NULL) {
+      fprintf(stderr, "Error when creating merging reader.\n");
+      goto exit;
+   }
+   pthread_create(&thr, NULL, sender, sctx);
+
+   while (1) {
+      res = ur_merge_recv(m, &ifc, &data, &size);
+      if (res != TRAP_E_OK && res != TRAP_E_FORMAT_CHANGED) {
+         fprintf(stderr, "ur_merge_recv() failed (%d).\n", res);
+         break;
+      }
+      if (size <= 1) {
+         break;
+      }
+      t = ur_get(tmplt[ifc], data, F_TIME_FIRST);
+      seq = ur_get(tmplt[ifc], data, F_MERGE_SEQ);
+      if (t != record_time(ifc, seq)) {
+         fprintf(stderr, "Record %" PRIu32 " of IFC %" PRIu32 " has wrong time.\n", seq, ifc);
+         break;
+      }
+      if (t < prev) {
+         fprintf(stderr, "Record %" PRIu32 " of IFC %" PRIu32 " is out of order.\n", seq, ifc);
+         break;
+      }
+      prev = t;
+      received++;
+   }
+   pthread_join(thr, NULL);
+
+   if (received != NO_IFCS * NO_RECORDS) {
+      fprintf(stderr, "Received %" PRIu32 " records, expected %d.\n", received, NO_IFCS * NO_RECORDS);
+      goto exit;
+   }
+   ret = run_lateness();
+exit:
+   ur_free_merge(m);
+   for (i = 0; i < NO_IFCS; i++) {
+      if (tmplt[i] != NULL) {
+         ur_free_template(tmplt[i]);
+      }
+   }
+   if (rctx != NULL) {
+      trap_ctx_finalize(&rctx);
+   }
+   if (sctx != NULL) {
+      trap_ctx_terminate(sctx);
+      trap_ctx_finalize(&sctx);
+   }
+   ur_finalize();
+   return ret;
+}
@@ -1481,3 +1481,245 @@ INLINE_IMPL unsigned int ur_get_link_count(ur_links_t *links);
 // END OF "Links" part *********************************************************
 // *****************************************************************************
 
+
+// *****************************************************************************
+// ** "Merge" part - reading records of more input interfaces ordered by time
+
+// Is record of interface at position a older than record of interface at position b?
+static inline int ur_merge_less(const ur_merge_t *m, uint32_t a, uint32_t b)
+{
+   return m->heads[a].time < m->heads[b].time || (m->heads[a].time == m->heads[b].time && a < b);
+}
+
+// Insert position of interface into the heap.
+static void ur_merge_heap_push(ur_merge_t *m, uint32_t pos)
+{
+   uint32_t i = m->heap_size++, parent;
+
+   while (i > 0) {
+      parent = (i - 1) / 2;
+      if (!ur_merge_less(m, pos, m->heap[parent])) {
+         break;
+      }
+      m->heap[i] = m->heap[parent];
+      i = parent;
+   }
+   m->heap[i] = pos;
+}
+
+// Remove the top of the heap.
+static void ur_merge_heap_pop(ur_merge_t *m)
+{
+   uint32_t i = 0, child, pos = m->heap[--m->heap_size];
+
+   while ((child = 2 * i + 1) < m->heap_size) {
+      if (child + 1 < m->heap_size && ur_merge_less(m, m->heap[child + 1], m->heap[child])) {
+         child++;
+      }
+      if (!ur_merge_less(m, m->heap[child], pos)) {
+         break;
+      }
+      m->heap[i] = m->heap[child];
+      i = child;
+   }
+   m->heap[i] = pos;
+}
+
+// Update template of interface after its format changed, the same as TRAP_CTX_RECEIVE.
+static void ur_merge_update_template(ur_merge_t *m, uint32_t pos)
+{
+   const char *spec = NULL;
+   uint8_t data_fmt;
+   ur_template_t *tmplt;
+   char *spec_cpy;
+
+   if (trap_ctx_get_data_fmt(m->ctx, TRAPIFC_INPUT, m->ifcs[pos], &data_fmt, &spec) != TRAP_E_OK) {
+      fprintf(stderr, "Data format was not loaded.\n");
+      return;
+   }
+   tmplt = ur_define_fields_and_update_template(spec, m->tmplts[pos]);
+   if (tmplt == NULL) {
+      fprintf(stderr, "Template could not be edited.\n");
+      return;
+   }
+   m->tmplts[pos] = tmplt;
+   if (tmplt->direction == UR_TMPLT_DIRECTION_BI) {
+      spec_cpy = ur_cpy_string(spec);
+      if (spec_cpy == NULL) {
+         fprintf(stderr, "Memory allocation problem.\n");
+      } else {
+         trap_ctx_set_data_fmt(m->ctx, tmplt->ifc_out, TRAP_FMT_UNIREC, spec_cpy);
+      }
+   }
+}
+
+// Receive records of interfaces in UR_MERGE_EMPTY state and insert them into the heap.
+static int ur_merge_fill(ur_merge_t *m, int timeout)
+{
+   const trap_multi_result_t *res;
+   const trap_multi_result_t *r;
+   ur_merge_head_t *h;
+   uint16_t size;
+   uint32_t pos, n = 0;
+   int ret, err = TRAP_E_OK;
+
+   for (pos = 0; pos < m->count; pos++) {
+      if (m->heads[pos].state == UR_MERGE_EMPTY) {
+         m->sel[n++] = m->ifcs[pos];
+      }
+   }
+   if (n == 0) {
+      return TRAP_E_OK;
+   }
+   ret = trap_ctx_multi_recv_ifcs(m->ctx, m->sel, n, timeout, (const void **) &res, &size);
+   if (ret != TRAP_E_OK) {
+      return ret;
+   }
+   for (pos = 0; pos < m->count; pos++) {
+      h = &m->heads[pos];
+      r = &res[m->ifcs[pos]];
+      if (h->state != UR_MERGE_EMPTY || r->result_code == TRAP_E_TIMEOUT) {
+         continue;
+      }
+      if (r->result_code == TRAP_E_FORMAT_CHANGED) {
+         ur_merge_update_template(m, pos);
+         h->fmt_changed = 1;
+      } else if (r->result_code != TRAP_E_OK) {
+         /* the other records must not be lost, report the error after them */
+         err = r->result_code;
+         continue;
+      }
+      h->idle = 0;
+      if (r->message_size <= 1) {
+         h->state = UR_MERGE_EOF;
+         m->eof_data = r->message;
+         m->eof_size = r->message_size;
+         m->eof_ifc = m->ifcs[pos];
+         continue;
+      }
+      h->data = r->message;
+      h->size = r->message_size;
+      h->time = 0;
+      if (ur_is_present(m->tmplts[pos], m->time_field)) {
+         h->time = *(ur_time_t *) ur_get_ptr_by_id(m->tmplts[pos], h->data, m->time_field);
+      }
+      if (h->time > m->watermark) {
+         m->watermark = h->time;
+      }
+      h->state = UR_MERGE_HEAD;
+      ur_merge_heap_push(m, pos);
+   }
+   return err;
+}
+
+// Create reader merging input interfaces by time.
+ur_merge_t *ur_ctx_create_merge(trap_ctx_t *ctx, const uint32_t *ifcs, uint32_t count, ur_template_t **tmplts,
+                                ur_field_id_t time_field, uint32_t lateness, int timeout)
+{
+   ur_merge_t *m;
+   uint32_t i;
+
+   if (ctx == NULL || count == 0 || tmplts == NULL || ur_get_type(time_field) != UR_TYPE_TIME) {
+      return NULL;
+   }
+   m = (ur_merge_t *) calloc(1, sizeof(ur_merge_t));
+   if (m == NULL) {
+      return NULL;
+   }
+   m->ifcs = (uint32_t *) malloc(count * sizeof(uint32_t));
+   m->heads = (ur_merge_head_t *) calloc(count, sizeof(ur_merge_head_t));
+   m->heap = (uint32_t *) malloc(count * sizeof(uint32_t));
+   m->sel = (uint32_t *) malloc(count * sizeof(uint32_t));
+   if (m->ifcs == NULL || m->heads == NULL || m->heap == NULL || m->sel == NULL) {
+      ur_free_merge(m);
+      return NULL;
+   }
+   for (i = 0; i < count; i++) {
+      m->ifcs[i] = (ifcs != NULL) ? ifcs[i] : i;
+   }
+   m->ctx = ctx;
+   m->count = count;
+   m->tmplts = tmplts;
+   m->time_field = time_field;
+   m->lateness = ur_time_from_sec_msec(lateness / 1000, lateness % 1000);
+   m->timeout = timeout;
+   m->last = -1;
+   return m;
+}
+
+// Get the next record ordered by time.
+int ur_merge_recv(ur_merge_t *m, uint32_t *ifc, const void **data, uint16_t *size)
+{
+   uint32_t pos, waiting;
+   int ret;
+
+   if (m->last >= 0) {
+      /* the returned record is not used anymore, the next one can be received */
+      m->heads[m->last].state = UR_MERGE_EMPTY;
+      m->last = -1;
+   }
+   /* records that are ready take precedence over waiting */
+   ret = ur_merge_fill(m, TRAP_NO_WAIT);
+   while (1) {
+      if (ret != TRAP_E_OK && ret != TRAP_E_TIMEOUT) {
+         return ret;
+      }
+      waiting = 0;
+      for (pos = 0; pos < m->count; pos++) {
+         waiting += (m->heads[pos].state == UR_MERGE_EMPTY && m->heads[pos].idle == 0);
+      }
+      if (m->heap_size > 0) {
+         pos = m->heap[0];
+         if (waiting == 0 || (m->lateness != 0 && m->heads[pos].time + m->lateness < m->watermark)) {
+            break;
+         }
+      } else if (waiting == 0) {
+         for (pos = 0; pos < m->count && m->heads[pos].state == UR_MERGE_EOF; pos++);
+         if (pos == m->count) {
+            /* all interfaces finished */
+            *ifc = m->eof_ifc;
+            *data = m->eof_data;
+            *size = m->eof_size;
+            return TRAP_E_OK;
+         }
+      }
+      ret = ur_merge_fill(m, m->timeout);
+      if (ret == TRAP_E_TIMEOUT) {
+         /* interfaces without data don't hold records of the others anymore */
+         for (pos = 0; pos < m->count; pos++) {
+            if (m->heads[pos].state == UR_MERGE_EMPTY) {
+               m->heads[pos].idle = 1;
+            }
+         }
+         if (m->heap_size == 0) {
+            return TRAP_E_TIMEOUT;
+         }
+      }
+   }
+
+   ur_merge_heap_pop(m);
+   m->last = pos;
+   *ifc = m->ifcs[pos];
+   *data = m->heads[pos].data;
+   *size = m->heads[pos].size;
+   if (m->heads[pos].fmt_changed) {
+      m->heads[pos].fmt_changed = 0;
+      return TRAP_E_FORMAT_CHANGED;
+   }
+   return TRAP_E_OK;
+}
+
+// Destroy reader merging input interfaces.
+void ur_free_merge(ur_merge_t *m)
+{
+   if (m != NULL) {
+      free(m->ifcs);
+      free(m->heads);
+      free(m->heap);
+      free(m->sel);
+      free(m);
+   }
+}
+
+// END OF "Merge" part *********************************************************
+// *****************************************************************************
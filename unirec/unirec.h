@@ -1036,6 +1036,97 @@ const char *ur_values_get_description_start_end(uint32_t start, uint32_t end, in
  * @}
  *//* urtemplate */
 
+/**
+ * \defgroup urmerge Merging of input interfaces by time
+ *
+ * Records from more input interfaces are returned ordered by a time field
+ * (e.g. TIME_FIRST) using a min-heap over the first record of every interface.
+ * Records are not copied, returned pointers point into the receive buffers of
+ * libtrap interfaces.
+ *
+ * @{
+ */
+
+/** \brief State of one input interface of #ur_merge_t */
+typedef struct {
+   const void *data;    ///< The first record not returned yet, valid when state is UR_MERGE_HEAD
+   uint16_t size;       ///< Size of the record
+   ur_time_t time;      ///< Value of the time field of the record
+   uint8_t state;       ///< UR_MERGE_EMPTY, UR_MERGE_HEAD, or UR_MERGE_EOF
+   uint8_t idle;        ///< If 1, interface had no data in timeout and it is not waited for
+   uint8_t fmt_changed; ///< If 1, format changed with the record (TRAP_E_FORMAT_CHANGED is returned with it)
+} ur_merge_head_t;
+
+#define UR_MERGE_EMPTY 0 ///< Interface has no record, it must be received
+#define UR_MERGE_HEAD 1  ///< Interface has a record in the heap
+#define UR_MERGE_EOF 2   ///< Interface sent the end-of-data record (size <= 1)
+
+/** \brief Reader merging input interfaces by time
+ * It is created by ur_ctx_create_merge() and destroyed by ur_free_merge().
+ */
+typedef struct {
+   trap_ctx_t *ctx;           ///< libtrap context
+   uint32_t count;            ///< Number of interfaces
+   uint32_t *ifcs;            ///< Indexes of input interfaces
+   ur_template_t **tmplts;    ///< Templates of interfaces (array of the caller, updated when format changes)
+   ur_field_id_t time_field;  ///< Time field records are ordered by
+   ur_time_t lateness;        ///< Lateness window as ur_time_t
+   int timeout;               ///< Timeout of waiting for data (see ur_ctx_create_merge())
+   ur_merge_head_t *heads;    ///< State of interfaces
+   uint32_t *heap;            ///< Min-heap of positions of interfaces in UR_MERGE_HEAD state
+   uint32_t heap_size;        ///< Number of items in heap
+   uint32_t *sel;             ///< Interfaces selected for trap_ctx_multi_recv_ifcs()
+   int32_t last;              ///< Position of interface whose record was returned last, -1 if none
+   ur_time_t watermark;       ///< The highest time seen
+   const void *eof_data;      ///< End-of-data record of the last finished interface
+   uint16_t eof_size;         ///< Size of eof_data
+   uint32_t eof_ifc;          ///< Interface of eof_data
+} ur_merge_t;
+
+/** \brief Create reader merging input interfaces by time
+ * Every interface needs its own template (e.g. from ur_ctx_create_input_template()),
+ * the array of templates is updated in the same way as by TRAP_CTX_RECEIVE when
+ * format of interface changes.
+ *
+ * A record is returned when every interface has a record (the record with the lowest
+ * time is returned), or when it is older than the highest time seen by more
+ * than lateness.  Interfaces that have no data in timeout are not waited for
+ * until they receive data again.
+ * \param[in] ctx libtrap context
+ * \param[in] ifcs Array of indexes of input interfaces, NULL means interfaces 0 to count-1
+ * \param[in] count Number of interfaces
+ * \param[in] tmplts Array of count templates, one for every interface
+ * \param[in] time_field ID of field of type time the records are ordered by
+ * \param[in] lateness Lateness window in milliseconds, 0 means records are returned only when every interface has a record
+ * \param[in] timeout Timeout (microseconds) of waiting for interfaces without data, TRAP_WAIT or TRAP_NO_WAIT
+ * \return Pointer to newly created reader or NULL in case of error.
+ */
+ur_merge_t *ur_ctx_create_merge(trap_ctx_t *ctx, const uint32_t *ifcs, uint32_t count, ur_template_t **tmplts,
+                                ur_field_id_t time_field, uint32_t lateness, int timeout);
+
+/** \brief Get the next record ordered by time
+ * Returned pointer is valid until the next call.  When all interfaces sent the
+ * end-of-data record (size <= 1), it is returned.  Records without the time field
+ * are treated as records with time 0.
+ * \param[in,out] m Merging reader
+ * \param[out] ifc Index of input interface of the record
+ * \param[out] data Pointer to the record
+ * \param[out] size Size of the record
+ * \return TRAP_E_OK, TRAP_E_FORMAT_CHANGED (template of ifc was updated), TRAP_E_TIMEOUT when no record
+ * is available in timeout, or other error of trap_ctx_multi_recv_ifcs()
+ */
+int ur_merge_recv(ur_merge_t *m, uint32_t *ifc, const void **data, uint16_t *size);
+
+/** \brief Destroy reader merging input interfaces
+ * Templates are not freed.
+ * \param[in] m Merging reader
+ */
+void ur_free_merge(ur_merge_t *m);
+
+/**
+ * @}
+ *//* urmerge */
+
 #ifdef __cplusplus
 } // extern "C"
 #endif